@@ -18,6 +18,18 @@ CONFIG_SHELL_COLORPROMPT	?= y
 CONFIG_SHFS_OPENBYNAME		?= y
 CONFIG_SHFS_CACHEINFO		?= y
 
+# Keep objects with the pin flag (and ones pinned from the shell)
+#  in the chunk cache
+CONFIG_SHFS_CACHE_PIN		?= y
+
+# Serve pre-encoded variants of objects (gzip, br, zstd)
+#  to clients that accept them (Accept-encoding)
+CONFIG_SHFS_VARIANTS		?= y
+
+# Verify chunks against the checksum table of the volume
+#  (shfs_mkfs -k) when they are loaded into the cache
+CONFIG_SHFS_CSUM		?= y
+
 # Enable statistic capabilities of SHFS
 #  If this option is disabled, STATS_HTTP is disabled as well
 CONFIG_SHFS_STATS		?= y
@@ -41,6 +53,10 @@ CONFIG_SHFS_STATS_HTTP		?= y
 #        otherwise this feature is disabled
 CONFIG_SHFS_STATS_HTTP_DPCR	?= 6
 
+# Track the most requested objects (by requests and
+#  transferred bytes) over sliding windows (see: shfs-top)
+CONFIG_SHFS_TOP			?= y
+
 ######################################
 ## HTTP
 ######################################
@@ -50,6 +66,12 @@ CONFIG_HTTP_INFO		?= y
 CONFIG_HTTP_URL_CUTARGS		?= y
 # Provide a performance test file on hash digest 0x0
 CONFIG_HTTP_TESTFILE		?= n
+# Serve OpenMetrics statistics on /?__metrics
+CONFIG_HTTP_METRICS		?= y
+# Shed load with 503 early when cache buffers or AIO tokens run out
+CONFIG_HTTP_ADMISSION		?= y
+# Share the bandwidth fairly across sessions (with optional rate caps)
+CONFIG_HTTP_SCHED		?= y
 
 ######################################
 ## ctldir (only available on Mini-OS)
@@ -61,6 +83,8 @@ CONFIG_CTLDIR_NOCHMOD		?= y
 ## Misc
 ######################################
 CONFIG_TESTSUITE		?= n
+# Latency histograms (http-latency cmd in shell, export-latency)
+CONFIG_LATENCY_HIST		?= y
 
 ######################################
 ## Debugging options
@@ -74,4 +98,5 @@ CONFIG_SHFS_CACHE_STATS	?= y
 CONFIG_HTTP_DEBUG		?= n
 CONFIG_HTTP_DEBUG_SESSIONSTATES	?= n
 CONFIG_HTTP_DEBUG_PRINTACCESS	?= n
+CONFIG_HTTP_BENCH_DEBUG		?= n
 CONFIG_CTLDIR_DEBUG		?= n
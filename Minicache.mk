@@ -13,6 +13,7 @@ MCOBJS						= ring.o \
 						  mempool.o \
 						  hexdump.o \
 						  debug.o \
+						  twheel.o \
 						  htable.o \
 						  shfs.o \
 						  shfs_check.o \
@@ -68,6 +69,12 @@ MCCFLAGS-$(CONFIG_SHFS_CACHE_DEBUG)	+= -DSHFS_CACHE_DEBUG
 MCCFLAGS-$(CONFIG_SHFS_CACHE_DISABLE)	+= -DSHFS_CACHE_DISABLE
 MCCFLAGS-$(CONFIG_SHFS_CACHE_IMMEDIATEDROP)	+= -DSHFS_CACHE_IMMEDIATEDROP
 MCCFLAGS-$(CONFIG_SHFS_CACHE_STATS)	+= -DSHFS_CACHE_STATS
+MCCFLAGS-$(CONFIG_SHFS_CACHE_PIN)	+= -DSHFS_CACHE_PIN
+MCCFLAGS-$(CONFIG_SHFS_VARIANTS)	+= -DSHFS_VARIANTS
+MCCFLAGS-$(CONFIG_SHFS_CSUM)		+= -DSHFS_CSUM
+MCOBJS-$(CONFIG_SHFS_CSUM)		+= crc32c.o
+MCCFLAGS-$(CONFIG_SHFS_TOP)		+= -DSHFS_TOP
+MCOBJS-$(CONFIG_SHFS_TOP)		+= shfs_top.o
 ifeq ($(CONFIG_SHFS_STATS),y)
 MCCFLAGS				+= -DSHFS_STATS
 MCOBJS					+= shfs_stats.o
@@ -103,16 +110,25 @@ MCCFLAGS-$(CONFIG_HTTP_TESTFILES)	+= -DHTTP_TESTFILES
 MCCFLAGS-$(CONFIG_HTTP_INFO)		+= -DHTTP_INFO
 MCCFLAGS-$(CONFIG_HTTP_URL_CUTARGS)	+= -DHTTP_URL_CUTARGS
 MCCFLAGS-$(CONFIG_HTTP_LINK_MEMCPY)	+= -DHTTP_LINK_MEMCPY
+MCCFLAGS-$(CONFIG_HTTP_METRICS)		+= -DHTTP_METRICS
+MCOBJS-$(CONFIG_HTTP_METRICS)		+= http_metrics.o
+MCCFLAGS-$(CONFIG_HTTP_ADMISSION)	+= -DHTTP_ADMISSION
+MCCFLAGS-$(CONFIG_HTTP_SCHED)		+= -DHTTP_SCHED
+MCCFLAGS-$(CONFIG_HTTP_BENCH)		+= -DHTTP_BENCH
+MCOBJS-$(CONFIG_HTTP_BENCH)		+= http_bench.o
 
 MCCFLAGS-$(CONFIG_HTTP_DEBUG)		+= -DHTTP_DEBUG
 MCCFLAGS-$(CONFIG_HTTP_DEBUG_SESSIONSTATES) += -DHTTP_DEBUG_SESSIONSTATES
 MCCFLAGS-$(CONFIG_HTTP_DEBUG_PRINTACCESS) += -DHTTP_DEBUG_PRINTACCESS
+MCCFLAGS-$(CONFIG_HTTP_BENCH_DEBUG)	+= -DHTTP_BENCH_DEBUG
 
 ######################################
 ## Misc
 ######################################
 MCCFLAGS-$(CONFIG_TESTSUITE)		+= -DTESTSUITE
 MCOBJS-$(CONFIG_TESTSUITE)		+= testsuite.o
+MCCFLAGS-$(CONFIG_LATENCY_HIST)		+= -DLATENCY_HIST
+MCOBJS-$(CONFIG_LATENCY_HIST)		+= lhist.o
 
 ######################################
 MCOBJS					+= $(MCOBJS-y)
@@ -91,6 +91,7 @@ else
 CONFIG_PTH_THREADS?=n
 CONFIG_SHELL?=n
 CONFIG_NETMAP?=y
+CONFIG_EPOLL?=y
 
 CONFIG_SHFS_CACHE_READAHEAD		?= 8
 CONFIG_SHFS_CACHE_POOL_NB_BUFFERS	?= 8192
@@ -104,6 +105,29 @@ CONFIG_SHELL:=n
 endif
 endif
 
+ifeq ($(CONFIG_EPOLL),y)
+ifeq ($(CONFIG_PTH_THREADS),y)
+# a blocking epoll_wait() would stall all pth threads
+CONFIG_EPOLL:=n
+endif
+endif
+
+ifeq ($(CONFIG_XDPIF),y)
+# AF_XDP replaces netmap
+CONFIG_NETMAP:=n
+CONFIG_XDPIF_IFNAME	?= eth2
+CONFIG_XDPIF_QUEUE	?= 0
+# copy mode works with any driver (e.g., veth)
+CONFIG_XDPIF_COPY	?= y
+endif
+
+ifeq ($(CONFIG_NULLIF),y)
+# in-memory pipe: the HTTP load generator is attached to its other end
+CONFIG_NETMAP:=n
+CONFIG_XDPIF:=n
+CONFIG_HTTP_BENCH:=y
+endif
+
 ifeq ($(CONFIG_NETMAP),y)
 ifndef NETMAP_INCLUDES
 $(error "Please define NETMAP_INCLUDES")
@@ -127,6 +151,7 @@ endif
 CFLAGS+= -DCONFIG_LWIP_NUM_TCPCON=$(CONFIG_LWIP_NUM_TCPCON)
 CFLAGS-$(CONFIG_LWIP_CHECKSUM_NOCHECK)+=-DCONFIG_LWIP_CHECKSUM_NOCHECK
 CFLAGS-$(CONFIG_LWIP_CHECKSUM_NOGEN)+=-DCONFIG_LWIP_CHECKSUM_NOGEN
+CFLAGS-$(CONFIG_EPOLL)+=-DCONFIG_EPOLL
 CFLAGS-$(CONFIG_DEBUG_LWIP)+=-DCONFIG_DEBUG_LWIP
 CFLAGS-$(CONFIG_DEBUG_LWIP_MAINLOOP)+=-DLWIP_MAINLOOP_DEBUG
 CFLAGS-$(CONFIG_DEBUG_LWIP_IF)+=-DLWIP_IF_DEBUG
@@ -256,8 +281,26 @@ ifeq ($(CONFIG_NETMAP),y)
 ARCHFILES+=$(wildcard $(LWIPARCH)/netif/netmapif.c)
 CFLAGS+=-DCONFIG_NETMAP -I$(NETMAP_INCLUDES)
 else
+ifeq ($(CONFIG_XDPIF),y)
+ARCHFILES+=$(wildcard $(LWIPARCH)/netif/xdpif.c)
+CFLAGS+=-DCONFIG_XDPIF -DXDPIF_IFNAME="\"$(strip $(CONFIG_XDPIF_IFNAME))\"" -DXDPIF_QUEUE=$(strip $(CONFIG_XDPIF_QUEUE))
+CFLAGS-$(CONFIG_XDPIF_COPY)+=-DCONFIG_XDPIF_COPY
+LDFLAGS+=-lxdp -lbpf
+else
+ifeq ($(CONFIG_NULLIF),y)
+ARCHFILES+=$(wildcard $(LWIPARCH)/netif/nullif.c)
+CFLAGS+=-DCONFIG_NULLIF
+LDFLAGS+=-lm
+else
 ARCHFILES+=$(wildcard $(LWIPARCH)/netif/tapif.c)
 CFLAGS+=-DCONFIG_TAPIF
+# checksum and segmentation offload to the host via virtio-net headers
+CONFIG_TAPIF_VNET?=y
+CONFIG_LWIP_GSO?=$(CONFIG_TAPIF_VNET)
+CFLAGS-$(CONFIG_TAPIF_VNET)+=-DCONFIG_TAPIF_VNET
+CFLAGS-$(CONFIG_LWIP_GSO)+=-DCONFIG_LWIP_GSO
+endif
+endif
 endif
 endif
 endif
@@ -349,3 +392,47 @@ $(LWIPLIB): $(LWIPOBJS)
 $(BUILDDIR)/$(MINICACHE_OUT): $(BUILDDIR)/.depend $(LWIPLIB) $(APPOBJS) $(APPFILES)
 	$(LD) $(APPOBJS) $(LDFLAGS) -l:$(LWIPLIB) -shared -o $(BUILDDIR)/$(MINICACHE_OUT)
 endif
+
+#################################
+# HTTP benchmark: builds MiniCache with a null netif and runs the
+# in-process load generator against the given SHFS volume, e.g.:
+#  make TARGET=linux bench BENCH_IMAGE=/path/to/volume.img
+BENCH_BUILDDIR		?= $(MINICACHE_ROOT)/build-bench
+BENCH_NB_SESS		?= 1024
+BENCH_ARGS		?= -T 10 -Z 1.0
+
+.PHONY: bench
+bench:
+ifeq ($(BENCH_IMAGE),)
+	$(error "Please define BENCH_IMAGE")
+endif
+	$(MAKE) CONFIG_NULLIF=y CONFIG_LWIP_NUM_TCPCON=$(BENCH_NB_SESS) BUILDDIR=$(BENCH_BUILDDIR) build
+	$(BENCH_BUILDDIR)/$(MINICACHE_OUT) -i 10.0.0.1/24 -b $(BENCH_IMAGE) -B $(BENCH_NB_SESS) $(BENCH_ARGS)
+
+#################################
+# Ring test: stress and throughput test of the SMP-safe ring with
+# producer and consumer threads that are pinned to different cores, e.g.:
+#  make TARGET=linux ringtest RINGTEST_ARGS="-p 4 -c 4"
+RINGTEST_ARGS		?=
+
+.PHONY: ringtest
+ringtest: $(BUILDDIR)/ring_test
+	$(BUILDDIR)/ring_test $(RINGTEST_ARGS)
+
+$(BUILDDIR)/ring_test: ring_test.c ring.c ring.h
+	$(MKDIR) $(BUILDDIR)
+	$(CC) -O2 -g -D$(TARGET) -I. -Itarget/$(TARGET)/include $(filter %.c,$^) -pthread -o $@
+
+#################################
+# Header test: parses a request that is split into pbufs at every byte
+# offset and checks that all received header lines are kept, e.g.:
+#  make TARGET=linux hdrtest HDRTEST_ARGS="-v"
+HDRTEST_ARGS		?=
+
+.PHONY: hdrtest
+hdrtest: $(BUILDDIR)/http_hdr_test
+	$(BUILDDIR)/http_hdr_test $(HDRTEST_ARGS)
+
+$(BUILDDIR)/http_hdr_test: http_hdr_test.c http_parser.c http_parser.h http_hdr.h
+	$(MKDIR) $(BUILDDIR)
+	$(CC) -O2 -g -D$(TARGET) $(CINCLUDES) $(filter %.c,$^) -o $@
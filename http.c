@@ -34,7 +34,7 @@
  * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
  */
 
-#if defined HAVE_SHELL && defined HTTP_INFO
+#if defined HAVE_SHELL && (defined HTTP_INFO || defined LATENCY_HIST)
 #include "shell.h"
 #endif
 
@@ -42,32 +42,46 @@
 #include "http_data.h"
 #include "http_fio.h"
 #include "http_link.h"
+#ifdef HTTP_METRICS
+#include "http_metrics.h"
+#endif
+#ifdef SHFS_TOP
+#include "shfs_top.h"
+#endif
 #include "http.h"
 
 struct http_srv *hs = NULL;
+uint32_t http_recvhdr_nb_rxpbufs = 0;
 
 static err_t httpsess_accept (void *argp, struct tcp_pcb *new_tpcb, err_t err);
 static err_t httpsess_close  (struct http_sess *hsess, enum http_sess_close type);
 static err_t httpsess_sent   (void *argp, struct tcp_pcb *tpcb, uint16_t len);
 static err_t httpsess_recv   (void *argp, struct tcp_pcb *tpcb, struct pbuf *p, err_t err);
 static void  httpsess_error  (void *argp, err_t err);
-static err_t httpsess_poll   (void *argp, struct tcp_pcb *tpcb);
+static void  httpsess_keepalive_expired(struct twheel_timer *t, void *argp);
+#ifdef HTTP_SCHED
+static void  httpsess_pace_expired(struct twheel_timer *t, void *argp);
+#endif
+static void  http_shrink_pools(struct twheel_timer *t, void *argp);
 static err_t httpsess_acknowledge(struct http_sess *hsess, size_t len);
+static int httprecv_req_begin(struct http_parser *parser);
 static int httprecv_req_complete(struct http_parser *parser);
 static int httprecv_hdr_url(struct http_parser *parser, const char *buf, size_t len);
+static int httprecv_hdr_field(struct http_parser *parser, const char *buf, size_t len);
+static int httprecv_hdr_value(struct http_parser *parser, const char *buf, size_t len);
 
 static http_parser_settings _http_parser_settings = {
-	.on_message_begin = NULL,
+	.on_message_begin = httprecv_req_begin,
 	.on_url = httprecv_hdr_url,
 	.on_status = NULL,
-	.on_header_field = httpparser_recvhdr_field,
-	.on_header_value = httpparser_recvhdr_value,
+	.on_header_field = httprecv_hdr_field,
+	.on_header_value = httprecv_hdr_value,
 	.on_headers_complete = NULL,
 	.on_body = NULL,
 	.on_message_complete = httprecv_req_complete
 };
 
-int init_http(uint16_t nb_sess, uint32_t nb_reqs)
+int init_http(uint32_t nb_sess, uint32_t nb_reqs)
 {
 	err_t err;
 	int ret = 0;
@@ -81,31 +95,54 @@ int init_http(uint16_t nb_sess, uint32_t nb_reqs)
 	hs->nb_sess = 0;
 	hs->max_nb_reqs = nb_reqs;
 	hs->nb_reqs = 0;
+	hs->max_nb_reqhdrs = nb_sess; /* headers are only held while parsing
+	                               * and responding the header */
+	hs->nb_reqhdrs = 0;
 
 	/* allocate session pool */
-	hs->sess_pool = alloc_simple_mempool(hs->max_nb_sess, sizeof(struct http_sess));
+	hs->sess_pool = alloc_mempool_slabs(hs->max_nb_sess, HTTP_POOL_SLAB_NB_OBJS,
+	                                    sizeof(struct http_sess));
 	if (!hs->sess_pool) {
 		ret = -ENOMEM;
 		goto err_free_hs;
 	}
 
 	/* allocate request pool */
-	hs->req_pool = alloc_simple_mempool(hs->max_nb_reqs, sizeof(struct http_req));
+	hs->req_pool = alloc_mempool_slabs(hs->max_nb_reqs, HTTP_POOL_SLAB_NB_OBJS,
+	                                   sizeof(struct http_req));
 	if (!hs->req_pool) {
 		ret = -ENOMEM;
 		goto err_free_sesspool;
 	}
 
+	/* allocate request header pool */
+	hs->reqhdr_pool = alloc_mempool_slabs(hs->max_nb_reqhdrs, HTTP_POOL_SLAB_NB_OBJS,
+	                                      sizeof(struct http_req_hdr));
+	if (!hs->reqhdr_pool) {
+		ret = -ENOMEM;
+		goto err_free_reqpool;
+	}
+
 	/* initialize http link system */
 	ret = httplink_init(hs);
 	if (ret < 0)
-		goto err_free_reqpool;
+		goto err_free_reqhdrpool;
+
+#ifdef HTTP_METRICS
+	/* allocate metrics state pool */
+	hs->metrics_pool = alloc_simple_mempool(HTTP_METRICS_MAXNB_REQS,
+	                                        sizeof(struct http_req_metrics_state));
+	if (!hs->metrics_pool) {
+		ret = -ENOMEM;
+		goto err_exit_link;
+	}
+#endif
 
 	/* register TCP listener */
 	hs->tpcb = tcp_new();
 	if (!hs->tpcb) {
 		ret = -ENOMEM;
-		goto err_exit_link;
+		goto err_free_metricspool;
 	}
 	err = tcp_bind(hs->tpcb, IP_ADDR_ANY, HTTP_LISTEN_PORT);
 	if (err != ERR_OK) {
@@ -122,21 +159,62 @@ int init_http(uint16_t nb_sess, uint32_t nb_reqs)
 
 	/* wait for I/O retry list */
 	dlist_init_head(hs->ioretry_chain);
+	hs->nb_ioretry = 0;
+
+#ifdef HTTP_SCHED
+	/* sessions that send file data */
+	dlist_init_head(hs->sched_chain);
+	hs->nb_sched = 0;
+	hs->sess_rate = 0;
+	hs->sched_cur = NULL;
+#endif
+
+	/* admission control */
+	hs->adm.qdelay = 0;
+	hs->adm.rnd = 0x2545f491; /* any non-zero seed */
+	hs->adm.nb_shed = 0;
+
+	/* idle sessions that can be reaped */
+	dlist_init_head(hs->idle_chain);
+	hs->nb_reaped = 0;
+
+	/* release unused pool slabs periodically */
+	twheel_timer_init(&hs->shrink_timer, http_shrink_pools, hs);
+	twheel_arm_periodic(&hs->shrink_timer, HTTP_POOL_SHRINK_INTERVAL);
+
+#ifdef LATENCY_HIST
+	lhist_reset(&hs->lat_ttfb);
+	lhist_reset(&hs->lat_total);
+	lhist_register(&hs->lat_ttfb, "http-ttfb");
+	lhist_register(&hs->lat_total, "http-total");
+#endif
 
 	printd("HTTP server %p initialized\n", hs);
 #if defined HAVE_SHELL && defined HTTP_INFO
 	shell_register_cmd("http-info", shcmd_http_info);
+#endif
+#if defined HAVE_SHELL && defined LATENCY_HIST
+	shell_register_cmd("http-latency", shcmd_http_latency);
+#endif
+#if defined HAVE_SHELL && defined HTTP_SCHED
+	shell_register_cmd("http-pace", shcmd_http_pace);
 #endif
 	return 0;
 
  err_free_tcp:
 	tcp_abort(hs->tpcb);
+ err_free_metricspool:
+#ifdef HTTP_METRICS
+	free_mempool(hs->metrics_pool);
+#endif
  err_exit_link:
 	httplink_exit(hs);
+ err_free_reqhdrpool:
+	free_mempool_slabs(hs->reqhdr_pool);
  err_free_reqpool:
-	free_mempool(hs->req_pool);
+	free_mempool_slabs(hs->req_pool);
  err_free_sesspool:
-	free_mempool(hs->sess_pool);
+	free_mempool_slabs(hs->sess_pool);
  err_free_hs:
 	target_free(hs);
  err_out:
@@ -151,12 +229,22 @@ void exit_http(void)
 		httpsess_close(hs->hsess_head, HSC_CLOSE);
 	}
 	BUG_ON(hs->nb_reqs != 0);
+	BUG_ON(hs->nb_reqhdrs != 0);
 	BUG_ON(hs->nb_sess != 0);
 
 	tcp_close(hs->tpcb);
+	twheel_cancel(&hs->shrink_timer);
+#ifdef LATENCY_HIST
+	lhist_unregister(&hs->lat_ttfb);
+	lhist_unregister(&hs->lat_total);
+#endif
+#ifdef HTTP_METRICS
+	free_mempool(hs->metrics_pool);
+#endif
 	httplink_exit(hs);
-	free_mempool(hs->req_pool);
-	free_mempool(hs->sess_pool);
+	free_mempool_slabs(hs->reqhdr_pool);
+	free_mempool_slabs(hs->req_pool);
+	free_mempool_slabs(hs->sess_pool);
 	target_free(hs);
 	hs = NULL;
 }
@@ -164,50 +252,262 @@ void exit_http(void)
 /*******************************************************************************
  * Session + Request handling
  ******************************************************************************/
+/* idle sessions are kept in the idle chain (oldest first) as well */
+#define httpsess_arm_idle(hsess, timeout) \
+	do { \
+		twheel_arm(&(hsess)->keepalive_timer, (timeout)); \
+		if (dlist_is_linked((hsess), hs->idle_chain, idle_chain)) \
+			dlist_relink_tail((hsess), hs->idle_chain, idle_chain); \
+		else \
+			dlist_append((hsess), hs->idle_chain, idle_chain); \
+	} while(0)
 #define httpsess_reset_keepalive(hsess) \
+	httpsess_arm_idle((hsess), HTTP_KEEPALIVE_TIMEOUT)
+/* an incomplete request header (and the received pbufs it references) is
+ * held for HTTP_HDR_TIMEOUT at most, counted from the begin of the request */
+#define httpsess_reset_hdrtimeout(hsess, hhdr) \
 	do { \
-		(hsess)->keepalive_timer = HTTP_KEEPALIVE_TIMEOUT; \
+		uint64_t __el = twheel_now() - (hhdr)->request.ts_begin; \
+		httpsess_arm_idle((hsess), __el < HTTP_HDR_TIMEOUT ? \
+		                  HTTP_HDR_TIMEOUT - __el : 0); \
 	} while(0)
 #define httpsess_halt_keepalive(hsess) \
 	do { \
-		(hsess)->keepalive_timer = -1; \
+		twheel_cancel(&(hsess)->keepalive_timer); \
+		if (dlist_is_linked((hsess), hs->idle_chain, idle_chain)) \
+			dlist_unlink((hsess), hs->idle_chain, idle_chain); \
 	} while(0)
 
-/* gets called whenever it is worth
- * to retry an failed file I/O operation (with EAGAIN) */
+/* gets called periodically: releases pool slabs that are not used anymore */
+static void http_shrink_pools(struct twheel_timer *t, void *argp)
+{
+	struct http_srv *hsrv = argp;
+
+	mempool_slabs_shrink(hsrv->sess_pool, HTTP_POOL_SHRINK_MINFREE);
+	mempool_slabs_shrink(hsrv->req_pool, HTTP_POOL_SHRINK_MINFREE);
+	mempool_slabs_shrink(hsrv->reqhdr_pool, HTTP_POOL_SHRINK_MINFREE);
+}
+
+/*******************************************************************************
+ * Admission control
+ ******************************************************************************/
+static inline uint32_t http_adm_rand(void)
+{
+	/* xorshift32: good enough for shedding decisions and jitter */
+	hs->adm.rnd ^= hs->adm.rnd << 13;
+	hs->adm.rnd ^= hs->adm.rnd >> 17;
+	hs->adm.rnd ^= hs->adm.rnd << 5;
+	return hs->adm.rnd;
+}
+
+/* number of parked sessions that could start their I/O now:
+ * each one needs at least a cache buffer and an AIO token */
+static inline uint32_t http_ioretry_budget(void)
+{
+	if (unlikely(!shfs_mounted))
+		return hs->nb_ioretry;
+	return min(shfs_cache_avail_count(),
+	           (uint32_t) mempool_free_count(shfs_vol.aiotoken_pool));
+}
+
+/* returns the current load pressure (0..1024) */
+static uint32_t http_adm_pressure(void)
+{
+	struct http_sess *oldest;
+	uint32_t p, q;
+#ifndef SHFS_CACHE_GROW
+	uint32_t nb;
+#endif
+
+	/* request objects */
+	p = (uint32_t) (((uint64_t) hs->nb_reqs << 10) / hs->max_nb_reqs);
+
+	if (shfs_mounted) {
+#ifndef SHFS_CACHE_GROW
+		/* cache buffers */
+		nb = mempool_nb_objs(shfs_vol.chunkcache->pool);
+		if (nb)
+			p = max(p, 1024 - (uint32_t) (((uint64_t) min(shfs_cache_avail_count(), nb) << 10) / nb));
+#endif
+		/* AIO tokens */
+		p = max(p, 1024 - (uint32_t) (((uint64_t) mempool_free_count(shfs_vol.aiotoken_pool) << 10)
+		                              / mempool_nb_objs(shfs_vol.aiotoken_pool)));
+	}
+
+	/* I/O retry queue delay: the oldest parked session counts
+	 * already before it is woken up */
+	q = hs->adm.qdelay;
+	oldest = dlist_first_el(hs->ioretry_chain, struct http_sess);
+	if (oldest)
+		q = max(q, (uint32_t) (twheel_now() - oldest->ts_ioretry));
+	p = max(p, (uint32_t) min(((uint64_t) q << 10) / HTTP_ADM_QDELAY_TARGET, 1024));
+
+	return min(p, 1024);
+}
+
+#ifdef HTTP_ADMISSION
+/* returns 0 if a new request should be shed */
+static inline int http_adm_admit(uint32_t pressure)
+{
+	if (likely(pressure <= HTTP_ADM_PRESSURE_LOW))
+		return 1;
+	return (http_adm_rand() % (1024 - HTTP_ADM_PRESSURE_LOW)) >=
+	       (pressure - HTTP_ADM_PRESSURE_LOW);
+}
+#endif
+
+/*
+ * Retry-After (seconds) for 503 responses: the time that parked sessions
+ * currently wait for I/O plus a share that grows with the pressure.
+ * It is jittered so that shed clients do not come back at once.
+ */
+static inline unsigned int http_retry_after(uint32_t pressure)
+{
+	unsigned int s;
+
+	s = HTTP_RETRY_AFTER_MIN
+	    + DIV_ROUND_UP(hs->adm.qdelay, 1000)
+	    + ((pressure * HTTP_RETRY_AFTER_PRESSURE) >> 10);
+	s += http_adm_rand() % (s / 2 + 1);
+	return min(s, HTTP_RETRY_AFTER_MAX);
+}
+
+/*
+ * Gets called from the main loop: Wakes up sessions that are parked
+ * because their file I/O failed with EAGAIN. Sessions are woken up in the
+ * order they were parked and only as many as I/O can be started for.
+ */
 void http_poll_ioretry(void) {
 	struct http_sess *hsess;
-	struct http_sess *hsess_next;
+	uint32_t budget;
+	uint64_t now;
 
 	if (unlikely(!hs))
 		return; /* no active http server */
+	if (likely(!hs->nb_ioretry))
+		return;
 
-	hsess = dlist_first_el(hs->ioretry_chain, struct http_sess);
-	/* clear head so that a new list is created
-	 * This avoids the the case that within a callback the elements gets
-	 * appanded to the list over an over again */
-	dlist_init_head(hs->ioretry_chain);
-	while (hsess) {
-		hsess_next = dlist_next_el(hsess, ioretry_chain);
+	/* sessions that register themselves again are appended to the tail
+	 * and are not retried again within this round */
+	budget = min(http_ioretry_budget(), hs->nb_ioretry);
+	if (!budget)
+		return;
 
-		/* "unlink" this element from the list because
-		 * the head is released already -> we need to do a list cleanup */
-		hsess->ioretry_chain.next = NULL;
-		hsess->ioretry_chain.prev = NULL;
+	now = twheel_now();
+	while (budget--) {
+		hsess = dlist_first_el(hs->ioretry_chain, struct http_sess);
+		if (!hsess)
+			break;
+		httpsess_unregister_ioretry(hsess);
+
+		/* queue delay */
+		hs->adm.qdelay -= hs->adm.qdelay >> HTTP_ADM_QDELAY_EWMA_SHIFT;
+		hs->adm.qdelay += ((uint32_t) (now - hsess->ts_ioretry)) >> HTTP_ADM_QDELAY_EWMA_SHIFT;
 
 		printd("Retrying I/O on session %p\n", hsess);
-		httpsess_respond(hsess); /* can register itself to the new list */
+		httpsess_respond(hsess); /* can register itself again */
+	}
+}
+
+#ifdef HTTP_SCHED
+/* rate cap of the session: the lower one of session and object */
+static inline uint32_t httpsess_rate(struct http_sess *hsess)
+{
+	struct http_req *hreq = hsess->rqueue_head;
+	uint32_t rate = hs->sess_rate;
+
+	if (hreq->type == HRT_FIOMSG && hreq->fd &&
+	    shfs_fio_rate(hreq->fd) &&
+	    (!rate || shfs_fio_rate(hreq->fd) < rate))
+		rate = shfs_fio_rate(hreq->fd);
+	return rate;
+}
+
+static inline void httpsess_refill(struct http_sess *hsess, uint32_t rate, uint64_t now)
+{
+	uint64_t tokens;
+
+	if (hsess->tokens >= HTTP_SCHED_QUANTUM) {
+		hsess->ts_refill = now;
+		return;
+	}
+
+	/* the clock is only advanced when tokens were added so that
+	 * fractions are not lost on low rates */
+	tokens = ((uint64_t) rate * (now - hsess->ts_refill)) / 1000;
+	if (tokens) {
+		hsess->tokens = (uint32_t) min(hsess->tokens + tokens, (uint64_t) HTTP_SCHED_QUANTUM);
+		hsess->ts_refill = now;
+	}
+}
+
+/*
+ * Gets called from the main loop: Sends out file data with deficit round
+ * robin across sessions. Per round, each session with data to send gets a
+ * quantum, limited by its rate cap. Sessions that used up their quantum
+ * append themselves again (httpsess_respond()). Blocked sessions (full
+ * send buffer, pending I/O) leave the round and are appended again when
+ * an ACK or an I/O completion calls httpsess_respond().
+ * Returns the number of sessions that wait for the next round.
+ */
+uint32_t http_poll_sched(void)
+{
+	struct http_sess *hsess;
+	uint32_t nb;
+	uint32_t rate;
+	uint64_t now;
 
-		hsess = hsess_next; /* next element */
+	if (unlikely(!hs))
+		return 0; /* no active http server */
+	if (!hs->nb_sched)
+		return 0;
+
+	/* appended sessions are served in the next round */
+	nb = hs->nb_sched;
+	now = twheel_now();
+	while (nb--) {
+		hsess = dlist_first_el(hs->sched_chain, struct http_sess);
+		httpsess_unsched(hsess);
+		if (unlikely(hsess->state != HSS_ESTABLISHED || !hsess->rqueue_head))
+			continue;
+
+		rate = httpsess_rate(hsess);
+		if (rate) {
+			httpsess_refill(hsess, rate, now);
+			if (hsess->tokens < HTTP_SCHED_PACE_MINLEN) {
+				/* rate cap is exceeded: wait for enough tokens */
+				twheel_arm(&hsess->pace_timer,
+				           DIV_ROUND_UP((uint64_t) (HTTP_SCHED_PACE_MINLEN - hsess->tokens) * 1000,
+				                        rate));
+				continue;
+			}
+			hsess->deficit += min(hsess->tokens, HTTP_SCHED_QUANTUM);
+		} else {
+			hsess->deficit += HTTP_SCHED_QUANTUM;
+		}
+
+		printd("Scheduling session %p (deficit: %"PRIu32" bytes)\n", hsess, hsess->deficit);
+		hs->sched_cur = hsess;
+		httpsess_respond(hsess); /* session might be closed afterwards */
+		hs->sched_cur = NULL;
 	}
+	return hs->nb_sched;
+}
+
+uint32_t http_sched_nb_pending(void)
+{
+	if (unlikely(!hs))
+		return 0;
+	return hs->nb_sched;
 }
+#endif
 
 static inline struct http_req *httpreq_open(struct http_sess *hsess)
 {
 	struct mempool_obj *hrobj;
 	struct http_req *hreq;
 
-	hrobj = mempool_pick(hsess->hsrv->req_pool);
+	hrobj = mempool_slabs_pick(hsess->hsrv->req_pool);
 	if (!hrobj)
 		return NULL;
 	hreq = hrobj->data;
@@ -215,13 +515,10 @@ static inline struct http_req *httpreq_open(struct http_sess *hsess)
 	hreq->hsess = hsess;
 	hreq->next = NULL;
 
+	hreq->h = NULL; /* picked when parsing starts */
+
 	hreq->state = HRS_PARSING_HDR;
 	hreq->type = HRT_UNDEF;
-	http_recvhdr_reset(&hreq->request.hdr);
-	hreq->request.url_len = 0;
-	hreq->request.url_overflow = 0;
-	hreq->request.url_argp = NULL;
-	http_sendhdr_reset(&hreq->response.hdr);
 	hreq->response.hdr_total_len = 0;
 	hreq->response.hdr_acked_len = 0;
 	hreq->response.ftr_acked_len = 0;
@@ -237,6 +534,42 @@ static inline struct http_req *httpreq_open(struct http_sess *hsess)
 	return hreq;
 }
 
+/* attaches a header part to a request */
+static inline int httpreq_open_hdr(struct http_req *hreq)
+{
+	struct mempool_obj *hhobj;
+	struct http_req_hdr *hhdr;
+
+	BUG_ON(hreq->h != NULL);
+
+	hhobj = mempool_slabs_pick(hs->reqhdr_pool);
+	if (!hhobj)
+		return -ENOMEM;
+	hhdr = hhobj->data;
+	hhdr->pobj = hhobj;
+	http_recvhdr_reset(&hhdr->request.hdr);
+	hhdr->request.url_len = 0;
+	hhdr->request.url_overflow = 0;
+	hhdr->request.url_argp = NULL;
+	hhdr->request.ts_begin = twheel_now();
+	http_sendhdr_reset(&hhdr->response.hdr);
+
+	hreq->h = hhdr;
+	++hs->nb_reqhdrs;
+	return 0;
+}
+
+/* releases the header part of a request (and the received pbufs that
+ * are referenced by it): the response header has to be acknowledged
+ * already because the send lines are passed to lwIP without copying */
+static inline void httpreq_close_hdr(struct http_req *hreq)
+{
+	http_recvhdr_release(&hreq->h->request.hdr);
+	mempool_put(hreq->h->pobj);
+	hreq->h = NULL;
+	--hs->nb_reqhdrs;
+}
+
 static inline void httpreq_close(struct http_req *hreq)
 {
 	struct http_sess *hsess = hreq->hsess;
@@ -260,13 +593,48 @@ static inline void httpreq_close(struct http_req *hreq)
 		default:
 			break;
 		}
+#ifdef SHFS_TOP
+		if (hreq->alen)
+			shfs_top_bytes(hreq->fd, hreq->alen);
+#endif
 		shfs_fio_close(hreq->fd);
 	}
+#ifdef HTTP_METRICS
+	if (hreq->type == HRT_METRICS)
+		httpreq_metrics_close(hreq);
+#endif
+	if (hreq->h)
+		httpreq_close_hdr(hreq);
 	mempool_put(hreq->pobj);
 	--hsess->hsrv->nb_reqs;
 	printd("Request %p destroyed\n", hreq);
 }
 
+/*
+ * Closes the session that is idle for the longest time in order to make
+ * room for a new one. Sessions that still wait for acknowledgements are
+ * skipped because lwIP references the sent buffers of their requests.
+ * Returns 0 on success, -1 when there was no session to reap
+ */
+static int httpsess_reap_idle(void)
+{
+	struct http_sess *hsess;
+	unsigned int i;
+
+	hsess = dlist_first_el(hs->idle_chain, struct http_sess);
+	for (i = 0; hsess && i < HTTP_REAP_MAXNB_SCAN; ++i) {
+		if (hsess->sent_infly == 0 && !hsess->aqueue_head &&
+		    !hsess->rqueue_head) {
+			printd("Reaping idle session %p\n", hsess);
+			httpsess_close(hsess, HSC_CLOSE);
+			++hs->nb_reaped;
+			return 0;
+		}
+		hsess = dlist_next_el(hsess, idle_chain);
+	}
+	return -1;
+}
+
 static err_t httpsess_accept(void *argp, struct tcp_pcb *new_tpcb, err_t err)
 {
 	struct mempool_obj *hsobj;
@@ -274,7 +642,9 @@ static err_t httpsess_accept(void *argp, struct tcp_pcb *new_tpcb, err_t err)
 
 	if (err != ERR_OK)
 		goto err_out;
-	hsobj = mempool_pick(hs->sess_pool);
+	hsobj = mempool_slabs_pick(hs->sess_pool);
+	if (!hsobj && httpsess_reap_idle() == 0)
+		hsobj = mempool_slabs_pick(hs->sess_pool);
 	if (!hsobj) {
 		err = ERR_MEM;
 		goto err_out;
@@ -286,6 +656,8 @@ static err_t httpsess_accept(void *argp, struct tcp_pcb *new_tpcb, err_t err)
 
 	/* setup request queue */
 	hsess->cpreq = httpreq_open(hsess);
+	if (!hsess->cpreq && httpsess_reap_idle() == 0)
+		hsess->cpreq = httpreq_open(hsess);
 	if (!hsess->cpreq) {
 		err = ERR_MEM;
 		goto err_free_hsess;
@@ -304,7 +676,6 @@ static err_t httpsess_accept(void *argp, struct tcp_pcb *new_tpcb, err_t err)
 	tcp_recv(hsess->tpcb, httpsess_recv); /* recv callback */
 	tcp_sent(hsess->tpcb, httpsess_sent); /* sent ack callback */
 	tcp_err (hsess->tpcb, httpsess_error); /* err callback */
-	tcp_poll(hsess->tpcb, httpsess_poll, HTTP_POLL_INTERVAL); /* poll callback */
 	tcp_setprio(hsess->tpcb, HTTP_TCP_PRIO);
 
 	/* Turn on TCP Keepalive */
@@ -314,10 +685,12 @@ static err_t httpsess_accept(void *argp, struct tcp_pcb *new_tpcb, err_t err)
 	hsess->tpcb->keep_cnt = 1;
 
 	/* init parser */
-	hsess->parser.data = (void *) &hsess->cpreq->request.hdr;
+	hsess->rx_pbuf = NULL;
 	http_parser_init(&(hsess)->parser, HTTP_REQUEST);
 
 	/* reset HTTP keep alive */
+	dlist_init_el(hsess, idle_chain);
+	twheel_timer_init(&hsess->keepalive_timer, httpsess_keepalive_expired, hsess);
 	httpsess_reset_keepalive((hsess));
 
 	/* register session to session list */
@@ -332,11 +705,18 @@ static err_t httpsess_accept(void *argp, struct tcp_pcb *new_tpcb, err_t err)
 	hs->hsess_tail = hsess;
 
 	dlist_init_el(hsess, ioretry_chain);
+#ifdef HTTP_SCHED
+	dlist_init_el(hsess, sched_chain);
+	hsess->deficit = 0;
+	hsess->tokens = HTTP_SCHED_QUANTUM;
+	hsess->ts_refill = twheel_now();
+	twheel_timer_init(&hsess->pace_timer, httpsess_pace_expired, hsess);
+#endif
 
 	hsess->state = HSS_ESTABLISHED;
 	++hs->nb_sess;
 	printd("New HTTP session accepted on server %p "
-		"(currently, there are %"PRIu16"/%"PRIu16" open sessions)\n",
+		"(currently, there are %"PRIu32"/%"PRIu32" open sessions)\n",
 		hs, hs->nb_sess, hs->max_nb_sess);
 	return 0;
 
@@ -344,7 +724,7 @@ static err_t httpsess_accept(void *argp, struct tcp_pcb *new_tpcb, err_t err)
 	mempool_put(hsobj);
  err_out:
 	printd("Session establishment declined on server %p "
-		"(currently, there are %"PRIu16"/%"PRIu16" open sessions)\n",
+		"(currently, there are %"PRIu32"/%"PRIu32" open sessions)\n",
 		hs, hs->nb_sess, hs->max_nb_sess);
 	return err;
 }
@@ -369,12 +749,16 @@ static err_t httpsess_close(struct http_sess *hsess, enum http_sess_close type)
 	tcp_recv(hsess->tpcb, NULL);
 	tcp_sent(hsess->tpcb, NULL);
 	tcp_err(hsess->tpcb,  NULL);
-	tcp_poll(hsess->tpcb, NULL, 0);
+	httpsess_halt_keepalive(hsess);
 
 	/* close unserved requests */
 	if (dlist_is_linked(hsess, hs->ioretry_chain, ioretry_chain))
 		printd(" Session is linked to IORetry list, removing it\n");
 	httpsess_unregister_ioretry(hsess);
+#ifdef HTTP_SCHED
+	httpsess_unsched(hsess);
+	twheel_cancel(&hsess->pace_timer);
+#endif
 
 	for (hreq = hsess->aqueue_head; hreq != NULL; hreq = hreq->next)
 		httpreq_close(hreq);
@@ -415,6 +799,30 @@ static err_t httpsess_close(struct http_sess *hsess, enum http_sess_close type)
 	return err;
 }
 
+/* Hides the data of a pbuf chain that was parsed already (all pbufs before q
+ * and off bytes of q), so that only the rest is repassed by lwIP.
+ * Parsed header lines keep their references to the hidden parts.
+ * Returns the number of hidden bytes */
+static inline uint16_t httpsess_hide_parsed(struct pbuf *p, struct pbuf *q, uint16_t off)
+{
+	struct pbuf *r;
+	uint16_t hidden = off;
+	uint16_t left, hide;
+
+	for (r = p; r != q; r = r->next)
+		hidden += r->len;
+
+	left = hidden;
+	for (r = p; left; r = r->next) {
+		hide = (r == q) ? off : r->len;
+		r->payload = (uint8_t *) r->payload + hide;
+		r->len -= hide;
+		r->tot_len -= left;
+		left -= hide;
+	}
+	return hidden;
+}
+
 static err_t httpsess_recv(void *argp, struct tcp_pcb *tpcb, struct pbuf *p, err_t err)
 {
 	/* lwIP pbuf handling depending on return value:
@@ -453,7 +861,9 @@ static err_t httpsess_recv(void *argp, struct tcp_pcb *tpcb, struct pbuf *p, err
 		if (ret == ERR_ABRT)
 			goto out; /* connection got aborted */
 		hsess->retry_replychain = 0;
-		goto out;
+		if (likely(HTTP_PARSER_ERRNO(&hsess->parser) != HPE_PAUSED))
+			goto out;
+		/* the rest of the data was not parsed yet (see below) */
 	}
 
 	cpreq = hsess->cpreq;
@@ -473,6 +883,20 @@ static err_t httpsess_recv(void *argp, struct tcp_pcb *tpcb, struct pbuf *p, err
 		goto out;
 	}
 
+	if (unlikely(!cpreq->h && !mempool_slabs_can_pick(hs->reqhdr_pool))) {
+		/* no header part left for the next request:
+		 * hold the data back until requests of other sessions are
+		 * responded (lwIP will repass it) */
+		printd("Request header pool exhausted: Postponing parsing\n");
+		ret = ERR_MEM;
+		goto out;
+	}
+	if (unlikely(HTTP_PARSER_ERRNO(&hsess->parser) == HPE_PAUSED)) {
+		/* continue the request that could not get a header part */
+		httpreq_open_hdr(cpreq);
+		http_parser_pause(&hsess->parser, 0);
+	}
+
 	switch (cpreq->state) {
 	case HRS_PARSING_HDR:
 	case HRS_PARSING_MSG:
@@ -480,8 +904,20 @@ static err_t httpsess_recv(void *argp, struct tcp_pcb *tpcb, struct pbuf *p, err
 		prev_rqueue_len = hsess->rqueue_len;
 		httpsess_halt_keepalive(hsess);
 		for (q = p; q != NULL; q = q->next) {
+			if (unlikely(!q->len))
+				continue; /* hidden by a previous call */
+			hsess->rx_pbuf = q; /* header lines reference it */
 			plen = http_parser_execute(&hsess->parser, &_http_parser_settings,
 			                           q->payload, q->len);
+			if (unlikely(HTTP_PARSER_ERRNO(&hsess->parser) == HPE_PAUSED)) {
+				/* a pipelined request could not get a header
+				 * part: hold the rest back in lwIP (ERR_MEM)
+				 * until headers of other requests are released */
+				printd("Request header pool exhausted: Postponing parsing of pipelined request\n");
+				tcp_recved(tpcb, httpsess_hide_parsed(p, q, plen));
+				ret = ERR_MEM;
+				break;
+			}
 			if (unlikely(hsess->parser.upgrade)) {
 				/* protocol upgrade requested */
 				printd("Unsupported HTTP protocol upgrade requested: Dropping connection...\n");
@@ -496,21 +932,29 @@ static err_t httpsess_recv(void *argp, struct tcp_pcb *tpcb, struct pbuf *p, err
 				goto out;
 			}
 		}
+		if (hsess->rqueue_len == 0 && cpreq->h) {
+			/* request header is incomplete: the keepalive timer
+			 * was halted above but the session is still idle */
+			httpsess_reset_hdrtimeout(hsess, cpreq->h);
+		}
 
 		printd("prev_rqueue_len == %u, hsess->rqueue_len = %u\n",
 		        prev_rqueue_len, hsess->rqueue_len);
 		if (prev_rqueue_len == 0 && hsess->rqueue_len) {
 			/* new request came in: start reply chain */
 			printd("Starting reply chain...\n");
-			ret = httpsess_respond(hsess);
-			if (ret == ERR_MEM) {
+			err = httpsess_respond(hsess);
+			if (err == ERR_MEM) {
 				/* out of memory for replying.
 				 * We will retry it later by holding the current
 				 * pbuf back in the stack */
 				printd("Replying failed: Out of memory\n");
 				hsess->retry_replychain = 1;
+				ret = ERR_MEM;
 				goto out;
 			}
+			if (err == ERR_ABRT)
+				ret = ERR_ABRT;
 			goto out;
 		}
 		break;
@@ -535,26 +979,30 @@ static void httpsess_error(void *argp, err_t err)
 	httpsess_close(hsess, HSC_KILL); /* drop connection */
 }
 
-/* Is called every 5 sec */
-static err_t httpsess_poll(void *argp, struct tcp_pcb *tpcb)
+/* Is called by the timer wheel when the session was idle for too long */
+static void httpsess_keepalive_expired(struct twheel_timer *t, void *argp)
 {
 	struct http_sess *hsess = argp;
 
-	printd("poll session %p\n", hsess);
-	if (unlikely(hsess->keepalive_timer == 0)) {
-		/* keepalive timeout: close connection */
-		if (hsess->sent_infly == 0) {
-			return httpsess_close(hsess, HSC_CLOSE);
-		} else {
-			/* we need to wait for the client until it ack'ed */
-			hsess->state = HSS_CLOSING;
-		}
+	printd("keepalive timeout of session %p\n", hsess);
+	if (hsess->sent_infly == 0) {
+		httpsess_close(hsess, HSC_CLOSE);
+	} else {
+		/* we need to wait for the client until it ack'ed */
+		hsess->state = HSS_CLOSING;
 	}
-	if (hsess->keepalive_timer > 0)
-		--hsess->keepalive_timer;
-	return ERR_OK;
 }
 
+#ifdef HTTP_SCHED
+/* Is called by the timer wheel when a rate capped session can send again */
+static void httpsess_pace_expired(struct twheel_timer *t, void *argp)
+{
+	struct http_sess *hsess = argp;
+
+	httpsess_sched(hsess);
+}
+#endif
+
 /**
  * Call tcp_write() in a loop trying smaller and smaller length
  *
@@ -656,33 +1104,61 @@ static int httprecv_hdr_url(struct http_parser *parser, const char *buf, size_t
 {
 	struct http_sess *hsess = container_of(parser, struct http_sess, parser);
 	struct http_req *hreq = hsess->cpreq;
-	register size_t i, curpos, maxlen;
+	register size_t curpos, maxlen;
+	const char *argp;
 
-	curpos = hreq->request.url_len;
-	maxlen = sizeof(hreq->request.url) - 1 - curpos;
+	if (unlikely(!hreq))
+		return 0; /* no request object: data is ignored */
+	curpos = hreq->h->request.url_len;
+	maxlen = sizeof(hreq->h->request.url) - 1 - curpos;
 	if (unlikely(len > maxlen)) {
-		hreq->request.url_overflow = 1; /* Out of memory */
+		hreq->h->request.url_overflow = 1; /* Out of memory */
 		len = maxlen;
 	}
 
-	if (!hreq->request.url_argp) {
-		for (i = 0; i < len; ++i) {
-			hreq->request.url[curpos + i] = buf[i];
+	if (!hreq->h->request.url_argp) {
+		argp = memchr(buf, HTTPURL_ARGS_INDICATOR, len);
+		if (argp)
+			hreq->h->request.url_argp = &hreq->h->request.url[curpos + (argp - buf)];
+	}
+	MEMCPY(&hreq->h->request.url[curpos], buf, len);
+	hreq->h->request.url_len += len;
+	return 0;
+}
 
-			if (buf[i] == HTTPURL_ARGS_INDICATOR) {
-				hreq->request.url_argp = &hreq->request.url[curpos + i];
-				hreq->request.url_len += i;
-				len    -= i;
-				buf    += i;
-				curpos += i;
-				goto memcpy;
-			}
-		}
-	} else {
-  memcpy:
-		MEMCPY(&hreq->request.url[curpos], buf, len);
+static int httprecv_hdr_field(struct http_parser *parser, const char *buf, size_t len)
+{
+	struct http_sess *hsess = container_of(parser, struct http_sess, parser);
+
+	if (unlikely(!hsess->cpreq))
+		return 0; /* no request object: data is ignored */
+	return http_recvhdr_add_field(&hsess->cpreq->h->request.hdr, hsess->rx_pbuf, buf, len);
+}
+
+static int httprecv_hdr_value(struct http_parser *parser, const char *buf, size_t len)
+{
+	struct http_sess *hsess = container_of(parser, struct http_sess, parser);
+
+	if (unlikely(!hsess->cpreq))
+		return 0; /* no request object: data is ignored */
+	return http_recvhdr_add_value(&hsess->cpreq->h->request.hdr, hsess->rx_pbuf, buf, len);
+}
+
+static int httprecv_req_begin(struct http_parser *parser)
+{
+	struct http_sess *hsess = container_of(parser, struct http_sess, parser);
+
+	if (unlikely(!hsess->cpreq))
+		return 0; /* data is ignored */
+	if (hsess->cpreq->h)
+		return 0; /* picked already */
+	if (unlikely(httpreq_open_hdr(hsess->cpreq) < 0)) {
+		/* this happens only for pipelined requests that start
+		 * within an already parsed pbuf: pause the parser at the
+		 * message boundary, httpsess_recv() holds the rest back */
+		printd("Could not allocate a request header object\n");
+		http_parser_pause(parser, 1);
 	}
-	hreq->request.url_len += len;
 	return 0;
 }
 
@@ -700,6 +1176,9 @@ static int httprecv_req_complete(struct http_parser *parser)
 	 *       the input */
 	hreq = hsess->cpreq;
 	hsess->cpreq = NULL;
+#ifdef LATENCY_HIST
+	hreq->ts_parsed = lhist_ticks();
+#endif
 	if (hsess->rqueue_tail)
 		hsess->rqueue_tail->next = hreq;
 	else
@@ -729,13 +1208,39 @@ static int httprecv_req_complete(struct http_parser *parser)
 	hreq->request.method = parser->method;
 
 	/* finalize request lines by adding terminating '\0' */
-	http_recvhdr_terminate(&hreq->request.hdr);
-	hreq->request.url[hreq->request.url_len++] = '\0';
+	http_recvhdr_terminate(&hreq->h->request.hdr);
+	hreq->h->request.url[hreq->h->request.url_len++] = '\0';
 	hreq->state = HRS_PREPARING_HDR;
 
 	return 0;
 }
 
+/* builds a complete 503 (Service unavailable) response header */
+static void httpreq_err503_hdr(struct http_req *hreq, uint32_t pressure)
+{
+	size_t nb_slines = 0;
+	size_t nb_dlines = 0;
+
+	hreq->response.code = 503;
+	http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines,
+			      HTTP_SHDR_503(hreq->request.http_major, hreq->request.http_minor));
+	http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines, HTTP_SHDR_HTML);
+	/* Content length */
+	http_sendhdr_add_dline(&hreq->h->response.hdr, &nb_dlines,
+			       "%s: %"PRIu64"\r\n", _http_dhdr[HTTP_DHDR_SIZE],
+			       _http_err503p_len);
+	/* Retry-after */
+	http_sendhdr_add_dline(&hreq->h->response.hdr, &nb_dlines,
+			       "%s: %u\r\n", _http_dhdr[HTTP_DHDR_RETRY],
+			       http_retry_after(pressure));
+	hreq->type = HRT_SMSG;
+	hreq->smsg = _http_err503p;
+	hreq->rlen = _http_err503p_len;
+	http_sendhdr_set_nbslines(&hreq->h->response.hdr, nb_slines);
+	http_sendhdr_set_nbdlines(&hreq->h->response.hdr, nb_dlines);
+	hreq->state = HRS_FINALIZING_HDR;
+}
+
 static inline void httpreq_prepare_hdr(struct http_req *hreq)
 {
 	size_t url_offset = 0;
@@ -752,6 +1257,9 @@ static inline void httpreq_prepare_hdr(struct http_req *hreq)
 #endif
 	char strsbuf[64];
 	char strlbuf[128];
+#ifdef HTTP_ADMISSION
+	uint32_t pressure;
+#endif
 
 	/* check request method (GET, POST, ...) */
 	if (hreq->request.method != HTTP_GET) {
@@ -764,40 +1272,55 @@ static inline void httpreq_prepare_hdr(struct http_req *hreq)
 
 #ifdef HTTP_DEBUG
 	printd("GET %s HTTP/%hu.%hu\n",
-	        hreq->request.url,
+	        hreq->h->request.url,
 	        hreq->request.http_major,
 	        hreq->request.http_minor);
-	for (l = 0; l < hreq->request.hdr.nb_lines; ++l) {
+	for (l = 0; l < hreq->h->request.hdr.nb_lines; ++l) {
 		printd("   %s: %s\n",
-		       hreq->request.hdr.line[l].field.b,
-		       hreq->request.hdr.line[l].value.b);
+		       hreq->h->request.hdr.line[l].field.b,
+		       hreq->h->request.hdr.line[l].value.b);
 	}
 #endif
 
 	/* try to open requested file and construct header */
 	/* eliminate leading '/'s */
-	while (hreq->request.url[url_offset] == '/')
+	while (hreq->h->request.url[url_offset] == '/')
 		++url_offset;
 
 #ifdef HTTP_URL_CUTARGS
 	/* remove args from URL when there was a filename passed (-> "open by filename") */
-	if (hreq->request.url_argp &&
-	    &(hreq->request.url[url_offset]) != hreq->request.url_argp)
-		*(hreq->request.url_argp) = '\0';
+	if (hreq->h->request.url_argp &&
+	    &(hreq->h->request.url[url_offset]) != hreq->h->request.url_argp)
+		*(hreq->h->request.url_argp) = '\0';
 #endif
 
+#ifdef HTTP_METRICS
+	if ((hreq->h->request.url[url_offset] == HTTPURL_ARGS_INDICATOR) &&
+	    (strcmp(&hreq->h->request.url[url_offset + 1], HTTP_METRICS_URL) == 0))
+		goto metrics_hdr;
+#endif
 #ifdef HTTP_TESTFILES
-	if ((hreq->request.url[url_offset] == HTTPURL_ARGS_INDICATOR) &&
-	    (hash_parse(&hreq->request.url[url_offset + 1], h, shfs_vol.hlen) == 0)) {
+	if ((hreq->h->request.url[url_offset] == HTTPURL_ARGS_INDICATOR) &&
+	    (hash_parse(&hreq->h->request.url[url_offset + 1], h, shfs_vol.hlen) == 0)) {
 		if (hash_is_zero(h, shfs_vol.hlen))
 			goto testfile_hdr0; /* empty testfile */
 		if (hash_is_max(h, shfs_vol.hlen))
 			goto testfile_hdr1; /* infinite testfile */
 	}
 #endif
-	hreq->fd = shfs_fio_open(&hreq->request.url[url_offset]);
+#ifdef HTTP_ADMISSION
+	/* shed load before any cache buffer or AIO token is used */
+	pressure = http_adm_pressure();
+	if (unlikely(!http_adm_admit(pressure))) {
+		printd("Overload (pressure: %"PRIu32"/1024): Shedding request\n", pressure);
+		++hs->adm.nb_shed;
+		httpreq_err503_hdr(hreq, pressure);
+		return;
+	}
+#endif
+	hreq->fd = shfs_fio_open(&hreq->h->request.url[url_offset]);
 	if (!hreq->fd) {
-		printd("Could not open requested file '%s': %s\n", &hreq->request.url[url_offset], strerror(errno));
+		printd("Could not open requested file '%s': %s\n", &hreq->h->request.url[url_offset], strerror(errno));
 		if (errno == ENOENT || errno == ENODEV)
 			goto err404_hdr; /* 404 File not found */
 		goto err500_hdr; /* 500 Internal server error */
@@ -841,38 +1364,63 @@ static inline void httpreq_prepare_hdr(struct http_req *hreq)
 	 */
  red307_hdr:
 	hreq->response.code = 307;
-	http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines,
+	http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines,
 			      HTTP_SHDR_307(hreq->request.http_major, hreq->request.http_minor));
 	strshfshost(strsbuf, sizeof(strsbuf),
 		    shfs_fio_link_rhost(hreq->fd));
 	shfs_fio_link_rpath(hreq->fd, strlbuf, sizeof(strlbuf));
-	http_sendhdr_add_dline(&hreq->response.hdr, &nb_dlines,
+	http_sendhdr_add_dline(&hreq->h->response.hdr, &nb_dlines,
 			       "%s: http://%s:%"PRIu16"/%s\r\n", _http_dhdr[HTTP_DHDR_LOCATION],
 			       strsbuf, shfs_fio_link_rport(hreq->fd), strlbuf);
 	hreq->type = HRT_NOMSG;
 	goto err_out;
 
+	/**
+	 * METRICS HEADER
+	 */
+#ifdef HTTP_METRICS
+ metrics_hdr:
+	/* the state is taken from a small pool: metrics are scraped rarely */
+	if (unlikely(httpreq_metrics_open(hreq) < 0)) {
+		httpreq_err503_hdr(hreq, http_adm_pressure());
+		return;
+	}
+	hreq->response.code = 200;
+	http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines,
+			      HTTP_SHDR_200(hreq->request.http_major, hreq->request.http_minor));
+	http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines, HTTP_SHDR_NOCACHE);
+	http_sendhdr_add_dline(&hreq->h->response.hdr, &nb_dlines,
+			       "%s: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n",
+			       _http_dhdr[HTTP_DHDR_MIME]);
+
+	/* length is unknown: the body ends by closing the connection */
+	hreq->type = HRT_METRICS;
+	hreq->is_stream = 1;
+	hreq->hsess->keepalive = 0;
+	goto err_out;
+#endif
+
 	/**
 	 * TESTFILE HEADER
 	 */
 #ifdef HTTP_TESTFILES
  testfile_hdr0: /* testfile with zero length */
 	hreq->response.code = 200;
-	http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines,
+	http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines,
 			      HTTP_SHDR_200(hreq->request.http_major, hreq->request.http_minor));
-	http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines, HTTP_SHDR_BINARY);
+	http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines, HTTP_SHDR_BINARY);
 
 	/* Content length */
-	http_sendhdr_add_dline(&hreq->response.hdr, &nb_dlines,
+	http_sendhdr_add_dline(&hreq->h->response.hdr, &nb_dlines,
 			       "%s: %"PRIu64"\r\n", _http_dhdr[HTTP_DHDR_SIZE], 0);
 	hreq->type = HRT_NOMSG;
 	goto err_out;
 
  testfile_hdr1: /* infinite testfile */
 	hreq->response.code = 200;
-	http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines,
+	http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines,
 			      HTTP_SHDR_200(hreq->request.http_major, hreq->request.http_minor));
-	http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines, HTTP_SHDR_BINARY);
+	http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines, HTTP_SHDR_BINARY);
 
 	hreq->rlen = sizeof(_http_testfile) - 1;
 	hreq->type = HRT_SMSG_INF;
@@ -887,12 +1435,12 @@ static inline void httpreq_prepare_hdr(struct http_req *hreq)
  err404_hdr:
 	/* 404 File not found */
 	hreq->response.code = 404;
-	http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines,
+	http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines,
 			      HTTP_SHDR_404(hreq->request.http_major, hreq->request.http_minor));
-	http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines,HTTP_SHDR_HTML);
-	http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines,HTTP_SHDR_NOCACHE);
+	http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines,HTTP_SHDR_HTML);
+	http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines,HTTP_SHDR_NOCACHE);
 	/* Content length */
-	http_sendhdr_add_dline(&hreq->response.hdr, &nb_dlines,
+	http_sendhdr_add_dline(&hreq->h->response.hdr, &nb_dlines,
 			       "%s: %"PRIu64"\r\n", _http_dhdr[HTTP_DHDR_SIZE],
 			       _http_err404p_len);
 	hreq->type = HRT_SMSG;
@@ -903,11 +1451,11 @@ static inline void httpreq_prepare_hdr(struct http_req *hreq)
  err500_hdr:
 	/* 500 Internal server error */
 	hreq->response.code = 500;
-	http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines,
+	http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines,
 			      HTTP_SHDR_500(hreq->request.http_major, hreq->request.http_minor));
-	http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines, HTTP_SHDR_HTML);
+	http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines, HTTP_SHDR_HTML);
 	/* Content length */
-	http_sendhdr_add_dline(&hreq->response.hdr, &nb_dlines,
+	http_sendhdr_add_dline(&hreq->h->response.hdr, &nb_dlines,
 			       "%s: %"PRIu64"\r\n", _http_dhdr[HTTP_DHDR_SIZE],
 			       _http_err500p_len);
 	hreq->type = HRT_SMSG;
@@ -918,11 +1466,11 @@ static inline void httpreq_prepare_hdr(struct http_req *hreq)
  err501_hdr:
 	/* 501 Invalid request */
 	hreq->response.code = 501;
-	http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines,
+	http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines,
 			      HTTP_SHDR_501(hreq->request.http_major, hreq->request.http_minor));
-	http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines, HTTP_SHDR_HTML);
+	http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines, HTTP_SHDR_HTML);
 	/* Content length */
-	http_sendhdr_add_dline(&hreq->response.hdr, &nb_dlines,
+	http_sendhdr_add_dline(&hreq->h->response.hdr, &nb_dlines,
 			       "%s: %"PRIu64"\r\n", _http_dhdr[HTTP_DHDR_SIZE],
 			       _http_err501p_len);
 	hreq->type = HRT_SMSG;
@@ -931,8 +1479,8 @@ static inline void httpreq_prepare_hdr(struct http_req *hreq)
 	goto err_out;
 
  err_out:
-	http_sendhdr_set_nbslines(&hreq->response.hdr, nb_slines);
-	http_sendhdr_set_nbdlines(&hreq->response.hdr, nb_dlines);
+	http_sendhdr_set_nbslines(&hreq->h->response.hdr, nb_slines);
+	http_sendhdr_set_nbdlines(&hreq->h->response.hdr, nb_dlines);
 	hreq->state = HRS_FINALIZING_HDR;
 	return;
 }
@@ -941,6 +1489,7 @@ static inline void httpreq_build_hdr(struct http_req *hreq)
 {
 	size_t nb_slines = 0;
 	size_t nb_dlines = 0;
+	uint64_t fsize = 0;
 	int ret;
 
 	/* For now, just remote links utilize this phase for connecting to 
@@ -954,8 +1503,13 @@ static inline void httpreq_build_hdr(struct http_req *hreq)
 	if (ret == -EAGAIN)
 		return; /* stay in current phase because we are not done yet */
 	if (ret < 0) {
+		if (ret == -ERANGE)
+			fsize = hreq->l.origin->fsize; /* origin is gone after closing */
 		httpreq_link_close(hreq);
 		shfs_fio_close(hreq->fd);
+		hreq->fd = NULL;
+		if (ret == -ERANGE)
+			goto err416_hdr; /* range of remote object is not satisfiable */
 		goto err503_hdr; /* an unknown error happend -> send out a 503 error page instead */
 	}
 
@@ -963,68 +1517,67 @@ static inline void httpreq_build_hdr(struct http_req *hreq)
 	hreq->state = HRS_FINALIZING_HDR;
 	return;
 
+ err416_hdr:
+	/* 416 Range request error */
+	hreq->response.code = 416;
+	http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines,
+			      HTTP_SHDR_416(hreq->request.http_major, hreq->request.http_minor));
+	http_sendhdr_add_dline(&hreq->h->response.hdr, &nb_dlines,
+			       "%s: %"PRIu64"\r\n", _http_dhdr[HTTP_DHDR_SIZE], 0);
+	/* Content range: complete length of the remote object */
+	http_sendhdr_add_dline(&hreq->h->response.hdr, &nb_dlines,
+			       "%s*/%"PRIu64"\r\n", _http_dhdr[HTTP_DHDR_RANGE], fsize);
+	hreq->type = HRT_NOMSG;
+	http_sendhdr_set_nbslines(&hreq->h->response.hdr, nb_slines);
+	http_sendhdr_set_nbdlines(&hreq->h->response.hdr, nb_dlines);
+	hreq->state = HRS_FINALIZING_HDR;
+	return;
+
  err503_hdr:
 	/* 503 Service unavailable */
-	hreq->response.code = 503;
-	http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines,
-			      HTTP_SHDR_503(hreq->request.http_major, hreq->request.http_minor));
-	http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines, HTTP_SHDR_HTML);
-	/* Content length */
-	http_sendhdr_add_dline(&hreq->response.hdr, &nb_dlines,
-			       "%s: %"PRIu64"\r\n", _http_dhdr[HTTP_DHDR_SIZE],
-			       _http_err503p_len);
-	/* Retry-after (TODO: replace the hard-coded 2 second) */
-	http_sendhdr_add_dline(&hreq->response.hdr, &nb_dlines,
-			       "%s: %u\r\n", _http_dhdr[HTTP_DHDR_RETRY],
-			       2);
-	hreq->type = HRT_SMSG;
-	hreq->smsg = _http_err503p;
-	hreq->rlen = _http_err503p_len;
-	http_sendhdr_set_nbslines(&hreq->response.hdr, nb_slines);
-	http_sendhdr_set_nbdlines(&hreq->response.hdr, nb_dlines);
-	hreq->state = HRS_FINALIZING_HDR;
+	httpreq_err503_hdr(hreq, http_adm_pressure());
 	return;
 }
 
 static inline void httpreq_finalize_hdr(struct http_req *hreq)
 {
-	size_t nb_slines = http_sendhdr_get_nbslines(&hreq->response.hdr);
-	size_t nb_dlines = http_sendhdr_get_nbdlines(&hreq->response.hdr);
+	size_t nb_slines = http_sendhdr_get_nbslines(&hreq->h->response.hdr);
+	size_t nb_dlines = http_sendhdr_get_nbdlines(&hreq->h->response.hdr);
 #ifdef HTTP_DEBUG
 	register unsigned l;
 #endif
 
 	/* Default header lines */
-	http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines, HTTP_SHDR_SERVER);
+	http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines, HTTP_SHDR_SERVER);
 
 	/* keepalive */
 	if (!hreq->request.keepalive || hreq->is_stream)
-		http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines, HTTP_SHDR_CONN_CLOSE);
+		http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines, HTTP_SHDR_CONN_CLOSE);
 	else
-		http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines, HTTP_SHDR_CONN_KEEPALIVE);
+		http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines, HTTP_SHDR_CONN_KEEPALIVE);
 
 	/* Calculate final header length */
-	http_sendhdr_set_nbslines(&hreq->response.hdr, nb_slines);
-	http_sendhdr_set_nbdlines(&hreq->response.hdr, nb_dlines);
-	hreq->response.hdr_total_len = http_sendhdr_calc_totallen(&hreq->response.hdr);
+	http_sendhdr_set_nbslines(&hreq->h->response.hdr, nb_slines);
+	http_sendhdr_set_nbdlines(&hreq->h->response.hdr, nb_dlines);
+	hreq->response.hdr_total_len = http_sendhdr_calc_totallen(&hreq->h->response.hdr);
 
 #ifdef HTTP_DEBUG
 	printd("Response:\n");
-	for (l = 0; l < hreq->response.hdr.nb_slines; ++l) {
+	for (l = 0; l < hreq->h->response.hdr.nb_slines; ++l) {
 		printd("   %s",
-		       hreq->response.hdr.sline[l].b);
+		       hreq->h->response.hdr.sline[l].b);
 	}
-	for (l = 0; l < hreq->response.hdr.nb_dlines; ++l) {
+	for (l = 0; l < hreq->h->response.hdr.nb_dlines; ++l) {
 		printd("   %s",
-		       hreq->response.hdr.dline[l].b);
+		       hreq->h->response.hdr.dline[l].b);
 	}
-	printd(" Header length: %lu\n", hreq->response.hdr.total_len);
+	printd(" Header length: %lu\n", hreq->h->response.hdr.total_len);
 	printd(" Body length:   %lu\n", hreq->rlen + _http_ftr_len);
 #endif
 #ifdef HTTP_DEBUG_PRINTACCESS
 	printk("[%03u] %s\n",
 	       hreq->response.code,
-	       hreq->request.url);
+	       hreq->h->request.url);
 #endif
 }
 
@@ -1085,6 +1638,9 @@ static inline void httpreq_finalize(struct http_req *hreq)
 			hsess->aqueue_head = hreq;
 		hsess->aqueue_tail = hreq;
 	} else {
+#ifdef LATENCY_HIST
+		lhist_add_since(&hs->lat_total, hreq->ts_parsed);
+#endif
 		httpreq_close(hreq);
 	}
 }
@@ -1176,10 +1732,13 @@ err_t httpsess_respond(struct http_sess *hsess)
 	case_HRS_RESPONDING_HDR:
 		hreq->state = HRS_RESPONDING_HDR;
 		hsess->sent = 0;
+#ifdef LATENCY_HIST
+		lhist_add_since(&hs->lat_ttfb, hreq->ts_parsed);
+#endif
 	case HRS_RESPONDING_HDR:
 		/* send out header */
 		//err = httpreq_write_hdr(hreq, &hsess->sent);
-		err = http_sendhdr_write(&hreq->response.hdr, &hsess->sent,
+		err = http_sendhdr_write(&hreq->h->response.hdr, &hsess->sent,
 					 (tcpwrite_fn_t) httpsess_write, (void *) hsess);
 		if (unlikely(err != ERR_OK && err != ERR_MEM))
 			goto err_close;
@@ -1216,6 +1775,14 @@ err_t httpsess_respond(struct http_sess *hsess)
 #endif
 
 		case HRT_FIOMSG:
+#ifdef HTTP_SCHED
+			if (hs->sched_cur != hsess) {
+				/* file data is sent when the scheduler
+				 * picks this session (http_poll_sched()) */
+				httpsess_sched(hsess);
+				break;
+			}
+#endif
 			/* send out data from file */
 			err = httpreq_write_fio(hreq, &hsess->sent);
 			if (unlikely(err != ERR_OK && err != ERR_MEM))
@@ -1233,7 +1800,21 @@ err_t httpsess_respond(struct http_sess *hsess)
 #endif
 				goto case_HRS_RESPONDING_EOM;
 			}
+#ifdef HTTP_SCHED
+			if (!hsess->deficit)
+				httpsess_sched(hsess); /* quantum is used up: next round */
+#endif
+			break;
+
+#ifdef HTTP_METRICS
+		case HRT_METRICS:
+			err = httpreq_write_metrics(hreq, &hsess->sent);
+			if (unlikely(err != ERR_OK && err != ERR_MEM))
+				goto err_close;
+			if (hreq->m->done)
+				goto case_HRS_RESPONDING_EOM;
 			break;
+#endif
 
 		case HRT_LINKMSG:
 			err = httpreq_write_link(hreq, &hsess->sent);
@@ -1241,6 +1822,8 @@ err_t httpsess_respond(struct http_sess *hsess)
 				goto case_HRS_RESPONDING_EOM;
 			if (unlikely(err != ERR_OK && err != ERR_MEM))
 				goto err_close; /* drop connection because of an unrecoverable error */
+			if (!hreq->is_stream && hsess->sent == hreq->rlen)
+				goto case_HRS_RESPONDING_EOM; /* remote object: range is sent */
 			break;
 
 		default:
@@ -1251,6 +1834,10 @@ err_t httpsess_respond(struct http_sess *hsess)
 	case_HRS_RESPONDING_EOM:
 		hreq->state = HRS_RESPONDING_EOM;
 		hsess->sent = 0;
+#ifdef HTTP_METRICS
+		if (hreq->type == HRT_METRICS)
+			hsess->sent = _http_ftr_len; /* no footer: "# EOF" has to be the last line */
+#endif
 	case HRS_RESPONDING_EOM:
 		err = httpsess_write_sbuf(hsess, &hsess->sent,
 		                          _http_ftr, _http_ftr_len);
@@ -1294,6 +1881,9 @@ static inline void httpreq_acknowledge(struct http_req *hreq, size_t *len, int *
 		} else {
 			hreq->response.hdr_acked_len += hdr_infly;
 			acked -= hdr_infly;
+
+			/* header is not required anymore */
+			httpreq_close_hdr(hreq);
 		}
 	}
 
@@ -1313,12 +1903,16 @@ static inline void httpreq_acknowledge(struct http_req *hreq, size_t *len, int *
 			hreq->alen += acked;
 			if (acked && hreq->type == HRT_FIOMSG)
 				httpreq_ack_fio(hreq, acked);
+			else if (acked && hreq->type == HRT_LINKMSG)
+				httpreq_ack_link(hreq, acked);
 			acked = 0;
 		} else {
 			hreq->alen += msg_infly;
 			acked -= msg_infly;
 			if (msg_infly && hreq->type == HRT_FIOMSG)
 				httpreq_ack_fio(hreq, msg_infly);
+			else if (msg_infly && hreq->type == HRT_LINKMSG)
+				httpreq_ack_link(hreq, msg_infly);
 		}
 	}
 
@@ -1364,6 +1958,9 @@ static err_t httpsess_acknowledge(struct http_sess *hsess, size_t len)
 					hsess->aqueue_head = NULL;
 					hsess->aqueue_tail = NULL;
 				}
+#ifdef LATENCY_HIST
+				lhist_add_since(&hs->lat_total, hreq->ts_parsed);
+#endif
 				httpreq_close(hreq);
 			}
 			continue;
@@ -1432,10 +2029,18 @@ int shcmd_http_info(FILE *cio, int argc, char *argv[])
 	struct http_sess *hsess;
 	struct http_req *hreq;
 #endif
-	uint16_t nb_sess, max_nb_sess;
+	uint32_t nb_sess, max_nb_sess;
 	uint32_t nb_reqs, max_nb_reqs;
+	uint32_t nb_reqhdrs, max_nb_reqhdrs;
+	uint32_t nb_rxpbufs;
 	uint16_t nb_links, max_nb_links;
-	uint64_t ps_sess, ps_reqs, ps_links;
+	uint64_t ps_sess, ps_reqs, ps_reqhdrs, ps_links;
+	uint64_t nb_reaped;
+	uint64_t nb_shed;
+	uint32_t pressure, qdelay;
+#ifdef HTTP_SCHED
+	uint32_t nb_sched, sess_rate;
+#endif
 	unsigned long pver;
 	size_t fio_nb_buffers = 0;
 	size_t link_nb_buffers = 0;
@@ -1453,8 +2058,19 @@ int shcmd_http_info(FILE *cio, int argc, char *argv[])
 	max_nb_sess  = hs->max_nb_sess;
 	nb_reqs      = hs->nb_reqs;
 	max_nb_reqs  = hs->max_nb_reqs;
+	nb_reqhdrs   = hs->nb_reqhdrs;
+	max_nb_reqhdrs = hs->max_nb_reqhdrs;
+	nb_rxpbufs   = http_recvhdr_nb_rxpbufs;
 	nb_links     = hs->nb_links;
 	max_nb_links = hs->max_nb_links;
+	nb_reaped    = hs->nb_reaped;
+	nb_shed      = hs->adm.nb_shed;
+	qdelay       = hs->adm.qdelay;
+	pressure     = http_adm_pressure();
+#ifdef HTTP_SCHED
+	nb_sched     = hs->nb_sched;
+	sess_rate    = hs->sess_rate;
+#endif
 	pver         = http_parser_version();
 	if (shfs_mounted) {
 		fio_nb_buffers = httpreq_fio_nb_buffers(shfs_vol.chunksize);
@@ -1462,14 +2078,27 @@ int shcmd_http_info(FILE *cio, int argc, char *argv[])
 		link_nb_buffers = httpreq_link_nb_buffers(shfs_vol.chunksize);
 		link_bffrlen = shfs_vol.chunksize * link_nb_buffers;
 	}
-	ps_sess  = mempool_size(hs->sess_pool);
-	ps_reqs  = mempool_size(hs->req_pool);
+	ps_sess  = mempool_slabs_size(hs->sess_pool);
+	ps_reqs  = mempool_slabs_size(hs->req_pool);
+	ps_reqhdrs = mempool_slabs_size(hs->reqhdr_pool);
 	ps_links = mempool_size(hs->link_pool);
 
 	/* thread switching might happen from here on */
 	fprintf(cio, " Listen port:                           %8"PRIu16"\n", HTTP_LISTEN_PORT);
-	fprintf(cio, " Number of sessions:                   %4"PRIu16"/%4"PRIu16" (%5"PRIu64" B per session, pool size: %6"PRIu64" KiB)\n", nb_sess,  max_nb_sess, (uint64_t) sizeof(struct http_sess), ps_sess / 1024);
+	fprintf(cio, " Number of sessions:                   %4"PRIu32"/%4"PRIu32" (%5"PRIu64" B per session, pool size: %6"PRIu64" KiB)\n", nb_sess,  max_nb_sess, (uint64_t) sizeof(struct http_sess), ps_sess / 1024);
 	fprintf(cio, " Number of requests:                   %4"PRIu32"/%4"PRIu32" (%5"PRIu64" B per request, pool size: %6"PRIu64" KiB)\n", nb_reqs,  max_nb_reqs, (uint64_t) sizeof(struct http_req), ps_reqs / 1024);
+	fprintf(cio, " Number of request headers:            %4"PRIu32"/%4"PRIu32" (%5"PRIu64" B per header,  pool size: %6"PRIu64" KiB)\n", nb_reqhdrs,  max_nb_reqhdrs, (uint64_t) sizeof(struct http_req_hdr), ps_reqhdrs / 1024);
+	fprintf(cio, " Received pbufs held by headers:       %4"PRIu32"/%4"PRIu32"\n", nb_rxpbufs, (uint32_t) HTTP_RECVHDR_MAX_RXPBUFS);
+	fprintf(cio, " Reaped idle sessions:                  %8"PRIu64"\n", nb_reaped);
+	fprintf(cio, " Load pressure:                         %8"PRIu32"/1024 (I/O queue delay: %"PRIu32" ms)\n", pressure, qdelay);
+	fprintf(cio, " Shed requests (503):                   %8"PRIu64"\n", nb_shed);
+#ifdef HTTP_SCHED
+	fprintf(cio, " Sessions waiting for sending:          %8"PRIu32" (quantum: %"PRIu32" B", nb_sched, (uint32_t) HTTP_SCHED_QUANTUM);
+	if (sess_rate)
+		fprintf(cio, ", rate cap: %"PRIu32" kbit/s)\n", sess_rate / 125);
+	else
+		fprintf(cio, ", no rate cap)\n");
+#endif
 	fprintf(cio, " Number of active uplinks:             %4"PRIu16"/%4"PRIu16" (%5"PRIu64" B per uplink,  pool size: %6"PRIu64" KiB)\n", nb_links, max_nb_links, (uint64_t) sizeof(struct http_req_link_origin), ps_links / 1024);
 	if (fio_nb_buffers) {
 		fprintf(cio, " File-I/O chunkbuffer chain length:     %8"PRIu64, (uint64_t) fio_nb_buffers);
@@ -1560,3 +2189,85 @@ int shcmd_http_info(FILE *cio, int argc, char *argv[])
 	return 0;
 }
 #endif
+
+#ifdef LATENCY_HIST
+/*
+ * Prints the latency histograms of the HTTP server
+ * and of the mounted SHFS members (in us)
+ */
+int shcmd_http_latency(FILE *cio, int argc, char *argv[])
+{
+	struct lhist *h;
+
+	if (argc > 2 || (argc == 2 && strcmp(argv[1], "reset") != 0)) {
+		fprintf(cio, "Usage: %s [reset]\n", argv[0]);
+		return -1;
+	}
+
+	if (argc == 2) {
+		foreach_lhist(h)
+			lhist_reset(h);
+		return 0;
+	}
+
+	fprintf(cio, "Latencies in us (counter: %"PRIu64" ticks/ms):\n", lhist_tpms);
+	lhist_print_hdr(cio);
+	foreach_lhist(h)
+		lhist_print(cio, h);
+	return 0;
+}
+#endif
+
+#ifdef HTTP_SCHED
+/*
+ * Rate caps in kbit/s (0: none) for the delivery of file data, e.g.,
+ * for pacing videos with a constant bitrate. Without a file, the cap of
+ * each session is set. If both apply, the lower one is taken.
+ */
+int shcmd_http_pace(FILE *cio, int argc, char *argv[])
+{
+	unsigned int kbits;
+	SHFS_FD f;
+	int ret = 0;
+
+	if (!hs) {
+		fprintf(cio, "HTTP server is not online\n");
+		return -1;
+	}
+	if (argc < 2 || argc > 3 ||
+	    sscanf(argv[argc - 1], "%u", &kbits) != 1 ||
+	    kbits > (UINT32_MAX / 125)) {
+		fprintf(cio, "Usage: %s [file] [kbit/s]\n", argv[0]);
+		return -1;
+	}
+
+	if (argc == 2) {
+		hs->sess_rate = kbits * 125;
+		return 0;
+	}
+
+	down(&shfs_mount_lock);
+	if (!shfs_mounted) {
+		fprintf(cio, "No SHFS filesystem is mounted\n");
+		ret = -1;
+		goto out;
+	}
+	f = shfs_fio_open(argv[1]);
+	if (!f) {
+		fprintf(cio, "Could not open %s: %s\n", argv[1], strerror(errno));
+		ret = -1;
+		goto out;
+	}
+	if (shfs_fio_islink(f)) {
+		fprintf(cio, "%s is a remote object\n", argv[1]);
+		ret = -1;
+	} else {
+		shfs_fio_set_rate(f, kbits * 125);
+	}
+	shfs_fio_close(f);
+
+ out:
+	up(&shfs_mount_lock);
+	return ret;
+}
+#endif
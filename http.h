@@ -40,13 +40,25 @@
 #include <stdio.h>
 #include <inttypes.h>
 
-int init_http(uint16_t nb_sess, uint32_t nb_reqs);
+#define HTTP_LISTEN_PORT 80
+
+int init_http(uint32_t nb_sess, uint32_t nb_reqs);
 void exit_http(void);
 
 void http_poll_ioretry(void);
+#ifdef HTTP_SCHED
+uint32_t http_poll_sched(void);
+uint32_t http_sched_nb_pending(void);
+#endif
 
 #ifdef HTTP_INFO
 int shcmd_http_info(FILE *cio, int argc, char *argv[]);
 #endif
+#ifdef LATENCY_HIST
+int shcmd_http_latency(FILE *cio, int argc, char *argv[]);
+#endif
+#ifdef HTTP_SCHED
+int shcmd_http_pace(FILE *cio, int argc, char *argv[]);
+#endif
 
 #endif
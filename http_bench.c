@@ -0,0 +1,520 @@
+/*
+ * In-process HTTP load generator
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <target/sys.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <lwip/tcp.h>
+
+#include "likely.h"
+#include "http_parser.h"
+#include "twheel.h"
+#include "shfs.h"
+#include "shfs_btable.h"
+#include "shfs_tools.h"
+#include "http_bench.h"
+
+#ifdef HTTP_BENCH_DEBUG
+#define ENABLE_DEBUG
+#endif
+#include "debug.h"
+
+enum hbench_phase {
+	HBP_WARMUP = 0,
+	HBP_RUN,
+	HBP_DONE
+};
+
+struct hbench_sess {
+	struct tcp_pcb *tpcb;
+	http_parser parser;
+	unsigned int obj; /* currently requested object */
+	uint64_t ts_req; /* ns */
+	int aborted; /* pcb was aborted while parsing (see hbench_recv()) */
+};
+
+struct hbench_obj {
+	char *req; /* pre-built request header */
+	size_t req_len;
+};
+
+struct hbench {
+	struct http_bench_args args;
+	enum hbench_phase phase;
+	struct twheel_timer phase_timer;
+	struct twheel_timer progress_timer;
+
+	struct hbench_sess *sess;
+	struct hbench_obj *obj;
+	unsigned int nb_objs;
+	double *cdf; /* Zipf distribution over objects */
+	uint64_t rand;
+
+	/* counters of the measurement phase */
+	uint64_t ts_start;
+	uint64_t ts_end;
+	uint64_t nb_reqs;
+	uint64_t nb_reqs_last; /* for progress output */
+	uint64_t nb_errs;
+	uint64_t nb_bytes;
+	uint32_t *lat; /* latency samples (us) */
+	uint64_t nb_lat;
+};
+
+static struct hbench *hb = NULL;
+
+static void hbench_connect(struct hbench_sess *s);
+static int hbench_recv_complete(http_parser *parser);
+
+static http_parser_settings _hbench_parser_settings = {
+	.on_message_complete = hbench_recv_complete
+};
+
+/* xorshift64*: cheap enough to not disturb the measurement */
+static inline uint64_t hbench_rand(void)
+{
+	hb->rand ^= hb->rand >> 12;
+	hb->rand ^= hb->rand << 25;
+	hb->rand ^= hb->rand >> 27;
+	return hb->rand * 2685821657736338717ull;
+}
+
+/* picks an object rank from the Zipf distribution */
+static unsigned int hbench_pick_obj(void)
+{
+	double u;
+	unsigned int l, r, m;
+
+	u = (double) (hbench_rand() >> 11) / (double) (1ull << 53);
+	l = 0;
+	r = hb->nb_objs - 1;
+	while (l < r) {
+		m = (l + r) >> 1;
+		if (hb->cdf[m] < u)
+			l = m + 1;
+		else
+			r = m;
+	}
+	return l;
+}
+
+static void hbench_record_latency(uint64_t ns)
+{
+	uint64_t i;
+
+	/* reservoir sampling: every response has the same chance to be sampled */
+	i = hb->nb_lat++;
+	if (i >= HTTP_BENCH_MAXSAMPLES) {
+		i = hbench_rand() % hb->nb_lat;
+		if (i >= HTTP_BENCH_MAXSAMPLES)
+			return;
+	}
+	hb->lat[i] = (uint32_t) min(ns / 1000, (uint64_t) UINT32_MAX);
+}
+
+static void hbench_close(struct hbench_sess *s)
+{
+	if (!s->tpcb)
+		return;
+
+	tcp_arg (s->tpcb, NULL);
+	tcp_recv(s->tpcb, NULL);
+	tcp_err (s->tpcb, NULL);
+	tcp_abort(s->tpcb); /* do not wait for TIME_WAIT */
+	s->tpcb = NULL;
+}
+
+/* returns -1 when the pcb was aborted (and a new one was connected) */
+static int hbench_request(struct hbench_sess *s)
+{
+	struct hbench_obj *o;
+	err_t err;
+
+	s->obj = hbench_pick_obj();
+	o = &hb->obj[s->obj];
+	s->ts_req = target_now_ns();
+
+	/* request headers are static: no copy needed */
+	err = tcp_write(s->tpcb, o->req, o->req_len, 0);
+	if (unlikely(err != ERR_OK)) {
+		printd("session %p: could not send request: %d\n", s, err);
+		++hb->nb_errs;
+		hbench_close(s);
+		hbench_connect(s);
+		return -1;
+	}
+	tcp_output(s->tpcb);
+	return 0;
+}
+
+static int hbench_recv_complete(http_parser *parser)
+{
+	struct hbench_sess *s = parser->data;
+
+	if (hb->phase == HBP_RUN) {
+		if (likely(parser->status_code == 200)) {
+			++hb->nb_reqs;
+			hbench_record_latency(target_now_ns() - s->ts_req);
+		} else {
+			++hb->nb_errs;
+		}
+	}
+	if (likely(hb->phase != HBP_DONE) && unlikely(hbench_request(s) < 0))
+		s->aborted = 1;
+	return 0;
+}
+
+static err_t hbench_recv(void *argp, struct tcp_pcb *tpcb, struct pbuf *p, err_t err)
+{
+	struct hbench_sess *s = argp;
+	struct pbuf *q;
+	size_t plen;
+
+	if (unlikely(!p || err != ERR_OK)) {
+		/* server closed the connection: reconnect */
+		printd("session %p: connection closed by server\n", s);
+		if (p) {
+			tcp_recved(tpcb, p->tot_len);
+			pbuf_free(p);
+		}
+		if (hb->phase == HBP_RUN)
+			++hb->nb_errs;
+		hbench_close(s);
+		hbench_connect(s);
+		return ERR_ABRT;
+	}
+
+	if (hb->phase == HBP_RUN)
+		hb->nb_bytes += p->tot_len;
+	tcp_recved(tpcb, p->tot_len);
+
+	s->aborted = 0;
+	for (q = p; q != NULL; q = q->next) {
+		plen = http_parser_execute(&s->parser, &_hbench_parser_settings,
+		                           q->payload, q->len);
+		if (unlikely(s->aborted)) {
+			/* pcb got aborted meanwhile (see hbench_request()):
+			 * s->tpcb might reuse the memory of tpcb already */
+			pbuf_free(p);
+			return ERR_ABRT;
+		}
+		if (unlikely(plen != q->len)) {
+			printd("session %p: HTTP parsing error\n", s);
+			pbuf_free(p);
+			if (hb->phase == HBP_RUN)
+				++hb->nb_errs;
+			hbench_close(s);
+			hbench_connect(s);
+			return ERR_ABRT;
+		}
+	}
+
+	pbuf_free(p);
+	return ERR_OK;
+}
+
+static void hbench_error(void *argp, err_t err)
+{
+	struct hbench_sess *s = argp;
+
+	/* pcb is already freed by lwIP */
+	printd("session %p: killed due to error: %d\n", s, err);
+	s->tpcb = NULL;
+	if (hb->phase == HBP_RUN)
+		++hb->nb_errs;
+	hbench_connect(s);
+}
+
+static err_t hbench_connected(void *argp, struct tcp_pcb *tpcb, err_t err)
+{
+	struct hbench_sess *s = argp;
+
+	if (unlikely(hb->phase == HBP_DONE))
+		return ERR_OK;
+	if (unlikely(hbench_request(s) < 0))
+		return ERR_ABRT; /* tpcb was aborted */
+	return ERR_OK;
+}
+
+static void hbench_connect(struct hbench_sess *s)
+{
+	err_t err;
+
+	if (unlikely(hb->phase == HBP_DONE))
+		return;
+
+	s->tpcb = tcp_new();
+	if (unlikely(!s->tpcb)) {
+		printd("session %p: could not allocate pcb\n", s);
+		return;
+	}
+	http_parser_init(&s->parser, HTTP_RESPONSE);
+	s->parser.data = s;
+
+	tcp_arg (s->tpcb, s);
+	tcp_recv(s->tpcb, hbench_recv);
+	tcp_err (s->tpcb, hbench_error);
+	tcp_nagle_disable(s->tpcb);
+	err = tcp_connect(s->tpcb, &hb->args.srv_ip, hb->args.srv_port, hbench_connected);
+	if (unlikely(err != ERR_OK)) {
+		printd("session %p: could not connect: %d\n", s, err);
+		hbench_close(s);
+	}
+}
+
+static int hbench_cmp_lat(const void *a, const void *b)
+{
+	uint32_t la = *((const uint32_t *) a);
+	uint32_t lb = *((const uint32_t *) b);
+
+	return (la > lb) - (la < lb);
+}
+
+#define hbench_percentile(lat, n, p) \
+	((lat)[min((uint64_t) ((double) (n) * (p)), (n) - 1)])
+
+static void hbench_report(void)
+{
+	uint64_t elapsed; /* us */
+	uint64_t n;
+
+	elapsed = (hb->ts_end - hb->ts_start) / 1000;
+	if (!elapsed)
+		elapsed = 1;
+	n = min(hb->nb_lat, (uint64_t) HTTP_BENCH_MAXSAMPLES);
+
+	printk("\n");
+	printk("HTTP benchmark: %u sessions, %u objects, Zipf s=%.2f, %.3f s\n",
+	       hb->args.nb_sess, hb->nb_objs, hb->args.zipf_s,
+	       (double) elapsed / 1000000.0);
+	printk(" Requests:      %12"PRIu64"\n", hb->nb_reqs);
+	printk(" Errors:        %12"PRIu64"\n", hb->nb_errs);
+	printk(" Request rate:  %12.1f req/s\n",
+	       (double) hb->nb_reqs * 1000000.0 / (double) elapsed);
+	printk(" Throughput:    %12.3f Gbit/s\n",
+	       (double) hb->nb_bytes * 8.0 / ((double) elapsed * 1000.0));
+	if (!n)
+		return;
+
+	qsort(hb->lat, n, sizeof(*hb->lat), hbench_cmp_lat);
+	printk(" Latency [us]:  min %"PRIu32", p50 %"PRIu32", p90 %"PRIu32", p99 %"PRIu32", p99.9 %"PRIu32", max %"PRIu32"\n",
+	       hb->lat[0],
+	       hbench_percentile(hb->lat, n, 0.5),
+	       hbench_percentile(hb->lat, n, 0.9),
+	       hbench_percentile(hb->lat, n, 0.99),
+	       hbench_percentile(hb->lat, n, 0.999),
+	       hb->lat[n - 1]);
+}
+
+static void hbench_progress(struct twheel_timer *t, void *argp)
+{
+	printk(" %8"PRIu64" req/s\n", hb->nb_reqs - hb->nb_reqs_last);
+	hb->nb_reqs_last = hb->nb_reqs;
+}
+
+static void hbench_phase_expired(struct twheel_timer *t, void *argp)
+{
+	unsigned int i;
+
+	switch (hb->phase) {
+	case HBP_WARMUP:
+		printk("HTTP benchmark: measuring for %"PRIu32" ms...\n", hb->args.duration);
+		hb->phase = HBP_RUN;
+		hb->ts_start = target_now_ns();
+		twheel_arm(&hb->phase_timer, hb->args.duration);
+		twheel_arm_periodic(&hb->progress_timer, 1000);
+		break;
+	case HBP_RUN:
+		hb->ts_end = target_now_ns();
+		hb->phase = HBP_DONE;
+		twheel_cancel(&hb->progress_timer);
+		for (i = 0; i < hb->args.nb_sess; ++i)
+			hbench_close(&hb->sess[i]);
+		hbench_report();
+		app_shutdown(TARGET_SHTDN_POWEROFF);
+		break;
+	default:
+		break;
+	}
+}
+
+/* collects regular (non-link) objects of the mounted volume */
+static int hbench_load_objs(void)
+{
+	struct htable_el *el;
+	struct shfs_bentry *bentry;
+	struct shfs_hentry *hentry;
+	char str_hash[(shfs_vol.hlen * 2) + 1];
+	char str_ip[16];
+	struct hbench_obj *o;
+	int len;
+	int ret = 0;
+
+	snprintf(str_ip, sizeof(str_ip), "%u.%u.%u.%u",
+	         ip4_addr1(&hb->args.srv_ip), ip4_addr2(&hb->args.srv_ip),
+	         ip4_addr3(&hb->args.srv_ip), ip4_addr4(&hb->args.srv_ip));
+
+	down(&shfs_mount_lock);
+	if (!shfs_mounted) {
+		ret = -ENODEV;
+		goto out;
+	}
+
+	hb->obj = calloc(shfs_vol.htable_nb_entries, sizeof(*hb->obj));
+	if (!hb->obj) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	hb->nb_objs = 0;
+	foreach_htable_el(shfs_vol.bt, el) {
+		bentry = el->private;
+		hentry = bentry->hentry;
+		if (SHFS_HENTRY_ISLINK(hentry))
+			continue;
+
+		hash_unparse(*el->h, shfs_vol.hlen, str_hash);
+		len = snprintf(NULL, 0, "GET /?%s HTTP/1.1\r\nHost: %s\r\n\r\n", str_hash, str_ip);
+		o = &hb->obj[hb->nb_objs];
+		o->req = malloc(len + 1);
+		if (!o->req) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		snprintf(o->req, len + 1, "GET /?%s HTTP/1.1\r\nHost: %s\r\n\r\n", str_hash, str_ip);
+		o->req_len = (size_t) len;
+		++hb->nb_objs;
+	}
+	if (!hb->nb_objs)
+		ret = -ENOENT;
+
+ out:
+	up(&shfs_mount_lock);
+	return ret;
+}
+
+/* cumulative Zipf distribution: P(rank k) ~ 1 / k^s */
+static int hbench_init_cdf(void)
+{
+	unsigned int i;
+	double sum = 0.0;
+
+	hb->cdf = malloc(sizeof(*hb->cdf) * hb->nb_objs);
+	if (!hb->cdf)
+		return -ENOMEM;
+
+	for (i = 0; i < hb->nb_objs; ++i) {
+		sum += 1.0 / pow((double) (i + 1), hb->args.zipf_s);
+		hb->cdf[i] = sum;
+	}
+	for (i = 0; i < hb->nb_objs; ++i)
+		hb->cdf[i] /= sum;
+	return 0;
+}
+
+int init_http_bench(const struct http_bench_args *args)
+{
+	unsigned int i;
+	int ret;
+
+	BUG_ON(hb != NULL);
+	hb = calloc(1, sizeof(*hb));
+	if (!hb) {
+		ret = -ENOMEM;
+		goto err_out;
+	}
+	hb->args = *args;
+	hb->rand = target_now_ns() | 1;
+
+	ret = hbench_load_objs();
+	if (ret < 0)
+		goto err_free_hb;
+	ret = hbench_init_cdf();
+	if (ret < 0)
+		goto err_free_hb;
+
+	hb->lat = malloc(sizeof(*hb->lat) * HTTP_BENCH_MAXSAMPLES);
+	hb->sess = calloc(hb->args.nb_sess, sizeof(*hb->sess));
+	if (!hb->lat || !hb->sess) {
+		ret = -ENOMEM;
+		goto err_free_hb;
+	}
+
+	twheel_timer_init(&hb->phase_timer, hbench_phase_expired, NULL);
+	twheel_timer_init(&hb->progress_timer, hbench_progress, NULL);
+	hb->phase = HBP_WARMUP;
+	printk("HTTP benchmark: %u sessions, %u objects, warming up...\n",
+	       hb->args.nb_sess, hb->nb_objs);
+	for (i = 0; i < hb->args.nb_sess; ++i)
+		hbench_connect(&hb->sess[i]);
+	twheel_arm(&hb->phase_timer, HTTP_BENCH_WARMUP);
+	return 0;
+
+ err_free_hb:
+	exit_http_bench();
+ err_out:
+	return ret;
+}
+
+void exit_http_bench(void)
+{
+	unsigned int i;
+
+	if (!hb)
+		return;
+
+	twheel_cancel(&hb->phase_timer);
+	twheel_cancel(&hb->progress_timer);
+	hb->phase = HBP_DONE;
+	if (hb->sess) {
+		for (i = 0; i < hb->args.nb_sess; ++i)
+			hbench_close(&hb->sess[i]);
+		free(hb->sess);
+	}
+	if (hb->obj) {
+		for (i = 0; i < hb->nb_objs; ++i)
+			free(hb->obj[i].req);
+		free(hb->obj);
+	}
+	if (hb->lat)
+		free(hb->lat);
+	if (hb->cdf)
+		free(hb->cdf);
+	free(hb);
+	hb = NULL;
+}
@@ -0,0 +1,66 @@
+/*
+ * In-process HTTP load generator
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#ifndef _HTTP_BENCH_H_
+#define _HTTP_BENCH_H_
+
+#include <target/sys.h>
+#include <stdint.h>
+#include <lwip/ip_addr.h>
+
+/*
+ * The load generator runs in the same lwIP instance as the HTTP server:
+ * its sessions are connected to the server through a loopback device
+ * (e.g., null netif) and keep requesting objects of the mounted volume.
+ * The requested objects follow a Zipf distribution (rank = position in the
+ * hash table). After a warm-up phase, requests are counted for the given
+ * duration. Finally, the results are printed and the system is shut down.
+ */
+#define HTTP_BENCH_WARMUP      1000      /* ms */
+#define HTTP_BENCH_MAXSAMPLES  (1 << 20) /* latency samples (reservoir) */
+
+struct http_bench_args {
+	ip4_addr_t srv_ip;
+	uint16_t srv_port;
+	unsigned int nb_sess;
+	uint32_t duration; /* ms */
+	double zipf_s;     /* Zipf exponent (0: uniform) */
+};
+
+int init_http_bench(const struct http_bench_args *args);
+void exit_http_bench(void);
+
+#endif /* _HTTP_BENCH_H_ */
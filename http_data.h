@@ -84,6 +84,10 @@ static const char __http_shdr34[] = "Accept-ranges: bytes\r\n";
 static const char __http_shdr35[] = "Transfer-encoding: chunked\r\n";
 static const char __http_shdr36[] = "User-Agent: "HTTP_SERVER_AGENT"\r\n";
 static const char __http_shdr37[] = "Cache-control: no-store, no-cache, must-revalidate, pre-check=0, post-check=0, max-age=0\r\n";
+static const char __http_shdr38[] = "Content-encoding: br\r\n";
+static const char __http_shdr39[] = "Content-encoding: zstd\r\n";
+static const char __http_shdr40[] = "Content-encoding: gzip\r\n";
+static const char __http_shdr41[] = "Vary: Accept-encoding\r\n";
 
 static const char * const _http_shdr[] = {
 	__http_shdr00, __http_shdr01, __http_shdr02, __http_shdr03, __http_shdr04,
@@ -93,7 +97,8 @@ static const char * const _http_shdr[] = {
 	__http_shdr20, __http_shdr21, __http_shdr22, __http_shdr23, __http_shdr24,
 	__http_shdr25, __http_shdr26, __http_shdr27, __http_shdr28, __http_shdr29,
 	__http_shdr30, __http_shdr31, __http_shdr32, __http_shdr33, __http_shdr34,
-	__http_shdr35, __http_shdr36, __http_shdr37
+	__http_shdr35, __http_shdr36, __http_shdr37, __http_shdr38, __http_shdr39,
+	__http_shdr40, __http_shdr41
 };
 static const size_t _http_shdr_len[] = {
 	sizeof(__http_shdr00) - 1, sizeof(__http_shdr01) - 1,
@@ -114,7 +119,9 @@ static const size_t _http_shdr_len[] = {
 	sizeof(__http_shdr30) - 1, sizeof(__http_shdr31) - 1,
 	sizeof(__http_shdr32) - 1, sizeof(__http_shdr33) - 1,
 	sizeof(__http_shdr34) - 1, sizeof(__http_shdr35) - 1,
-	sizeof(__http_shdr36) - 1, sizeof(__http_shdr37) - 1
+	sizeof(__http_shdr36) - 1, sizeof(__http_shdr37) - 1,
+	sizeof(__http_shdr38) - 1, sizeof(__http_shdr39) - 1,
+	sizeof(__http_shdr40) - 1, sizeof(__http_shdr41) - 1
 };
 
 /* Indexes into _http_shdr */
@@ -156,9 +163,16 @@ static const size_t _http_shdr_len[] = {
 #define HTTP_SHDR_ENC_CHUNKED    35 /* Transfer-Encoding: chunked */
 #define HTTP_SHDR_USERAGENT      36 /* User agent */
 #define HTTP_SHDR_NOSTORE        37 /* No store */
+#define HTTP_SHDR_CENC_BR        38 /* Content-encoding: br */
+#define HTTP_SHDR_CENC_ZSTD      39 /* Content-encoding: zstd */
+#define HTTP_SHDR_CENC_GZIP      40 /* Content-encoding: gzip */
+#define HTTP_SHDR_VARY_ENC       41 /* Vary: Accept-encoding */
 
 #define HTTP_SHDR_DEFAULT_TYPE   HTTP_SHDR_PLAIN
 
+/* Content-encoding of a pre-encoded variant (venc: SHFS_VENC_*) */
+#define HTTP_SHDR_CENC(venc)     (HTTP_SHDR_CENC_BR + (venc))
+
 #define HTTP_SHDR_OK(major, minor) HTTP_SHDR_200((major), (minor))
 #define HTTP_SHDR_200(major, minor) \
 	(((major) < 1) ? HTTP09_SHDR_200 : (((minor) < 1) ? HTTP10_SHDR_200 : HTTP11_SHDR_200))
@@ -186,10 +200,11 @@ static const char __http_dhdr03[] = "Retry-after";
 static const char __http_dhdr04[] = "Location";
 static const char __http_dhdr05[] = "Host";
 static const char __http_dhdr06[] = "Icy-metadata";
+static const char __http_dhdr07[] = "Range: bytes=";
 
 static const char * const _http_dhdr[] = {
 	__http_dhdr00, __http_dhdr01, __http_dhdr02, __http_dhdr03,
-	__http_dhdr04, __http_dhdr05, __http_dhdr06
+	__http_dhdr04, __http_dhdr05, __http_dhdr06, __http_dhdr07
 };
 
 #define HTTP_DHDR_MIME            0 /* content-type */
@@ -199,6 +214,7 @@ static const char * const _http_dhdr[] = {
 #define HTTP_DHDR_LOCATION        4 /* location */
 #define HTTP_DHDR_HOST            5 /* host */
 #define HTTP_DHDR_ICYMETADATA     6 /* Icy-metadata */
+#define HTTP_DHDR_REQRANGE        7 /* range (request) */
 
 static const char _http_err404p[] = \
 	"<!DOCTYPE HTML PUBLIC \"-//IETF//DTD HTML 2.0//EN\">\r\n"
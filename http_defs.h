@@ -46,12 +46,17 @@
 #include "http_parser.h"
 #include "http_data.h"
 #include "http_hdr.h"
+#include "http.h"
 
 #include "mempool.h"
 #if defined SHFS_STATS && defined SHFS_STATS_HTTP
 #include "shfs_stats.h"
 #endif
 #include "dlist.h"
+#include "twheel.h"
+#ifdef LATENCY_HIST
+#include "lhist.h"
+#endif
 
 #include "shfs.h"
 #include "shfs_cache.h"
@@ -63,19 +68,48 @@
 #endif
 #include "debug.h"
 
-#define HTTP_LISTEN_PORT          80
 #define HTTP_TCP_PRIO             TCP_PRIO_MAX
 #define HTTP_MAXNB_LINKS          4 /* nb of simultaneous links to an origin server */
 #define HTTP_LINK_TCP_PRIO        TCP_PRIO_MAX
 
-#define HTTP_POLL_INTERVAL        10 /* = x * 500ms; 10 = 5s */
-#define HTTP_KEEPALIVE_TIMEOUT     3 /* = x * HTTP_POLL_INTERVAL */
+#define HTTP_KEEPALIVE_TIMEOUT 15000 /* = x ms */
+#define HTTP_HDR_TIMEOUT       10000 /* = x ms; max. time to receive a request header */
+#define HTTP_REAP_MAXNB_SCAN     8 /* nb of idle sessions that are checked for reaping */
 #define HTTP_TCPKEEPALIVE_TIMEOUT 90 /* = x sec */
 #define HTTP_TCPKEEPALIVE_IDLE    30 /* = x sec */
 
-#define HTTP_LINK_CONNECT_TIMEOUT   3 /* = x sec */
-#define HTTP_LINK_RESPONSE_TIMEOUT 10 /* = x sec */
-#define HTTP_LINK_RECEIVE_TIMEOUT  30 /* = x sec */
+#define HTTP_LINK_CONNECT_TIMEOUT   3000 /* = x ms */
+#define HTTP_LINK_RESPONSE_TIMEOUT 10000 /* = x ms */
+#define HTTP_LINK_RECEIVE_TIMEOUT  30000 /* = x ms; max. idle time while receiving */
+
+/* origin server failover/load balancing */
+#define HTTP_LINK_MAXNB_UPSTREAMS  (HTTP_MAXNB_LINKS * (1 + SHFS_LINK_MAX_NB_ALTORIGINS))
+#define HTTP_LINK_UPSTREAM_MAXFAILS 2 /* consecutive failures until an origin is considered as down */
+#define HTTP_LINK_UPSTREAM_HOLDDOWN 5 /* = x sec, doubled on each further failure */
+#define HTTP_LINK_UPSTREAM_EWMA_SHIFT 3 /* weight of a new latency sample = 1/(2^x) */
+
+/* admission control: requests are answered with 503 early when the load
+ * pressure (0..1024) on cache buffers, AIO tokens, request objects or the
+ * I/O retry queue delay exceeds the low mark. Above the mark, the share of
+ * shed requests rises linearly until everything is shed at full pressure */
+#define HTTP_ADM_PRESSURE_LOW       768
+#define HTTP_ADM_QDELAY_TARGET      200 /* = x ms; I/O retry queue delay that is full pressure */
+#define HTTP_ADM_QDELAY_EWMA_SHIFT    3 /* weight of a new queue delay sample = 1/(2^x) */
+#define HTTP_RETRY_AFTER_MIN          1 /* = x sec */
+#define HTTP_RETRY_AFTER_MAX         30 /* = x sec */
+#define HTTP_RETRY_AFTER_PRESSURE     8 /* = x sec added at full pressure */
+
+/* file data is sent out by a deficit round robin scheduler across sessions
+ * (see http_poll_sched()): per round, a session may send up to a quantum.
+ * With a rate cap (per session or per object), a session waits until it
+ * may send at least HTTP_SCHED_PACE_MINLEN bytes */
+#define HTTP_SCHED_QUANTUM        16384 /* = x bytes */
+#define HTTP_SCHED_PACE_MINLEN    TCP_MSS
+
+/* session, request and header pools grow in slabs up to their maximum */
+#define HTTP_POOL_SLAB_NB_OBJS      256
+#define HTTP_POOL_SHRINK_INTERVAL 10000 /* = x ms */
+#define HTTP_POOL_SHRINK_MINFREE  HTTP_POOL_SLAB_NB_OBJS /* free objects that are kept */
 
 #define HTTPHDR_URL_MAXLEN        99 /* MAX: '/' + '?' + 512 bits hash + '\0' */
 #define HTTPURL_ARGS_INDICATOR   '?'
@@ -136,14 +170,21 @@ enum http_sess_close {
 
 struct http_srv {
 	struct tcp_pcb *tpcb;
-	struct mempool *sess_pool;
-	struct mempool *req_pool;
+	struct mempool_slabs *sess_pool;
+	struct mempool_slabs *req_pool;
+	struct mempool_slabs *reqhdr_pool;
 	struct mempool *link_pool;
+#ifdef HTTP_METRICS
+	struct mempool *metrics_pool;
+#endif
+	struct twheel_timer shrink_timer;
 
-	uint16_t nb_sess;
-	uint16_t max_nb_sess;
+	uint32_t nb_sess;
+	uint32_t max_nb_sess;
 	uint32_t nb_reqs;
 	uint32_t max_nb_reqs;
+	uint32_t nb_reqhdrs;
+	uint32_t max_nb_reqhdrs;
 	uint16_t nb_links;
 	uint16_t max_nb_links;
 
@@ -151,7 +192,28 @@ struct http_srv {
 	struct http_sess *hsess_tail;
 
 	struct dlist_head links;
-	struct dlist_head ioretry_chain;
+	struct dlist_head ioretry_chain; /* parked sessions, oldest first */
+	uint32_t nb_ioretry;
+	struct dlist_head idle_chain; /* idle keep-alive sessions, oldest first */
+	uint64_t nb_reaped; /* idle sessions closed for new ones */
+
+#ifdef HTTP_SCHED
+	struct dlist_head sched_chain; /* sessions with file data to send, in round order */
+	uint32_t nb_sched;
+	uint32_t sess_rate; /* bytes/s, rate cap of each session (0: none) */
+	struct http_sess *sched_cur; /* session that is served by the scheduler */
+#endif
+
+	struct {
+		uint32_t qdelay; /* ms, EWMA of the I/O retry queue delay */
+		uint32_t rnd; /* xorshift32 state */
+		uint64_t nb_shed; /* requests that were answered with 503 */
+	} adm;
+
+#ifdef LATENCY_HIST
+	struct lhist lat_ttfb; /* request parsed -> first header byte written */
+	struct lhist lat_total; /* request parsed -> response acknowledged */
+#endif
 };
 
 extern struct http_srv *hs;
@@ -162,25 +224,20 @@ enum http_sess_state {
 	HSS_CLOSING
 };
 
+/*
+ * Fields that are touched on every send and ACK (httpsess_sent(),
+ * httpsess_respond()) come first so that they share a cache line;
+ * the parser state and the session list linkage are only required
+ * while receiving or when sessions are opened and closed
+ */
 struct http_sess {
-	struct http_sess *next;
-	struct http_sess *prev;
-
-	struct mempool_obj *pobj;
-	struct http_srv *hsrv;
 	struct tcp_pcb *tpcb;
 	enum http_sess_state state;
+	int keepalive;
 	size_t sent_infly;
 	size_t sent;
 
-	struct http_parser parser;
-
-	int keepalive;
-	int keepalive_timer; /* -1 timeout disabled, 0 timeout expired */
-
-	struct http_req *cpreq; /* current request that is parsed */
 	struct http_req *rqueue_head; /* request serve queue of parsed requests */
-	struct http_req *rqueue_tail;
 	struct http_req *aqueue_head; /* acknowledge queue (requests that are done with sending out but not yet acknowledged) */
 	struct http_req *aqueue_tail;
 	unsigned int rqueue_len; /* current number of simultaneous requests */
@@ -189,8 +246,28 @@ struct http_sess {
 	                       * within recv because of ERR_MEM */
 	int _in_respond;      /* diables recursive httpsess_respond calls DELETEME */
 	dlist_el(ioretry_chain);
+	uint64_t ts_ioretry; /* ms, when session was parked on the I/O retry chain */
+#ifdef HTTP_SCHED
+	dlist_el(sched_chain);
+	uint32_t deficit; /* bytes that can be sent in the current round */
+#endif
+
+	struct http_req *rqueue_tail;
+	dlist_el(idle_chain);
+	struct http_req *cpreq; /* current request that is parsed */
+	struct http_parser parser;
+	struct pbuf *rx_pbuf; /* received pbuf that is currently parsed */
+	struct twheel_timer keepalive_timer; /* armed while session is idle */
+#ifdef HTTP_SCHED
+	uint32_t tokens; /* rate cap: bytes that can be sent (token bucket) */
+	uint64_t ts_refill; /* ms, last refill of the bucket */
+	struct twheel_timer pace_timer; /* armed while rate cap is exceeded */
+#endif
 
-	//struct http_srv *hs;
+	struct http_sess *next;
+	struct http_sess *prev;
+	struct mempool_obj *pobj;
+	struct http_srv *hsrv;
 };
 
 enum http_req_state {
@@ -214,6 +291,9 @@ enum http_req_type {
 	HRT_FIOMSG,    /* dynamic message body (file from shfs) */
 	HRT_LINKMSG,   /* dynamic message body (uplink described by shfs) */
 	HRT_NOMSG,     /* just response header, no body */
+#ifdef HTTP_METRICS
+	HRT_METRICS,   /* dynamic message body (generated statistics) */
+#endif
 };
 
 struct http_req_fio_state { /* defined in http_fio.h */
@@ -233,6 +313,27 @@ struct http_req_fio_state { /* defined in http_fio.h */
 	unsigned int cce_max_nb;
 };
 
+#ifdef HTTP_METRICS
+#define HTTP_METRICS_URL          "__metrics" /* served on "/?__metrics" */
+#define HTTP_METRICS_LBUF_LEN     256
+#define HTTP_METRICS_MAXNB_REQS   2 /* nb of simultaneous metrics requests */
+
+struct http_req_metrics_state { /* defined in http_metrics.h */
+	struct mempool_obj *pobj;
+	unsigned int fam; /* current metric family */
+	unsigned int smpl; /* next sample of family (0: descriptor) */
+	unsigned int tbl; /* object families only: current stats table */
+	int cur_valid;
+	hash512_t cur; /* object families only: last exported object */
+	int done;
+
+	/* generated lines that are not sent out yet */
+	size_t lpos;
+	size_t llen;
+	char lbuf[HTTP_METRICS_LBUF_LEN];
+};
+#endif
+
 struct http_req_link_origin; /* defined in http_link.h */
 
 struct http_req_link_state {
@@ -240,42 +341,68 @@ struct http_req_link_state {
 	size_t pos;
 	unsigned int cce_idx;
 	size_t acked_pos;
+	size_t end_pos; /* objects only: stream position after requested range */
+
+	/* requested range of the remote object */
+	uint64_t rfirst;
+	uint64_t rlast; /* UINT64_MAX: until end of object */
 
 	dlist_el(clients);
 };
 
-struct http_req {
+/*
+ * Header part of a request: It is only required while the request is parsed
+ * and its response header is built and sent out. It is picked from the
+ * header pool when the parser starts with a request and put back as soon
+ * as the response header got acknowledged by the client, so that idle
+ * keep-alive sessions and requests that are sending their body do not
+ * hold it (and the referenced pbufs of the request lines).
+ */
+struct http_req_hdr {
 	struct mempool_obj *pobj;
+
+	struct {
+		char url[HTTPHDR_URL_MAXLEN];
+		uint8_t url_len;
+		uint8_t url_overflow;
+		char *url_argp; /* ptr to argument in url */
+		uint64_t ts_begin; /* ms, when receiving began */
+		struct http_recv_hdr hdr;
+	} request;
+
+	struct {
+		struct http_send_hdr hdr;
+	} response;
+};
+
+/*
+ * The remaining request object is touched on every send and ACK: the fields
+ * that are used by httpsess_respond() and httpreq_acknowledge() come first
+ */
+struct http_req {
 	struct http_sess *hsess;
 	struct http_req *next;
-	enum http_req_state state;
-	enum http_req_type type;
+	uint8_t state; /* enum http_req_state */
+	uint8_t type; /* enum http_req_type */
+	uint8_t is_stream; /* is true when final data length is unknown while sending */
 
 	struct {
 		uint8_t http_major;
 		uint8_t http_minor;
 		uint8_t http_errno;
 		uint8_t method;
-		int keepalive;
-		char url[HTTPHDR_URL_MAXLEN];
-		size_t url_len;
-		int url_overflow;
-		char *url_argp; /* ptr to argument in url */
-		struct http_recv_hdr hdr;
+		uint8_t keepalive;
 	} request;
 
 	struct {
 		uint16_t code;
-		struct http_send_hdr hdr;
-		size_t hdr_eoh_off; /* end of header offset */
-		size_t hdr_total_len; /* total length (inclusive EOH line) */
-		size_t hdr_acked_len; /* acked bytes from header */
-		size_t ftr_acked_len; /* acked bytes from footer */
+		uint16_t ftr_acked_len; /* acked bytes from footer */
+		uint32_t hdr_total_len; /* total length (inclusive EOH line) */
+		uint32_t hdr_acked_len; /* acked bytes from header */
 	} response;
 
 	uint64_t rlen; /* (requested) number of bytes of message body */
 	uint64_t alen; /* (acknowledged) number of bytes (of rlen) */
-	int is_stream; /* is true when final data length is unknown while sending */
 
 	/* Static buffer I/O */
 	const char *smsg;
@@ -284,8 +411,17 @@ struct http_req {
 	union {
 		struct http_req_fio_state  f;
 		struct http_req_link_state l;
+#ifdef HTTP_METRICS
+		struct http_req_metrics_state *m; /* taken from metrics_pool */
+#endif
 	};
 
+	struct http_req_hdr *h; /* NULL when not (or no longer) required */
+	struct mempool_obj *pobj;
+#ifdef LATENCY_HIST
+	uint64_t ts_parsed; /* lhist ticks */
+#endif
+
 #if defined SHFS_STATS && defined SHFS_STATS_HTTP
 	struct {
 		struct shfs_el_stats *el_stats;
@@ -305,6 +441,8 @@ struct http_req {
 			dlist_append((hsess), \
 			             hs->ioretry_chain, \
 			             ioretry_chain); \
+			(hsess)->ts_ioretry = twheel_now(); \
+			++hs->nb_ioretry; \
 		} \
 	} while(0)
 
@@ -316,9 +454,48 @@ struct http_req {
 			dlist_unlink((hsess), \
 			             hs->ioretry_chain, \
 			             ioretry_chain); \
+			--hs->nb_ioretry; \
+		} \
+	} while(0)
+
+#ifdef HTTP_SCHED
+/* session gets served in the next scheduler round (if not already) */
+#define httpsess_sched(hsess) \
+	do { \
+		if (!dlist_is_linked((hsess), \
+		                     hs->sched_chain, \
+		                     sched_chain)) { \
+			dlist_append((hsess), \
+			             hs->sched_chain, \
+			             sched_chain); \
+			(hsess)->deficit = 0; \
+			++hs->nb_sched; \
 		} \
 	} while(0)
 
+#define httpsess_unsched(hsess) \
+	do { \
+		if (dlist_is_linked((hsess), \
+		                    hs->sched_chain, \
+		                    sched_chain)) { \
+			dlist_unlink((hsess), \
+			             hs->sched_chain, \
+			             sched_chain); \
+			--hs->nb_sched; \
+		} \
+	} while(0)
+
+/* accounts sent file data to the session's quantum and rate cap */
+#define httpsess_sched_charge(hsess, len) \
+	do { \
+		(hsess)->deficit -= (uint32_t) (len); \
+		if ((hsess)->tokens > (uint32_t) (len)) \
+			(hsess)->tokens -= (uint32_t) (len); \
+		else \
+			(hsess)->tokens = 0; \
+	} while(0)
+#endif
+
 #define httpsess_flush(hsess) tcp_output((hsess)->tpcb)
 
 err_t httpsess_write(struct http_sess *hsess, const void* buf, size_t *len, uint8_t apiflags);
@@ -55,12 +55,13 @@ static inline int httpreq_fio_aioreq(struct http_req *hreq, chk_t addr, unsigned
 
 	BUG_ON(hreq->f.cce_t);
 
-	ret = shfs_cache_aread(addr,
-	                       httpreq_fio_aiocb,
-	                       hreq,
-	                       NULL,
-	                       &(hreq->f.cce[cce_idx]),
-			       &(hreq->f.cce_t));
+	ret = shfs_cache_aread_lim(addr,
+	                           hreq->f.volchk_last + 1, /* no read-ahead behind requested range */
+	                           httpreq_fio_aiocb,
+	                           hreq,
+	                           NULL,
+	                           &(hreq->f.cce[cce_idx]),
+	                           &(hreq->f.cce_t));
 	if (ret < 0)
 		printd("failed to perform request for chunk %"PRIchk" [cce_idx=%u]: %d\n", addr, cce_idx, ret);
 	else
@@ -144,10 +145,17 @@ static inline err_t httpreq_write_fio(struct http_req *hreq, size_t *sent)
 	chk_off = shfs_volchkoff_foff(hreq->fd, foff);
 	left = min(shfs_vol.chunksize - chk_off, hreq->rlen - roff);
 	slen = left;
+#ifdef HTTP_SCHED
+	if (slen > hreq->hsess->deficit)
+		slen = hreq->hsess->deficit; /* quantum of this round is used up */
+#endif
 	err  = httpsess_write(hreq->hsess,
 	                      ((uint8_t *) (hreq->f.cce[idx]->buffer)) + chk_off,
 	                      &slen, TCP_WRITE_FLAG_MORE);
 	*sent += slen;
+#ifdef HTTP_SCHED
+	httpsess_sched_charge(hreq->hsess, slen);
+#endif
 	if (unlikely(err != ERR_OK || !slen)) {
 		printd("[idx=%u] sending failed, aborting this round\n", idx);
 		httpsess_flush(hreq->hsess); /* send buffer might be full:
@@ -192,33 +200,142 @@ static inline void httpreq_fio_init(struct http_req *hreq)
 	BUG_ON(hreq->f.cce_max_nb > HTTPREQ_FIO_MAXNB_BUFFERS);
 }
 
+#ifdef SHFS_VARIANTS
+/* parses a qvalue (RFC 7231, 5.3.1) into thousandths */
+static inline int _httpreq_fio_qvalue(const char *p)
+{
+	int q = 0;
+	int f = 100;
+
+	if (*p == '1')
+		return 1000;
+	if (*p != '0')
+		return 0; /* invalid */
+	if (*(++p) == '.') {
+		for (++p; f && *p >= '0' && *p <= '9'; ++p, f /= 10)
+			q += (*p - '0') * f;
+	}
+	return q;
+}
+
+/*
+ * Returns the pre-encoded variant (SHFS_VENC_*) of the opened file
+ * that fits best to the Accept-encoding header of the request or -1
+ * if the identity version has to be served. On equal qvalues,
+ * the order of SHFS_VENC_* decides.
+ */
+static inline int httpreq_fio_negotiate_venc(struct http_req *hreq)
+{
+	int q[SHFS_NB_VENCS];
+	int qany = -1; /* "*" */
+	int qv, bestq = 0;
+	int best = -1;
+	const char *p, *t;
+	size_t tlen;
+	int venc;
+	int ret;
+
+	ret = http_recvhdr_findfield(&hreq->h->request.hdr, "accept-encoding");
+	if (ret < 0)
+		return -1;
+
+	for (venc = 0; venc < SHFS_NB_VENCS; ++venc)
+		q[venc] = -1;
+	p = hreq->h->request.hdr.line[ret].value.b;
+	while (*p != '\0') {
+		while (*p == ' ' || *p == '\t' || *p == ',')
+			++p;
+		t = p;
+		while (*p != '\0' && *p != ',' && *p != ';' &&
+		       *p != ' ' && *p != '\t')
+			++p;
+		tlen = p - t;
+
+		/* parameters (only q is of interest) */
+		qv = 1000;
+		while (*p != '\0' && *p != ',') {
+			if (*p == ';') {
+				for (++p; *p == ' ' || *p == '\t'; ++p);
+				if ((*p == 'q' || *p == 'Q') && p[1] == '=')
+					qv = _httpreq_fio_qvalue(p + 2);
+				continue;
+			}
+			++p;
+		}
+
+		if (tlen == 1 && t[0] == '*') {
+			qany = qv;
+			continue;
+		}
+		for (venc = 0; venc < SHFS_NB_VENCS; ++venc) {
+			if (strlen(shfs_venc_name[venc]) == tlen &&
+			    strncasecmp(t, shfs_venc_name[venc], tlen) == 0)
+				q[venc] = qv;
+		}
+	}
+
+	for (venc = 0; venc < SHFS_NB_VENCS; ++venc) {
+		qv = (q[venc] >= 0) ? q[venc] : qany;
+		if (qv > bestq && shfs_fio_has_variant(hreq->fd, venc)) {
+			best = venc;
+			bestq = qv;
+		}
+	}
+	return best;
+}
+#endif
+
 static inline int httpreq_fio_build_hdr(struct http_req *hreq)
 {
-	size_t nb_slines = http_sendhdr_get_nbslines(&hreq->response.hdr);
-	size_t nb_dlines = http_sendhdr_get_nbdlines(&hreq->response.hdr);
+	size_t nb_slines = http_sendhdr_get_nbslines(&hreq->h->response.hdr);
+	size_t nb_dlines = http_sendhdr_get_nbdlines(&hreq->h->response.hdr);
 	char strsbuf[64];
 	int ret;
+#ifdef SHFS_VARIANTS
+	SHFS_FD vfd;
+	int vary = 0;
+	int venc;
+#endif
 
 	httpreq_fio_init(hreq);
 
+#ifdef SHFS_VARIANTS
+	/* Pre-encoded variant accepted by the client?
+	 * The variant replaces the opened file */
+	for (venc = 0; venc < SHFS_NB_VENCS; ++venc)
+		vary |= shfs_fio_has_variant(hreq->fd, venc);
+	venc = vary ? httpreq_fio_negotiate_venc(hreq) : -1;
+	if (venc >= 0) {
+		vfd = shfs_fio_open_variant(hreq->fd, venc);
+		if (vfd) {
+			shfs_fio_close(hreq->fd);
+			hreq->fd = vfd;
+		} else {
+			printd("Could not open variant '%s': %s\n",
+			       shfs_venc_name[venc], strerror(errno));
+			venc = -1; /* fallback to identity */
+		}
+	}
+#endif
+
 	shfs_fio_size(hreq->fd, &hreq->f.fsize);
 
 	/* File range requested? */
 	hreq->response.code = 200;	/* 200 OK */
 	hreq->f.rfirst = 0;
 	hreq->f.rlast  = hreq->f.fsize - 1;
-	ret = http_recvhdr_findfield(&hreq->request.hdr, "range");
+	ret = http_recvhdr_findfield(&hreq->h->request.hdr, "range");
 	if (ret >= 0) {
 		/* Because range requests require different answer codes
 		 * (e.g., 206 OK or 416 EINVAL), we need to check the
 		 * range request here already.
 		 * http://www.w3.org/Protocols/rfc2616/rfc2616-sec14.html#sec14.16 */
 		hreq->response.code = 416;
-		if (strncasecmp("bytes=", hreq->request.hdr.line[ret].value.b, 6) == 0) {
+		if (strncasecmp("bytes=", hreq->h->request.hdr.line[ret].value.b, 6) == 0) {
 			uint64_t rfirst;
 			uint64_t rlast;
 
-			ret = sscanf(hreq->request.hdr.line[ret].value.b + 6,
+			ret = sscanf(hreq->h->request.hdr.line[ret].value.b + 6,
 			             "%"PRIu64"-%"PRIu64,
 			             &rfirst, &rlast);
 			if (ret == 1) {
@@ -251,32 +368,42 @@ static inline int httpreq_fio_build_hdr(struct http_req *hreq)
 
 	/* HTTP OK [first line] (code can be 216 or 200) */
 	if (hreq->response.code == 206)
-		http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines,
+		http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines,
 				      HTTP_SHDR_206(hreq->request.http_major, hreq->request.http_minor));
 	else
-		http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines,
+		http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines,
 				      HTTP_SHDR_200(hreq->request.http_major, hreq->request.http_minor));
 
 	/* Accept range */
-	http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines, HTTP_SHDR_ACC_BYTERANGE);
+	http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines, HTTP_SHDR_ACC_BYTERANGE);
 
 	/* MIME (by element or default) */
 	shfs_fio_mime(hreq->fd, strsbuf, sizeof(strsbuf));
 	if (strsbuf[0] == '\0')
-		http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines,
+		http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines,
 				      HTTP_SHDR_DEFAULT_TYPE);
 	else
-		http_sendhdr_add_dline(&hreq->response.hdr, &nb_dlines,
+		http_sendhdr_add_dline(&hreq->h->response.hdr, &nb_dlines,
 				       "%s: %s\r\n", _http_dhdr[HTTP_DHDR_MIME], strsbuf);
 
+#ifdef SHFS_VARIANTS
+	/* Content encoding */
+	if (venc >= 0)
+		http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines,
+				      HTTP_SHDR_CENC(venc));
+	if (vary)
+		http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines,
+				      HTTP_SHDR_VARY_ENC);
+#endif
+
 	/* Content length */
 	hreq->rlen = (hreq->f.rlast + 1) - hreq->f.rfirst;
-	http_sendhdr_add_dline(&hreq->response.hdr, &nb_dlines,
+	http_sendhdr_add_dline(&hreq->h->response.hdr, &nb_dlines,
 			       "%s: %"PRIu64"\r\n", _http_dhdr[HTTP_DHDR_SIZE], hreq->rlen);
 
 	/* Content range */
 	if (hreq->response.code == 206)
-		http_sendhdr_add_dline(&hreq->response.hdr, &nb_dlines,
+		http_sendhdr_add_dline(&hreq->h->response.hdr, &nb_dlines,
 				       "%s%"PRIu64"-%"PRIu64"/%"PRIu64"\r\n",
 				       _http_dhdr[HTTP_DHDR_RANGE],
 				       hreq->f.rfirst, hreq->f.rlast, hreq->f.fsize);
@@ -289,17 +416,21 @@ static inline int httpreq_fio_build_hdr(struct http_req *hreq)
 		hreq->f.volchkoff_last  = shfs_volchkoff_foff(hreq->fd, hreq->f.rlast + hreq->f.rfirst); /* last byte in last chunk */
 	}
  out:
-	http_sendhdr_set_nbslines(&hreq->response.hdr, nb_slines);
-	http_sendhdr_set_nbdlines(&hreq->response.hdr, nb_dlines);
+	http_sendhdr_set_nbslines(&hreq->h->response.hdr, nb_slines);
+	http_sendhdr_set_nbdlines(&hreq->h->response.hdr, nb_dlines);
 	return 0;
 
  err416_hdr:
 	/* 416 Range request error */
 	hreq->response.code = 416;
-	http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines,
+	http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines,
 			      HTTP_SHDR_416(hreq->request.http_major, hreq->request.http_minor));
-	http_sendhdr_add_dline(&hreq->response.hdr, &nb_dlines,
+	http_sendhdr_add_dline(&hreq->h->response.hdr, &nb_dlines,
 			       "%s: %"PRIu64"\r\n", _http_dhdr[HTTP_DHDR_SIZE], 0);
+	/* Content range: complete length (RFC 7233, 4.4) */
+	http_sendhdr_add_dline(&hreq->h->response.hdr, &nb_dlines,
+			       "%s*/%"PRIu64"\r\n", _http_dhdr[HTTP_DHDR_RANGE],
+			       hreq->f.fsize);
 	hreq->type = HRT_NOMSG;
 	goto out;
 }
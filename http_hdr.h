@@ -40,10 +40,19 @@
 #include <target/sys.h>
 #include <inttypes.h>
 #include <lwip/opt.h>
+#include <lwip/pbuf.h>
 #include "http_parser.h"
 #include "http_data.h"
 
-#define HTTP_RECVHDR_MAXNB_LINES   12
+#define HTTP_RECVHDR_MAXNB_LINES   16
+#define HTTP_RECVHDR_MAXNB_PBUFS   8
+#define HTTP_RECVHDR_MAXNB_RXPBUFS 4   /* received pbufs that are referenced by a header */
+#define HTTP_RECVHDR_SPILL_LEN     512 /* min. size of a pbuf that takes copies */
+#ifndef HTTP_RECVHDR_MAX_RXPBUFS
+/* received pbufs that are referenced by all headers together: the rest of
+ * the pool is kept for reception */
+#define HTTP_RECVHDR_MAX_RXPBUFS   (PBUF_POOL_SIZE / 4)
+#endif
 #define HTTP_SENDHDR_MAXNB_SLINES  8
 #define HTTP_SENDHDR_MAXNB_DLINES  4
 #define HTTP_HDR_DLINE_MAXLEN      80
@@ -54,6 +63,12 @@
        __typeof__ (b) __b = (b); \
        __a < __b ? __a : __b; })
 #endif
+#ifndef max
+#define max(a, b) \
+    ({ __typeof__ (a) __a = (a); \
+       __typeof__ (b) __b = (b); \
+       __a > __b ? __a : __b; })
+#endif
 #ifndef min3
 #define min3(a, b, c) \
 	min(min((a), (b)), (c))
@@ -64,38 +79,46 @@ struct _hdr_dbuffer {
 	size_t len;
 };
 
-#define _hdr_dbuffer_reset(dbffr) \
-	do { (dbffr)->len = 0; } while(0)
-#define _hdr_dbuffer_terminate(dbffr) \
-	do { \
-		ASSERT((dbffr)->len < HTTP_HDR_DLINE_MAXLEN); \
-		(dbffr)->b[(dbffr)->len++] = '\0'; \
-	} while(0)
-static inline void _hdr_dbuffer_add(struct _hdr_dbuffer *dbffr, const char *src, size_t len)
-{
-	register size_t curpos, maxlen;
-
-	curpos = dbffr->len;
-	maxlen = sizeof(dbffr->b) - 1 - curpos; /* minus 1 to store terminating '\0' later */
-
-	len = maxlen < len ? maxlen : len;
-	memcpy(&dbffr->b[curpos], src, len);
-	dbffr->len += len;
-}
-
 struct _hdr_sbuffer {
 	const char *b;
 	size_t len;
 };
 
+/*
+ * Received header lines are not copied: fields and values reference the
+ * payload of the received pbufs, which are kept referenced by the header
+ * until http_recvhdr_release() is called. Strings that span multiple
+ * pbufs (or that cannot be terminated in place) are copied to PBUF_RAM
+ * pbufs that are shared by all copies of a header. Strings are also copied
+ * when the list of pbufs is full, when a header references
+ * HTTP_RECVHDR_MAXNB_RXPBUFS received pbufs already, or when all headers
+ * together reference HTTP_RECVHDR_MAX_RXPBUFS. This way, received pbufs
+ * are released early and the PBUF_POOL does not run dry. Like lines
+ * beyond HTTP_RECVHDR_MAXNB_LINES, lines are only ignored when no memory
+ * is left for copying them.
+ */
+struct _hdr_ref {
+	char *b;      /* '\0'-terminated after http_recvhdr_terminate() */
+	uint16_t len;
+	uint8_t pidx; /* index of pbuf in http_recv_hdr */
+};
+
 struct _hdr_line {
-	struct _hdr_dbuffer field;
-	struct _hdr_dbuffer value;
+	struct _hdr_ref field;
+	struct _hdr_ref value;
 };
 
+extern uint32_t http_recvhdr_nb_rxpbufs; /* referenced by all headers */
+
 struct http_recv_hdr {
 	struct _hdr_line line[HTTP_RECVHDR_MAXNB_LINES];
 	uint32_t nb_lines;
+	struct pbuf *pbuf[HTTP_RECVHDR_MAXNB_PBUFS]; /* referenced pbufs */
+	uint32_t nb_pbufs;
+	uint32_t nb_rxpbufs; /* received pbufs in this list */
+	uint32_t spilled; /* bitmask of pbufs that hold copies */
+	int spill_idx;    /* pbuf that takes further copies, -1 if there is none */
+	uint16_t spill_off; /* used bytes of this pbuf */
 
 	int last_was_value;
 	int overflow; /* more lines in received header than memory available */
@@ -232,9 +255,130 @@ static inline err_t http_sendhdr_write(struct http_send_hdr *shdr, size_t *sent,
 	return err;
 }
 
-static inline int httpparser_recvhdr_field(struct http_parser *parser, const char *buf, size_t len)
+/* returns the index of the received pbuf p in the list of referenced pbufs,
+ * -1 if no further received pbuf can be referenced (the string has to be
+ * copied then) */
+static inline int _hdr_pbuf_idx(struct http_recv_hdr *rhdr, struct pbuf *p)
+{
+	register int i;
+
+	for (i = (int) rhdr->nb_pbufs - 1; i >= 0; --i) {
+		if (rhdr->pbuf[i] == p)
+			return i;
+	}
+	if (unlikely(rhdr->nb_pbufs >= HTTP_RECVHDR_MAXNB_PBUFS - 1 ||
+	             rhdr->nb_rxpbufs == HTTP_RECVHDR_MAXNB_RXPBUFS ||
+	             http_recvhdr_nb_rxpbufs >= HTTP_RECVHDR_MAX_RXPBUFS))
+		return -1; /* keep the last entry for a copy, release p early */
+	pbuf_ref(p);
+	++rhdr->nb_rxpbufs;
+	++http_recvhdr_nb_rxpbufs;
+	rhdr->pbuf[rhdr->nb_pbufs] = p;
+	return (int) rhdr->nb_pbufs++;
+}
+
+/* appends buf to a copy of ref. Copies are placed one after another (each
+ * with room for the terminating '\0') into PBUF_RAM pbufs. A string that is
+ * extended is moved to the end of the copies when it is not there already.
+ * Copy pbufs grow geometrically, so that long strings are copied only a
+ * few times */
+static inline int _hdr_ref_spill(struct http_recv_hdr *rhdr, struct _hdr_ref *ref,
+                                 const char *buf, size_t len)
+{
+	struct pbuf *p = NULL, *old = NULL;
+	size_t need = ref->len + len + 1;
+	size_t nlen;
+	char *b;
+	int idx;
+
+	if (unlikely(need > UINT16_MAX))
+		return -ENOMEM;
+	if (rhdr->spill_idx >= 0) {
+		p = rhdr->pbuf[rhdr->spill_idx];
+		if (ref->len && ref->pidx == rhdr->spill_idx &&
+		    ref->b + ref->len + 1 == (char *) p->payload + rhdr->spill_off) {
+			/* ref is the last copy: extend it in place */
+			if (rhdr->spill_off + len <= p->len) {
+				if (len)
+					MEMCPY(ref->b + ref->len, buf, len);
+				ref->len += len;
+				rhdr->spill_off += len;
+				return 0;
+			}
+			if (ref->b == (char *) p->payload)
+				old = p; /* ref is the only copy: replace this pbuf */
+		} else if (rhdr->spill_off + need <= p->len) {
+			/* append a new copy of ref */
+			b = (char *) p->payload + rhdr->spill_off;
+			goto copy;
+		}
+	}
+
+	nlen = max((size_t) HTTP_RECVHDR_SPILL_LEN, need << 1);
+	if (p)
+		nlen = max(nlen, (size_t) p->len << 1);
+	nlen = min((size_t) UINT16_MAX, nlen);
+	if (!old && unlikely(rhdr->nb_pbufs == HTTP_RECVHDR_MAXNB_PBUFS))
+		return -ENOMEM;
+	p = pbuf_alloc(PBUF_RAW, (uint16_t) nlen, PBUF_RAM);
+	if (unlikely(!p))
+		return -ENOMEM;
+	if (old) {
+		idx = rhdr->spill_idx;
+	} else {
+		idx = (int) rhdr->nb_pbufs++;
+		rhdr->spilled |= (1 << idx);
+		rhdr->spill_idx = idx;
+	}
+	rhdr->pbuf[idx] = p;
+	rhdr->spill_off = 0;
+	b = p->payload;
+
+ copy:
+	if (ref->len)
+		MEMCPY(b, ref->b, ref->len);
+	if (len)
+		MEMCPY(b + ref->len, buf, len);
+	if (old)
+		pbuf_free(old);
+	ref->b = b;
+	ref->len += len;
+	ref->pidx = (uint8_t) rhdr->spill_idx;
+	rhdr->spill_off += (uint16_t) need;
+	return 0;
+}
+
+/* appends buf (located in the payload of p) to ref */
+static inline int _hdr_ref_add(struct http_recv_hdr *rhdr, struct _hdr_ref *ref,
+                               struct pbuf *p, const char *buf, size_t len)
+{
+	int idx;
+
+	if (unlikely(!len))
+		return 0;
+	if (ref->len == 0) {
+		if (unlikely(len > UINT16_MAX - 1))
+			return -ENOMEM;
+		idx = _hdr_pbuf_idx(rhdr, p);
+		if (unlikely(idx < 0))
+			return _hdr_ref_spill(rhdr, ref, buf, len);
+		ref->b = (char *) buf;
+		ref->len = (uint16_t) len;
+		ref->pidx = (uint8_t) idx;
+		return 0;
+	}
+	if (likely(rhdr->pbuf[ref->pidx] == p && ref->b + ref->len == buf &&
+	           ref->len + len <= UINT16_MAX - 1)) {
+		ref->len += (uint16_t) len; /* continues in same pbuf */
+		return 0;
+	}
+	return _hdr_ref_spill(rhdr, ref, buf, len);
+}
+
+/* p is the received pbuf that contains buf */
+static inline int http_recvhdr_add_field(struct http_recv_hdr *rhdr, struct pbuf *p,
+                                         const char *buf, size_t len)
 {
-	struct http_recv_hdr *rhdr = (struct http_recv_hdr *) parser->data;
 	register unsigned l;
 
 	if (unlikely(rhdr->overflow))
@@ -246,7 +390,7 @@ static inline int httpparser_recvhdr_field(struct http_parser *parser, const cha
 			return 0;
 		}
 
-		/* switch to next line and reset its buffer */
+		/* switch to next line and reset its references */
 		rhdr->last_was_value = 0;
 		rhdr->line[rhdr->nb_lines].field.len = 0;
 		rhdr->line[rhdr->nb_lines].value.len = 0;
@@ -254,13 +398,17 @@ static inline int httpparser_recvhdr_field(struct http_parser *parser, const cha
 	}
 
 	l = rhdr->nb_lines - 1;
-	_hdr_dbuffer_add(&rhdr->line[l].field, buf, len);
+	if (unlikely(_hdr_ref_add(rhdr, &rhdr->line[l].field, p, buf, len) < 0)) {
+		/* out of memory: drop this and further lines */
+		--rhdr->nb_lines;
+		rhdr->overflow = 1;
+	}
 	return 0;
 }
 
-static inline int httpparser_recvhdr_value(struct http_parser *parser, const char *buf, size_t len)
+static inline int http_recvhdr_add_value(struct http_recv_hdr *rhdr, struct pbuf *p,
+                                         const char *buf, size_t len)
 {
-	struct http_recv_hdr *rhdr = (struct http_recv_hdr *) parser->data;
 	register unsigned l;
 
 	if (unlikely(rhdr->overflow))
@@ -271,7 +419,32 @@ static inline int httpparser_recvhdr_value(struct http_parser *parser, const cha
 		return -EINVAL; /* parsing error */
 
 	l = rhdr->nb_lines - 1;
-	_hdr_dbuffer_add(&rhdr->line[l].value, buf, len);
+	if (unlikely(_hdr_ref_add(rhdr, &rhdr->line[l].value, p, buf, len) < 0)) {
+		--rhdr->nb_lines;
+		rhdr->overflow = 1;
+	}
+	return 0;
+}
+
+static inline int _hdr_ref_terminate(struct http_recv_hdr *rhdr, struct _hdr_ref *ref)
+{
+	struct pbuf *p;
+
+	if (ref->len == 0) {
+		ref->b = (char *) "";
+		return 0;
+	}
+	if (rhdr->spilled & (1 << ref->pidx))
+		goto terminate; /* copies always have room */
+	p = rhdr->pbuf[ref->pidx];
+	if (unlikely(ref->b + ref->len >= (char *) p->payload + p->len)) {
+		/* no room behind the string in this pbuf */
+		if (_hdr_ref_spill(rhdr, ref, NULL, 0) < 0)
+			return -ENOMEM;
+	}
+	/* the byte behind the string (':', CR or LF) was parsed already */
+ terminate:
+	ref->b[ref->len] = '\0';
 	return 0;
 }
 
@@ -281,11 +454,31 @@ static inline void http_recvhdr_terminate(struct http_recv_hdr *rhdr)
 	register unsigned l;
 
 	for (l = 0; l < rhdr->nb_lines; ++l) {
-		_hdr_dbuffer_terminate(&rhdr->line[l].field);
-		_hdr_dbuffer_terminate(&rhdr->line[l].value);
+		if (unlikely(_hdr_ref_terminate(rhdr, &rhdr->line[l].field) < 0 ||
+		             _hdr_ref_terminate(rhdr, &rhdr->line[l].value) < 0)) {
+			/* out of memory: drop this and further lines */
+			rhdr->nb_lines = l;
+			rhdr->overflow = 1;
+			break;
+		}
 	}
 }
 
+/* drops all received lines and releases referenced pbufs */
+static inline void http_recvhdr_release(struct http_recv_hdr *rhdr)
+{
+	register unsigned i;
+
+	for (i = 0; i < rhdr->nb_pbufs; ++i)
+		pbuf_free(rhdr->pbuf[i]);
+	http_recvhdr_nb_rxpbufs -= rhdr->nb_rxpbufs;
+	rhdr->nb_pbufs = 0;
+	rhdr->nb_rxpbufs = 0;
+	rhdr->spilled = 0;
+	rhdr->spill_idx = -1;
+	rhdr->nb_lines = 0;
+}
+
 /* returns the field line number on success, -1 if it was not found */
 static inline int http_recvhdr_findfield(struct http_recv_hdr *rhdr, const char *field)
 {
@@ -305,6 +498,10 @@ static inline int http_recvhdr_findfield(struct http_recv_hdr *rhdr, const char
 #define http_recvhdr_reset(rhdr) \
 	do { \
 		(rhdr)->nb_lines = 0;		\
+		(rhdr)->nb_pbufs = 0;		\
+		(rhdr)->nb_rxpbufs = 0;		\
+		(rhdr)->spilled = 0;		\
+		(rhdr)->spill_idx = -1;		\
 		(rhdr)->last_was_value = 1;	\
 		(rhdr)->overflow = 0;		\
 	} while(0)
@@ -0,0 +1,314 @@
+/*
+ * Test for received HTTP header lines that are split across pbufs
+ * (linux target)
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+/*
+ * One request is fed to the parser like httpsess_recv() does: it is split
+ * into received pbufs that are released after parsing. It is split once at
+ * every byte offset and into segments of every length up to
+ * HT_MAX_SEGLEN, the latter also while the PBUF_POOL runs low (all
+ * strings are copied then). Each time, all header lines have to be
+ * received unaltered, the header may not reference more than
+ * HTTP_RECVHDR_MAXNB_RXPBUFS received pbufs, and every pbuf has to be
+ * released together with the header.
+ * pbufs are allocated from the heap by this test, so that lwIP is not
+ * required.
+ *
+ * Usage: http_hdr_test [-v]
+ */
+#include <target/sys.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+
+#ifndef HTTP_SERVER_AGENT
+#define HTTP_SERVER_AGENT "http_hdr_test"
+#endif
+
+#include <lwip/tcp.h>
+#include "likely.h"
+#include "http_parser.h"
+#include "http_hdr.h"
+
+#define HT_MAX_SEGLEN 64
+
+static const char * const ht_lines[][2] = {
+	{ "Host", "www.example.com" },
+	{ "User-Agent", "Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 "
+	                "Firefox/128.0 (header split test)" },
+	{ "Accept", "text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8" },
+	{ "Accept-Language", "en-US,en;q=0.5" },
+	{ "Accept-Encoding", "gzip, deflate, br, zstd" },
+	{ "Connection", "keep-alive" },
+	{ "Cookie", "session=6b3f9c1e2d7a4f0b8e5c3a1d9f7b2e4c; theme=dark; "
+	            "consent=analytics%3A0%2Cmarketing%3A0; tz=Europe%2FBerlin; "
+	            "recent=%2Fvideos%2F1%2C%2Fvideos%2F2%2C%2Fvideos%2F3" },
+	{ "Range", "bytes=1024-2047" },
+	{ "If-None-Match", "\"5e1f-6a3b\"" },
+	{ "Cache-Control", "max-age=0" },
+};
+#define HT_NB_LINES (sizeof(ht_lines) / sizeof(ht_lines[0]))
+
+static char ht_req[2048];
+static size_t ht_req_len;
+static struct http_recv_hdr ht_hdr;
+static struct pbuf *ht_rx_pbuf; /* pbuf that is currently parsed */
+static int ht_complete;
+static int ht_verbose;
+static long ht_nb_pbufs; /* allocated by this test */
+static uint32_t ht_nb_rxpbufs; /* referenced by other headers */
+
+uint32_t http_recvhdr_nb_rxpbufs = 0;
+
+/*
+ * pbuf functions that are used by http_hdr.h
+ */
+struct pbuf *pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
+{
+	struct pbuf *p;
+
+	p = calloc(1, sizeof(*p) + length);
+	if (!p)
+		return NULL;
+	p->payload = (void *) (p + 1);
+	p->len = length;
+	p->tot_len = length;
+	p->ref = 1;
+	++ht_nb_pbufs;
+	return p;
+}
+
+void pbuf_ref(struct pbuf *p)
+{
+	++p->ref;
+}
+
+u8_t pbuf_free(struct pbuf *p)
+{
+	if (--p->ref)
+		return 0;
+	free(p);
+	--ht_nb_pbufs;
+	return 1;
+}
+
+/*
+ * Parser callbacks
+ */
+static int ht_hdr_field(struct http_parser *parser, const char *buf, size_t len)
+{
+	return http_recvhdr_add_field(&ht_hdr, ht_rx_pbuf, buf, len);
+}
+
+static int ht_hdr_value(struct http_parser *parser, const char *buf, size_t len)
+{
+	return http_recvhdr_add_value(&ht_hdr, ht_rx_pbuf, buf, len);
+}
+
+static int ht_req_complete(struct http_parser *parser)
+{
+	http_recvhdr_terminate(&ht_hdr);
+	ht_complete = 1;
+	return 0;
+}
+
+static http_parser_settings ht_parser_settings = {
+	.on_header_field = ht_hdr_field,
+	.on_header_value = ht_hdr_value,
+	.on_message_complete = ht_req_complete,
+};
+
+static void ht_build_req(void)
+{
+	unsigned int l;
+
+	ht_req_len = snprintf(ht_req, sizeof(ht_req), "GET /index.html HTTP/1.1\r\n");
+	for (l = 0; l < HT_NB_LINES; ++l)
+		ht_req_len += snprintf(ht_req + ht_req_len, sizeof(ht_req) - ht_req_len,
+		                       "%s: %s\r\n", ht_lines[l][0], ht_lines[l][1]);
+	ht_req_len += snprintf(ht_req + ht_req_len, sizeof(ht_req) - ht_req_len, "\r\n");
+}
+
+static int ht_check(const char *desc)
+{
+	unsigned int l;
+	int ret = 0;
+
+	if (!ht_complete) {
+		printf("%s: request was not completed\n", desc);
+		return -1;
+	}
+	if (ht_hdr.overflow || http_recvhdr_get_nblines(&ht_hdr) != HT_NB_LINES) {
+		printf("%s: %u of %u lines received (overflow: %d)\n", desc,
+		       http_recvhdr_get_nblines(&ht_hdr), (unsigned int) HT_NB_LINES,
+		       ht_hdr.overflow);
+		return -1;
+	}
+	for (l = 0; l < HT_NB_LINES; ++l) {
+		if (strcmp(ht_hdr.line[l].field.b, ht_lines[l][0]) != 0 ||
+		    strcmp(ht_hdr.line[l].value.b, ht_lines[l][1]) != 0 ||
+		    ht_hdr.line[l].field.len != strlen(ht_lines[l][0]) ||
+		    ht_hdr.line[l].value.len != strlen(ht_lines[l][1])) {
+			printf("%s: line %u mismatch: '%s: %s'\n", desc, l,
+			       ht_hdr.line[l].field.b, ht_hdr.line[l].value.b);
+			ret = -1;
+		}
+	}
+	if (ht_hdr.nb_rxpbufs > HTTP_RECVHDR_MAXNB_RXPBUFS ||
+	    http_recvhdr_nb_rxpbufs != ht_nb_rxpbufs + ht_hdr.nb_rxpbufs ||
+	    (ht_nb_rxpbufs >= HTTP_RECVHDR_MAX_RXPBUFS && ht_hdr.nb_rxpbufs)) {
+		printf("%s: %u received pbufs referenced (%u by all headers)\n", desc,
+		       ht_hdr.nb_rxpbufs, http_recvhdr_nb_rxpbufs);
+		ret = -1;
+	}
+	if (ht_verbose)
+		printf("%s: %u lines in %u pbufs (%u copies)\n", desc,
+		       http_recvhdr_get_nblines(&ht_hdr), ht_hdr.nb_pbufs,
+		       (unsigned int) __builtin_popcount(ht_hdr.spilled));
+	return ret;
+}
+
+/* feeds the request in segments that end at the given offsets */
+static int ht_run(const char *desc, const size_t *end, unsigned int nb_segs)
+{
+	struct http_parser parser;
+	struct pbuf *p;
+	size_t off = 0;
+	size_t plen;
+	unsigned int s;
+	int ret = 0;
+
+	http_parser_init(&parser, HTTP_REQUEST);
+	http_recvhdr_nb_rxpbufs = ht_nb_rxpbufs;
+	http_recvhdr_reset(&ht_hdr);
+	ht_complete = 0;
+
+	for (s = 0; s < nb_segs; ++s) {
+		p = pbuf_alloc(PBUF_RAW, (u16_t) (end[s] - off), PBUF_POOL);
+		if (!p) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		memcpy(p->payload, ht_req + off, p->len);
+		ht_rx_pbuf = p;
+		plen = http_parser_execute(&parser, &ht_parser_settings,
+		                           p->payload, p->len);
+		pbuf_free(p); /* like httpsess_recv() */
+		if (plen != end[s] - off) {
+			printf("%s: parsing error: %s\n", desc,
+			       http_errno_name(HTTP_PARSER_ERRNO(&parser)));
+			ret = -1;
+			goto out;
+		}
+		off = end[s];
+	}
+	ret = ht_check(desc);
+
+ out:
+	http_recvhdr_release(&ht_hdr);
+	if (ht_nb_pbufs) {
+		printf("%s: %ld pbufs were not released\n", desc, ht_nb_pbufs);
+		ht_nb_pbufs = 0;
+		ret = -1;
+	}
+	if (http_recvhdr_nb_rxpbufs != ht_nb_rxpbufs) {
+		printf("%s: %u received pbufs are still counted\n", desc,
+		       http_recvhdr_nb_rxpbufs - ht_nb_rxpbufs);
+		ret = -1;
+	}
+	return ret;
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s [-v]\n", argv0);
+}
+
+int main(int argc, char *argv[])
+{
+	static size_t end[sizeof(ht_req)];
+	unsigned int nb_runs = 0, nb_errors = 0;
+	unsigned int nb_segs;
+	char desc[64];
+	size_t i, seglen;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "vh")) != -1) {
+		switch (opt) {
+		case 'v':
+			ht_verbose = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	ht_build_req();
+
+	/* one request, split at every byte offset */
+	for (i = 0; i <= ht_req_len; ++i) {
+		nb_segs = 0;
+		if (i > 0 && i < ht_req_len)
+			end[nb_segs++] = i;
+		end[nb_segs++] = ht_req_len;
+		snprintf(desc, sizeof(desc), "split at %zu", i);
+		nb_errors += ht_run(desc, end, nb_segs) ? 1 : 0;
+		++nb_runs;
+	}
+
+	/* one request, split into segments of the same length,
+	 * with and without received pbufs held by other headers */
+	for (ht_nb_rxpbufs = 0; ht_nb_rxpbufs <= HTTP_RECVHDR_MAX_RXPBUFS;
+	     ht_nb_rxpbufs += HTTP_RECVHDR_MAX_RXPBUFS) {
+		for (seglen = 1; seglen <= HT_MAX_SEGLEN; ++seglen) {
+			nb_segs = 0;
+			for (i = seglen; i < ht_req_len; i += seglen)
+				end[nb_segs++] = i;
+			end[nb_segs++] = ht_req_len;
+			snprintf(desc, sizeof(desc), "%zu byte segments%s", seglen,
+			         ht_nb_rxpbufs ? " (pool runs low)" : "");
+			nb_errors += ht_run(desc, end, nb_segs) ? 1 : 0;
+			++nb_runs;
+		}
+	}
+
+	printf("%u of %u runs of a %zu byte request failed\n",
+	       nb_errors, nb_runs, ht_req_len);
+	return nb_errors ? 1 : 0;
+}
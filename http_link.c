@@ -38,13 +38,15 @@
 
 static err_t httplink_request(struct http_req_link_origin *o);
 static err_t httplink_write(struct http_req_link_origin *o, const void* buf, size_t *len, uint8_t apiflags);
+static int httplink_recv_hdrfield(http_parser *parser, const char *buf, size_t len);
+static int httplink_recv_hdrvalue(http_parser *parser, const char *buf, size_t len);
 static int httplink_recv_data(http_parser *parser, const char *c, size_t len);
 static int httplink_recv_hdrcomplete(http_parser *parser);
 static int httplink_recv_datacomplete(http_parser *parser);
 
 static http_parser_settings _httplink_parser_settings = {
-	.on_header_field = httpparser_recvhdr_field,
-	.on_header_value = httpparser_recvhdr_value,
+	.on_header_field = httplink_recv_hdrfield,
+	.on_header_value = httplink_recv_hdrvalue,
 	.on_headers_complete = httplink_recv_hdrcomplete,
 	.on_body = httplink_recv_data,
 	.on_message_complete = httplink_recv_datacomplete
@@ -53,6 +55,9 @@ static http_parser_settings _httplink_parser_settings = {
 typedef int (*http_data_cb) (http_parser*, const char *at, size_t length);
 typedef int (*http_cb) (http_parser*);
 
+/* health states of recently used origin servers */
+static struct http_link_upstream _httplink_upstreams[HTTP_LINK_MAXNB_UPSTREAMS];
+
 int httplink_init(struct http_srv *hs)
 {
   hs->link_pool = alloc_simple_mempool(HTTP_MAXNB_LINKS, sizeof(struct http_req_link_origin));
@@ -62,6 +67,7 @@ int httplink_init(struct http_srv *hs)
   hs->nb_links = 0;
   hs->max_nb_links = HTTP_MAXNB_LINKS;
   dlist_init_head(hs->links);
+  memset(_httplink_upstreams, 0, sizeof(_httplink_upstreams));
 
   return 0;
 }
@@ -73,6 +79,209 @@ void httplink_exit(struct http_srv *hs)
   free_mempool(hs->link_pool);
 }
 
+/*
+ * Origin server selection
+ *
+ * Candidates of a link are the primary origin (index 0) and the
+ * alternative origins stored in the SHFS entry (index 1..n). Servers that
+ * failed recently are considered as down and are only used if there is
+ * no other choice left. From the remaining ones, the server with the least
+ * outstanding upstream connections is picked. Ties are broken by the
+ * smoothed response latency (EWMA).
+ */
+static int httplink_candidate(struct http_req_link_origin *o, unsigned int i,
+			      struct shfs_host *h, uint16_t *port)
+{
+	struct shfs_altorigin *ao;
+
+	*port = shfs_fio_link_rport(o->fd);
+	if (i == 0) {
+		shfshost_copy(h, shfs_fio_link_rhost(o->fd));
+		return 0;
+	}
+
+	ao = shfs_fio_link_altorigin(o->fd, i - 1);
+	if (!SHFS_ALTORIGIN_ISSET(ao))
+		return -ENOENT;
+	memset(h, 0, sizeof(*h));
+	h->type = SHFS_HOST_TYPE_IPV4;
+	memcpy(h->addr, ao->addr, sizeof(ao->addr));
+	return 0;
+}
+
+static struct http_link_upstream *httplink_upstream_lookup(const struct shfs_host *h, uint16_t port)
+{
+	unsigned int i;
+
+	for (i = 0; i < HTTP_LINK_MAXNB_UPSTREAMS; ++i) {
+		if (_httplink_upstreams[i].port == port &&
+		    shfshost_compare(&_httplink_upstreams[i].host, h) == 0)
+			return &_httplink_upstreams[i];
+	}
+	return NULL;
+}
+
+static struct http_link_upstream *httplink_upstream_get(const struct shfs_host *h, uint16_t port)
+{
+	struct http_link_upstream *us;
+	struct http_link_upstream *victim = NULL;
+	unsigned int i;
+
+	us = httplink_upstream_lookup(h, port);
+	if (us)
+		return us;
+
+	/* replace the least recently used entry that is not in use */
+	for (i = 0; i < HTTP_LINK_MAXNB_UPSTREAMS; ++i) {
+		if (_httplink_upstreams[i].nb_outstanding)
+			continue;
+		if (!victim || _httplink_upstreams[i].ts_used < victim->ts_used)
+			victim = &_httplink_upstreams[i];
+	}
+	if (unlikely(!victim))
+		return NULL;
+
+	memset(victim, 0, sizeof(*victim));
+	shfshost_copy(&victim->host, h);
+	victim->port = port;
+	return victim;
+}
+
+int httplink_select_upstream(struct http_req_link_origin *o)
+{
+	struct http_link_upstream *us;
+	struct shfs_host h, best_h;
+	uint16_t port, best_port = 0;
+	uint32_t nb_outstanding, best_nb_outstanding = 0;
+	uint32_t ewma_ms, best_ewma_ms = 0;
+	int down, best_down = 0;
+	int best = -1;
+	uint64_t now;
+	unsigned int i;
+
+	BUG_ON(o->us != NULL);
+	now = target_now_ns();
+
+	for (i = 0; i < (1 + SHFS_LINK_MAX_NB_ALTORIGINS); ++i) {
+		if (o->us_tried & (1 << i))
+			continue;
+		if (httplink_candidate(o, i, &h, &port) < 0)
+			continue;
+
+		us = httplink_upstream_lookup(&h, port);
+		if (us) {
+			down = (us->nb_fails >= HTTP_LINK_UPSTREAM_MAXFAILS &&
+				now < us->ts_retry);
+			nb_outstanding = us->nb_outstanding;
+			ewma_ms = us->ewma_ms;
+		} else {
+			/* unknown server: assume it is healthy */
+			down = 0;
+			nb_outstanding = 0;
+			ewma_ms = 0;
+		}
+
+		if (best >= 0) {
+			if (down > best_down)
+				continue;
+			if (down == best_down) {
+				if (nb_outstanding > best_nb_outstanding)
+					continue;
+				if (nb_outstanding == best_nb_outstanding &&
+				    ewma_ms >= best_ewma_ms)
+					continue;
+			}
+		}
+		best = (int) i;
+		best_down = down;
+		best_nb_outstanding = nb_outstanding;
+		best_ewma_ms = ewma_ms;
+		best_port = port;
+		shfshost_copy(&best_h, &h);
+	}
+
+	if (best < 0) {
+		printd("origin %p: No origin server left to try\n", o);
+		return -ENOENT;
+	}
+	o->us_tried |= (1 << best);
+
+	us = httplink_upstream_get(&best_h, best_port);
+	if (unlikely(!us))
+		return -ENOMEM;
+	++us->nb_outstanding;
+	us->ts_used = now;
+	o->us = us;
+
+	printd("origin %p: Selected origin server %d (outstanding: %"PRIu32", latency: %"PRIu32" ms%s)\n",
+	       o, best, best_nb_outstanding, best_ewma_ms, best_down ? ", down" : "");
+	return 0;
+}
+
+static inline void httplink_upstream_succeeded(struct http_link_upstream *us, uint64_t ts_connect)
+{
+	uint32_t sample_ms;
+
+	sample_ms = (uint32_t) NSEC_TO_MSEC(target_now_ns() - ts_connect);
+	if (us->ewma_ms == 0)
+		us->ewma_ms = sample_ms;
+	else
+		us->ewma_ms = us->ewma_ms - (us->ewma_ms >> HTTP_LINK_UPSTREAM_EWMA_SHIFT)
+			      + (sample_ms >> HTTP_LINK_UPSTREAM_EWMA_SHIFT);
+	us->nb_fails = 0;
+}
+
+static inline void httplink_upstream_failed(struct http_link_upstream *us)
+{
+	unsigned int shift;
+
+	if (us->nb_fails < UINT8_MAX)
+		++us->nb_fails;
+	if (us->nb_fails >= HTTP_LINK_UPSTREAM_MAXFAILS) {
+		shift = min(us->nb_fails - HTTP_LINK_UPSTREAM_MAXFAILS, 4);
+		us->ts_retry = target_now_ns() +
+			((uint64_t) HTTP_LINK_UPSTREAM_HOLDDOWN * 1000000000ull << shift);
+	}
+}
+
+static inline void httplink_release_upstream(struct http_req_link_origin *o)
+{
+	if (o->us) {
+		--o->us->nb_outstanding;
+		o->us = NULL;
+	}
+}
+
+/*
+ * Switches an origin that could not be connected to the next origin server.
+ * Afterwards, sstate is HRLOS_RESOLVE if there was a server left to try,
+ * otherwise it is HRLOS_ERROR. Clients have to be notified by the caller.
+ * The return value is the one of closing the failed connection.
+ */
+err_t httplink_failover(struct http_req_link_origin *o, enum http_sess_close type)
+{
+	err_t err;
+
+	printd("origin %p: Connecting to origin server failed\n", o);
+	if (o->us)
+		httplink_upstream_failed(o->us);
+	err = httplink_close(o, type); /* releases the upstream */
+	o->sstate = HRLOS_ERROR;
+
+	if (httplink_select_upstream(o) < 0)
+		return err; /* we ran out of origin servers */
+	o->tpcb = tcp_new();
+	if (!o->tpcb) {
+		httplink_release_upstream(o);
+		return err;
+	}
+	http_recvhdr_release(&o->response.hdr); /* of previous server */
+	httplink_init_state(o);
+	httplink_init_pcb(o);
+	printd("origin %p: Failing over to next origin server\n", o);
+	return err;
+}
+
 #if LWIP_DNS
 void httpreq_link_dnscb(const char *name, ip_addr_t *ipaddr, void *argp)
 {
@@ -81,14 +290,14 @@ void httpreq_link_dnscb(const char *name, ip_addr_t *ipaddr, void *argp)
 
 	if (!((ipaddr) && (ipaddr->addr))) {
 		printd("Could not resolve '%s'\n", name);
-		o->sstate = HRLOS_ERROR;
+		httplink_failover(o, HSC_CLOSE);
 	} else {
 		printd("Name resolution for '%s' was successful\n", name);
 		o->rip.addr = ipaddr->addr;
 		o->sstate = HRLOS_CONNECT;
 	}
 
-	httpsess_respond(hreq->hsess);
+	httplink_notify_clients(o);
 }
 #endif
 
@@ -124,6 +333,22 @@ static inline void httplink_build_reqhdr(struct http_req_link_origin *o)
 	http_sendhdr_add_dline(&o->request.hdr, &nb_dlines,
 			       "%s: 0\r\n", _http_dhdr[HTTP_DHDR_ICYMETADATA]);
 
+	/* ask only for the part of the object that is needed by the clients
+	 * (skipped for servers that are known to ignore range requests) */
+	o->req_range = 0;
+	if ((o->req_first != 0 || o->req_last != UINT64_MAX) &&
+	    o->us->accept_ranges >= 0) {
+		if (o->req_last == UINT64_MAX)
+			http_sendhdr_add_dline(&o->request.hdr, &nb_dlines,
+					       "%s%"PRIu64"-\r\n", _http_dhdr[HTTP_DHDR_REQRANGE],
+					       o->req_first);
+		else
+			http_sendhdr_add_dline(&o->request.hdr, &nb_dlines,
+					       "%s%"PRIu64"-%"PRIu64"\r\n", _http_dhdr[HTTP_DHDR_REQRANGE],
+					       o->req_first, o->req_last);
+		o->req_range = 1;
+	}
+
 	http_sendhdr_set_nbslines(&o->request.hdr, nb_slines);
 	http_sendhdr_set_nbdlines(&o->request.hdr, nb_dlines);
 	o->request.hdr_total_len = http_sendhdr_calc_totallen(&o->request.hdr);
@@ -152,7 +377,7 @@ err_t httplink_connected(void *argp, struct tcp_pcb * tpcb, err_t err)
   /* switch to request phase */
   o->cstate = HRLOC_REQUEST;
   o->sstate = HRLOS_WAIT_RESPONSE;
-  o->timeout = HTTP_LINK_RESPONSE_TIMEOUT;
+  twheel_arm(&o->timer, HTTP_LINK_RESPONSE_TIMEOUT);
   return httplink_request(o);
 }
 
@@ -161,6 +386,8 @@ err_t httplink_close(struct http_req_link_origin *o, enum http_sess_close type)
 {
 	err_t err;
 
+	httplink_release_upstream(o);
+	twheel_cancel(&o->timer);
 	if (!o->tpcb)
 		return ERR_OK;
 
@@ -176,7 +403,6 @@ err_t httplink_close(struct http_req_link_origin *o, enum http_sess_close type)
 	tcp_recv(o->tpcb, NULL);
 	tcp_sent(o->tpcb, NULL);
 	tcp_err (o->tpcb, NULL);
-	tcp_poll(o->tpcb, NULL, 0);
 	tcp_arg (o->tpcb, NULL);
 
 	/* terminate connection */
@@ -215,7 +441,7 @@ static err_t httplink_request(struct http_req_link_origin *o)
 		if (o->sent == o->request.hdr_total_len) {
 			/* we are done -> switch to receive mode */
 			o->cstate = HRLOC_GETRESPONSE;
-			o->timeout = HTTP_LINK_RESPONSE_TIMEOUT;
+			twheel_arm(&o->timer, HTTP_LINK_RESPONSE_TIMEOUT);
 		}
 		break;
 
@@ -301,6 +527,48 @@ err_t httplink_sent(void *argp, struct tcp_pcb *tpcb, uint16_t len)
 	return ERR_OK;
 }
 
+/*
+ * Receive window regulation for remote objects
+ *
+ * Other than for live streams, no client of an object is allowed to lose
+ * sync with the origin. Received data is announced to the origin (opening
+ * the TCP receive window again) only as long as the buffer ring can still
+ * take a full window on top of what the slowest client did not consume yet.
+ */
+void httplink_update_wnd(struct http_req_link_origin *o)
+{
+	struct http_req *hreq;
+	size_t ref, min_ref = o->pos;
+	size_t limit;
+	uint16_t len;
+
+	if (!o->tpcb)
+		return;
+
+	dlist_foreach(hreq, o->clients, l.clients) {
+		if (hreq->state >= HRS_FINALIZING_HDR)
+			ref = hreq->l.acked_pos;
+		else if (hreq->l.rfirst >= o->offset) /* not positioned yet */
+			ref = (size_t) (hreq->l.rfirst - o->offset);
+		else
+			ref = 0;
+		if (ref < min_ref)
+			min_ref = ref;
+	}
+
+	limit = httplink_ring_len(o) - shfs_vol.chunksize; /* see lower_limit */
+	if (limit > TCP_WND)
+		limit -= TCP_WND;
+	else
+		limit >>= 1;
+
+	while (o->recv_pending && (o->pos - min_ref) <= limit) {
+		len = (uint16_t) min(o->recv_pending, UINT16_MAX);
+		tcp_recved(o->tpcb, len);
+		o->recv_pending -= len;
+	}
+}
+
 err_t httplink_recv(void *argp, struct tcp_pcb *tpcb, struct pbuf *p, err_t err)
 {
 	struct http_req_link_origin *o = (struct http_req_link_origin *) argp;
@@ -315,19 +583,35 @@ err_t httplink_recv(void *argp, struct tcp_pcb *tpcb, struct pbuf *p, err_t err)
 			tcp_recved(tpcb, p->tot_len);
 			pbuf_free(p);
 		}
+		if (httplink_is_connecting(o)) {
+			/* server closed before it replied */
+			ret = httplink_failover(o, HSC_ABORT);
+			httplink_notify_clients(o);
+			return ret;
+		}
 		return httplink_close(o, HSC_ABORT);
 	}
 
 	switch (o->cstate) {
 	case HRLOC_GETRESPONSE:
 	case HRLOC_CONNECTED:
+		o->ts_lastrecv = twheel_now(); /* checked by receive timeout */
+
 		/* feed parser */
 		for (q = p; q != NULL; q = q->next) {
+			o->rx_pbuf = q; /* header lines reference it */
 			plen = http_parser_execute(&o->parser, &_httplink_parser_settings,
 			                           q->payload, q->len);
 			if (unlikely(plen != q->len)) {
 				/* less data was parsed: this happens only when
-				 * there was a parsing error */
+				 * there was a parsing error or the server did not
+				 * accept our request */
+				if (httplink_is_connecting(o)) {
+					printd("Invalid reply from origin server: Trying next one...\n");
+					ret = httplink_failover(o, HSC_ABORT);
+					httplink_notify_clients(o);
+					goto out;
+				}
 				printd("HTTP protocol parsing error: Dropping connection...\n");
 				ret = httplink_close(o, HSC_CLOSE);
 				goto out;
@@ -346,7 +630,13 @@ err_t httplink_recv(void *argp, struct tcp_pcb *tpcb, struct pbuf *p, err_t err)
 		goto out;
 	}
 
-	tcp_recved(tpcb, p->tot_len);
+	if (o->sstate == HRLOS_CONNECTED && !o->is_stream) {
+		/* window is opened by clients */
+		o->recv_pending += p->tot_len;
+		httplink_update_wnd(o);
+	} else if (o->tpcb) {
+		tcp_recved(tpcb, p->tot_len);
+	}
 
  out:
 	pbuf_free(p);
@@ -358,50 +648,61 @@ void httplink_error(void *argp, err_t err)
 	struct http_req_link_origin *o = (struct http_req_link_origin *) argp;
 
 	printd("Killing origin connection %p due to error: %d\n", o, err);
-	httplink_close(o, HSC_KILL); /* drop connection */
+	if (httplink_is_connecting(o))
+		httplink_failover(o, HSC_KILL); /* e.g., connection refused */
+	else
+		httplink_close(o, HSC_KILL); /* drop connection */
+	httplink_notify_clients(o);
 }
 
-err_t httplink_poll(void *argp, struct tcp_pcb *tpcb)
+void httplink_timeout(struct twheel_timer *t, void *argp)
 {
 	struct http_req_link_origin *o = (struct http_req_link_origin *) argp;
+	uint64_t idle;
 
-	printd("Polling origin connection %p\n", o);
 	switch (o->sstate) {
-	case HRLOS_CONNECT:
+	case HRLOS_WAIT:
 	case HRLOS_WAIT_RESPONSE:
-		--o->timeout;
-		if (o->timeout == 0) {
-			printd("Timeout expired\n", o);
-			o->sstate = HRLOS_ERROR;
-			httplink_notify_clients(o);
-		}
+		printd("origin %p: Timeout expired\n", o);
+		httplink_failover(o, HSC_ABORT);
+		httplink_notify_clients(o);
 		break;
 
 	case HRLOS_CONNECTED: /* time out when receiving data */
-		if (o->to_pos != o->pos) {
-			/* reset timeout */
-			o->timeout = HTTP_LINK_RECEIVE_TIMEOUT;
-			o->to_pos  = o->pos;
+		idle = twheel_now() - o->ts_lastrecv;
+		if (idle < HTTP_LINK_RECEIVE_TIMEOUT) {
+			/* data was received in the meantime */
+			twheel_arm(&o->timer, HTTP_LINK_RECEIVE_TIMEOUT - idle);
 			break;
 		}
 
-		--o->timeout;
-		if (o->timeout == 0) {
-			printd("Receive timeout expired\n", o);
-			o->sstate = HRLOS_ERROR;
-			httplink_notify_clients(o);
-		}
+		printd("origin %p: Receive timeout expired\n", o);
+		o->sstate = HRLOS_ERROR;
+		httplink_notify_clients(o);
 		break;
 
 	default:
 		break;
 	}
-	return ERR_OK;
 }
 
 /*
  * Following functions get called by parser when incoming message is decoded
  */
+static int httplink_recv_hdrfield(http_parser *parser, const char *buf, size_t len)
+{
+	struct http_req_link_origin *o = container_of(parser, struct http_req_link_origin, parser);
+
+	return http_recvhdr_add_field(&o->response.hdr, o->rx_pbuf, buf, len);
+}
+
+static int httplink_recv_hdrvalue(http_parser *parser, const char *buf, size_t len)
+{
+	struct http_req_link_origin *o = container_of(parser, struct http_req_link_origin, parser);
+
+	return http_recvhdr_add_value(&o->response.hdr, o->rx_pbuf, buf, len);
+}
+
 static int httplink_recv_hdrcomplete(http_parser *parser)
 {
 	struct http_req_link_origin *o = container_of(parser, struct http_req_link_origin, parser);
@@ -427,14 +728,49 @@ static int httplink_recv_hdrcomplete(http_parser *parser)
 	}
 #endif
 
-	/* did server respond with status code 200? */
-	if (parser->status_code != 200) {
-		printd("Server of origin %p did not return 200: Closing connection...\n", o);
-		httplink_close(o, HSC_CLOSE);
-		httplink_notify_clients(o);
-		return 0;
+	/* did server respond with status code 200 or 206?
+	 * Otherwise, stop parsing: httplink_recv() fails over to the next server */
+	if (parser->status_code != 200 &&
+	    !(parser->status_code == 206 && o->req_range)) {
+		printd("Server of origin %p did not return 200\n", o);
+		return -1;
 	}
 
+	/* object or stream? */
+	if (parser->status_code == 206) {
+		ret = http_recvhdr_findfield(&o->response.hdr, "content-range");
+		if (ret < 0 ||
+		    sscanf(o->response.hdr.line[ret].value.b,
+			   "bytes %"PRIu64"-%"PRIu64"/%"PRIu64,
+			   &o->offset, &o->end, &o->fsize) != 3 ||
+		    o->offset != o->req_first || o->end < o->offset ||
+		    o->end >= o->fsize) {
+			printd("origin %p: Invalid content range in partial response\n", o);
+			return -1;
+		}
+		++o->end; /* points behind last byte */
+		o->is_stream = 0;
+		o->us->accept_ranges = 1;
+	} else if (parser->content_length != UINT64_MAX &&
+		   parser->content_length != 0) {
+		o->offset = 0;
+		o->fsize = o->end = parser->content_length;
+		o->is_stream = 0;
+		if (o->req_range) {
+			/* server ignored our range request: remember it */
+			o->us->accept_ranges = -1;
+		} else {
+			ret = http_recvhdr_findfield(&o->response.hdr, "accept-ranges");
+			if (ret >= 0 && strcasecmp(o->response.hdr.line[ret].value.b, "bytes") == 0)
+				o->us->accept_ranges = 1;
+		}
+	} else {
+		o->is_stream = 1;
+	}
+	printd("origin %p: Receiving %s (offset: %"PRIu64", end: %"PRIu64", size: %"PRIu64")\n",
+	       o, o->is_stream ? "stream" : "object", o->offset, o->end, o->fsize);
+	httplink_upstream_succeeded(o->us, o->ts_connect);
+
 	/* search for mime type in response */
 	ret = http_recvhdr_findfield(&o->response.hdr, _http_dhdr[HTTP_DHDR_MIME]);
 	if (ret >= 0) {
@@ -449,15 +785,17 @@ static int httplink_recv_hdrcomplete(http_parser *parser)
 		lft = HTTPLINK_DEFAULT_FORMAT;
 	}
 
-	/* init format parser */
-	printd("origin %p: Initialize join parser with format id %d\n", o, lft);
-	init_lformat(&o->lfs, lft, 0);
+	/* init format parser (streams only, objects are joined by range) */
+	if (o->is_stream) {
+		printd("origin %p: Initialize join parser with format id %d\n", o, lft);
+		init_lformat(&o->lfs, lft, 0);
+	}
 
 	/* switch to connected phase */
 	o->sstate = HRLOS_CONNECTED;
 	o->cstate = HRLOC_CONNECTED;
-	o->to_pos = o->pos;
-	o->timeout = HTTP_LINK_RECEIVE_TIMEOUT;
+	o->ts_lastrecv = twheel_now();
+	twheel_arm(&o->timer, HTTP_LINK_RECEIVE_TIMEOUT);
 
 	/* we will announce to clients later since
 	 * we might retrieve some data already */
@@ -498,7 +836,8 @@ static int httplink_recv_data(http_parser *parser, const char *c, size_t len)
 		       rlen, idx, o->cce[idx]->buffer, bffr_off, pos);
 		//printh(c, rlen);
 		MEMCPY((void *)(((uintptr_t) o->cce[idx]->buffer) + bffr_off), c, rlen);
-		lformat_parse(&o->lfs, (void *)(((uintptr_t) o->cce[idx]->buffer) + bffr_off), rlen); /* updates join */
+		if (o->is_stream)
+			lformat_parse(&o->lfs, (void *)(((uintptr_t) o->cce[idx]->buffer) + bffr_off), rlen); /* updates join */
 
 		pos += rlen;
 		len -= rlen;
@@ -506,8 +845,9 @@ static int httplink_recv_data(http_parser *parser, const char *c, size_t len)
 		if (rlen == avail) {
 			/* point to next buffer is current is full */
 			idx = (idx + 1) % o->cce_max_idx;
-			if (idx > o->cce_max_idx)
-				o->lower_limit += shfs_vol.chunksize;
+			/* the buffer we write to next held the oldest data */
+			if (pos >= httplink_ring_len(o))
+				o->lower_limit = pos - httplink_ring_len(o) + shfs_vol.chunksize;
 		}
 	}
 
@@ -45,6 +45,9 @@
 #define HTTPLINK_DEFAULT_FORMAT LFT_RAW512
 
 #define httpreq_link_nb_buffers(chunksize)  (max(2,((DIV_ROUND_UP(HTTPREQ_SNDBUF, (size_t) chunksize)) << 1)))
+/* number of bytes held by the buffer ring of an origin */
+#define httplink_ring_len(o) \
+	((size_t) (o)->cce_max_idx * (size_t) shfs_vol.chunksize)
 
 /* server states */
 enum http_req_link_origin_sstate {
@@ -58,6 +61,9 @@ enum http_req_link_origin_sstate {
 	HRLOS_EOF /* end-of-file */
 };
 
+#define httplink_is_connecting(o) \
+	((o)->sstate >= HRLOS_RESOLVE && (o)->sstate < HRLOS_CONNECTED)
+
 /* client states */
 enum http_req_link_origin_cstate {
 	HRLOC_ERROR,
@@ -66,6 +72,21 @@ enum http_req_link_origin_cstate {
 	HRLOC_CONNECTED,
 };
 
+/*
+ * Health state of an origin server; shared by all links that use it
+ */
+struct http_link_upstream {
+	struct shfs_host host;
+	uint16_t port;
+
+	uint32_t nb_outstanding; /* number of upstream connections using this server */
+	uint32_t ewma_ms; /* smoothed time until response header was received */
+	uint8_t nb_fails; /* consecutive failures */
+	int8_t accept_ranges; /* 1: server handles ranges, -1: server ignored our range, 0: unknown */
+	uint64_t ts_retry; /* server is considered as down until this point in time (ns) */
+	uint64_t ts_used;
+};
+
 struct http_req_link_origin {
 	struct tcp_pcb *tpcb;
 	ip_addr_t rip;
@@ -88,6 +109,7 @@ struct http_req_link_origin {
 	struct shfs_cache_entry *cce[HTTPREQ_LINK_MAXNB_BUFFERS];
 
 	struct http_parser parser;
+	struct pbuf *rx_pbuf; /* received pbuf that is currently parsed */
 	struct {
 		char req[HTTP_HDR_DLINE_MAXLEN];
 		struct http_send_hdr hdr;
@@ -100,8 +122,23 @@ struct http_req_link_origin {
 		const char *mime;
 	} response;
 
-	size_t to_pos;
-	uint16_t timeout;
+	struct twheel_timer timer; /* connect, response, and receive timeout */
+	uint64_t ts_lastrecv; /* ms */
+
+	/* remote objects (non-stream) */
+	int is_stream; /* known after response header was received */
+	uint64_t req_first; /* range requested from origin (chunk aligned) */
+	uint64_t req_last; /* UINT64_MAX: until end of object */
+	int req_range; /* range request was sent to origin */
+	uint64_t offset; /* object offset of stream position 0 */
+	uint64_t end; /* object offset behind last byte of response */
+	uint64_t fsize; /* object size (0: unknown) */
+	size_t recv_pending; /* received bytes that are not announced to the origin yet */
+
+	/* upstream selection */
+	struct http_link_upstream *us; /* currently used origin server */
+	uint8_t us_tried; /* bitmask of already tried servers (0 = primary) */
+	uint64_t ts_connect;
 
 	dlist_el(links);
 	dlist_head(clients);
@@ -117,7 +154,10 @@ err_t httplink_connected(void *argp, struct tcp_pcb * tpcb, err_t err);
 err_t httplink_sent   (void *argp, struct tcp_pcb *tpcb, uint16_t len);
 err_t httplink_recv   (void *argp, struct tcp_pcb *tpcb, struct pbuf *p, err_t err);
 void  httplink_error  (void *argp, err_t err);
-err_t httplink_poll   (void *argp, struct tcp_pcb *tpcb);
+void  httplink_timeout(struct twheel_timer *t, void *argp);
+int   httplink_select_upstream(struct http_req_link_origin *o);
+err_t httplink_failover(struct http_req_link_origin *o, enum http_sess_close type);
+void  httplink_update_wnd(struct http_req_link_origin *o);
 
 static inline void httplink_notify_clients(struct http_req_link_origin *o)
 {
@@ -133,6 +173,101 @@ static inline void httplink_notify_clients(struct http_req_link_origin *o)
   }
 }
 
+static inline void httplink_init_pcb(struct http_req_link_origin *o)
+{
+	tcp_arg(o->tpcb, o);
+	tcp_recv(o->tpcb, httplink_recv); /* recv callback */
+	tcp_sent(o->tpcb, httplink_sent); /* sent ack callback */
+	tcp_err (o->tpcb, httplink_error); /* err callback */
+	tcp_setprio(o->tpcb, HTTP_LINK_TCP_PRIO);
+}
+
+static inline void httplink_init_state(struct http_req_link_origin *o)
+{
+	/* init parser */
+	o->rx_pbuf = NULL;
+	http_parser_init(&o->parser, HTTP_RESPONSE);
+	http_recvhdr_reset(&o->response.hdr);
+	o->response.mime = NULL;
+
+	/* init state */
+	http_sendhdr_reset(&o->request.hdr);
+	o->sent = 0;
+	o->sent_infly = 0;
+	o->request.hdr_total_len = 0;
+	o->request.hdr_acked_len = 0;
+	o->is_stream = 0;
+	o->req_range = 0;
+	o->offset = 0;
+	o->end = 0;
+	o->fsize = 0;
+	o->recv_pending = 0;
+	o->sstate = HRLOS_RESOLVE;
+	o->cstate = HRLOC_ERROR;
+}
+
+/*
+ * Parses a client range request ("bytes=first-[last]")
+ * Unparseable ranges are ignored: the full object is requested then
+ */
+static inline void httpreq_link_parse_range(struct http_req *hreq)
+{
+	uint64_t rfirst, rlast;
+	int ret;
+
+	hreq->l.rfirst = 0;
+	hreq->l.rlast  = UINT64_MAX;
+
+	ret = http_recvhdr_findfield(&hreq->h->request.hdr, "range");
+	if (ret < 0 ||
+	    strncasecmp("bytes=", hreq->h->request.hdr.line[ret].value.b, 6) != 0)
+		return;
+	ret = sscanf(hreq->h->request.hdr.line[ret].value.b + 6,
+		     "%"PRIu64"-%"PRIu64,
+		     &rfirst, &rlast);
+	if (ret == 1) {
+		hreq->l.rfirst = rfirst;
+	} else if (ret == 2 && rfirst <= rlast) {
+		hreq->l.rfirst = rfirst;
+		hreq->l.rlast  = rlast;
+	}
+	printd("Client requested range of remote object: %"PRIu64"-%"PRIu64"\n",
+	       hreq->l.rfirst, hreq->l.rlast);
+}
+
+/*
+ * Checks if a request can be served by an existing upstream connection.
+ * Live streams are always joined (at the most recent join point).
+ * Objects are joined when the requested range starts within the data
+ * window of the origin or shortly behind it. This way, concurrent partial
+ * fetches of the same object are merged.
+ */
+static inline int httplink_can_join(struct http_req_link_origin *o, struct http_req *hreq)
+{
+	uint64_t rlast = hreq->l.rlast;
+
+	if (o->fd != hreq->fd || o->sstate == HRLOS_ERROR)
+		return 0;
+	if (o->is_stream)
+		return 1;
+
+	if (o->sstate < HRLOS_CONNECTED) {
+		/* response not received yet: compare with what was requested */
+		return (hreq->l.rfirst >= o->req_first &&
+			hreq->l.rfirst <= o->req_first + httplink_ring_len(o) &&
+			rlast <= o->req_last);
+	}
+
+	if (o->fsize && rlast >= o->fsize)
+		rlast = o->fsize - 1;
+	if (o->sstate == HRLOS_EOF) /* no further data will arrive */
+		return (hreq->l.rfirst >= o->offset + o->lower_limit &&
+			rlast < o->offset + o->pos);
+	return (hreq->l.rfirst >= o->offset + o->lower_limit &&
+		hreq->l.rfirst <= o->offset + o->pos + httplink_ring_len(o) &&
+		rlast < o->end);
+}
+
 static inline int httpreq_link_prepare_hdr(struct http_req *hreq)
 {
 	//struct http_srv *hs = hreq->hsess->hs;
@@ -140,15 +275,18 @@ static inline int httpreq_link_prepare_hdr(struct http_req *hreq)
 	struct http_req_link_origin *o;
 	unsigned int i;
 
-	o = (struct http_req_link_origin *) shfs_fio_get_cookie(hreq->fd);
-	if (o) {
-		/* append this request to client list (join) */
-		dlist_append(hreq, o->clients, l.clients);
-		hreq->l.origin = o;
-		++o->nb_clients;
+	httpreq_link_parse_range(hreq);
 
-		printd("origin found %p, request %p joined\n", o, hreq);
-		return 0;
+	dlist_foreach(o, hs->links, links) {
+		if (httplink_can_join(o, hreq)) {
+			/* append this request to client list (join) */
+			dlist_append(hreq, o->clients, l.clients);
+			hreq->l.origin = o;
+			++o->nb_clients;
+
+			printd("origin found %p, request %p joined\n", o, hreq);
+			return 0;
+		}
 	}
 
 	/* create a new upstream link */
@@ -157,6 +295,7 @@ static inline int httpreq_link_prepare_hdr(struct http_req *hreq)
 		goto err_out;
 	o = (struct http_req_link_origin *) pobj->data;
 	o->pobj = pobj;
+	twheel_timer_init(&o->timer, httplink_timeout, o);
 
 	o->fd = shfs_fio_openf(hreq->fd);
 	if (!o->fd)
@@ -176,6 +315,19 @@ static inline int httpreq_link_prepare_hdr(struct http_req *hreq)
 	o->pos = 0;
 	o->lower_limit = 0;
 
+	/* range to request from origin (aligned to chunks) */
+	o->req_first = hreq->l.rfirst - (hreq->l.rfirst % shfs_vol.chunksize);
+	if (hreq->l.rlast == UINT64_MAX)
+		o->req_last = UINT64_MAX;
+	else
+		o->req_last = ALIGN_UP(hreq->l.rlast + 1, (uint64_t) shfs_vol.chunksize) - 1;
+
+	/* pick an origin server */
+	o->us = NULL;
+	o->us_tried = 0;
+	if (httplink_select_upstream(o) < 0)
+		goto err_free_cce_all;
+
 	/* append origin to list of origins */
 	dlist_init_el(o, links);
 	dlist_append(o, hs->links, links);
@@ -187,42 +339,25 @@ static inline int httpreq_link_prepare_hdr(struct http_req *hreq)
 	hreq->l.origin = o;
 	o->nb_clients = 1;
 
-	/* init parser */
-	o->parser.data = (void *) &o->response.hdr;
-	http_parser_init(&o->parser, HTTP_RESPONSE);
-	http_recvhdr_reset(&o->response.hdr);
-	o->response.mime = NULL;
-
-	/* init state */
-	http_sendhdr_reset(&o->request.hdr);
-	o->sent = 0;
-	o->sent_infly = 0;
-	o->request.hdr_total_len = 0;
-	o->request.hdr_acked_len = 0;
-	o->sstate = HRLOS_RESOLVE;
-	o->cstate = HRLOC_ERROR;
+	/* init parser and state */
+	httplink_init_state(o);
 
 	/* set tcp callbacks */
-	tcp_arg(o->tpcb, o);
-	tcp_recv(o->tpcb, httplink_recv); /* recv callback */
-	tcp_sent(o->tpcb, httplink_sent); /* sent ack callback */
-	tcp_err (o->tpcb, httplink_error); /* err callback */
-	tcp_poll(o->tpcb, httplink_poll, HTTP_POLL_INTERVAL); /* poll callback */
-	tcp_setprio(o->tpcb, HTTP_LINK_TCP_PRIO);
-
-	/* add cookie to file descriptor
-	 * (never fails because we checked for NULL already ahead) */
-	shfs_fio_set_cookie(o->fd, o);
+	httplink_init_pcb(o);
 
 	printd("new origin %p with request %p created\n", o, hreq);
 	return 0;
 
+ err_free_cce_all:
+	i = o->cce_max_idx;
  err_free_cce:
 	for (; i > 0; --i) {
 		printd("origin %p: release blank cache buffer %u @%p...\n", o, i - 1, o->cce[i - 1]);
 		shfs_cache_release(o->cce[i - 1]);
 	}
  err_close_fd:
+	if (o->tpcb)
+		tcp_close(o->tpcb);
 	shfs_fio_close(o->fd);
  err_free_o:
 	mempool_put(pobj);
@@ -234,69 +369,151 @@ static inline int httpreq_link_prepare_hdr(struct http_req *hreq)
 void httpreq_link_dnscb(const char *name, ip_addr_t *ipaddr, void *argp);
 #endif
 
-static inline int httpreq_link_build_hdr(struct http_req *hreq)
+/*
+ * Resolves the address of the selected origin server (if not done yet) and
+ * initiates the connection to it. Returns 0 when the result is signaled
+ * asynchronously, a negative value when this origin server failed.
+ */
+static inline int httpreq_link_connect(struct http_req *hreq)
 {
-	//struct http_srv *hs = hreq->hsess->hs;
-	size_t nb_slines;
-	size_t nb_dlines;
 	struct http_req_link_origin *o = hreq->l.origin;
 	err_t err;
 	int ret;
 
-	/* connection procedure */
-	switch(o->sstate) {
-	case HRLOS_RESOLVE:
-		/* resolv remote host name */
+	if (o->sstate == HRLOS_RESOLVE) {
+		/* resolv remote host name of selected origin server */
 		printd("Resolving origin host address...\n");
-		o->rport = shfs_fio_link_rport(o->fd);
+		o->rport = o->us->port;
 #if LWIP_DNS
-		ret = shfshost2ipaddr(shfs_fio_link_rhost(o->fd), &o->rip, httpreq_link_dnscb, hreq);
+		ret = shfshost2ipaddr(&o->us->host, &o->rip, httpreq_link_dnscb, hreq);
 		if (ret >= 1) {
 			o->sstate = HRLOS_WAIT_RESOLVE;
-			return -EAGAIN;
+			return 0;
 		}
 #else
-		ret = shfshost2ipaddr(shfs_fio_link_rhost(o->fd), &o->rip);
+		ret = shfshost2ipaddr(&o->us->host, &o->rip);
 #endif
 		if (ret < 0) {
 			printd("Resolution of origin host address failed: %d\n", ret);
-			goto err_out;
+			return ret;
 		}
 		printd("Resolution could be done directly\n");
 		o->sstate = HRLOS_CONNECT;
-		goto case_HRLOS_CONNECT;
+	}
+
+	/* connect to remote */
+	printd("Connecting to origin host...\n");
+	twheel_arm(&o->timer, HTTP_LINK_CONNECT_TIMEOUT);
+	o->ts_connect = target_now_ns();
+	err = tcp_connect(o->tpcb, &o->rip, o->rport, httplink_connected);
+	if (err != ERR_OK)
+		return -EIO;
+	o->sstate = HRLOS_WAIT;
+	return 0;
+}
+
+static inline int httpreq_link_build_hdr(struct http_req *hreq)
+{
+	//struct http_srv *hs = hreq->hsess->hs;
+	size_t nb_slines;
+	size_t nb_dlines;
+	struct http_req_link_origin *o = hreq->l.origin;
 
-	case_HRLOS_CONNECT:
+	/* connection procedure */
+	switch(o->sstate) {
+	case HRLOS_RESOLVE:
 	case HRLOS_CONNECT:
-		/* connect to remote */
-		printd("Connecting to origin host...\n");
-		o->timeout = HTTP_LINK_CONNECT_TIMEOUT;
-		err = tcp_connect(o->tpcb, &o->rip, o->rport, httplink_connected);
-		if (err != ERR_OK)
-			goto err_out;
-		o->sstate = HRLOS_WAIT;
-		return -EAGAIN;
+		/* try the remaining origin servers in turn */
+		for (;;) {
+			if (httpreq_link_connect(hreq) == 0)
+				return -EAGAIN; /* wait for resolution or connection */
+			httplink_failover(o, HSC_CLOSE);
+			if (o->sstate != HRLOS_RESOLVE)
+				goto err_out; /* we ran out of origin servers */
+		}
 
+	case HRLOS_EOF:
+		if (o->is_stream)
+			goto err_out; /* stream ended already */
+		/* fall through: object data is still buffered */
 	case HRLOS_CONNECTED:
 		/* create header for client */
-		nb_slines = http_sendhdr_get_nbslines(&hreq->response.hdr);
-		nb_dlines = http_sendhdr_get_nbdlines(&hreq->response.hdr);
-
-		hreq->response.code = 200;	/* 200 OK */
-		http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines,
-				      HTTP_SHDR_200(hreq->request.http_major, hreq->request.http_minor));
-		http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines, HTTP_SHDR_NOCACHE);
-		http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines, HTTP_SHDR_NOSTORE);
+		nb_slines = http_sendhdr_get_nbslines(&hreq->h->response.hdr);
+		nb_dlines = http_sendhdr_get_nbdlines(&hreq->h->response.hdr);
+
+		if (o->is_stream) {
+			hreq->response.code = 200;	/* 200 OK */
+			http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines,
+					      HTTP_SHDR_200(hreq->request.http_major, hreq->request.http_minor));
+			http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines, HTTP_SHDR_NOCACHE);
+			http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines, HTTP_SHDR_NOSTORE);
+			if (o->response.mime)
+				http_sendhdr_add_dline(&hreq->h->response.hdr, &nb_dlines,
+						       "%s: %s\r\n", _http_dhdr[HTTP_DHDR_MIME], o->response.mime);
+			hreq->is_stream = 1;
+			/* most recent join point in stream */
+			hreq->l.pos     = hreq->l.acked_pos = lformat_getrjoin(&o->lfs);
+			hreq->l.cce_idx = (hreq->l.pos / shfs_vol.chunksize) % o->cce_max_idx;
+
+			http_sendhdr_set_nbslines(&hreq->h->response.hdr, nb_slines);
+			http_sendhdr_set_nbdlines(&hreq->h->response.hdr, nb_dlines);
+			return 0;
+		}
+
+		/* remote object: check requested range against object size */
+		if (hreq->l.rfirst >= o->fsize) {
+			printd("Requested range %"PRIu64"-%"PRIu64" is not satisfiable (object size: %"PRIu64")\n",
+			       hreq->l.rfirst, hreq->l.rlast, o->fsize);
+			return -ERANGE; /* will end up in err416_hdr */
+		}
+		if (hreq->l.rlast >= o->fsize) {
+			/* a range request for the whole object
+			 * is answered like a full request */
+			if (hreq->l.rfirst == 0)
+				hreq->l.rlast = UINT64_MAX;
+			else
+				hreq->l.rlast = o->fsize - 1;
+		}
+		if (unlikely(hreq->l.rfirst < o->offset + o->lower_limit ||
+			     (hreq->l.rlast != UINT64_MAX && hreq->l.rlast >= o->end) ||
+			     (hreq->l.rlast == UINT64_MAX && o->end != o->fsize))) {
+			/* origin did not deliver what we need */
+			printd("Origin %p cannot serve range %"PRIu64"-%"PRIu64" (has %"PRIu64"-%"PRIu64")\n",
+			       o, hreq->l.rfirst, hreq->l.rlast, o->offset + o->lower_limit, o->end);
+			goto err_out;
+		}
+
+		if (hreq->l.rlast == UINT64_MAX) {
+			hreq->response.code = 200;	/* 200 OK */
+			http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines,
+					      HTTP_SHDR_200(hreq->request.http_major, hreq->request.http_minor));
+			hreq->rlen = o->fsize - hreq->l.rfirst;
+		} else {
+			hreq->response.code = 206;	/* 206 Partial content */
+			http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines,
+					      HTTP_SHDR_206(hreq->request.http_major, hreq->request.http_minor));
+			hreq->rlen = hreq->l.rlast - hreq->l.rfirst + 1;
+		}
+		http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines, HTTP_SHDR_ACC_BYTERANGE);
+		http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines, HTTP_SHDR_NOCACHE);
+		http_sendhdr_add_shdr(&hreq->h->response.hdr, &nb_slines, HTTP_SHDR_NOSTORE);
 		if (o->response.mime)
-			http_sendhdr_add_dline(&hreq->response.hdr, &nb_dlines,
+			http_sendhdr_add_dline(&hreq->h->response.hdr, &nb_dlines,
 					       "%s: %s\r\n", _http_dhdr[HTTP_DHDR_MIME], o->response.mime);
-		hreq->is_stream = 1;
-		/* most recent join point in stream */
-		hreq->l.pos     = hreq->l.acked_pos = lformat_getrjoin(&o->lfs);
+		http_sendhdr_add_dline(&hreq->h->response.hdr, &nb_dlines,
+				       "%s: %"PRIu64"\r\n", _http_dhdr[HTTP_DHDR_SIZE], hreq->rlen);
+		if (hreq->response.code == 206)
+			http_sendhdr_add_dline(&hreq->h->response.hdr, &nb_dlines,
+					       "%s%"PRIu64"-%"PRIu64"/%"PRIu64"\r\n",
+					       _http_dhdr[HTTP_DHDR_RANGE],
+					       hreq->l.rfirst, hreq->l.rlast, o->fsize);
+		hreq->is_stream = 0;
+		hreq->l.pos     = hreq->l.acked_pos = hreq->l.rfirst - o->offset;
+		hreq->l.end_pos = hreq->l.pos + hreq->rlen;
 		hreq->l.cce_idx = (hreq->l.pos / shfs_vol.chunksize) % o->cce_max_idx;
 
-		http_sendhdr_set_nbslines(&hreq->response.hdr, nb_slines);
-		http_sendhdr_set_nbdlines(&hreq->response.hdr, nb_dlines);
+		http_sendhdr_set_nbslines(&hreq->h->response.hdr, nb_slines);
+		http_sendhdr_set_nbdlines(&hreq->h->response.hdr, nb_dlines);
 		return 0;
 
 	case HRLOS_ERROR:
@@ -308,7 +525,7 @@ static inline int httpreq_link_build_hdr(struct http_req *hreq)
 	/* build response */
 	return 0; /* next phase */
 
- err_out: /* will end up in err500_hdr */
+ err_out: /* will end up in err503_hdr */
 	printd("Error happened on origin %p, exiting request %p\n", o, hreq);
 	o->sstate = HRLOS_ERROR;
 	return -1;
@@ -324,23 +541,33 @@ static inline void httpreq_link_close(struct http_req *hreq)
 	dlist_unlink(hreq, o->clients, l.clients);
 	printd("request %p removed from origin %p\n", hreq, o);
 	if (o->nb_clients == 0) {
-		shfs_fio_clear_cookie(o->fd);
 		--hs->nb_links;
 		dlist_unlink(o, hs->links, links);
 		if (o->tpcb) /* close connection to origin if not done yet */
 			httplink_close(o, HSC_CLOSE);
+		twheel_cancel(&o->timer);
 		for (i = 0; i < o->cce_max_idx; ++i) {
 			printd("origin %p: release blank cache buffer %u @%p...\n", o, i, o->cce[i]);
 			shfs_cache_release(o->cce[i]);
 		}
+		http_recvhdr_release(&o->response.hdr);
 		shfs_fio_close(o->fd);
 		mempool_put(o->pobj);
 		printd("origin %p destroyed\n", o);
+	} else if (o->recv_pending) {
+		/* removed client might have been the slowest one */
+		httplink_update_wnd(o);
 	}
 }
 
-#define httpreq_ack_link(hreq, acked) \
-  do { (hreq)->l.acked_pos += acked; } while(0)
+static inline void httpreq_ack_link(struct http_req *hreq, size_t acked)
+{
+	hreq->l.acked_pos += acked;
+
+	/* objects: clients regulate the receive window to the origin */
+	if (!hreq->is_stream && hreq->l.origin->recv_pending)
+		httplink_update_wnd(hreq->l.origin);
+}
 
 static inline err_t httpreq_write_link(struct http_req *hreq, size_t *sent)
 {
@@ -365,7 +592,15 @@ static inline err_t httpreq_write_link(struct http_req *hreq, size_t *sent)
 	}
 
 	/* send out data to catch up to origins position */
-	left = o->pos - pos;
+	if (hreq->is_stream) {
+		left = o->pos - pos;
+	} else {
+		/* objects: client might wait for data ahead of origin */
+		if (pos >= o->pos)
+			left = 0;
+		else
+			left = min(o->pos, hreq->l.end_pos) - pos;
+	}
 	while (left) {
 		//idx = (pos / shfs_vol.chunksize) % o->cce_max_idx;
 		bffr_off = pos % shfs_vol.chunksize;
@@ -397,15 +632,22 @@ static inline err_t httpreq_write_link(struct http_req *hreq, size_t *sent)
 		}
 	}
 
-	if (pos == o->pos) /* we catched up: send out what we have */
-		httpsess_flush(hsess);
+	if (pos == o->pos || (!hreq->is_stream && pos == hreq->l.end_pos))
+		httpsess_flush(hsess); /* we catched up: send out what we have */
 
 	hreq->l.cce_idx = idx;
 	hreq->l.pos     = pos;
 	*sent          += slen_total;
 
-	if (unlikely(o->sstate != HRLOS_CONNECTED && err != ERR_OK && err != ERR_MEM))
-		return ERR_CONN; /* this error code is used to signal that we run out of data */
+	if (unlikely(o->sstate != HRLOS_CONNECTED)) {
+		if (!hreq->is_stream && pos < hreq->l.end_pos && pos >= o->pos) {
+			/* origin went away before our range was delivered */
+			printd("Request %p: origin %p closed before end of range was received\n", hreq, o);
+			return ERR_ABRT;
+		}
+		if (err != ERR_OK && err != ERR_MEM)
+			return ERR_CONN; /* this error code is used to signal that we run out of data */
+	}
 	return err;
 }
 
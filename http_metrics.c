@@ -0,0 +1,630 @@
+/*
+ * Fast HTTP Server Implementation for SHFS volumes
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <stdarg.h>
+
+#include "http_metrics.h"
+#if LWIP_STATS
+#include <lwip/stats.h>
+#endif
+#ifdef LATENCY_HIST
+#include "lhist.h"
+#endif
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#endif
+
+/*
+ * A metric family is exported by printing its descriptor and all of its
+ * samples. sample() appends sample i to the family name
+ * (e.g., "_total{label=\"x\"} 42\n") and returns the number of
+ * written bytes, 0 if the family has no further sample, or -ENOSPC
+ * if the sample did not fit into the buffer.
+ */
+struct _hm_family {
+	const char *name;
+	const char *type;
+	const char *help;
+	int (*sample)(struct http_req_metrics_state *m, unsigned int i,
+	              char *buf, size_t len);
+};
+
+static int _hm_printf(char *buf, size_t len, const char *fmt, ...)
+{
+	va_list ap;
+	int ret;
+
+	va_start(ap, fmt);
+	ret = vsnprintf(buf, len, fmt, ap);
+	va_end(ap);
+
+	if (ret < 0 || (size_t) ret >= len)
+		return -ENOSPC;
+	return ret;
+}
+
+#define HM_SCALAR(fn, fmt, expr)					\
+	static int fn(struct http_req_metrics_state *m, unsigned int i, \
+	              char *buf, size_t len)				\
+	{								\
+		if (i)							\
+			return 0;					\
+		return _hm_printf(buf, len, " "fmt"\n", (expr));	\
+	}
+
+/* counter samples carry the "_total" suffix */
+#define HM_COUNTER(fn, fmt, expr)					\
+	static int fn(struct http_req_metrics_state *m, unsigned int i, \
+	              char *buf, size_t len)				\
+	{								\
+		if (i)							\
+			return 0;					\
+		return _hm_printf(buf, len, "_total "fmt"\n", (expr));	\
+	}
+
+/* -------------------------------------------------------------------
+ * HTTP server
+ * ------------------------------------------------------------------- */
+HM_SCALAR(_hm_http_sess,       "%"PRIu32, hs->nb_sess)
+HM_SCALAR(_hm_http_sess_max,   "%"PRIu32, hs->max_nb_sess)
+HM_COUNTER(_hm_http_sess_reaped, "%"PRIu64, hs->nb_reaped)
+HM_COUNTER(_hm_http_shed,      "%"PRIu64, hs->adm.nb_shed)
+HM_SCALAR(_hm_http_qdelay,     "%"PRIu32, hs->adm.qdelay)
+HM_SCALAR(_hm_http_reqs,       "%"PRIu32, hs->nb_reqs)
+HM_SCALAR(_hm_http_reqs_max,   "%"PRIu32, hs->max_nb_reqs)
+HM_SCALAR(_hm_http_links,      "%"PRIu16, hs->nb_links)
+HM_SCALAR(_hm_http_links_max,  "%"PRIu16, hs->max_nb_links)
+
+/* -------------------------------------------------------------------
+ * Memory pools
+ * ------------------------------------------------------------------- */
+static int _hm_pool(unsigned int i, const char **name,
+                    uint32_t *nb_objs, uint32_t *nb_free_objs)
+{
+	struct mempool_slabs *s = NULL;
+	struct mempool *p = NULL;
+
+	switch (i) {
+	case 0:
+		*name = "http_sess";
+		s = hs->sess_pool;
+		break;
+	case 1:
+		*name = "http_req";
+		s = hs->req_pool;
+		break;
+	case 2:
+		*name = "http_reqhdr";
+		s = hs->reqhdr_pool;
+		break;
+	case 3:
+		*name = "http_link";
+		p = hs->link_pool;
+		break;
+	case 4:
+		*name = "http_metrics";
+		p = hs->metrics_pool;
+		break;
+	case 5:
+		*name = "shfs_aiotoken";
+		p = shfs_mounted ? shfs_vol.aiotoken_pool : NULL;
+		break;
+	case 6:
+		*name = "shfs_cache";
+		p = (shfs_mounted && shfs_vol.chunkcache) ? shfs_vol.chunkcache->pool : NULL;
+		break;
+	default:
+		break;
+	}
+
+	if (s) {
+		*nb_objs = mempool_slabs_nb_objs(s);
+		*nb_free_objs = mempool_slabs_free_count(s);
+		return 0;
+	}
+	if (p) {
+		*nb_objs = mempool_nb_objs(p);
+		*nb_free_objs = mempool_free_count(p);
+		return 0;
+	}
+	return -1;
+}
+
+static int _hm_pool_objs(struct http_req_metrics_state *m, unsigned int i,
+                         char *buf, size_t len)
+{
+	uint32_t nb_objs, nb_free_objs;
+	const char *name;
+
+	if (_hm_pool(i, &name, &nb_objs, &nb_free_objs) < 0)
+		return 0;
+	return _hm_printf(buf, len, "{pool=\"%s\"} %"PRIu32"\n",
+	                  name, nb_objs);
+}
+
+static int _hm_pool_free(struct http_req_metrics_state *m, unsigned int i,
+                         char *buf, size_t len)
+{
+	uint32_t nb_objs, nb_free_objs;
+	const char *name;
+
+	if (_hm_pool(i, &name, &nb_objs, &nb_free_objs) < 0)
+		return 0;
+	return _hm_printf(buf, len, "{pool=\"%s\"} %"PRIu32"\n",
+	                  name, nb_free_objs);
+}
+
+/* -------------------------------------------------------------------
+ * SHFS chunk cache
+ * ------------------------------------------------------------------- */
+static int _hm_cache_buffers(struct http_req_metrics_state *m, unsigned int i,
+                             char *buf, size_t len)
+{
+	if (!shfs_mounted || !shfs_vol.chunkcache)
+		return 0;
+
+	switch (i) {
+	case 0:
+		return _hm_printf(buf, len, "{state=\"loaded\"} %"PRIu64"\n",
+		                  shfs_vol.chunkcache->nb_entries);
+	case 1:
+		return _hm_printf(buf, len, "{state=\"referenced\"} %"PRIu64"\n",
+		                  shfs_vol.chunkcache->nb_ref_entries);
+	default:
+		break;
+	}
+	return 0;
+}
+
+#ifdef SHFS_CACHE_STATS
+#define HM_CACHE_EV(ev) \
+	{ #ev, offsetof(struct shfs_cache, stats.ev) }
+
+static const struct {
+	const char *name;
+	size_t off;
+} _hm_cache_ev[] = {
+	HM_CACHE_EV(hit),
+	HM_CACHE_EV(hitwait),
+	HM_CACHE_EV(rdahead),
+	HM_CACHE_EV(miss),
+	HM_CACHE_EV(blank),
+	HM_CACHE_EV(evict),
+	HM_CACHE_EV(memerr),
+	HM_CACHE_EV(iosuc),
+	HM_CACHE_EV(ioerr),
+};
+
+static int _hm_cache_events(struct http_req_metrics_state *m, unsigned int i,
+                            char *buf, size_t len)
+{
+	if (!shfs_mounted || !shfs_vol.chunkcache ||
+	    i >= ARRAY_SIZE(_hm_cache_ev))
+		return 0;
+	return _hm_printf(buf, len, "_total{event=\"%s\"} %"PRIu32"\n",
+	                  _hm_cache_ev[i].name,
+	                  *((uint32_t *) ((uint8_t *) shfs_vol.chunkcache
+	                                  + _hm_cache_ev[i].off)));
+}
+#endif /* SHFS_CACHE_STATS */
+
+/* -------------------------------------------------------------------
+ * Latency histograms
+ * ------------------------------------------------------------------- */
+#ifdef LATENCY_HIST
+#define HM_LAT_NB_SAMPLES 6 /* 4 quantiles, count, sum */
+
+static const uint32_t _hm_lat_q[] = { 500000, 900000, 990000, 999000 };
+static const char * const _hm_lat_qstr[] = { "0.5", "0.9", "0.99", "0.999" };
+
+static int _hm_latency(struct http_req_metrics_state *m, unsigned int i,
+                       char *buf, size_t len)
+{
+	struct lhist *h;
+	unsigned int n = i / HM_LAT_NB_SAMPLES;
+	unsigned int s = i % HM_LAT_NB_SAMPLES;
+	uint64_t ns;
+
+	foreach_lhist(h) {
+		if (n-- == 0)
+			break;
+	}
+	if (!h)
+		return 0;
+
+	switch (s) {
+	case 4:
+		return _hm_printf(buf, len, "_count{name=\"%s\"} %"PRIu64"\n",
+		                  h->name, h->count);
+	case 5:
+		ns = lhist_ticks_to_ns(h->sum);
+		break;
+	default:
+		ns = lhist_ticks_to_ns(lhist_quantile(h, _hm_lat_q[s]));
+		return _hm_printf(buf, len, "{name=\"%s\",quantile=\"%s\"} %"PRIu64".%09"PRIu64"\n",
+		                  h->name, _hm_lat_qstr[s], ns / 1000000000, ns % 1000000000);
+	}
+	return _hm_printf(buf, len, "_sum{name=\"%s\"} %"PRIu64".%09"PRIu64"\n",
+	                  h->name, ns / 1000000000, ns % 1000000000);
+}
+#endif /* LATENCY_HIST */
+
+/* -------------------------------------------------------------------
+ * lwIP
+ * ------------------------------------------------------------------- */
+#if LWIP_STATS
+static const struct {
+	const char *name;
+	struct stats_proto *s;
+} _hm_lwip_proto[] = {
+#if LINK_STATS
+	{ "link",   &lwip_stats.link },
+#endif
+#if ETHARP_STATS
+	{ "etharp", &lwip_stats.etharp },
+#endif
+#if IP_STATS
+	{ "ip",     &lwip_stats.ip },
+#endif
+#if ICMP_STATS
+	{ "icmp",   &lwip_stats.icmp },
+#endif
+#if UDP_STATS
+	{ "udp",    &lwip_stats.udp },
+#endif
+#if TCP_STATS
+	{ "tcp",    &lwip_stats.tcp },
+#endif
+	{ NULL,     NULL }
+};
+
+#define HM_LWIP_EV(ev) \
+	{ #ev, offsetof(struct stats_proto, ev) }
+
+static const struct {
+	const char *name;
+	size_t off;
+} _hm_lwip_ev[] = {
+	HM_LWIP_EV(xmit),
+	HM_LWIP_EV(recv),
+	HM_LWIP_EV(fw),
+	HM_LWIP_EV(drop),
+	HM_LWIP_EV(chkerr),
+	HM_LWIP_EV(lenerr),
+	HM_LWIP_EV(memerr),
+	HM_LWIP_EV(rterr),
+	HM_LWIP_EV(proterr),
+	HM_LWIP_EV(opterr),
+	HM_LWIP_EV(err),
+};
+
+static int _hm_lwip_packets(struct http_req_metrics_state *m, unsigned int i,
+                            char *buf, size_t len)
+{
+	unsigned int p = i / ARRAY_SIZE(_hm_lwip_ev);
+	unsigned int e = i % ARRAY_SIZE(_hm_lwip_ev);
+
+	if (p >= ARRAY_SIZE(_hm_lwip_proto) - 1)
+		return 0;
+	return _hm_printf(buf, len, "_total{proto=\"%s\",event=\"%s\"} %"PRIu64"\n",
+	                  _hm_lwip_proto[p].name, _hm_lwip_ev[e].name,
+	                  (uint64_t) *((STAT_COUNTER *) ((uint8_t *) _hm_lwip_proto[p].s
+	                                                 + _hm_lwip_ev[e].off)));
+}
+
+#if MEMP_STATS
+static const char * const _hm_memp_names[] = {
+#define LWIP_MEMPOOL(name,num,size,desc) desc,
+#include <lwip/memp_std.h>
+};
+
+static int _hm_lwip_memp_used(struct http_req_metrics_state *m, unsigned int i,
+                              char *buf, size_t len)
+{
+	if (i >= MEMP_MAX)
+		return 0;
+	return _hm_printf(buf, len, "{pool=\"%s\"} %"PRIu64"\n",
+	                  _hm_memp_names[i], (uint64_t) lwip_stats.memp[i].used);
+}
+
+static int _hm_lwip_memp_err(struct http_req_metrics_state *m, unsigned int i,
+                             char *buf, size_t len)
+{
+	if (i >= MEMP_MAX)
+		return 0;
+	return _hm_printf(buf, len, "_total{pool=\"%s\"} %"PRIu64"\n",
+	                  _hm_memp_names[i], (uint64_t) lwip_stats.memp[i].err);
+}
+#endif /* MEMP_STATS */
+#endif /* LWIP_STATS */
+
+/* -------------------------------------------------------------------
+ * Per-object statistics
+ * ------------------------------------------------------------------- */
+#ifdef SHFS_STATS
+/*
+ * Objects are iterated over the volume's hash table (tbl = 0) followed by
+ * the table of missed objects (tbl = 1). Between two calls, only the hash
+ * of the last exported object is kept. Its table element is looked up
+ * again on the next call because the tables might have been changed in
+ * between (e.g., remount). If the object disappeared, the family ends early.
+ */
+static struct htable_el *_hm_obj_el(struct http_req_metrics_state *m,
+                                    unsigned int *tbl, int next)
+{
+	struct htable_el *el;
+
+	*tbl = m->tbl;
+	if (!shfs_mounted)
+		return NULL;
+
+	if (!m->cur_valid) {
+		el = shfs_vol.bt->head;
+	} else {
+		el = htable_lookup(*tbl ? shfs_vol.mstats.el_ht : shfs_vol.bt, m->cur);
+		if (!el)
+			return NULL;
+		if (next)
+			el = el->next;
+	}
+	if (!el && *tbl == 0) {
+		*tbl = 1;
+		el = shfs_vol.mstats.el_ht->head;
+	}
+	return el;
+}
+
+typedef int (_hm_obj_print_t)(char *buf, size_t len, const char *strhash,
+                              struct shfs_el_stats *stats, unsigned int s);
+
+/* exports nb_s samples per object */
+static int _hm_obj_sample(struct http_req_metrics_state *m, unsigned int i,
+                          char *buf, size_t len,
+                          unsigned int nb_s, _hm_obj_print_t *print)
+{
+	struct htable_el *el;
+	struct shfs_el_stats *stats;
+	char strhash[(sizeof(hash512_t) * 2) + 1];
+	unsigned int s = i % nb_s;
+	unsigned int tbl;
+	int ret;
+
+	el = _hm_obj_el(m, &tbl, (s == 0));
+	if (!el)
+		return 0;
+
+	if (tbl)
+		stats = (struct shfs_el_stats *) el->private;
+	else
+		stats = shfs_stats_from_bentry((struct shfs_bentry *) el->private);
+	hash_unparse(*el->h, shfs_vol.hlen, strhash);
+
+	ret = print(buf, len, strhash, stats, s);
+	if (ret > 0 && s == 0) {
+		/* advance cursor */
+		hash_copy(m->cur, *el->h, shfs_vol.hlen);
+		m->cur_valid = 1;
+		m->tbl = tbl;
+	}
+	return ret;
+}
+
+static int _hm_obj_print_hits(char *buf, size_t len, const char *strhash,
+                              struct shfs_el_stats *stats, unsigned int s)
+{
+	return _hm_printf(buf, len, "_total{hash=\"%s\"} %"PRIu32"\n",
+	                  strhash, stats->h);
+}
+
+static int _hm_obj_print_misses(char *buf, size_t len, const char *strhash,
+                                struct shfs_el_stats *stats, unsigned int s)
+{
+	return _hm_printf(buf, len, "_total{hash=\"%s\"} %"PRIu32"\n",
+	                  strhash, stats->m);
+}
+
+static int _hm_obj_print_laccess(char *buf, size_t len, const char *strhash,
+                                 struct shfs_el_stats *stats, unsigned int s)
+{
+	return _hm_printf(buf, len, "{hash=\"%s\"} %"PRIu32"\n",
+	                  strhash, stats->laccess);
+}
+
+static int _hm_obj_hits(struct http_req_metrics_state *m, unsigned int i,
+                        char *buf, size_t len)
+{
+	return _hm_obj_sample(m, i, buf, len, 1, _hm_obj_print_hits);
+}
+
+static int _hm_obj_misses(struct http_req_metrics_state *m, unsigned int i,
+                          char *buf, size_t len)
+{
+	return _hm_obj_sample(m, i, buf, len, 1, _hm_obj_print_misses);
+}
+
+static int _hm_obj_laccess(struct http_req_metrics_state *m, unsigned int i,
+                           char *buf, size_t len)
+{
+	return _hm_obj_sample(m, i, buf, len, 1, _hm_obj_print_laccess);
+}
+
+#ifdef SHFS_STATS_HTTP
+static int _hm_obj_print_completed(char *buf, size_t len, const char *strhash,
+                                   struct shfs_el_stats *stats, unsigned int s)
+{
+	return _hm_printf(buf, len, "_total{hash=\"%s\"} %"PRIu32"\n",
+	                  strhash, stats->c);
+}
+
+static int _hm_obj_completed(struct http_req_metrics_state *m, unsigned int i,
+                             char *buf, size_t len)
+{
+	return _hm_obj_sample(m, i, buf, len, 1, _hm_obj_print_completed);
+}
+
+#ifdef SHFS_STATS_HTTP_DPC
+static int _hm_obj_print_progress(char *buf, size_t len, const char *strhash,
+                                  struct shfs_el_stats *stats, unsigned int s)
+{
+	return _hm_printf(buf, len, "_total{hash=\"%s\",progress=\"%u\"} %"PRIu32"\n",
+	                  strhash, SHFS_STATS_HTTP_DPC_THRESHOLD_PERCENTAGE(s),
+	                  stats->p[s]);
+}
+
+static int _hm_obj_progress(struct http_req_metrics_state *m, unsigned int i,
+                            char *buf, size_t len)
+{
+	return _hm_obj_sample(m, i, buf, len, SHFS_STATS_HTTP_DPCR, _hm_obj_print_progress);
+}
+#endif /* SHFS_STATS_HTTP_DPC */
+#endif /* SHFS_STATS_HTTP */
+#endif /* SHFS_STATS */
+
+static const struct _hm_family _hm_families[] = {
+	{ "minicache_http_sessions", "gauge",
+	  "Open HTTP sessions", _hm_http_sess },
+	{ "minicache_http_sessions_max", "gauge",
+	  "Maximum number of HTTP sessions", _hm_http_sess_max },
+	{ "minicache_http_sessions_reaped", "counter",
+	  "Idle HTTP sessions closed to accept new ones", _hm_http_sess_reaped },
+	{ "minicache_http_requests_shed", "counter",
+	  "HTTP requests answered with 503 by admission control", _hm_http_shed },
+	{ "minicache_http_ioretry_delay_milliseconds", "gauge",
+	  "Average time sessions wait for cache buffers", _hm_http_qdelay },
+	{ "minicache_http_requests", "gauge",
+	  "HTTP requests in progress", _hm_http_reqs },
+	{ "minicache_http_requests_max", "gauge",
+	  "Maximum number of HTTP requests in progress", _hm_http_reqs_max },
+	{ "minicache_http_links", "gauge",
+	  "Open connections to origin servers", _hm_http_links },
+	{ "minicache_http_links_max", "gauge",
+	  "Maximum number of connections to origin servers", _hm_http_links_max },
+	{ "minicache_mempool_objects", "gauge",
+	  "Objects of a memory pool", _hm_pool_objs },
+	{ "minicache_mempool_free_objects", "gauge",
+	  "Free objects of a memory pool", _hm_pool_free },
+	{ "minicache_cache_buffers", "gauge",
+	  "Chunk buffers of the SHFS cache", _hm_cache_buffers },
+#ifdef SHFS_CACHE_STATS
+	{ "minicache_cache_events", "counter",
+	  "SHFS cache events", _hm_cache_events },
+#endif
+#ifdef LATENCY_HIST
+	{ "minicache_latency_seconds", "summary",
+	  "Latencies of HTTP requests and chunk I/O", _hm_latency },
+#endif
+#if LWIP_STATS
+	{ "minicache_lwip_packets", "counter",
+	  "lwIP protocol events", _hm_lwip_packets },
+#if MEMP_STATS
+	{ "minicache_lwip_memp_used", "gauge",
+	  "Used elements of an lwIP memory pool", _hm_lwip_memp_used },
+	{ "minicache_lwip_memp_errors", "counter",
+	  "Allocation errors of an lwIP memory pool", _hm_lwip_memp_err },
+#endif
+#endif
+#ifdef SHFS_STATS
+	{ "minicache_object_hits", "counter",
+	  "Cache hits of an object", _hm_obj_hits },
+	{ "minicache_object_misses", "counter",
+	  "Cache misses of an object", _hm_obj_misses },
+	{ "minicache_object_last_access_seconds", "gauge",
+	  "Timestamp of the last access of an object", _hm_obj_laccess },
+#ifdef SHFS_STATS_HTTP
+	{ "minicache_object_downloads", "counter",
+	  "Completed HTTP transfers of an object", _hm_obj_completed },
+#ifdef SHFS_STATS_HTTP_DPC
+	{ "minicache_object_progress", "counter",
+	  "HTTP transfers of an object that reached a progress", _hm_obj_progress },
+#endif
+#endif
+#endif
+};
+
+#define HM_NB_FAMILIES ARRAY_SIZE(_hm_families)
+
+size_t httpreq_metrics_generate(struct http_req *hreq)
+{
+	struct http_req_metrics_state *m = hreq->m;
+	const struct _hm_family *f;
+	char *buf = m->lbuf;
+	size_t left = sizeof(m->lbuf);
+	int nlen;
+	int ret;
+
+	while (m->fam < HM_NB_FAMILIES) {
+		f = &_hm_families[m->fam];
+
+		if (m->smpl == 0) {
+			/* family descriptor */
+			ret = _hm_printf(buf, left, "# TYPE %s %s\n# HELP %s %s\n",
+			                 f->name, f->type, f->name, f->help);
+		} else {
+			nlen = _hm_printf(buf, left, "%s", f->name);
+			if (nlen < 0)
+				break;
+			ret = f->sample(m, m->smpl - 1, buf + nlen, left - nlen);
+			if (ret == 0) {
+				/* switch to next family */
+				++m->fam;
+				m->smpl = 0;
+				m->tbl = 0;
+				m->cur_valid = 0;
+				continue;
+			}
+			if (ret > 0)
+				ret += nlen;
+		}
+		if (ret < 0)
+			break; /* buffer is full */
+
+		buf += ret;
+		left -= ret;
+		++m->smpl;
+	}
+
+	if (m->fam == HM_NB_FAMILIES) {
+		ret = _hm_printf(buf, left, "# EOF\n");
+		if (ret > 0) {
+			buf += ret;
+			left -= ret;
+			++m->fam;
+		}
+	}
+
+	return sizeof(m->lbuf) - left;
+}
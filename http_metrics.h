@@ -0,0 +1,104 @@
+/*
+ * Fast HTTP Server Implementation for SHFS volumes
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#ifndef _HTTP_METRICS_H_
+#define _HTTP_METRICS_H_
+
+#include "http_defs.h"
+
+/*
+ * Statistics are exposed in OpenMetrics text format. The body is generated
+ * incrementally: whenever the line buffer of the request was sent out,
+ * httpreq_metrics_generate() fills it with the next lines. Only
+ * complete lines are generated so that no state is lost in between.
+ * The response is terminated by closing the connection.
+ */
+size_t httpreq_metrics_generate(struct http_req *hreq);
+
+static inline int httpreq_metrics_open(struct http_req *hreq)
+{
+	struct mempool_obj *mobj;
+
+	mobj = mempool_pick(hs->metrics_pool);
+	if (unlikely(!mobj))
+		return -ENOMEM;
+	hreq->m = (struct http_req_metrics_state *) mobj->data;
+	hreq->m->pobj = mobj;
+	hreq->m->fam = 0;
+	hreq->m->smpl = 0;
+	hreq->m->tbl = 0;
+	hreq->m->cur_valid = 0;
+	hreq->m->done = 0;
+	hreq->m->lpos = 0;
+	hreq->m->llen = 0;
+	return 0;
+}
+
+static inline void httpreq_metrics_close(struct http_req *hreq)
+{
+	mempool_put(hreq->m->pobj);
+	hreq->m = NULL;
+}
+
+static inline err_t httpreq_write_metrics(struct http_req *hreq, size_t *sent)
+{
+	struct http_req_metrics_state *m = hreq->m;
+	size_t slen;
+	err_t err = ERR_OK;
+
+	for (;;) {
+		if (m->lpos == m->llen) {
+			/* buffer was sent out: generate next lines */
+			m->lpos = 0;
+			m->llen = httpreq_metrics_generate(hreq);
+			if (!m->llen) {
+				m->done = 1;
+				break;
+			}
+		}
+
+		slen = m->llen - m->lpos;
+		err = httpsess_write(hreq->hsess, &m->lbuf[m->lpos], &slen,
+		                     TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE);
+		m->lpos += slen;
+		*sent += slen;
+		if (m->lpos < m->llen)
+			break; /* send buffer is full: continue when data got acknowledged */
+	}
+	return err;
+}
+
+#endif /* _HTTP_METRICS_H_ */
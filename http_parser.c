@@ -452,6 +452,182 @@ do {                                                                 \
 #endif
 
 
+/* Fast path: runs of plain URL, header name and header value characters
+ * are skipped at once instead of feeding them byte by byte through the
+ * state machine. On x86_64, SSE4.2 (pcmpestri) and AVX2 are used when the
+ * CPU supports them (detected at runtime). Bytes that a fast scan stops at
+ * are handed over to the regular parser, so unusual input takes the
+ * scalar path.
+ */
+#if defined __x86_64__ && defined __GNUC__ && !defined HTTP_PARSER_NO_SIMD
+# define HTTP_PARSER_SIMD
+# include <cpuid.h>
+# include <immintrin.h>
+#endif
+
+enum fastpath_level
+  { FAST_NONE = 0
+  , FAST_SCALAR
+  , FAST_SSE42
+  , FAST_AVX2
+  };
+
+static int fastpath_hw = -1; /* best available level, -1: not detected yet */
+static int fastpath = -1; /* level in use */
+
+#ifdef HTTP_PARSER_SIMD
+/* Stop sets for pcmpestri as (low, high) byte ranges */
+static const char url_path_stop[16] =
+  { 0x00, 0x20, '#', '#', '?', '?', 0x7f, (char) 0xff };
+#define URL_PATH_STOP_LEN 8
+static const char url_query_stop[16] =
+  { 0x00, 0x20, '#', '#', 0x7f, (char) 0xff };
+#define URL_QUERY_STOP_LEN 6
+/* everything except [-0-9A-Za-z] */
+static const char token_stop[16] =
+  { 0x00, 0x2c, 0x2e, 0x2f, 0x3a, 0x40, 0x5b, 0x60, 0x7b, (char) 0xff };
+#define TOKEN_STOP_LEN 10
+
+static int fastpath_detect(void)
+{
+  unsigned int eax, ebx, ecx, edx;
+  uint32_t xcr0_lo, xcr0_hi;
+
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_2))
+    return FAST_SCALAR;
+
+  /* AVX2 also requires that the OS saves the YMM registers */
+  if (!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX))
+    return FAST_SSE42;
+  __asm__ __volatile__ ("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+  if ((xcr0_lo & 0x6) != 0x6 || __get_cpuid_max(0, NULL) < 7)
+    return FAST_SSE42;
+  __cpuid_count(7, 0, eax, ebx, ecx, edx);
+  return (ebx & bit_AVX2) ? FAST_AVX2 : FAST_SSE42;
+}
+
+/* Returns the first byte that falls into one of the ranges. Less than 16
+ * remaining bytes are left to the caller. */
+__attribute__((target("sse4.2")))
+static const char *scan_ranges_sse42(const char *p, const char *end,
+                                     const char *ranges, int ranges_len)
+{
+  __m128i r = _mm_loadu_si128((const __m128i *) ranges);
+  __m128i v;
+  int i;
+
+  for (; end - p >= 16; p += 16) {
+    v = _mm_loadu_si128((const __m128i *) p);
+    i = _mm_cmpestri(r, ranges_len, v, 16,
+                     _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+    if (i != 16)
+      return p + i;
+  }
+  return p;
+}
+
+__attribute__((target("avx2")))
+static const char *scan_crlf_avx2(const char *p, const char *end)
+{
+  const __m256i cr = _mm256_set1_epi8(CR);
+  const __m256i lf = _mm256_set1_epi8(LF);
+  __m256i v;
+  uint32_t m;
+
+  for (; end - p >= 32; p += 32) {
+    v = _mm256_loadu_si256((const __m256i *) p);
+    m = (uint32_t) _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, cr),
+                                                        _mm256_cmpeq_epi8(v, lf)));
+    if (m)
+      return p + __builtin_ctz(m);
+  }
+  return p;
+}
+
+/* SSE2 is always available on x86_64 */
+static const char *scan_crlf_sse2(const char *p, const char *end)
+{
+  const __m128i cr = _mm_set1_epi8(CR);
+  const __m128i lf = _mm_set1_epi8(LF);
+  __m128i v;
+  uint32_t m;
+
+  for (; end - p >= 16; p += 16) {
+    v = _mm_loadu_si128((const __m128i *) p);
+    m = (uint32_t) _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, cr),
+                                                  _mm_cmpeq_epi8(v, lf)));
+    if (m)
+      return p + __builtin_ctz(m);
+  }
+  return p;
+}
+#else
+static int fastpath_detect(void)
+{
+  return FAST_SCALAR;
+}
+#endif
+
+/* Skips characters that keep the parser in s_req_path or
+ * s_req_query_string */
+static const char *scan_url(const char *p, const char *end, enum state s)
+{
+  if (s == s_req_path) {
+#ifdef HTTP_PARSER_SIMD
+    if (fastpath >= FAST_SSE42)
+      p = scan_ranges_sse42(p, end, url_path_stop, URL_PATH_STOP_LEN);
+#endif
+    while (p != end && IS_URL_CHAR(*p))
+      ++p;
+  } else {
+#ifdef HTTP_PARSER_SIMD
+    if (fastpath >= FAST_SSE42)
+      p = scan_ranges_sse42(p, end, url_query_stop, URL_QUERY_STOP_LEN);
+#endif
+    while (p != end && (IS_URL_CHAR(*p) || *p == '?'))
+      ++p;
+  }
+  return p;
+}
+
+/* Skips the common header name characters */
+static const char *scan_token(const char *p, const char *end)
+{
+#ifdef HTTP_PARSER_SIMD
+  if (fastpath >= FAST_SSE42)
+    p = scan_ranges_sse42(p, end, token_stop, TOKEN_STOP_LEN);
+#endif
+  while (p != end && (IS_ALPHANUM(*p) || *p == '-'))
+    ++p;
+  return p;
+}
+
+/* Returns the first CR or LF, end if there is none */
+static const char *scan_crlf(const char *p, const char *end)
+{
+#ifdef HTTP_PARSER_SIMD
+  if (fastpath >= FAST_AVX2)
+    p = scan_crlf_avx2(p, end);
+  p = scan_crlf_sse2(p, end);
+#endif
+  while (p != end && *p != CR && *p != LF)
+    ++p;
+  return p;
+}
+
+int
+http_parser_set_fastpath(int enable)
+{
+  int prev;
+
+  if (UNLIKELY(fastpath_hw < 0))
+    fastpath_hw = fastpath_detect();
+  prev = (fastpath < 0) || (fastpath > FAST_NONE);
+  fastpath = enable ? fastpath_hw : FAST_NONE;
+  return prev;
+}
+
+
 /* Map errno values to strings for human-readable output */
 #define HTTP_STRERROR_GEN(n, s) { "HPE_" #n, s },
 static struct {
@@ -978,6 +1154,14 @@ reexecute:
         }
         UPDATE_STATE(s_req_method);
 
+        /* fast path: "GET " */
+        if (fastpath > FAST_NONE && ch == 'G' && data + len - p >= 4 &&
+            p[1] == 'E' && p[2] == 'T' && p[3] == ' ') {
+          UPDATE_STATE(s_req_spaces_before_url);
+          COUNT_HEADER_SIZE(3);
+          p += 3;
+        }
+
         CALLBACK_NOTIFY(message_begin);
 
         break;
@@ -1137,6 +1321,16 @@ reexecute:
               SET_ERRNO(HPE_INVALID_URL);
               goto error;
             }
+
+            /* fast path: skip the following plain characters */
+            if (fastpath > FAST_NONE &&
+                (CURRENT_STATE() == s_req_path ||
+                 CURRENT_STATE() == s_req_query_string)) {
+              const char *q = scan_url(p + 1, data + len, CURRENT_STATE());
+
+              COUNT_HEADER_SIZE(q - (p + 1));
+              p = q - 1;
+            }
         }
         break;
       }
@@ -1144,6 +1338,17 @@ reexecute:
       case s_req_http_start:
         switch (ch) {
           case 'H':
+            /* fast path: "HTTP/1.1\r\n" and "HTTP/1.0\r\n" */
+            if (fastpath > FAST_NONE && data + len - p >= 10 &&
+                memcmp(p, "HTTP/1.", 7) == 0 &&
+                (p[7] == '1' || p[7] == '0') && p[8] == CR && p[9] == LF) {
+              parser->http_major = 1;
+              parser->http_minor = p[7] - '0';
+              UPDATE_STATE(s_header_field_start);
+              COUNT_HEADER_SIZE(9);
+              p += 9;
+              break;
+            }
             UPDATE_STATE(s_req_http_H);
             break;
           case ' ':
@@ -1317,6 +1522,11 @@ reexecute:
       {
         const char* start = p;
         for (; p != data + len; p++) {
+          if (fastpath > FAST_NONE && parser->header_state == h_general) {
+            p = scan_token(p, data + len);
+            if (p == data + len)
+              break;
+          }
           ch = *p;
           c = TOKEN(ch);
 
@@ -1547,6 +1757,13 @@ reexecute:
 
               limit = MIN(limit, HTTP_MAX_HEADER_SIZE);
 
+              if (fastpath > FAST_NONE) {
+                p_cr = scan_crlf(p, p + limit);
+                p = (p_cr == p + limit) ? data + len : p_cr;
+                --p;
+                break;
+              }
+
               p_cr = (const char*) memchr(p, CR, limit);
               p_lf = (const char*) memchr(p, LF, limit);
               if (p_cr != NULL) {
@@ -2143,6 +2360,9 @@ http_parser_init (http_parser *parser, enum http_parser_type t)
   parser->type = t;
   parser->state = (t == HTTP_REQUEST ? s_start_req : (t == HTTP_RESPONSE ? s_start_res : s_start_req_or_res));
   parser->http_errno = HPE_OK;
+
+  if (UNLIKELY(fastpath < 0))
+    http_parser_set_fastpath(1);
 }
 
 void
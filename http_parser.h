@@ -330,6 +330,11 @@ int http_parser_parse_url(const char *buf, size_t buflen,
                           int is_connect,
                           struct http_parser_url *u);
 
+/* Enable or disable the fast path for common requests (enabled by
+ * default; vectorized if supported by the CPU). Returns the previous
+ * setting. */
+int http_parser_set_fastpath(int enable);
+
 /* Pause or un-pause the parser; a nonzero value pauses */
 void http_parser_pause(http_parser *parser, int paused);
 
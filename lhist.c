@@ -0,0 +1,156 @@
+/*
+ * Log-bucketed latency histograms
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <target/sys.h>
+#include <errno.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "lhist.h"
+
+#ifndef min
+#define min(a, b) \
+    ({ __typeof__ (a) __a = (a); \
+       __typeof__ (b) __b = (b); \
+       __a < __b ? __a : __b; })
+#endif
+
+#define LHIST_CALIB_NS 10000000 /* 10 ms */
+
+uint64_t lhist_tpms = 0;
+struct dlist_head lhist_reg;
+
+int init_lhist(void)
+{
+	uint64_t t0, t1;
+	uint64_t n0, n1;
+
+	dlist_init_head(lhist_reg);
+
+	/* calibrate counter against system clock */
+	n0 = target_now_ns();
+	t0 = lhist_ticks();
+	do {
+		n1 = target_now_ns();
+	} while (n1 - n0 < LHIST_CALIB_NS);
+	t1 = lhist_ticks();
+
+	lhist_tpms = ((t1 - t0) * 1000000) / (n1 - n0);
+	if (!lhist_tpms)
+		return -EINVAL;
+	return 0;
+}
+
+void exit_lhist(void)
+{
+	struct lhist *h;
+
+	while ((h = dlist_first_el(lhist_reg, struct lhist)))
+		dlist_unlink(h, lhist_reg, reg_list);
+}
+
+void lhist_reset(struct lhist *h)
+{
+	h->count = 0;
+	h->sum = 0;
+	h->min = UINT64_MAX;
+	h->max = 0;
+	memset(h->bucket, 0, sizeof(h->bucket));
+}
+
+uint64_t lhist_quantile(const struct lhist *h, uint32_t q_ppm)
+{
+	register unsigned int i;
+	uint64_t rank;
+	uint64_t c = 0;
+
+	if (!h->count)
+		return 0;
+
+	/* rank of the requested value (1..count) */
+	rank = (h->count * q_ppm + 999999) / 1000000;
+	if (rank == 0)
+		rank = 1;
+
+	for (i = 0; i < LHIST_NB_BUCKETS; ++i) {
+		c += h->bucket[i];
+		if (c >= rank)
+			return min(_lhist_bucket_hi(i), h->max);
+	}
+	return h->max;
+}
+
+void lhist_register(struct lhist *h, const char *name)
+{
+	strncpy(h->name, name, sizeof(h->name) - 1);
+	h->name[sizeof(h->name) - 1] = '\0';
+	dlist_append(h, lhist_reg, reg_list);
+}
+
+void lhist_unregister(struct lhist *h)
+{
+	dlist_unlink(h, lhist_reg, reg_list);
+}
+
+void lhist_print_hdr(FILE *cio)
+{
+	fprintf(cio, "%-16s %12s %10s %10s %10s %10s %10s %10s %10s\n",
+	        "", "count", "min", "avg", "p50", "p90", "p99", "p99.9", "max");
+}
+
+#define _lhist_print_us(cio, ticks)					\
+	do {								\
+		uint64_t __ns = lhist_ticks_to_ns((ticks));		\
+		fprintf((cio), " %6"PRIu64".%03"PRIu64,		\
+		        __ns / 1000, __ns % 1000);			\
+	} while (0)
+
+void lhist_print(FILE *cio, const struct lhist *h)
+{
+	fprintf(cio, "%-16s %12"PRIu64, h->name, h->count);
+	if (!h->count) {
+		fprintf(cio, "\n");
+		return;
+	}
+	_lhist_print_us(cio, h->min);
+	_lhist_print_us(cio, h->sum / h->count);
+	_lhist_print_us(cio, lhist_quantile(h, 500000));
+	_lhist_print_us(cio, lhist_quantile(h, 900000));
+	_lhist_print_us(cio, lhist_quantile(h, 990000));
+	_lhist_print_us(cio, lhist_quantile(h, 999000));
+	_lhist_print_us(cio, h->max);
+	fprintf(cio, "\n");
+}
@@ -0,0 +1,179 @@
+/*
+ * Log-bucketed latency histograms
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+#ifndef _LHIST_H_
+#define _LHIST_H_
+
+#include <target/sys.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "dlist.h"
+#include "likely.h"
+
+/*
+ * HDR-style histogram: values (ticks) are sorted into power-of-two groups
+ * that are linearly split into LHIST_SUB_COUNT sub-buckets each. This bounds
+ * the relative error of a reported value to 1/LHIST_SUB_COUNT (~6%).
+ * Values below LHIST_SUB_COUNT are counted exactly, values of
+ * LHIST_MAX_BITS bits or more end up in the last bucket.
+ *
+ * Values are taken from the CPU timestamp counter (TSC on x86, the virtual
+ * counter on ARMv8) and are only converted to time when they are read out.
+ * Since each event loop (core) records to its own histograms, no locking
+ * nor atomic operations are used. Note: The counter has to be invariant.
+ */
+#define LHIST_SUB_BITS 4
+#define LHIST_SUB_COUNT (1 << LHIST_SUB_BITS)
+#define LHIST_SUB_MASK (LHIST_SUB_COUNT - 1)
+#define LHIST_MAX_BITS 44 /* ~1.6h on 3 GHz */
+#define LHIST_NB_BUCKETS ((LHIST_MAX_BITS - LHIST_SUB_BITS + 1) << LHIST_SUB_BITS)
+
+#define LHIST_NAME_MAXLEN 16
+
+struct lhist {
+	uint64_t count;
+	uint64_t sum; /* ticks */
+	uint64_t min; /* ticks */
+	uint64_t max; /* ticks */
+	uint32_t bucket[LHIST_NB_BUCKETS];
+
+	char name[LHIST_NAME_MAXLEN];
+	dlist_el(reg_list);
+};
+
+extern uint64_t lhist_tpms; /* ticks per ms, calibrated by init_lhist() */
+
+int  init_lhist(void);
+void exit_lhist(void);
+
+static inline uint64_t lhist_ticks(void)
+{
+#if defined __x86_64__ || defined __i386__
+	uint32_t lo, hi;
+
+	__asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((uint64_t) hi << 32) | lo;
+#elif defined __aarch64__
+	uint64_t t;
+
+	__asm__ __volatile__ ("mrs %0, cntvct_el0" : "=r" (t));
+	return t;
+#else
+	return target_now_ns();
+#endif
+}
+
+static inline uint64_t lhist_ticks_to_ns(uint64_t t)
+{
+	if (unlikely(!lhist_tpms))
+		return 0;
+	return (t / lhist_tpms) * 1000000
+		+ ((t % lhist_tpms) * 1000000) / lhist_tpms;
+}
+
+static inline unsigned int _lhist_idx(uint64_t v)
+{
+	register unsigned int e;
+
+	if (v < LHIST_SUB_COUNT)
+		return (unsigned int) v;
+	e = 63 - __builtin_clzll(v); /* position of MSB */
+	if (unlikely(e >= LHIST_MAX_BITS))
+		return LHIST_NB_BUCKETS - 1;
+	return ((e - LHIST_SUB_BITS + 1) << LHIST_SUB_BITS)
+		| (unsigned int) ((v >> (e - LHIST_SUB_BITS)) & LHIST_SUB_MASK);
+}
+
+/* smallest value (ticks) that is counted by bucket idx */
+static inline uint64_t _lhist_bucket_lo(unsigned int idx)
+{
+	register unsigned int g = idx >> LHIST_SUB_BITS;
+
+	if (g == 0)
+		return idx;
+	return (uint64_t) (LHIST_SUB_COUNT + (idx & LHIST_SUB_MASK)) << (g - 1);
+}
+
+/* biggest value (ticks) that is counted by bucket idx */
+static inline uint64_t _lhist_bucket_hi(unsigned int idx)
+{
+	register unsigned int g = idx >> LHIST_SUB_BITS;
+
+	if (g == 0)
+		return idx;
+	return _lhist_bucket_lo(idx) + (1ull << (g - 1)) - 1;
+}
+
+static inline void lhist_add(struct lhist *h, uint64_t ticks)
+{
+	++h->count;
+	h->sum += ticks;
+	if (ticks < h->min)
+		h->min = ticks;
+	if (ticks > h->max)
+		h->max = ticks;
+	++h->bucket[_lhist_idx(ticks)];
+}
+
+/* adds the time that passed since ts (from lhist_ticks()) */
+#define lhist_add_since(h, ts) \
+	lhist_add((h), lhist_ticks() - (ts))
+
+void lhist_reset(struct lhist *h);
+
+/*
+ * Returns the value (in ticks) below or equal to which the fraction
+ * q_ppm (parts per million) of the recorded values fall,
+ * e.g., q_ppm = 999000 for the 99.9th percentile
+ */
+uint64_t lhist_quantile(const struct lhist *h, uint32_t q_ppm);
+
+/*
+ * Registry of histograms that are printed/exported by the
+ * shell commands. The name is copied to the histogram
+ */
+void lhist_register(struct lhist *h, const char *name);
+void lhist_unregister(struct lhist *h);
+
+extern struct dlist_head lhist_reg;
+#define foreach_lhist(h) \
+	dlist_foreach((h), lhist_reg, reg_list)
+
+/* prints a summary line of h in us (see lhist_print_hdr() for the columns) */
+void lhist_print_hdr(FILE *cio);
+void lhist_print(FILE *cio, const struct lhist *h);
+
+#endif /* _LHIST_H_ */
@@ -52,6 +52,12 @@
        __typeof__ (b) __b = (b); \
        __a > __b ? __a : __b; })
 #endif
+#ifndef min
+#define min(a, b) \
+    ({ __typeof__ (a) __a = (a); \
+       __typeof__ (b) __b = (b); \
+       __a < __b ? __a : __b; })
+#endif
 #ifndef POWER_OF_2
   #define POWER_OF_2(x)   ((0 != x) && (0 == (x & (x-1))))
 #endif
@@ -274,3 +280,123 @@ void free_mempool(struct mempool *p)
 	target_free(p);
   }
 }
+
+/*
+ * Growable memory pool
+ */
+static void _mempool_slabs_put(struct mempool_obj *obj, void *argp)
+{
+  struct mempool_slabs *s = argp;
+
+  s->nb_free_objs++;
+}
+
+struct mempool_slabs *alloc_mempool_slabs(uint32_t max_nb_objs, uint32_t slab_nb_objs, size_t obj_size)
+{
+  struct mempool_slabs *s;
+
+  ASSERT(slab_nb_objs > 0);
+
+  s = target_malloc(MIN_ALIGN, sizeof(*s));
+  if (!s) {
+	errno = ENOMEM;
+	goto error;
+  }
+  s->slab_nb_objs = min(slab_nb_objs, max_nb_objs);
+  s->max_nb_objs  = max_nb_objs;
+  s->max_nb_slabs = (max_nb_objs + s->slab_nb_objs - 1) / s->slab_nb_objs;
+  s->nb_slabs     = 0;
+  s->cur          = 0;
+  s->nb_objs      = 0;
+  s->nb_free_objs = 0;
+  s->obj_size     = obj_size;
+  s->pool_size    = 0;
+
+  s->slab = target_malloc(MIN_ALIGN, s->max_nb_slabs * sizeof(struct mempool *));
+  if (!s->slab) {
+	errno = ENOMEM;
+	goto error_free_s;
+  }
+
+  /* first slab is always kept */
+  if (mempool_slabs_grow(s) < 0)
+	goto error_free_slab;
+
+  printd("growable pool @ %p: %"PRIu32" objects in slabs of %"PRIu32" objects at most\n",
+	 s, s->max_nb_objs, s->slab_nb_objs);
+  return s;
+
+ error_free_slab:
+  target_free(s->slab);
+ error_free_s:
+  target_free(s);
+ error:
+  return NULL;
+}
+
+void free_mempool_slabs(struct mempool_slabs *s)
+{
+  uint32_t i;
+
+  if (s) {
+	for (i = 0; i < s->nb_slabs; ++i)
+	  free_mempool(s->slab[i]);
+	target_free(s->slab);
+	target_free(s);
+  }
+}
+
+int mempool_slabs_grow(struct mempool_slabs *s)
+{
+  struct mempool *p;
+
+  if (s->nb_objs == s->max_nb_objs) {
+	errno = ENOSPC;
+	return -1;
+  }
+  BUG_ON(s->nb_slabs == s->max_nb_slabs);
+
+  /* the last slab might be smaller because of the budget */
+  p = alloc_enhanced_mempool(min(s->slab_nb_objs, s->max_nb_objs - s->nb_objs), s->obj_size, 0, 0, 0, 0, 0,
+			     NULL, NULL, NULL, NULL, _mempool_slabs_put, s);
+  if (!p)
+	return -1;
+
+  s->cur = s->nb_slabs;
+  s->slab[s->nb_slabs++] = p;
+  s->nb_objs      += p->nb_objs;
+  s->nb_free_objs += p->nb_free_objs;
+  s->pool_size    += p->pool_size;
+  printd("pool %p: added slab %"PRIu32" @ %p (%"PRIu32"/%"PRIu32" objects free)\n",
+	 s, s->cur, p, s->nb_free_objs, s->nb_objs);
+  return 0;
+}
+
+uint32_t mempool_slabs_shrink(struct mempool_slabs *s, uint32_t min_nb_free_objs)
+{
+  struct mempool *p;
+  uint32_t i;
+  uint32_t ret = 0;
+
+  for (i = s->nb_slabs - 1; i > 0; --i) {
+	p = s->slab[i];
+	if (p->nb_free_objs != p->nb_objs)
+	  continue; /* slab is in use */
+	if (s->nb_free_objs - p->nb_objs < min_nb_free_objs)
+	  break;
+
+	s->nb_objs      -= p->nb_objs;
+	s->nb_free_objs -= p->nb_objs;
+	s->pool_size    -= p->pool_size;
+	s->slab[i] = s->slab[--s->nb_slabs];
+	free_mempool(p);
+	++ret;
+  }
+
+  if (ret) {
+	s->cur = 0;
+	printd("pool %p: released %"PRIu32" slabs (%"PRIu32"/%"PRIu32" objects free)\n",
+	       s, ret, s->nb_free_objs, s->nb_objs);
+  }
+  return ret;
+}
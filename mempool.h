@@ -315,6 +315,67 @@ static inline int mempool_obj_append(struct mempool_obj *obj, ssize_t len)
   return 0;
 }
 
+/*
+ * GROWABLE MEMORY POOL
+ *
+ * Objects are allocated in slabs of slab_nb_objs objects each. A slab is
+ * a simple memory pool. A new slab is added when all slabs are exhausted
+ * and the budget of max_nb_objs objects is not reached yet. Picked objects
+ * are put back with mempool_put() as usual. Slabs that became completely
+ * unused are released again with mempool_slabs_shrink() (except the first
+ * one).
+ */
+struct mempool_slabs {
+  struct mempool **slab;
+  uint32_t nb_slabs;
+  uint32_t max_nb_slabs;
+  uint32_t cur;          /* slab that objects are picked from */
+  uint32_t slab_nb_objs;
+  uint32_t max_nb_objs;  /* budget */
+  uint32_t nb_objs;      /* of all slabs */
+  uint32_t nb_free_objs; /* of all slabs */
+  size_t obj_size;
+  size_t pool_size;      /* of all slabs */
+};
+
+struct mempool_slabs *alloc_mempool_slabs(uint32_t max_nb_objs, uint32_t slab_nb_objs, size_t obj_size);
+void free_mempool_slabs(struct mempool_slabs *s);
+/* Returns 0 on success, -1 on failure (budget reached or out of memory) */
+int mempool_slabs_grow(struct mempool_slabs *s);
+/* Releases unused slabs as long as min_nb_free_objs objects are left free
+ * Returns the number of released slabs */
+uint32_t mempool_slabs_shrink(struct mempool_slabs *s, uint32_t min_nb_free_objs);
+
+/*
+ * Pick an object from a growable memory pool
+ * Returns NULL on failure
+ */
+static inline struct mempool_obj *mempool_slabs_pick(struct mempool_slabs *s)
+{
+  uint32_t i;
+
+  if (unlikely(s->slab[s->cur]->nb_free_objs == 0)) {
+	if (s->nb_free_objs) {
+	  for (i = 0; s->slab[i]->nb_free_objs == 0; ++i);
+	  s->cur = i;
+	} else if (mempool_slabs_grow(s) < 0) {
+	  return NULL;
+	}
+  }
+  s->nb_free_objs--;
+  return mempool_pick(s->slab[s->cur]);
+}
+
+#define mempool_slabs_free_count(s) ((s)->nb_free_objs)
+
+#define mempool_slabs_nb_objs(s) ((s)->nb_objs)
+
+#define mempool_slabs_size(s) ((s)->pool_size)
+
+/* true if an object can be picked without exceeding the budget */
+#define mempool_slabs_can_pick(s) \
+  ((s)->nb_free_objs || (s)->nb_objs < (s)->max_nb_objs)
+
 /*
  * NOTE:
  * Using the famous container_of() macro does not work with structs
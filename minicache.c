@@ -62,6 +62,10 @@
 #include "likely.h"
 #include "mempool.h"
 #include "http.h"
+#include "twheel.h"
+#ifdef LATENCY_HIST
+#include "lhist.h"
+#endif
 #ifdef HAVE_SHELL
 #include "shell.h"
 #include "shell_extras.h"
@@ -77,9 +81,26 @@
 #ifdef TESTSUITE
 #include "testsuite.h"
 #endif
+#ifdef HTTP_BENCH
+#include "http_bench.h"
+#if !defined CAN_LOOPBACK_NETDEV || !defined CONFIG_LWIP_IPDEV
+#error "HTTP_BENCH requires a loopback network device (e.g., CONFIG_NULLIF)"
+#endif
+#endif
 
 #include "debug.h"
 
+/* epoll-based main loop (linux): event sources are registered once,
+ * only those that became ready are handled in an iteration */
+#if defined CONFIG_EPOLL && defined CAN_POLL_NETDEV && defined CAN_NOTIFY_BLKDEV
+#include <sys/epoll.h>
+#define MAINLOOP_EPOLL
+#define MAINLOOP_MAXEVENTS 4
+/* event sources (epoll_event.data.u32) */
+#define MAINLOOP_SRC_NETIF  0x1
+#define MAINLOOP_SRC_BLKDEV 0x2
+#endif
+
 /* r = a - b on struct timeval */
 #define TV_SUB(r, a, b)							\
 	do {									\
@@ -124,6 +145,56 @@ extern uint64_t shfs_tt_vbdopen;
 #define TT_END(var) while(0) {}
 #endif /* TRACE_BOOTTIME */
 
+#ifdef CONFIG_LWIP_NOTHREADS
+/* lwIP timers are driven by the timer wheel */
+struct lwip_tmr {
+    struct twheel_timer timer;
+    uint32_t interval; /* ms */
+    void (*func)(void);
+    int dhcp; /* only needed when DHCP is used */
+};
+
+static struct lwip_tmr lwip_tmrs[] = {
+    { .interval = ARP_TMR_INTERVAL,        .func = etharp_tmr,       .dhcp = 0 },
+    { .interval = IP_TMR_INTERVAL,         .func = ip_reass_tmr,     .dhcp = 0 },
+    { .interval = TCP_TMR_INTERVAL,        .func = tcp_tmr,          .dhcp = 0 },
+#if LWIP_DNS
+    { .interval = DNS_TMR_INTERVAL,        .func = dns_tmr,          .dhcp = 0 },
+#endif
+    { .interval = DHCP_FINE_TIMER_MSECS,   .func = dhcp_fine_tmr,    .dhcp = 1 },
+    { .interval = DHCP_COARSE_TIMER_MSECS, .func = dhcp_coarse_tmr,  .dhcp = 1 },
+};
+
+#define NB_LWIP_TMRS (sizeof(lwip_tmrs) / sizeof(lwip_tmrs[0]))
+
+static void lwip_tmr_expired(struct twheel_timer *t, void *argp)
+{
+    struct lwip_tmr *lt = argp;
+
+    lt->func();
+}
+
+static inline void lwip_tmrs_arm(int dhcp)
+{
+    unsigned int i;
+
+    for (i = 0; i < NB_LWIP_TMRS; ++i) {
+	twheel_timer_init(&lwip_tmrs[i].timer, lwip_tmr_expired, &lwip_tmrs[i]);
+	if (lwip_tmrs[i].dhcp && !dhcp)
+	    continue;
+	twheel_arm_periodic(&lwip_tmrs[i].timer, lwip_tmrs[i].interval);
+    }
+}
+
+static inline void lwip_tmrs_cancel(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < NB_LWIP_TMRS; ++i)
+	twheel_cancel(&lwip_tmrs[i].timer);
+}
+#endif /* CONFIG_LWIP_NOTHREADS */
+
 #ifdef CONFIG_MINDER_PRINT
 #define MINDER_INTERVAL 500
 static inline void minder_print(void)
@@ -281,6 +352,12 @@ struct mcargs {
 
     unsigned int    startup_delay;
 
+#ifdef HTTP_BENCH
+    unsigned int    bench_nb_sess; /* 0: no benchmark */
+    unsigned int    bench_duration; /* s */
+    double          bench_zipf_s;
+#endif
+
     /* static arp entries can only be added if DHCP is disabled */
     struct {
 	    ip4_addr_t ip;
@@ -384,6 +461,15 @@ static int parse_args_setval_int(int *out, const char *buf)
 	return 0;
 }
 
+#ifdef HTTP_BENCH
+static int parse_args_setval_double(double *out, const char *buf)
+{
+	if (sscanf(buf, "%lf", out) != 1)
+		return -1;
+	return 0;
+}
+#endif
+
 static int parse_args(int argc, char *argv[])
 {
     char *presnip;
@@ -418,6 +504,11 @@ static int parse_args(int argc, char *argv[])
 #endif
     args.nb_sarp_entries = 0;
     args.prefetch = 0;
+#ifdef HTTP_BENCH
+    args.bench_nb_sess = 0;
+    args.bench_duration = 10;
+    args.bench_zipf_s = 1.0;
+#endif
     while ((opt = getopt(argc, argv,
                          "s:i:g:b:hc:a:P"
 #if LWIP_DNS
@@ -425,6 +516,9 @@ static int parse_args(int argc, char *argv[])
 #endif
 #ifdef SHFS_STATS
                          "x:"
+#endif
+#ifdef HTTP_BENCH
+                         "B:T:Z:"
 #endif
                           )) != -1) {
          switch(opt) {
@@ -540,6 +634,32 @@ static int parse_args(int argc, char *argv[])
 	      }
 	      args.nb_http_sess = ival;
               break;
+#ifdef HTTP_BENCH
+         case 'B': /* number of benchmark sessions (enables benchmark) */
+	      ret = parse_args_setval_int(&ival, optarg);
+	      if (ret < 0 || ival < 1 || ival > CONFIG_LWIP_NUM_TCPCON) {
+		      printk("at most %u benchmark sessions supported\n",
+		             CONFIG_LWIP_NUM_TCPCON);
+	           return -1;
+	      }
+	      args.bench_nb_sess = ival;
+              break;
+         case 'T': /* benchmark duration */
+	      ret = parse_args_setval_int(&ival, optarg);
+	      if (ret < 0 || ival < 1) {
+	           printk("invalid benchmark duration specified\n");
+	           return -1;
+	      }
+	      args.bench_duration = (unsigned int) ival;
+              break;
+         case 'Z': /* Zipf exponent of benchmark object popularity */
+	      ret = parse_args_setval_double(&args.bench_zipf_s, optarg);
+	      if (ret < 0 || args.bench_zipf_s < 0.0) {
+	           printk("invalid Zipf exponent specified (e.g., 0.99)\n");
+	           return -1;
+	      }
+              break;
+#endif
 
          default:
 	      return -1;
@@ -608,6 +728,11 @@ int main(int argc, char *argv[])
 {
     struct netif netif;
     struct netif *niret;
+#ifdef HTTP_BENCH
+    struct netif bench_netif;
+    ip4_addr_t bench_ip;
+    struct http_bench_args bench_args;
+#endif
 #ifdef HAVE_CTLDIR
     struct ctldir *cd = NULL;
 #endif
@@ -620,21 +745,16 @@ int main(int argc, char *argv[])
     fd_set poll_wfdset;
     struct timeval poll_to;
 #endif
-#if defined CONFIG_LWIP_NOTHREADS || defined CONFIG_MINDER_PRINT
+#ifdef MAINLOOP_EPOLL
+    int poll_epfd = -1;
+    struct epoll_event poll_ev[MAINLOOP_MAXEVENTS];
+    int poll_nb_ev;
+    uint32_t poll_src;
+#endif
     uint64_t ts_now;
     uint64_t ts_till;
     uint64_t ts_to;
-#endif
-#ifdef CONFIG_LWIP_NOTHREADS
-    uint64_t ts_tcp = 0;
-    uint64_t ts_etharp = 0;
-    uint64_t ts_ipreass = 0;
-#if LWIP_DNS
-    uint64_t ts_dns = 0;
-#endif
-    uint64_t ts_dhcp_fine = 0;
-    uint64_t ts_dhcp_coarse = 0;
-#endif /* CONFIG_LWIP_NOTHREADS */
+    uint64_t ts_wheel;
 #ifdef CONFIG_MINDER_PRINT
     uint64_t ts_minder = 0;
 #endif /* CONFIG_MINDER_PRINT */
@@ -714,6 +834,7 @@ int main(int argc, char *argv[])
     /* -----------------------------------
      * lwIP initialization
      * ----------------------------------- */
+    init_twheel();
     printk("Starting networking...\n");
     TT_START(tt_lwipinit);
 #ifdef CONFIG_LWIP_NOTHREADS
@@ -808,6 +929,34 @@ int main(int argc, char *argv[])
 	    }
 	}
     }
+#ifdef HTTP_BENCH
+    if (args.bench_nb_sess) {
+	/* the load generator is attached to the other end of the pipe,
+	 * it uses the next address of the subnet */
+	if (args.dhclient) {
+	    printk("FATAL: Benchmark requires a static IP address (-i)\n");
+	    goto out;
+	}
+	ip4_addr_set_u32(&bench_ip, htonl(ntohl(ip4_addr_get_u32(&args.ip)) + 1));
+	if (!ip4_addr_netcmp(&bench_ip, &args.ip, &args.mask) ||
+	    ip4_addr_isbroadcast(&bench_ip, &netif)) {
+	    printk("FATAL: Subnet is too small for the benchmark client\n");
+	    goto out;
+	}
+	printk("Initialize benchmark client interface: %u.%u.%u.%u...\n",
+	       ip4_addr1(&bench_ip), ip4_addr2(&bench_ip), ip4_addr3(&bench_ip), ip4_addr4(&bench_ip));
+	niret = netif_add(&bench_netif, &bench_ip, &args.mask, &args.gw, &netif,
+	                  target_netif_peer_init, ip4_input);
+	if (!niret) {
+	    printk("FATAL: Could not initialize the benchmark client interface\n");
+	    goto out;
+	}
+	netif_set_up(&bench_netif);
+    }
+#endif
+#ifdef CONFIG_LWIP_NOTHREADS
+    lwip_tmrs_arm(args.dhclient);
+#endif
 
     /* -----------------------------------
      * detect available block devices
@@ -824,6 +973,11 @@ int main(int argc, char *argv[])
     /* -----------------------------------
      * filesystem initialization & automount
      * ----------------------------------- */
+#ifdef LATENCY_HIST
+    printk("Calibrating latency counter...\n");
+    if (init_lhist() < 0)
+	    printk("Warning: Could not calibrate latency counter\n");
+#endif
     printk("Loading SHFS...\n");
     init_shfs();
 #ifdef CONFIG_AUTOMOUNT
@@ -923,6 +1077,30 @@ int main(int argc, char *argv[])
     FD_ZERO(&poll_rfdset);
     FD_ZERO(&poll_wfdset);
     ts_to = 0;
+#elif defined MAINLOOP_EPOLL
+    poll_epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (poll_epfd < 0) {
+	    printk("FATAL: Could not create epoll instance: %s\n", strerror(errno));
+	    goto out;
+    }
+    poll_ev[0].events = EPOLLIN;
+    poll_ev[0].data.u32 = MAINLOOP_SRC_NETIF;
+    if (epoll_ctl(poll_epfd, EPOLL_CTL_ADD, target_netif_fd(&netif), &poll_ev[0]) < 0) {
+	    printk("FATAL: Could not register network interface for polling: %s\n", strerror(errno));
+	    goto out;
+    }
+    ret = blkdev_notify_fd();
+    if (ret < 0) {
+	    printk("FATAL: Could not enable block device notifications: %s\n", strerror(-ret));
+	    goto out;
+    }
+    poll_ev[0].events = EPOLLIN;
+    poll_ev[0].data.u32 = MAINLOOP_SRC_BLKDEV;
+    if (epoll_ctl(poll_epfd, EPOLL_CTL_ADD, ret, &poll_ev[0]) < 0) {
+	    printk("FATAL: Could not register block device notifications for polling: %s\n", strerror(errno));
+	    goto out;
+    }
+    ts_to = 0;
 #endif
 
     /* -----------------------------------
@@ -957,6 +1135,24 @@ int main(int argc, char *argv[])
     printk("\n");
 #endif
 
+#ifdef HTTP_BENCH
+    /* -----------------------------------
+     * HTTP benchmark (shuts down when done)
+     * ----------------------------------- */
+    if (args.bench_nb_sess) {
+	    bench_args.srv_ip = args.ip;
+	    bench_args.srv_port = HTTP_LISTEN_PORT;
+	    bench_args.nb_sess = args.bench_nb_sess;
+	    bench_args.duration = args.bench_duration * 1000;
+	    bench_args.zipf_s = args.bench_zipf_s;
+	    ret = init_http_bench(&bench_args);
+	    if (ret < 0) {
+		    printk("FATAL: Could not start HTTP benchmark: %s\n", strerror(-ret));
+		    goto out;
+	    }
+    }
+#endif
+
 #ifdef __MINIOS__
     /* -----------------------------------
      * Prefetch data to cache (after 250ms)
@@ -992,11 +1188,23 @@ int main(int argc, char *argv[])
 #if defined CONFIG_LWIP_NOTHREADS || defined CONFIG_MINDER_PRINT
 	}
 #endif
+#elif defined MAINLOOP_EPOLL
+	/* sleep until a source gets ready or the next timer is due */
+	poll_src = 0;
+	poll_nb_ev = epoll_wait(poll_epfd, poll_ev, MAINLOOP_MAXEVENTS,
+				(int) min(ts_to, (uint64_t) INT_MAX));
+	while (poll_nb_ev > 0)
+		poll_src |= poll_ev[--poll_nb_ev].data.u32;
+	if (poll_src & MAINLOOP_SRC_BLKDEV)
+		blkdev_notify_clear();
 #else
 	schedule(); /* yield CPU */
 #endif
 
 	/* poll block devices */
+#ifdef MAINLOOP_EPOLL
+	if (poll_src & MAINLOOP_SRC_BLKDEV)
+#endif
 	shfs_poll_blkdevs();
 
 	/* poll IO retry chain of HTTP */
@@ -1004,34 +1212,39 @@ int main(int argc, char *argv[])
 
 #ifdef CONFIG_LWIP_NOTHREADS
         /* NIC handling loop (single threaded lwip) */
+#ifdef MAINLOOP_EPOLL
+	if (poll_src & MAINLOOP_SRC_NETIF)
+#endif
 	target_netif_poll(&netif);
 #endif /* CONFIG_LWIP_NOTHREADS */
 
-#if defined CONFIG_LWIP_NOTHREADS || defined CONFIG_MINDER_PRINT
+#ifdef HTTP_SCHED
+	/* send out file data of HTTP sessions (one scheduler round) */
+	http_poll_sched();
+#endif
+
         ts_now  = NSEC_TO_MSEC(target_now_ns());
 	ts_till = UINT64_MAX;
-#endif
-#ifdef CONFIG_LWIP_NOTHREADS
-	/* Process lwip network-related timers */
-        TIMED(ts_now, ts_till, ts_etharp,  ARP_TMR_INTERVAL, etharp_tmr());
-        TIMED(ts_now, ts_till, ts_ipreass, IP_TMR_INTERVAL,  ip_reass_tmr());
-        TIMED(ts_now, ts_till, ts_tcp,     TCP_TMR_INTERVAL, tcp_tmr());
-#if LWIP_DNS
-        TIMED(ts_now, ts_till, ts_dns,     DNS_TMR_INTERVAL, dns_tmr());
-#endif
-        if (args.dhclient) {
-	        TIMED(ts_now, ts_till, ts_dhcp_fine,   DHCP_FINE_TIMER_MSECS,   dhcp_fine_tmr());
-	        TIMED(ts_now, ts_till, ts_dhcp_coarse, DHCP_COARSE_TIMER_MSECS, dhcp_coarse_tmr());
-        }
-#endif /* CONFIG_LWIP_NOTHREADS */
+
+	/* Process expired timers (lwIP, HTTP timeouts) */
+	ts_wheel = twheel_run(ts_now);
+	if (ts_wheel != UINT64_MAX)
+		ts_till = ts_now + ts_wheel;
 #ifdef CONFIG_MINDER_PRINT
         TIMED(ts_now, ts_till, ts_minder,  MINDER_INTERVAL,  minder_print());
 #endif /* CONFIG_MINDER_PRINT */
 #ifdef CONFIG_DEBUG_PRINT
         TIMED(ts_now, ts_till, ts_debug,  DEBUG_INTERVAL,  debug_print());
 #endif /* CONFIG_DEBUG_PRINT */
-#if defined CONFIG_LWIP_NOTHREADS || defined CONFIG_MINDER_PRINT || defined CONFIG_DEBUG_PRINT
         ts_to = ts_till - ts_now;
+#ifdef HTTP_SCHED
+	if (http_sched_nb_pending())
+		ts_to = 0; /* sessions wait for the next round: do not sleep */
+#endif
+
+#ifdef target_netif_flush
+	/* transmit packets that were enqueued during this iteration */
+	target_netif_flush(&netif);
 #endif
 
         if (unlikely(shall_suspend)) {
@@ -1062,6 +1275,9 @@ int main(int argc, char *argv[])
 	    printk("Closing stats device...\n");
 	    exit_shfs_stats_export();
     }
+#endif
+#ifdef HTTP_BENCH
+    exit_http_bench();
 #endif
     printk("Stopping HTTP server...\n");
     exit_http();
@@ -1072,10 +1288,27 @@ int main(int argc, char *argv[])
     printk("Unmounting cache filesystem...\n");
     umount_shfs(0); /* we cannot enforce unmount but all files should be closed here anyways */
     exit_shfs();
+#ifdef LATENCY_HIST
+    exit_lhist();
+#endif
     printk("Stopping networking...\n");
+#ifdef CONFIG_LWIP_NOTHREADS
+    lwip_tmrs_cancel();
+#endif
+#ifdef HTTP_BENCH
+    if (args.bench_nb_sess) {
+	    netif_set_down(&bench_netif);
+	    netif_remove(&bench_netif);
+    }
+#endif
     netif_set_down(&netif);
     netif_remove(&netif);
+    exit_twheel();
  out:
+#ifdef MAINLOOP_EPOLL
+    if (poll_epfd >= 0)
+	close(poll_epfd);
+#endif
     if (shall_reboot)
         target_reboot();
     target_halt();
@@ -62,7 +62,7 @@
  * POSSIBILITY OF SUCH DAMAGE.
  *
  */
-/* Note: This implementation is thread-safe but not SMP-safe. */
+/* Note: struct ring is thread-safe but not SMP-safe. */
 
 #include <target/sys.h>
 #include <errno.h>
@@ -103,3 +103,30 @@ void free_ring(struct ring *r)
 {
     target_free(r);
 }
+
+struct smp_ring *alloc_smp_ring(uint32_t size, int flags)
+{
+    struct smp_ring *r;
+
+    ASSERT(size > 1 && POWER_OF_2(size));
+
+    r = target_malloc(CACHELINE_SIZE, sizeof(struct smp_ring) + (sizeof(void *) * size));
+    if (!r) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    r->size = size;
+    r->mask = size - 1;
+    r->prod.head = 0;
+    r->prod.tail = 0;
+    r->prod.single = !!(flags & SMP_RING_SP);
+    r->cons.head = 0;
+    r->cons.tail = 0;
+    r->cons.single = !!(flags & SMP_RING_SC);
+    return r;
+}
+
+void free_smp_ring(struct smp_ring *r)
+{
+    target_free(r);
+}
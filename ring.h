@@ -62,7 +62,10 @@
  * POSSIBILITY OF SUCH DAMAGE.
  *
  */
-/* Note: This implementation is thread-safe but not SMP-safe. */
+/*
+ * Note: struct ring is thread-safe but not SMP-safe.
+ *       struct smp_ring (see below) can be used across cores.
+ */
 
 #ifndef _RING_H_
 #define _RING_H_
@@ -72,6 +75,8 @@
 #include <stdint.h>
 #include <errno.h>
 
+#include "likely.h"
+
 struct ring {
     volatile uint32_t enq_idx;
     volatile uint32_t deq_idx;
@@ -149,7 +154,7 @@ static inline uint32_t ring_try_enqueue_multiple(struct ring *r, void *elements[
     uint32_t i = 0;
     int ret = 0;
 
-    while (!ret || i < count)
+    while (!ret && i < count)
         ret = ring_enqueue(r, elements[i++]);
 
     if (!ret)
@@ -217,7 +222,7 @@ static inline uint32_t ring_try_dequeue_multiple(struct ring *r, void *elements[
     int ret = 0;
     void *e;
 
-    while (!ret || i < count) {
+    while (!ret && i < count) {
         e = ring_dequeue(r);
         if (!e)
             return i;
@@ -227,4 +232,213 @@ static inline uint32_t ring_try_dequeue_multiple(struct ring *r, void *elements[
     return i;
 }
 
+/*
+ * SMP-safe ring (lock-free)
+ *
+ * Producers and consumers can run on different cores. Each side
+ * reserves slots by advancing its head (compare-and-swap when there are
+ * multiple producers or consumers), copies the elements and publishes
+ * them by advancing its tail. Tails are published in reservation order,
+ * so a producer (consumer) that is preempted while copying delays the
+ * publication of the ones that reserved after it.
+ * The indices are free running; head and tail of each side are kept on
+ * their own cache line so that producers and consumers do not share one.
+ */
+#define RING_CACHELINE_SIZE 64
+
+#define SMP_RING_SP 0x1 /* single producer: enqueue without compare-and-swap */
+#define SMP_RING_SC 0x2 /* single consumer: dequeue without compare-and-swap */
+
+#if defined __x86_64__ || defined __i386__
+#define ring_cpu_relax() __asm__ __volatile__("pause" ::: "memory")
+#elif defined __arm__ || defined __aarch64__
+#define ring_cpu_relax() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define ring_cpu_relax() __asm__ __volatile__("" ::: "memory")
+#endif
+
+struct smp_ring_headtail {
+    volatile uint32_t head; /* slots up to here are reserved */
+    volatile uint32_t tail; /* slots up to here are published */
+    uint32_t single;
+    uint8_t _pad[RING_CACHELINE_SIZE - (3 * sizeof(uint32_t))];
+};
+
+struct smp_ring {
+    uint32_t size;
+    uint32_t mask;
+    uint8_t _pad[RING_CACHELINE_SIZE - (2 * sizeof(uint32_t))];
+
+    struct smp_ring_headtail prod;
+    struct smp_ring_headtail cons;
+    void *ring[];
+};
+
+/* Note: size has to be a power of two. (size - 1) slots are available in the ring */
+struct smp_ring *alloc_smp_ring(uint32_t size, int flags);
+void free_smp_ring(struct smp_ring *r);
+
+/* Note: The following values are snapshots only when other cores are
+ *       enqueuing or dequeuing at the same time */
+/* number of used slots */
+#define smp_ring_count(r) \
+    ((uint32_t) (__atomic_load_n(&(r)->prod.tail, __ATOMIC_ACQUIRE) - \
+                 __atomic_load_n(&(r)->cons.tail, __ATOMIC_ACQUIRE)))
+/* number of available slots */
+#define smp_ring_avail(r) ((r)->mask - smp_ring_count((r)))
+#define smp_ring_full(r) (smp_ring_avail((r)) == 0)
+#define smp_ring_empty(r) (smp_ring_count((r)) == 0)
+
+/*
+ * Enqueues up to count elements (all or nothing if fixed is set)
+ * Returns the number of enqueued elements
+ */
+static inline uint32_t _smp_ring_enqueue(struct smp_ring *r, void * const elements[],
+                                         uint32_t count, int fixed)
+{
+    uint32_t head, next, free, n, i;
+
+    head = __atomic_load_n(&r->prod.head, __ATOMIC_RELAXED);
+    do {
+        /* head has to be read before the consumer's tail, otherwise
+         * free might be overestimated */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        free = r->mask + __atomic_load_n(&r->cons.tail, __ATOMIC_ACQUIRE) - head;
+
+        n = count;
+        if (unlikely(n > free)) {
+            if (fixed || !free)
+                return 0;
+            n = free;
+        }
+        next = head + n;
+
+        if (r->prod.single) {
+            r->prod.head = next;
+            break;
+        }
+    } while (unlikely(!__atomic_compare_exchange_n(&r->prod.head, &head, next, 0,
+                                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED)));
+
+    for (i = 0; i < n; i++)
+        r->ring[(head + i) & r->mask] = elements[i];
+
+    /* wait for producers that reserved before us (acquire: the accesses
+     * of all of them are published with our tail) */
+    if (!r->prod.single)
+        while (unlikely(__atomic_load_n(&r->prod.tail, __ATOMIC_ACQUIRE) != head))
+            ring_cpu_relax();
+    __atomic_store_n(&r->prod.tail, next, __ATOMIC_RELEASE);
+    return n;
+}
+
+/*
+ * Dequeues up to count elements (all or nothing if fixed is set)
+ * Returns the number of dequeued elements
+ */
+static inline uint32_t _smp_ring_dequeue(struct smp_ring *r, void *elements[],
+                                         uint32_t count, int fixed)
+{
+    uint32_t head, next, used, n, i;
+
+    head = __atomic_load_n(&r->cons.head, __ATOMIC_RELAXED);
+    do {
+        /* head has to be read before the producer's tail, otherwise
+         * used might be overestimated */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        used = __atomic_load_n(&r->prod.tail, __ATOMIC_ACQUIRE) - head;
+
+        n = count;
+        if (unlikely(n > used)) {
+            if (fixed || !used)
+                return 0;
+            n = used;
+        }
+        next = head + n;
+
+        if (r->cons.single) {
+            r->cons.head = next;
+            break;
+        }
+    } while (unlikely(!__atomic_compare_exchange_n(&r->cons.head, &head, next, 0,
+                                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED)));
+
+    for (i = 0; i < n; i++)
+        elements[i] = r->ring[(head + i) & r->mask];
+
+    /* wait for consumers that reserved before us (acquire: the accesses
+     * of all of them are published with our tail) */
+    if (!r->cons.single)
+        while (unlikely(__atomic_load_n(&r->cons.tail, __ATOMIC_ACQUIRE) != head))
+            ring_cpu_relax();
+    __atomic_store_n(&r->cons.tail, next, __ATOMIC_RELEASE);
+    return n;
+}
+
+/*
+ * Returns 0 on success, -1 on errors (inspect errno for reason)
+ */
+static inline int smp_ring_enqueue(struct smp_ring *r, void *element)
+{
+    if (unlikely(!_smp_ring_enqueue(r, &element, 1, 1))) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Returns 0 on success, -1 on errors (inspect errno for reason)
+ */
+static inline int smp_ring_enqueue_multiple(struct smp_ring *r, void *elements[], uint32_t count)
+{
+    if (unlikely(_smp_ring_enqueue(r, elements, count, 1) != count)) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Returns the number of successfully enqueued elements
+ */
+static inline uint32_t smp_ring_try_enqueue_multiple(struct smp_ring *r, void *elements[], uint32_t count)
+{
+    return _smp_ring_enqueue(r, elements, count, 0);
+}
+
+/*
+ * Returns NULL on errors (inspect errno for reason)
+ */
+static inline void *smp_ring_dequeue(struct smp_ring *r)
+{
+    void *e;
+
+    if (unlikely(!_smp_ring_dequeue(r, &e, 1, 1))) {
+        errno = ENOBUFS;
+        return NULL;
+    }
+    return e;
+}
+
+/*
+ * Returns 0 on success, -1 on errors (inspect errno for reason)
+ */
+static inline int smp_ring_dequeue_multiple(struct smp_ring *r, void *elements[], uint32_t count)
+{
+    if (unlikely(_smp_ring_dequeue(r, elements, count, 1) != count)) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Returns the number of successfully dequeued elements
+ */
+static inline uint32_t smp_ring_try_dequeue_multiple(struct smp_ring *r, void *elements[], uint32_t count)
+{
+    return _smp_ring_dequeue(r, elements, count, 0);
+}
+
 #endif /* _RING_H_ */
@@ -0,0 +1,318 @@
+/*
+ * Stress and throughput test for the SMP-safe ring (linux target)
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+/*
+ * Producer threads enqueue sequence numbers tagged with their id in
+ * random bursts, consumer threads dequeue them in random bursts. Every
+ * consumer has to see the numbers of each producer in increasing order
+ * and all consumers together have to see each number exactly once
+ * (checked by count and sum). Threads are pinned to cores round robin.
+ *
+ * Usage: ring_test [-p producers] [-c consumers] [-n elements per producer]
+ *                  [-s ring size] [-b max. burst]
+ * It runs a SPSC round (SMP_RING_SP | SMP_RING_SC) followed by a MPMC
+ * round with the given number of threads.
+ */
+#define _GNU_SOURCE
+#include <target/sys.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "likely.h"
+#include "ring.h"
+
+#define RT_ID_BITS   8
+#define RT_ID_SHIFT  ((sizeof(uintptr_t) * 8) - RT_ID_BITS)
+#define RT_SEQ_MASK  ((((uintptr_t) 1) << RT_ID_SHIFT) - 1)
+#define RT_MAXNB_THREADS (1 << RT_ID_BITS)
+#define RT_MAX_BURST 256
+
+struct rt_args {
+	unsigned int nb_prod;
+	unsigned int nb_cons;
+	uint64_t nb_elements; /* per producer */
+	uint32_t size;
+	uint32_t burst;
+};
+
+struct rt_thread {
+	pthread_t t;
+	unsigned int id;
+	uint32_t rnd; /* xorshift32 state */
+	uint64_t count;
+	uint64_t sum[RT_MAXNB_THREADS]; /* consumers: per producer */
+	uint64_t last[RT_MAXNB_THREADS]; /* consumers: per producer */
+	uint64_t nb_errors;
+};
+
+static struct rt_args args;
+static struct smp_ring *ring;
+static pthread_barrier_t start;
+static uint64_t nb_consumed; /* all consumers */
+static uint64_t nb_total;
+
+static inline uint32_t rt_rand(struct rt_thread *rt)
+{
+	rt->rnd ^= rt->rnd << 13;
+	rt->rnd ^= rt->rnd >> 17;
+	rt->rnd ^= rt->rnd << 5;
+	return rt->rnd;
+}
+
+static void rt_pin(unsigned int i)
+{
+	long nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	cpu_set_t set;
+
+	if (nb_cpus <= 1)
+		return;
+	CPU_ZERO(&set);
+	CPU_SET(i % nb_cpus, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void *rt_producer(void *argp)
+{
+	struct rt_thread *rt = argp;
+	void *e[RT_MAX_BURST];
+	uint64_t seq = 1; /* 0 would be a NULL element for id 0 */
+	uint32_t b, n, i;
+
+	rt_pin(rt->id);
+	pthread_barrier_wait(&start);
+
+	while (seq <= args.nb_elements) {
+		b = (rt_rand(rt) % args.burst) + 1;
+		if (b > args.nb_elements - seq + 1)
+			b = (uint32_t) (args.nb_elements - seq + 1);
+		for (i = 0; i < b; ++i)
+			e[i] = (void *) (((uintptr_t) rt->id << RT_ID_SHIFT) | (uintptr_t) (seq + i));
+
+		/* exercise all enqueue variants */
+		if (b == 1)
+			n = smp_ring_enqueue(ring, e[0]) == 0 ? 1 : 0;
+		else if (rt->rnd & 0x100)
+			n = smp_ring_enqueue_multiple(ring, e, b) == 0 ? b : 0;
+		else
+			n = smp_ring_try_enqueue_multiple(ring, e, b);
+
+		if (!n)
+			sched_yield(); /* ring is full */
+		seq += n;
+		rt->count += n;
+	}
+	return NULL;
+}
+
+static void *rt_consumer(void *argp)
+{
+	struct rt_thread *rt = argp;
+	void *e[RT_MAX_BURST];
+	uintptr_t v, seq;
+	unsigned int p;
+	uint32_t b, n, i;
+
+	rt_pin(args.nb_prod + rt->id);
+	pthread_barrier_wait(&start);
+
+	while (__atomic_load_n(&nb_consumed, __ATOMIC_RELAXED) < nb_total) {
+		b = (rt_rand(rt) % args.burst) + 1;
+
+		/* exercise all dequeue variants */
+		if (b == 1) {
+			e[0] = smp_ring_dequeue(ring);
+			n = e[0] ? 1 : 0;
+		} else if (rt->rnd & 0x100) {
+			n = smp_ring_dequeue_multiple(ring, e, b) == 0 ? b : 0;
+		} else {
+			n = smp_ring_try_dequeue_multiple(ring, e, b);
+		}
+
+		if (!n) {
+			sched_yield(); /* ring is empty */
+			continue;
+		}
+		for (i = 0; i < n; ++i) {
+			v = (uintptr_t) e[i];
+			p = (unsigned int) (v >> RT_ID_SHIFT);
+			seq = v & RT_SEQ_MASK;
+			if (unlikely(p >= args.nb_prod || seq <= rt->last[p])) {
+				++rt->nb_errors;
+				continue;
+			}
+			rt->last[p] = seq;
+			rt->sum[p] += seq;
+		}
+		rt->count += n;
+		__atomic_fetch_add(&nb_consumed, n, __ATOMIC_RELAXED);
+	}
+	return NULL;
+}
+
+static int rt_run(const char *name, unsigned int nb_prod, unsigned int nb_cons, int flags)
+{
+	struct rt_thread *prod, *cons;
+	uint64_t ts_start, ts_end;
+	uint64_t count, sum, nb_errors;
+	unsigned int i, p;
+	int ret = 0;
+
+	args.nb_prod = nb_prod;
+	args.nb_cons = nb_cons;
+	nb_total = (uint64_t) nb_prod * args.nb_elements;
+	nb_consumed = 0;
+
+	ring = alloc_smp_ring(args.size, flags);
+	prod = calloc(nb_prod, sizeof(*prod));
+	cons = calloc(nb_cons, sizeof(*cons));
+	if (!ring || !prod || !cons) {
+		fprintf(stderr, "%s: Out of memory\n", name);
+		ret = -1;
+		goto out;
+	}
+	pthread_barrier_init(&start, NULL, nb_prod + nb_cons + 1);
+
+	for (i = 0; i < nb_prod; ++i) {
+		prod[i].id = i;
+		prod[i].rnd = 0x2545f491 + i;
+		pthread_create(&prod[i].t, NULL, rt_producer, &prod[i]);
+	}
+	for (i = 0; i < nb_cons; ++i) {
+		cons[i].id = i;
+		cons[i].rnd = 0x9e3779b9 + i;
+		pthread_create(&cons[i].t, NULL, rt_consumer, &cons[i]);
+	}
+
+	pthread_barrier_wait(&start);
+	ts_start = target_now_ns();
+	for (i = 0; i < nb_prod; ++i)
+		pthread_join(prod[i].t, NULL);
+	for (i = 0; i < nb_cons; ++i)
+		pthread_join(cons[i].t, NULL);
+	ts_end = target_now_ns();
+	pthread_barrier_destroy(&start);
+
+	/* check */
+	count = 0;
+	nb_errors = 0;
+	for (i = 0; i < nb_cons; ++i) {
+		count += cons[i].count;
+		nb_errors += cons[i].nb_errors;
+	}
+	for (p = 0; p < nb_prod; ++p) {
+		sum = 0;
+		for (i = 0; i < nb_cons; ++i)
+			sum += cons[i].sum[p];
+		if (sum != (args.nb_elements * (args.nb_elements + 1)) / 2)
+			++nb_errors;
+	}
+	if (count != nb_total || !smp_ring_empty(ring))
+		++nb_errors;
+
+	printf("%-4s %3u:%-3u %12"PRIu64" elements in %8.3f s: %8.2f Mops/s, %s\n",
+	       name, nb_prod, nb_cons, count,
+	       (double) (ts_end - ts_start) / 1e9,
+	       (double) count * 1e3 / (double) (ts_end - ts_start),
+	       nb_errors ? "FAILED" : "OK");
+	if (nb_errors)
+		ret = -1;
+
+ out:
+	free(cons);
+	free(prod);
+	if (ring)
+		free_smp_ring(ring);
+	return ret;
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s [-p producers] [-c consumers] [-n elements per producer]"
+	        " [-s ring size] [-b max. burst]\n", argv0);
+}
+
+int main(int argc, char *argv[])
+{
+	long nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned int nb_prod, nb_cons;
+	int opt;
+	int ret = 0;
+
+	nb_prod = nb_cons = (nb_cpus > 2) ? (unsigned int) (nb_cpus / 2) : 1;
+	args.nb_elements = 10000000;
+	args.size = 1024;
+	args.burst = 32;
+
+	while ((opt = getopt(argc, argv, "p:c:n:s:b:h")) != -1) {
+		switch (opt) {
+		case 'p':
+			nb_prod = (unsigned int) strtoul(optarg, NULL, 10);
+			break;
+		case 'c':
+			nb_cons = (unsigned int) strtoul(optarg, NULL, 10);
+			break;
+		case 'n':
+			args.nb_elements = strtoull(optarg, NULL, 10);
+			break;
+		case 's':
+			args.size = (uint32_t) strtoul(optarg, NULL, 10);
+			break;
+		case 'b':
+			args.burst = (uint32_t) strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (!nb_prod || nb_prod > RT_MAXNB_THREADS ||
+	    !nb_cons || nb_cons > RT_MAXNB_THREADS ||
+	    !args.nb_elements || args.nb_elements > RT_SEQ_MASK ||
+	    args.size < 2 || (args.size & (args.size - 1)) ||
+	    !args.burst || args.burst > RT_MAX_BURST) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	ret |= rt_run("SPSC", 1, 1, SMP_RING_SP | SMP_RING_SC);
+	ret |= rt_run("MPMC", nb_prod, nb_cons, 0);
+	return ret ? 1 : 0;
+}
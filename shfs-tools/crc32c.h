@@ -0,0 +1 @@
+../crc32c.h
\ No newline at end of file
@@ -53,6 +53,7 @@
 #include "shfs_alloc.h"
 #include "http_parser.h"
 #include "shfs_check.h"
+#include "crc32c.h"
 
 #ifndef INET_ADDRLEN
 #define INET_ADDRLEN 4
@@ -70,25 +71,33 @@ static struct vol_info shfs_vol;
 /******************************************************************************
  * ARGUMENT PARSING                                                           *
  ******************************************************************************/
-const char *short_opts = "h?vVfa:u:r:c:d:Cm:n:t:D:li";
+const char *short_opts = "h?vVfj:a:M:u:r:c:d:Cp:P:m:e:I:n:t:o:D:liO:";
 
 static struct option long_opts[] = {
 	{"help",		no_argument,		NULL,	'h'},
 	{"version",		no_argument,		NULL,	'V'},
 	{"verbose",		no_argument,		NULL,	'v'},
 	{"force",		no_argument,		NULL,	'f'},
+	{"jobs",		required_argument,	NULL,	'j'},
 	{"add-obj",		required_argument,	NULL,	'a'},
+	{"manifest",		required_argument,	NULL,	'M'},
 	{"add-lnk",		required_argument,	NULL,	'u'},
 	{"rm-obj",		required_argument,	NULL,	'r'},
 	{"cat-obj",		required_argument,	NULL,	'c'},
 	{"set-default",		required_argument,	NULL,	'd'},
 	{"clear-default",	no_argument,		NULL,	'C'},
+	{"pin",			required_argument,	NULL,	'p'},
+	{"unpin",		required_argument,	NULL,	'P'},
 	{"mime",		required_argument,	NULL,	'm'},
+	{"encoding",		required_argument,	NULL,	'e'},
+	{"identity",		required_argument,	NULL,	'I'},
 	{"name",		required_argument,	NULL,	'n'},
 	{"digest",		required_argument,	NULL,	'D'},
 	{"type",		required_argument,	NULL,	't'},
+	{"origin",		required_argument,	NULL,	'o'},
 	{"ls",			no_argument,            NULL,	'l'},
 	{"info",		no_argument,            NULL,	'i'},
+	{"optimize",		required_argument,	NULL,	'O'},
 	{NULL, 0, NULL, 0} /* end of list */
 };
 
@@ -108,7 +117,11 @@ static void print_usage(char *argv0)
 	printf("  -V, --version                displays program version and exit\n");
 	printf("  -v, --verbose                increases verbosity level (max. %d times)\n", D_MAX);
 	printf("  -f, --force                  suppresses warnings and user questions\n");
+	printf("  -j, --jobs [N]               adds up to N objects in parallel\n");
+	printf("                                (default: number of online CPUs)\n");
 	printf("  -a, --add-obj [FILE]         adds FILE as object to the volume\n");
+	printf("  -M, --manifest [FILE]        adds an object for each line of FILE:\n");
+	printf("                                PATH[<TAB>MIME[<TAB>NAME[<TAB>HASH]]]\n");
 	printf("  -u, --add-lnk [URL]          adds URL as remote link to the volume\n");
 	printf("  For each add-obj, add-lnk token:\n");
 	printf("    -n, --name [NAME]          sets an additional name for the object\n");
@@ -117,25 +130,39 @@ static void print_usage(char *argv0)
 	                                        "hash function 'Manual')\n");
 	printf("  For each add-obj token:\n");
 	printf("    -m, --mime [MIME]          sets the MIME type for the object\n");
-	//printf("    -e, --encoding [ENCODING]  sets encoding type for preencoded content\n");
+	printf("    -e, --encoding [ENC]       adds the object as pre-encoded variant of\n");
+	printf("                                an identity object (see: -I)\n");
+	printf("                               ENC can be: gzip, br, zstd\n");
+	printf("    -I, --identity [HASH]      sets the identity object of a variant\n");
 	printf("  For each add-lnk token:\n");
 	printf("    -t, --type [TYPE]          sets the TYPE for a linked object\n");
 	printf("                               TYPE can be: redirect, raw, auto\n");
+	printf("    -o, --origin [HOST]        adds HOST as alternative origin for failover\n");
+	printf("                                (at most %u times, HOST is resolved to IPv4,\n", SHFS_LINK_MAX_NB_ALTORIGINS);
+	printf("                                 the port of URL is used)\n");
 	printf("  -r, --rm-obj [HASH]          removes an object from the volume\n");
 	printf("  -c, --cat-obj [HASH]         exports an object to stdout\n");
 	printf("  -d, --set-default [HASH]     sets the object with HASH as default\n");
 	printf("  -C, --clear-default          clears reference to default object\n");
+	printf("  -p, --pin [HASH]             keeps the object with HASH in the cache\n");
+	printf("  -P, --unpin [HASH]           clears the pin flag of the object with HASH\n");
 	printf("  -l, --ls                     lists the volume contents\n");
 	printf("  -i, --info                   shows volume information\n");
+	printf("  -O, --optimize [FILE]        relocates objects: the ones listed in FILE\n");
+	printf("                                (export-stats, top or list of HASH) are\n");
+	printf("                                placed first, free space is compacted\n");
 	printf("\n");
 	printf("Example (adding a file):\n");
 	printf(" %s --add-obj song.mp3 -m audio/mpeg3 /dev/ram15\n", argv0);
+	printf("Example (adding the files listed in a manifest with 8 jobs):\n");
+	printf(" %s -j 8 --manifest files.txt /dev/ram15\n", argv0);
 }
 
 static void release_args(struct args *args)
 {
 	struct token *ctoken;
 	struct token *ntoken;
+	unsigned int i;
 
 	ctoken = args->tokens;
 
@@ -143,10 +170,16 @@ static void release_args(struct args *args)
 	while (ctoken) {
 		if (ctoken->path)
 			free(ctoken->path);
+		for (i = 0; i < ctoken->nb_optaltorigins; ++i)
+			free(ctoken->optaltorigin[i]);
 		if (ctoken->optstr0)
 			free(ctoken->optstr0);
 		if (ctoken->optstr1)
 			free(ctoken->optstr1);
+		if (ctoken->optstr3)
+			free(ctoken->optstr3);
+		if (ctoken->optstr4)
+			free(ctoken->optstr4);
 		ntoken = ctoken->next;
 		free(ctoken);
 		ctoken = ntoken;
@@ -195,6 +228,76 @@ static inline int parse_args_set_ltype(enum ltype *out, const char *arg)
 	return -EINVAL;
 }
 
+/**
+ * Adds an add-obj token for each line of a manifest:
+ *  PATH[<TAB>MIME[<TAB>NAME[<TAB>HASH]]]
+ * Empty fields are not set, empty lines and lines starting with '#'
+ * are skipped
+ */
+static int parse_args_manifest(const char *path, struct token **ctoken, struct args *args)
+{
+	FILE *fp;
+	char *line = NULL;
+	size_t line_size = 0;
+	ssize_t len;
+	char *p;
+	char *field[4];
+	unsigned int nb_fields;
+	unsigned int mline = 0;
+	int ret = 0;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		eprintf("Could not open manifest %s: %s\n", path, strerror(errno));
+		return -EINVAL;
+	}
+
+	while ((len = getline(&line, &line_size, fp)) >= 0) {
+		++mline;
+		while (len && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+			line[--len] = '\0';
+		if (len == 0 || line[0] == '#')
+			continue;
+
+		p = line;
+		for (nb_fields = 0; nb_fields < 4 && p; ++nb_fields)
+			field[nb_fields] = strsep(&p, "\t");
+		if (p) {
+			eprintf("%s:%u: Too many fields\n", path, mline);
+			ret = -EINVAL;
+			break;
+		}
+		if (field[0][0] == '\0') {
+			eprintf("%s:%u: Path of object is missing\n", path, mline);
+			ret = -EINVAL;
+			break;
+		}
+
+		*ctoken = args_add_token(*ctoken, args);
+		(*ctoken)->action = ADDOBJ;
+		(*ctoken)->mline = mline;
+		if (parse_args_setval_str(&(*ctoken)->path, field[0]) < 0)
+			die();
+		if (nb_fields > 1 && field[1][0] != '\0' &&
+		    parse_args_setval_str(&(*ctoken)->optstr0, field[1]) < 0)
+			die();
+		if (nb_fields > 2 && field[2][0] != '\0' &&
+		    parse_args_setval_str(&(*ctoken)->optstr1, field[2]) < 0)
+			die();
+		if (nb_fields > 3 && field[3][0] != '\0' &&
+		    parse_args_setval_str(&(*ctoken)->optstr2, field[3]) < 0)
+			die();
+	}
+	if (ferror(fp)) {
+		eprintf("Could not read manifest %s: %s\n", path, strerror(errno));
+		ret = -EINVAL;
+	}
+
+	free(line);
+	fclose(fp);
+	return ret;
+}
+
 static int parse_args(int argc, char **argv, struct args *args)
 /*
  * Parse arguments on **argv (number of args on argc)
@@ -211,11 +314,14 @@ static int parse_args(int argc, char **argv, struct args *args)
  */
 {
 	int opt, opt_index = 0;
+	int jobs;
+	long nb_cpus;
 	struct token *ctoken;
 	/*
 	 * set default values
 	 */
 	args->nb_devs = 0;
+	args->jobs = 0;
 	args->tokens = NULL;
 	ctoken = args->tokens;
 
@@ -243,12 +349,23 @@ static int parse_args(int argc, char **argv, struct args *args)
 		case 'f': /* force */
 			force = 1;
 			break;
+		case 'j': /* jobs */
+			if (parse_args_setval_int(&jobs, optarg) < 0 || jobs < 1) {
+				eprintf("Invalid number of jobs: %s\n", optarg);
+				return -EINVAL;
+			}
+			args->jobs = jobs;
+			break;
 		case 'a': /* add-obj */
 			ctoken = args_add_token(ctoken, args);
 			ctoken->action = ADDOBJ;
 			if (parse_args_setval_str(&ctoken->path, optarg) < 0)
 				die();
 			break;
+		case 'M': /* manifest */
+			if (parse_args_manifest(optarg, &ctoken, args) < 0)
+				return -EINVAL;
+			break;
 		case 'u': /* add-lnk */
 			ctoken = args_add_token(ctoken, args);
 			ctoken->action = ADDLNK;
@@ -256,15 +373,35 @@ static int parse_args(int argc, char **argv, struct args *args)
 				die();
 			break;
 		case 'm': /* mime */
-			if (!ctoken || (ctoken->action != ADDOBJ)) {
+			if (!ctoken || (ctoken->action != ADDOBJ) || ctoken->mline) {
 				eprintf("Please set mime after an add-obj token\n");
 				return -EINVAL;
 			}
 			if (parse_args_setval_str(&ctoken->optstr0, optarg) < 0)
 				die();
 			break;
+		case 'e': /* encoding */
+			if (!ctoken || (ctoken->action != ADDOBJ) || ctoken->mline) {
+				eprintf("Please set encoding after an add-obj token\n");
+				return -EINVAL;
+			}
+			if (shfs_venc_parse(optarg, strlen(optarg) + 1) < 0) {
+				eprintf("Encoding '%s' is invalid and not supported\n", optarg);
+				return -EINVAL;
+			}
+			if (parse_args_setval_str(&ctoken->optstr3, optarg) < 0)
+				die();
+			break;
+		case 'I': /* identity */
+			if (!ctoken || (ctoken->action != ADDOBJ) || ctoken->mline) {
+				eprintf("Please set identity after an add-obj token\n");
+				return -EINVAL;
+			}
+			if (parse_args_setval_str(&ctoken->optstr4, optarg) < 0)
+				die();
+			break;
 		case 'n': /* name */
-			if (!ctoken || (ctoken->action != ADDOBJ && ctoken->action != ADDLNK)) {
+			if (!ctoken || (ctoken->action != ADDOBJ && ctoken->action != ADDLNK) || ctoken->mline) {
 				eprintf("Please set name after an add-obj, add-lnk token\n");
 				return -EINVAL;
 			}
@@ -272,7 +409,7 @@ static int parse_args(int argc, char **argv, struct args *args)
 				die();
 			break;
 		case 'D': /* digest */
-			if (!ctoken || (ctoken->action != ADDOBJ && ctoken->action != ADDLNK)) {
+			if (!ctoken || (ctoken->action != ADDOBJ && ctoken->action != ADDLNK) || ctoken->mline) {
 				eprintf("Please set digest after an add-obj, add-lnk token\n");
 				return -EINVAL;
 			}
@@ -289,6 +426,20 @@ static int parse_args(int argc, char **argv, struct args *args)
 				return -EINVAL;
 			}
 			break;
+		case 'o': /* origin */
+			if (!ctoken || (ctoken->action != ADDLNK)) {
+				eprintf("Please set origin after an add-lnk token\n");
+				return -EINVAL;
+			}
+			if (ctoken->nb_optaltorigins >= SHFS_LINK_MAX_NB_ALTORIGINS) {
+				eprintf("At most %u alternative origins are supported\n",
+					SHFS_LINK_MAX_NB_ALTORIGINS);
+				return -EINVAL;
+			}
+			if (parse_args_setval_str(&ctoken->optaltorigin[ctoken->nb_optaltorigins], optarg) < 0)
+				die();
+			++ctoken->nb_optaltorigins;
+			break;
 		case 'r': /* rm-obj */
 			ctoken = args_add_token(ctoken, args);
 			ctoken->action = RMOBJ;
@@ -311,6 +462,18 @@ static int parse_args(int argc, char **argv, struct args *args)
 			ctoken = args_add_token(ctoken, args);
 			ctoken->action = CLEARDEFOBJ;
 			break;
+		case 'p': /* pin */
+			ctoken = args_add_token(ctoken, args);
+			ctoken->action = PINOBJ;
+			if (parse_args_setval_str(&ctoken->path, optarg) < 0)
+				die();
+			break;
+		case 'P': /* unpin */
+			ctoken = args_add_token(ctoken, args);
+			ctoken->action = UNPINOBJ;
+			if (parse_args_setval_str(&ctoken->path, optarg) < 0)
+				die();
+			break;
 		case 'l': /* ls */
 			ctoken = args_add_token(ctoken, args);
 			ctoken->action = LSOBJS;
@@ -319,6 +482,12 @@ static int parse_args(int argc, char **argv, struct args *args)
 			ctoken = args_add_token(ctoken, args);
 			ctoken->action = SHOWINFO;
 			break;
+		case 'O': /* optimize */
+			ctoken = args_add_token(ctoken, args);
+			ctoken->action = OPTIMIZE;
+			if (parse_args_setval_str(&ctoken->path, optarg) < 0)
+				die();
+			break;
 		default:
 			/* unknown option */
 			return -EINVAL;
@@ -333,11 +502,21 @@ static int parse_args(int argc, char **argv, struct args *args)
 	args->devpath = &argv[optind];
 	args->nb_devs = argc - optind;
 
+	if (!args->jobs) {
+		nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		args->jobs = nb_cpus > 0 ? nb_cpus : 1;
+	}
+
 	/* check token list, if mandatory argements were given */
 	for (ctoken = args->tokens; ctoken != NULL; ctoken = ctoken->next) {
 		switch(ctoken->action) {
 		case ADDOBJ:
-			/* nothing to check (mime is optional) */
+			/* mime is optional, a variant needs both */
+			if (!ctoken->optstr3 != !ctoken->optstr4) {
+				eprintf("Please set encoding and identity for variant %s\n",
+					ctoken->path);
+				return -EINVAL;
+			}
 			break;
 		default:
 			break; /* unsupported token but should never happen */
@@ -529,6 +708,8 @@ static void load_vol_hconf(void)
 	shfs_vol.hfunc                        = hdr_config->hfunc;
 	shfs_vol.hlen                         = hdr_config->hlen;
 	shfs_vol.allocator                    = hdr_config->allocator;
+	shfs_vol.csum_ref                     = hdr_config->csum_ref;
+	shfs_vol.csum_len                     = SHFS_CSUM_SIZE_CHUNKS(shfs_vol.volsize, shfs_vol.chunksize);
 
 	/* brief configuration check */
 	if (shfs_vol.htable_len == 0)
@@ -597,6 +778,150 @@ static void load_vol_htable(void)
 	}
 }
 
+/**
+ * Small object packing
+ * The table keeps the used length of each chunk that is only partially
+ * filled by the last bytes of an object
+ */
+static void ptail_set(chk_t chunk, uint64_t end)
+{
+	unsigned int i;
+
+	for (i = 0; i < shfs_vol.nb_ptail; ++i) {
+		if (shfs_vol.ptail[i].chunk == chunk) {
+			if (end > shfs_vol.ptail[i].end)
+				shfs_vol.ptail[i].end = end;
+			if (shfs_vol.ptail[i].end >= shfs_vol.chunksize) {
+				/* chunk is full: remove it from table */
+				shfs_vol.ptail[i] = shfs_vol.ptail[--shfs_vol.nb_ptail];
+			}
+			return;
+		}
+	}
+	if (end >= shfs_vol.chunksize)
+		return;
+
+	if (shfs_vol.nb_ptail == shfs_vol.max_ptail) {
+		shfs_vol.max_ptail = shfs_vol.max_ptail ? (shfs_vol.max_ptail << 1) : 64;
+		shfs_vol.ptail = realloc(shfs_vol.ptail, sizeof(*shfs_vol.ptail) * shfs_vol.max_ptail);
+		if (!shfs_vol.ptail)
+			die();
+	}
+	shfs_vol.ptail[shfs_vol.nb_ptail].chunk = chunk;
+	shfs_vol.ptail[shfs_vol.nb_ptail].end = end;
+	++shfs_vol.nb_ptail;
+}
+
+#define hentry_last_chunk(hentry) \
+	((hentry)->f_attr.chunk + \
+	 ((hentry)->f_attr.offset + (hentry)->f_attr.len - 1) / shfs_vol.chunksize)
+
+static void ptail_add_hentry(struct shfs_hentry *hentry)
+{
+	uint64_t end;
+
+	if (SHFS_HENTRY_ISLINK(hentry) || hentry->f_attr.len == 0)
+		return;
+
+	end = ((hentry->f_attr.offset + hentry->f_attr.len - 1) % shfs_vol.chunksize) + 1;
+	ptail_set(hentry_last_chunk(hentry), ALIGN_UP(end, SHFS_PACK_ALIGN));
+}
+
+/* recalculates the used length of a chunk (e.g., after an object was removed) */
+static void ptail_reload(chk_t chunk)
+{
+	struct htable_el *el;
+	struct shfs_bentry *bentry;
+	struct shfs_hentry *hentry;
+	unsigned int i;
+
+	for (i = 0; i < shfs_vol.nb_ptail; ++i) {
+		if (shfs_vol.ptail[i].chunk == chunk) {
+			shfs_vol.ptail[i] = shfs_vol.ptail[--shfs_vol.nb_ptail];
+			break;
+		}
+	}
+
+	foreach_htable_el(shfs_vol.bt, el) {
+		bentry = el->private;
+		hentry = (struct shfs_hentry *)
+			((uint8_t *) shfs_vol.htable_chunk_cache[bentry->hentry_htchunk]
+			 + bentry->hentry_htoffset);
+		if (!SHFS_HENTRY_ISLINK(hentry) && hentry->f_attr.len &&
+		    hentry_last_chunk(hentry) == chunk)
+			ptail_add_hentry(hentry);
+	}
+}
+
+/*
+ * Returns the chunk with the smallest unused tail that can still
+ * take len bytes (best-fit) and the offset within it, 0 if there is none
+ */
+static chk_t ptail_find(uint64_t len, uint64_t *off)
+{
+	unsigned int i;
+	unsigned int best = 0;
+	uint64_t left, best_free = 0;
+
+	for (i = 0; i < shfs_vol.nb_ptail; ++i) {
+		left = shfs_vol.chunksize - shfs_vol.ptail[i].end;
+		if (left >= len &&
+		    (best_free == 0 || left < best_free)) {
+			best = i;
+			best_free = left;
+		}
+	}
+	if (best_free == 0)
+		return 0;
+
+	*off = shfs_vol.ptail[best].end;
+	return shfs_vol.ptail[best].chunk;
+}
+
+/**
+ * This function loads the chunk checksum table into memory (if any)
+ */
+static void load_vol_csum(void)
+{
+	int ret;
+
+	if (!shfs_vol.csum_ref)
+		return;
+
+	dprintf(D_L0, "Reading checksum table...\n");
+	shfs_vol.csum = malloc(shfs_vol.csum_len * shfs_vol.chunksize);
+	shfs_vol.csum_chunk_state = calloc(shfs_vol.csum_len, sizeof(int));
+	if (!shfs_vol.csum || !shfs_vol.csum_chunk_state)
+		die();
+	ret = sync_read_chunk(&shfs_vol.s, shfs_vol.csum_ref, shfs_vol.csum_len, shfs_vol.csum);
+	if (ret < 0)
+		dief("An error occured while reading the checksum table from the volume\n");
+}
+
+/**
+ * Updates the checksum of a chunk that was written
+ */
+static void csum_store(chk_t chunk, uint32_t crc)
+{
+	uint64_t entries_per_chunk;
+
+	if (!shfs_vol.csum)
+		return;
+
+	entries_per_chunk = shfs_vol.chunksize / sizeof(uint32_t);
+	shfs_vol.csum[chunk] = crc;
+	shfs_vol.csum_chunk_state[chunk / entries_per_chunk] |= CCS_MODIFIED;
+}
+
+/* same as csum_store() but computes the checksum of buf (chunksize bytes) */
+static void csum_set(chk_t chunk, const void *buf)
+{
+	if (!shfs_vol.csum)
+		return;
+
+	csum_store(chunk, crc32c(buf, shfs_vol.chunksize));
+}
+
 /**
  * Initialize allocator
  */
@@ -625,6 +950,12 @@ static void load_vol_alist(void)
 		if (ret < 0)
 			dief("Could not register an allocator entry for backup hash table: %s\n", strerror(errno));
 	}
+	if (shfs_vol.csum_ref) {
+		dprintf(D_L0, "Registering checksum table region to allocator...\n");
+		ret = shfs_alist_register(shfs_vol.al, shfs_vol.csum_ref, shfs_vol.csum_len);
+		if (ret < 0)
+			dief("Could not register an allocator entry for checksum table: %s\n", strerror(errno));
+	}
 
 	dprintf(D_L0, "Registering containers to allocator...\n");
 	foreach_htable_el(shfs_vol.bt, el) {
@@ -636,6 +967,7 @@ static void load_vol_alist(void)
 		                    hentry->f_attr.chunk,
 		                    DIV_ROUND_UP(hentry->f_attr.offset + hentry->f_attr.len,
 		                                 shfs_vol.chunksize));
+		ptail_add_hentry(hentry);
 	}
 }
 
@@ -658,41 +990,74 @@ void mount_shfs(char *path[], unsigned int count)
 	/* load htable (uses shfs_sync_read_chunk) */
 	load_vol_htable();
 
+	/* load checksum table (uses shfs_sync_read_chunk) */
+	load_vol_csum();
+
 	/* load and initialize allocator */
 	load_vol_alist();
 }
 
+/**
+ * Writes modified chunks of the hash table (and its backup) and of the
+ * checksum table back to the volume
+ */
+static int sync_vol_meta(void)
+{
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < shfs_vol.htable_len; ++i) {
+		if (!(shfs_vol.htable_chunk_cache_state[i] & CCS_MODIFIED))
+			continue;
+		ret = sync_write_chunk(&shfs_vol.s, shfs_vol.htable_ref + i,
+		                       1,
+		                       shfs_vol.htable_chunk_cache[i]);
+		if (ret < 0)
+			return ret;
+		if (shfs_vol.htable_bak_ref) {
+			ret = sync_write_chunk(&shfs_vol.s, shfs_vol.htable_bak_ref + i,
+			                       1,
+			                       shfs_vol.htable_chunk_cache[i]);
+			if (ret < 0)
+				return ret;
+		}
+		shfs_vol.htable_chunk_cache_state[i] &= ~CCS_MODIFIED;
+	}
+
+	if (shfs_vol.csum) {
+		for (i = 0; i < shfs_vol.csum_len; ++i) {
+			if (!(shfs_vol.csum_chunk_state[i] & CCS_MODIFIED))
+				continue;
+			ret = sync_write_chunk(&shfs_vol.s, shfs_vol.csum_ref + i,
+			                       1,
+			                       (uint8_t *) shfs_vol.csum + (i * shfs_vol.chunksize));
+			if (ret < 0)
+				return ret;
+			shfs_vol.csum_chunk_state[i] &= ~CCS_MODIFIED;
+		}
+	}
+	return 0;
+}
+
 /**
  * Unmounts a previously mounted SHFS volume
  */
 void umount_shfs(void) {
   unsigned int i;
-  int ret;
 
   shfs_free_alist(shfs_vol.al);
-  for(i = 0; i < shfs_vol.htable_len; ++i) {
-    if (shfs_vol.htable_chunk_cache_state[i] & CCS_MODIFIED) {
-      /* write buffer back to disk since it has been modified */
-      ret = sync_write_chunk(&shfs_vol.s, shfs_vol.htable_ref + i,
-                             1,
-                             shfs_vol.htable_chunk_cache[i]);
-      if (ret < 0)
-	dief("An error occured while writing back the hash table to the volume!\n"
-	     "The filesystem might be in a corrupted state right now\n");
-      if (shfs_vol.htable_bak_ref) {
-	ret = sync_write_chunk(&shfs_vol.s, shfs_vol.htable_bak_ref + i,
-	                       1,
-	                       shfs_vol.htable_chunk_cache[i]);
-	if (ret < 0)
-	  dief("An error occured while writing back the hash table to the volume!\n"
-	       "The filesystem might be in a corrupted state right now\n");
-      }
-    }
-    /* free buffer */
+  free(shfs_vol.ptail);
+  if (sync_vol_meta() < 0)
+    dief("An error occured while writing back the hash table to the volume!\n"
+         "The filesystem might be in a corrupted state right now\n");
+  for(i = 0; i < shfs_vol.htable_len; ++i)
     free(shfs_vol.htable_chunk_cache[i]);
-  }
   free(shfs_vol.htable_chunk_cache);
   free(shfs_vol.htable_chunk_cache_state);
+  if (shfs_vol.csum) {
+    free(shfs_vol.csum);
+    free(shfs_vol.csum_chunk_state);
+  }
   shfs_free_btable(shfs_vol.bt);
   for(i = 0; i < shfs_vol.s.nb_members; ++i)
     close_disk(shfs_vol.s.member[i].d);
@@ -774,147 +1139,273 @@ static inline hashid shfs_mhash_type(uint8_t hfunc, uint8_t hlen) {
 	return type;
 }
 
-static int actn_addfile(struct token *j)
+/*
+ * Ingest queues: each one can take all segments of a job,
+ * so only pop blocks
+ */
+static void ingest_queue_init(struct ingest_queue *q)
+{
+	q->head = 0;
+	q->count = 0;
+	if (pthread_mutex_init(&q->lock, NULL) != 0 ||
+	    pthread_cond_init(&q->cond, NULL) != 0)
+		die();
+}
+
+static void ingest_queue_destroy(struct ingest_queue *q)
+{
+	pthread_cond_destroy(&q->cond);
+	pthread_mutex_destroy(&q->lock);
+}
+
+static void ingest_queue_push(struct ingest_queue *q, struct ingest_seg *seg)
+{
+	pthread_mutex_lock(&q->lock);
+	q->seg[(q->head + q->count) % INGEST_NB_SEGS] = seg;
+	++q->count;
+	pthread_cond_signal(&q->cond);
+	pthread_mutex_unlock(&q->lock);
+}
+
+static struct ingest_seg *ingest_queue_pop(struct ingest_queue *q)
+{
+	struct ingest_seg *seg;
+
+	pthread_mutex_lock(&q->lock);
+	while (!q->count)
+		pthread_cond_wait(&q->cond, &q->lock);
+	seg = q->seg[q->head];
+	q->head = (q->head + 1) % INGEST_NB_SEGS;
+	--q->count;
+	pthread_mutex_unlock(&q->lock);
+	return seg;
+}
+
+/* reads len bytes from a file (len is only undercut at the end of file) */
+static ssize_t ingest_read(int fd, void *buf, size_t len)
+{
+	ssize_t ret;
+	size_t done = 0;
+
+	while (done < len) {
+		ret = read(fd, (uint8_t *) buf + done, len - done);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (ret == 0)
+			break;
+		done += ret;
+	}
+	return done;
+}
+
+/*
+ * Opens a file of a token and reserves its container
+ * (small files are placed by the writer when they are committed)
+ * Has to be called with the batch lock held
+ */
+static struct ingest_file *ingest_open(struct token *j)
 {
+	struct ingest_file *f;
 	struct shfs_bentry *bentry;
-	struct shfs_hentry *hentry;
-	char str_hash[(shfs_vol.hlen * 2) + 1];
-	void *tmp_chk;
+	struct shfs_hentry *ihentry;
 	struct stat fd_stat;
-	int fd;
-	int ret;
-	size_t fsize;
-	size_t left;
-	chk_t csize;
-	size_t rlen;
-	hash512_t fhash;
-	chk_t cchk;
-	MHASH td;
-	uint64_t c;
+
+	f = calloc(1, sizeof(*f));
+	if (!f) {
+		fatal();
+		goto err;
+	}
+	f->token = j;
+	f->venc = -1;
+	f->td = MHASH_FAILED;
 
 	dprintf(D_L0, "Opening %s...\n", j->path);
-	fd = open(j->path, O_RDONLY);
-	if (fd < 0) {
+	f->fd = open(j->path, O_RDONLY);
+	if (f->fd < 0) {
 		eprintf("Could not open %s: %s\n", j->path, strerror(errno));
-		ret = -1;
-		goto err;
+		goto err_free_f;
 	}
-	ret = fstat(fd, &fd_stat);
-	if (ret < 0) {
+	if (fstat(f->fd, &fd_stat) < 0) {
 		eprintf("Could not retrieve stats from %s: %s\n", j->path, strerror(errno));
 		goto err_close_fd;
 	}
 	if (!S_ISREG(fd_stat.st_mode)) {
 		eprintf("%s is not a regular file\n", j->path);
-		ret = -1;
-		goto err_close_fd;
-	}
-
-	/* find and alloc container */
-	fsize = fd_stat.st_size;
-	csize = DIV_ROUND_UP(fsize, shfs_vol.chunksize);
-	dprintf(D_L0, "Searching for an appropriate container to store file contents (%"PRIchk" chunks)...\n", csize);
-	cchk = shfs_alist_find_free(shfs_vol.al, csize);
-	if (cchk == 0 || cchk >= shfs_vol.volsize) {
-		eprintf("Could not find appropriate volume area to store %s\n", j->path);
-		ret = -1;
 		goto err_close_fd;
 	}
-	dprintf(D_L1, "Found appropriate container at chunk %"PRIchk"\n", cchk);
-	dprintf(D_L1, "Reserving container...\n");
-	shfs_alist_register(shfs_vol.al, cchk, csize);
-
-	/* allocate temporary buffer used for I/O */
-	tmp_chk = malloc(shfs_vol.chunksize);
-	if (!tmp_chk) {
-		fatal();
-		ret = -1;
-		goto err_release_container;
+	f->fsize = fd_stat.st_size;
+	f->csize = DIV_ROUND_UP(f->fsize, shfs_vol.chunksize);
+
+	if (j->optstr3) {
+		/* pre-encoded variant: find its identity object */
+		f->venc = shfs_venc_parse(j->optstr3, strlen(j->optstr3) + 1);
+		if (hash_parse(j->optstr4, f->ihash, shfs_vol.hlen) != 0) {
+			eprintf("Could not parse identity hash digest %s for %s\n", j->optstr4, j->path);
+			goto err_close_fd;
+		}
+		bentry = shfs_btable_lookup(shfs_vol.bt, f->ihash);
+		if (!bentry) {
+			eprintf("Identity object %s of %s not found\n", j->optstr4, j->path);
+			goto err_close_fd;
+		}
+		ihentry = (struct shfs_hentry *)
+			((uint8_t *) shfs_vol.htable_chunk_cache[bentry->hentry_htchunk]
+			 + bentry->hentry_htoffset);
+		if (SHFS_HENTRY_ISLINK(ihentry) || SHFS_HENTRY_ISVARIANT(ihentry)) {
+			eprintf("Identity object %s of %s has to be a regular object\n", j->optstr4, j->path);
+			goto err_close_fd;
+		}
 	}
 
-	/* calculate hash */
 	if (shfs_vol.hfunc != SHFUNC_MANUAL) {
 		if (j->optstr2)
 			eprintf("Volume does not support manual hash digests. Ignoring specified digest for %s\n", j->path);
-
-		dprintf(D_L0, "Calculating hash of file contents...\n");
-		td = mhash_init(shfs_mhash_type(shfs_vol.hfunc, shfs_vol.hlen));
-		if (td == MHASH_FAILED) {
-			eprintf("Could not initialize hash algorithm\n");
-			ret = -1;
-			goto err_free_tmp_chk;
-		}
-		if (lseek(fd, 0, SEEK_SET) < 0) {
-			eprintf("Could not seek on %s: %s\n", j->path, strerror(errno));
-			ret = -1;
-			goto err_free_tmp_chk;
-		}
-		for (c = 0; c < csize; c++) {
-			if (c == (csize - 1))
-				rlen = fsize % shfs_vol.chunksize;
-			else
-				rlen = shfs_vol.chunksize;
-
-			ret = read(fd, tmp_chk, rlen);
-			if (ret < 0) {
-				eprintf("Could not read from %s: %s\n", j->path, strerror(errno));
-				ret = -1;
-				goto err_mhash_deinit;
-			}
-			if (cancel) {
-				ret = -2;
-				goto err_mhash_deinit;
-			}
-			mhash(td, tmp_chk, rlen); /* hash chunk */
-		}
-		mhash_deinit(td, &fhash);
 	} else {
 		if (!j->optstr2) {
 			eprintf("Missing required hash digest for %s\n", j->path);
-			ret = -1;
-			goto err_free_tmp_chk;
+			goto err_close_fd;
 		}
-		if (hash_parse(j->optstr2, fhash, shfs_vol.hlen) != 0) {
+		if (hash_parse(j->optstr2, f->fhash, shfs_vol.hlen) != 0) {
 			eprintf("Could not parse specified hash digest %s for %s\n", j->optstr2, j->path);
-			ret = -1;
-			goto err_free_tmp_chk;
+			goto err_close_fd;
+		}
+		if (shfs_btable_lookup(shfs_vol.bt, f->fhash)) {
+			eprintf("An entry with the same hash as %s already exists\n", j->path);
+			goto err_close_fd;
 		}
 	}
-	if (verbosity >= D_L0) {
-		str_hash[(shfs_vol.hlen * 2)] = '\0';
-		hash_unparse(fhash, shfs_vol.hlen, str_hash);
-		printf("Hash for %s is: %s\n",
-		       j->path,
-		       str_hash);
+
+	if (f->fsize >= shfs_vol.chunksize) {
+		dprintf(D_L0, "Searching for an appropriate container to store %s (%"PRIchk" chunks)...\n",
+		        j->path, f->csize);
+		f->cchk = shfs_alist_find_free(shfs_vol.al, f->csize);
+		if (f->cchk == 0 || f->cchk >= shfs_vol.volsize) {
+			eprintf("Could not find appropriate volume area to store %s\n", j->path);
+			goto err_close_fd;
+		}
+		dprintf(D_L1, "Reserving container at chunk %"PRIchk"...\n", f->cchk);
+		shfs_alist_register(shfs_vol.al, f->cchk, f->csize);
 	}
+	return f;
 
-	/* find place in hash list and add entry
-	 * (still in-memory, will be written to device on umount) */
-	dprintf(D_L0, "Trying to add a hash table entry...\n");
-	bentry = shfs_btable_lookup(shfs_vol.bt, fhash);
+ err_close_fd:
+	close(f->fd);
+ err_free_f:
+	free(f);
+ err:
+	return NULL;
+}
+
+/*
+ * Places a small file (packed into a partially used chunk, if possible),
+ * adds its hash table entry and releases the file
+ * Has to be called with the batch lock held
+ */
+static int ingest_commit(struct ingest_job *job, struct ingest_seg *seg)
+{
+	struct ingest_file *f = seg->f;
+	struct token *j = f->token;
+	struct shfs_bentry *bentry;
+	struct shfs_hentry *hentry;
+	struct shfs_hentry *ihentry = NULL;
+	char str_hash[(shfs_vol.hlen * 2) + 1];
+	uint64_t coff = 0;
+	int ret = f->wret;
+
+	if (ret < 0)
+		goto out;
+
+	bentry = shfs_btable_lookup(shfs_vol.bt, f->fhash);
 	if (bentry) {
-		eprintf("An entry with the same hash already exists\n");
+		eprintf("An entry with the same hash as %s already exists\n", j->path);
 		ret = -1;
-		goto err_free_tmp_chk;
+		goto out;
 	}
-	bentry = shfs_btable_addentry(shfs_vol.bt, fhash);
+	if (f->venc >= 0) {
+		bentry = shfs_btable_lookup(shfs_vol.bt, f->ihash);
+		if (!bentry) {
+			eprintf("Identity object %s of %s not found\n", j->optstr4, j->path);
+			ret = -1;
+			goto out;
+		}
+		ihentry = (struct shfs_hentry *)
+			((uint8_t *) shfs_vol.htable_chunk_cache[bentry->hentry_htchunk]
+			 + bentry->hentry_htoffset);
+	}
+
+	if (!f->cchk) {
+		/* small file: try to pack it into a partially used chunk */
+		if (f->fsize)
+			f->cchk = ptail_find(f->fsize, &coff);
+		if (f->cchk) {
+			dprintf(D_L0, "Packing %s into chunk %"PRIchk" at offset %"PRIu64"\n",
+			        j->path, f->cchk, coff);
+		} else {
+			f->cchk = shfs_alist_find_free(shfs_vol.al, f->csize);
+			if (f->cchk == 0 || f->cchk >= shfs_vol.volsize) {
+				eprintf("Could not find appropriate volume area to store %s\n", j->path);
+				f->cchk = 0;
+				ret = -1;
+				goto out;
+			}
+		}
+		shfs_alist_register(shfs_vol.al, f->cchk, f->csize);
+
+		if (coff) {
+			/* packed: keep the objects that are stored in this chunk already */
+			ret = sync_read_chunk(&shfs_vol.s, f->cchk, 1, job->pbuf);
+			if (ret < 0) {
+				eprintf("Could not read from volume '%s': %s\n", shfs_vol.volname, strerror(errno));
+				goto out;
+			}
+			memcpy((uint8_t *) job->pbuf + coff, seg->buf, f->fsize);
+			ret = sync_write_chunk(&shfs_vol.s, f->cchk, 1, job->pbuf);
+			if (ret < 0) {
+				eprintf("Could not write to volume '%s': %s\n", shfs_vol.volname, strerror(errno));
+				goto out;
+			}
+			csum_set(f->cchk, job->pbuf);
+		} else if (f->csize) {
+			ret = sync_write_chunk(&shfs_vol.s, f->cchk, 1, seg->buf);
+			if (ret < 0) {
+				eprintf("Could not write to volume '%s': %s\n", shfs_vol.volname, strerror(errno));
+				goto out;
+			}
+			csum_store(f->cchk, seg->crc[0]);
+		}
+	}
+
+	/* add hash table entry
+	 * (still in-memory, will be written to device on umount) */
+	bentry = shfs_btable_addentry(shfs_vol.bt, f->fhash);
 	if (!bentry) {
 		eprintf("Target bucket of hash table is full\n");
 		ret = -1;
-		goto err_free_tmp_chk;
+		goto out;
 	}
 	hentry = (struct shfs_hentry *)
 		((uint8_t *) shfs_vol.htable_chunk_cache[bentry->hentry_htchunk]
 		 + bentry->hentry_htoffset);
-	hash_copy(hentry->hash, fhash, shfs_vol.hlen);
-	hentry->f_attr.chunk = cchk;
-	hentry->f_attr.offset = 0;
-	hentry->f_attr.len = (uint64_t) fsize;
+	hash_copy(hentry->hash, f->fhash, shfs_vol.hlen);
+	hentry->f_attr.chunk = f->cchk;
+	hentry->f_attr.offset = coff;
+	hentry->f_attr.len = f->fsize;
 	hentry->ts_creation = gettimestamp_s();
 	hentry->flags = 0;
 	memset(hentry->f_attr.mime, 0, sizeof(hentry->f_attr.mime));
-	memset(hentry->f_attr.encoding, 0, sizeof(hentry->f_attr.encoding));  /* currently unused */
+	memset(hentry->f_attr.encoding, 0, sizeof(hentry->f_attr.encoding));
+	memset(hentry->f_attr.identity, 0, sizeof(hentry->f_attr.identity));
 	memset(hentry->name, 0, sizeof(hentry->name));
+	if (ihentry) {
+		/* variant: served with the MIME type of its identity object */
+		strncpy(hentry->f_attr.encoding, shfs_venc_name[f->venc], sizeof(hentry->f_attr.encoding) - 1);
+		memcpy(hentry->f_attr.identity, f->ihash, min(sizeof(hentry->f_attr.identity),
+		                                              (size_t) shfs_vol.hlen));
+		memcpy(hentry->f_attr.mime, ihentry->f_attr.mime, sizeof(hentry->f_attr.mime));
+	}
 	if (j->optstr0) /* mime */
 		strncpy(hentry->f_attr.mime, j->optstr0, sizeof(hentry->f_attr.mime));
 	if (j->optstr1) /* filename */
@@ -922,64 +1413,258 @@ static int actn_addfile(struct token *j)
 	else
 		strncpy(hentry->name, basename(j->path), sizeof(hentry->name));
 	shfs_vol.htable_chunk_cache_state[bentry->hentry_htchunk] |= CCS_MODIFIED;
+	ptail_add_hentry(hentry);
 
-	/* copy file contents */
-	dprintf(D_L0, "Copying file contents...\n");
-	if (lseek(fd, 0, SEEK_SET) < 0) {
-		eprintf("Could not seek on %s: %s\n", j->path, strerror(errno));
-		ret = -1;
-		goto err_free_tmp_chk;
+	if (verbosity >= D_L0) {
+		str_hash[(shfs_vol.hlen * 2)] = '\0';
+		hash_unparse(f->fhash, shfs_vol.hlen, str_hash);
+		printf("Hash for %s is: %s\n",
+		       j->path,
+		       str_hash);
 	}
 
-	left = fsize;
-	c = 0;
-	while (left) {
-		if (left > shfs_vol.chunksize) {
-			rlen = shfs_vol.chunksize;
-			left -= shfs_vol.chunksize;
-		} else {
-			rlen = left;
-			left = 0;
-			memset(tmp_chk, 0, shfs_vol.chunksize);
+ out:
+	if (ret < 0) {
+		if (f->cchk) {
+			dprintf(D_L1, "Discard container reservation of %s...\n", j->path);
+			shfs_alist_unregister(shfs_vol.al, f->cchk, f->csize);
 		}
+		++job->b->failed;
+	}
+	close(f->fd);
+	free(f);
+	return ret;
+}
 
-		ret = read(fd, tmp_chk, rlen);
-		if (ret < 0) {
-			eprintf("Could not read from %s: %s\n", j->path, strerror(errno));
-			ret = -1;
-			goto err_free_tmp_chk;
+static void *ingest_reader(void *argp)
+{
+	struct ingest_job *job = argp;
+	struct ingest_batch *b = job->b;
+	struct ingest_file *f;
+	struct ingest_seg *seg;
+	struct token *j;
+	uint64_t left;
+	size_t seglen;
+	ssize_t rlen;
+
+	for (;;) {
+		pthread_mutex_lock(&b->lock);
+		if (!b->left || cancel) {
+			pthread_mutex_unlock(&b->lock);
+			break;
 		}
+		j = b->next;
+		b->next = j->next;
+		--b->left;
+		f = ingest_open(j);
+		if (!f)
+			++b->failed;
+		pthread_mutex_unlock(&b->lock);
+		if (!f)
+			continue;
+
+		/* an empty file is passed as one segment without chunks */
+		left = f->fsize;
+		do {
+			seg = ingest_queue_pop(&job->freeq);
+			seg->f = f;
+			seg->c = (f->fsize - left) / shfs_vol.chunksize;
+			seglen = min(left, (uint64_t) b->seg_chunks * shfs_vol.chunksize);
+			seg->nb_chunks = DIV_ROUND_UP(seglen, shfs_vol.chunksize);
+			seg->len = seglen;
+			seg->ret = 0;
+
+			rlen = ingest_read(f->fd, seg->buf, seglen);
+			if (rlen < 0) {
+				eprintf("Could not read from %s: %s\n", j->path, strerror(errno));
+				seg->ret = -1;
+			} else if ((size_t) rlen < seglen) {
+				eprintf("%s was truncated while reading\n", j->path);
+				seg->ret = -1;
+			}
+			if (cancel)
+				seg->ret = -2;
+			if (seglen % shfs_vol.chunksize)
+				memset((uint8_t *) seg->buf + seglen, 0,
+				       shfs_vol.chunksize - (seglen % shfs_vol.chunksize));
+
+			left -= seglen;
+			seg->last = (left == 0 || seg->ret < 0);
+			ingest_queue_push(&job->hashq, seg);
+		} while (!seg->last);
+	}
 
-		ret = sync_write_chunk(&shfs_vol.s, cchk + c, 1, tmp_chk);
-		if (ret < 0) {
-			eprintf("Could not write to volume '%s': %s\n", shfs_vol.volname, strerror(errno));
-			ret = -1;
-			goto err_free_tmp_chk;
+	/* end of stream */
+	seg = ingest_queue_pop(&job->freeq);
+	seg->f = NULL;
+	ingest_queue_push(&job->hashq, seg);
+	return NULL;
+}
+
+static void *ingest_hasher(void *argp)
+{
+	struct ingest_job *job = argp;
+	struct ingest_file *f;
+	struct ingest_seg *seg;
+	chk_t c;
+
+	for (;;) {
+		seg = ingest_queue_pop(&job->hashq);
+		f = seg->f;
+		if (!f) {
+			ingest_queue_push(&job->writeq, seg);
+			break;
 		}
-		if (cancel) {
-			ret = -2;
-			goto err_free_tmp_chk;
+
+		if (seg->ret < 0)
+			f->hret = seg->ret;
+		if (f->hret == 0 && shfs_vol.hfunc != SHFUNC_MANUAL) {
+			if (seg->c == 0) {
+				f->td = mhash_init(shfs_mhash_type(shfs_vol.hfunc, shfs_vol.hlen));
+				if (f->td == MHASH_FAILED) {
+					eprintf("Could not initialize hash algorithm\n");
+					f->hret = -1;
+				}
+			}
+			if (f->hret == 0)
+				mhash(f->td, seg->buf, seg->len);
+		}
+		if (f->hret == 0 && shfs_vol.csum) {
+			for (c = 0; c < seg->nb_chunks; ++c)
+				seg->crc[c] = crc32c((uint8_t *) seg->buf + c * shfs_vol.chunksize,
+				                     shfs_vol.chunksize);
+		}
+		if (seg->last && f->td != MHASH_FAILED) {
+			if (f->hret == 0)
+				mhash_deinit(f->td, &f->fhash);
+			else
+				mhash_deinit(f->td, NULL);
+			f->td = MHASH_FAILED;
 		}
 
-		++c;
+		seg->ret = f->hret;
+		ingest_queue_push(&job->writeq, seg);
 	}
+	return NULL;
+}
 
-	free(tmp_chk);
-	close(fd);
+static void *ingest_writer(void *argp)
+{
+	struct ingest_job *job = argp;
+	struct ingest_batch *b = job->b;
+	struct ingest_file *f;
+	struct ingest_seg *seg;
+	chk_t c;
+	int ret;
 
-	return 0;
+	for (;;) {
+		seg = ingest_queue_pop(&job->writeq);
+		f = seg->f;
+		if (!f)
+			break;
 
- err_mhash_deinit:
-	mhash_deinit(td, NULL);
- err_free_tmp_chk:
-	free(tmp_chk);
- err_release_container:
-	dprintf(D_L1, "Discard container reservation...\n");
-	shfs_alist_unregister(shfs_vol.al, cchk, csize);
- err_close_fd:
-	close(fd);
- err:
-	return ret;
+		if (seg->ret < 0)
+			f->wret = seg->ret;
+		if (f->wret == 0 && f->cchk) {
+			ret = sync_write_chunk(&shfs_vol.s, f->cchk + seg->c, seg->nb_chunks, seg->buf);
+			if (ret < 0) {
+				eprintf("Could not write to volume '%s': %s\n", shfs_vol.volname, strerror(errno));
+				f->wret = -1;
+			}
+		}
+		if (f->wret == 0 && f->cchk && shfs_vol.csum) {
+			pthread_mutex_lock(&b->lock);
+			for (c = 0; c < seg->nb_chunks; ++c)
+				csum_store(f->cchk + seg->c + c, seg->crc[c]);
+			pthread_mutex_unlock(&b->lock);
+		}
+		if (seg->last) {
+			pthread_mutex_lock(&b->lock);
+			ingest_commit(job, seg);
+			pthread_mutex_unlock(&b->lock);
+		}
+
+		ingest_queue_push(&job->freeq, seg);
+	}
+	return NULL;
+}
+
+/* number of add-obj tokens that can be ingested as one batch */
+static unsigned int addobj_batch_len(struct token *j)
+{
+	unsigned int count = 1;
+
+	/* a variant needs its identity object to be committed already */
+	for (j = j->next; j && j->action == ADDOBJ && !j->optstr3; j = j->next)
+		++count;
+	return count;
+}
+
+static int actn_addfiles(struct token *j, unsigned int count, unsigned int nb_jobs)
+{
+	struct ingest_batch b;
+	struct ingest_job *job;
+	unsigned int i, s;
+
+	if (nb_jobs > count)
+		nb_jobs = count;
+	b.next = j;
+	b.left = count;
+	b.failed = 0;
+	b.seg_chunks = max(INGEST_SEGLEN / shfs_vol.chunksize, 1);
+	if (pthread_mutex_init(&b.lock, NULL) != 0)
+		die();
+
+	dprintf(D_L0, "Ingesting %u files with %u jobs...\n", count, nb_jobs);
+	job = calloc(nb_jobs, sizeof(*job));
+	if (!job)
+		die();
+	for (i = 0; i < nb_jobs; ++i) {
+		job[i].b = &b;
+		ingest_queue_init(&job[i].freeq);
+		ingest_queue_init(&job[i].hashq);
+		ingest_queue_init(&job[i].writeq);
+		job[i].pbuf = malloc(shfs_vol.chunksize);
+		if (!job[i].pbuf)
+			die();
+		for (s = 0; s < INGEST_NB_SEGS; ++s) {
+			job[i].seg[s].buf = malloc(b.seg_chunks * shfs_vol.chunksize);
+			job[i].seg[s].crc = malloc(b.seg_chunks * sizeof(uint32_t));
+			if (!job[i].seg[s].buf || !job[i].seg[s].crc)
+				die();
+			ingest_queue_push(&job[i].freeq, &job[i].seg[s]);
+		}
+
+		if (pthread_create(&job[i].writer, NULL, ingest_writer, &job[i]) != 0 ||
+		    pthread_create(&job[i].hasher, NULL, ingest_hasher, &job[i]) != 0 ||
+		    pthread_create(&job[i].reader, NULL, ingest_reader, &job[i]) != 0)
+			dief("Could not create ingest threads\n");
+	}
+
+	for (i = 0; i < nb_jobs; ++i) {
+		pthread_join(job[i].reader, NULL);
+		pthread_join(job[i].hasher, NULL);
+		pthread_join(job[i].writer, NULL);
+
+		for (s = 0; s < INGEST_NB_SEGS; ++s) {
+			free(job[i].seg[s].buf);
+			free(job[i].seg[s].crc);
+		}
+		free(job[i].pbuf);
+		ingest_queue_destroy(&job[i].writeq);
+		ingest_queue_destroy(&job[i].hashq);
+		ingest_queue_destroy(&job[i].freeq);
+	}
+	free(job);
+	pthread_mutex_destroy(&b.lock);
+
+	if (cancel)
+		return -2;
+	if (b.failed) {
+		eprintf("%u of %u files could not be added\n", b.failed, count);
+		return -1;
+	}
+	return 0;
 }
 
 static inline int hntosaddr(const char *hn, int ai_family, struct sockaddr *out)
@@ -1075,9 +1760,11 @@ static int actn_addlink(struct token *j)
 	struct shfs_bentry *bentry;
 	struct shfs_hentry *hentry;
 	struct shfs_host rhost;
+	struct shfs_host ahost[SHFS_LINK_MAX_NB_ALTORIGINS];
 	char str_hash[(shfs_vol.hlen * 2) + 1];
 	char str_rhost[sizeof(rhost.name) + 1];
 	struct http_parser_url u;
+	unsigned int i;
 	hash512_t fhash;
 	MHASH td;
 	int ret;
@@ -1133,9 +1820,20 @@ static int actn_addlink(struct token *j)
 		goto err;
 	}
 	strshfshost(str_rhost, sizeof(str_rhost), &rhost);
+	for (i = 0; i < j->nb_optaltorigins; ++i) {
+		dprintf(D_L0, "Quering host address for alternative origin %s...\n", j->optaltorigin[i]);
+		if ((ret = hntoshfshost(j->optaltorigin[i], strlen(j->optaltorigin[i]),
+					SHFS_HOST_TYPE_IPV4, &ahost[i])) < 0) {
+			eprintf("Hostname query for %s failed: %s\n", j->optaltorigin[i], strerror(-ret));
+			goto err;
+		}
+	}
 
 	dprintf(D_L1, "Going to add the following remote entry:\n");
 	dprintf(D_L1, " Host: %s\n", str_rhost);
+	for (i = 0; i < j->nb_optaltorigins; ++i)
+		dprintf(D_L1, " Alternative host: %"PRIu8".%"PRIu8".%"PRIu8".%"PRIu8"\n",
+			ahost[i].addr[0], ahost[i].addr[1], ahost[i].addr[2], ahost[i].addr[3]);
 	dprintf(D_L1, " Port: %"PRIu16"\n", u.port);
 	if (u.field_data[UF_PATH].len > 1 || u.field_data[UF_QUERY].len > 1)
 		dprintf(D_L1, " Path: /%s\n", j->path + u.field_data[UF_PATH].off + 1);
@@ -1210,6 +1908,10 @@ static int actn_addlink(struct token *j)
 		break;
 	}
 	memcpy(&hentry->l_attr.rhost, &rhost, sizeof(hentry->l_attr.rhost));
+	memset(hentry->l_altorigin, 0, sizeof(hentry->l_altorigin));
+	for (i = 0; i < j->nb_optaltorigins; ++i)
+		memcpy(SHFS_HENTRY_LINK_ALTORIGIN(hentry, i)->addr, ahost[i].addr,
+		       sizeof(SHFS_HENTRY_LINK_ALTORIGIN(hentry, i)->addr));
 	if ((u.field_set & (1 << UF_PATH) &&
 	     u.field_data[UF_PATH].len > 1) ||
 	    (u.field_set & (1 << UF_QUERY) &&
@@ -1259,7 +1961,8 @@ static int actn_rmfile(struct token *token)
 		((uint8_t *) shfs_vol.htable_chunk_cache[bentry->hentry_htchunk]
 		 + bentry->hentry_htoffset);
 
-	/* release container */
+	/* release container
+	 * Note: Chunks shared with packed objects stay registered by those */
 	if (!SHFS_HENTRY_ISLINK(hentry)) {
 		dprintf(D_L0, "Releasing container...\n");
 		ret = shfs_alist_unregister(shfs_vol.al, hentry->f_attr.chunk,
@@ -1278,6 +1981,9 @@ static int actn_rmfile(struct token *token)
 	hash_clear(hentry->hash, shfs_vol.hlen);
 	shfs_vol.htable_chunk_cache_state[bentry->hentry_htchunk] |= CCS_MODIFIED;
 
+	if (!SHFS_HENTRY_ISLINK(hentry) && hentry->f_attr.len)
+		ptail_reload(hentry_last_chunk(hentry));
+
  out:
 	return ret;
 }
@@ -1426,6 +2132,48 @@ static int actn_setdefault(struct token *token)
 	return ret;
 }
 
+static int actn_pin(struct token *token)
+{
+	struct shfs_bentry *bentry;
+	struct shfs_hentry *hentry;
+	hash512_t h;
+	int ret = 0;
+
+	/* parse hash string */
+	dprintf(D_L0, "Looking for hash table entry of object %s...\n", token->path);
+	ret = hash_parse(token->path, h, shfs_vol.hlen);
+	if (ret < 0) {
+		eprintf("Could not parse hash value\n");
+		ret = -1;
+		goto out;
+	}
+	/* find htable entry */
+	bentry = shfs_btable_lookup(shfs_vol.bt, h);
+	if (!bentry) {
+		eprintf("No such entry found\n");
+		ret = -1;
+		goto out;
+	}
+
+	if (token->action == UNPINOBJ) {
+		bentry_clearflags(bentry, SHFS_EFLAG_PIN);
+		goto out;
+	}
+
+	hentry = (struct shfs_hentry *)
+		 ((uint8_t *) shfs_vol.htable_chunk_cache[bentry->hentry_htchunk]
+		  + bentry->hentry_htoffset);
+	if (SHFS_HENTRY_ISLINK(hentry)) {
+		eprintf("Remote links cannot be pinned\n");
+		ret = -1;
+		goto out;
+	}
+	bentry_setflags(bentry, SHFS_EFLAG_PIN);
+
+ out:
+	return ret;
+}
+
 static int actn_ls(struct token *token)
 {
 	struct htable_el *el;
@@ -1480,10 +2228,11 @@ static int actn_ls(struct token *token)
 			       DIV_ROUND_UP(hentry->f_attr.len + hentry->f_attr.offset, shfs_vol.chunksize));
 
 		/* flags */
-		printf("  %c%c%c ",
+		printf(" %c%c%c%c ",
 		       (hentry->flags & SHFS_EFLAG_LINK)    ? 'L' : '-',
 		       (hentry->flags & SHFS_EFLAG_DEFAULT) ? 'D' : '-',
-		       (hentry->flags & SHFS_EFLAG_HIDDEN)  ? 'H' : '-');
+		       (hentry->flags & SHFS_EFLAG_HIDDEN)  ? 'H' : '-',
+		       (hentry->flags & SHFS_EFLAG_PIN)     ? 'P' : '-');
 
 		/* ltype, mime */
 		if (SHFS_HENTRY_ISLINK(hentry)) {
@@ -1501,7 +2250,10 @@ static int actn_ls(struct token *token)
 
 			printf("%-24s ", " ");
 		} else {
-			printf("      ");
+			if (SHFS_HENTRY_ISVARIANT(hentry))
+				printf("%5.5s ", hentry->f_attr.encoding);
+			else
+				printf("      ");
 			printf("%-24s ", str_mime);
 		}
 
@@ -1567,6 +2319,424 @@ static int actn_info(struct token *token)
 	return ret;
 }
 
+/*
+ * Layout optimization
+ * Objects are placed one after another behind the volume metadata: hot
+ * objects (listed in a popularity file) first, each starting at a new
+ * chunk, followed by the cold ones in their current order (small cold
+ * objects are packed). Objects that occupy the target area of the next
+ * placement are moved to the end of the free space first. Metadata is
+ * written after each move, so the volume stays consistent on aborts.
+ */
+static int opt_cmp_hentry(const void *a, const void *b)
+{
+	const struct opt_obj *oa = a;
+	const struct opt_obj *ob = b;
+
+	return (oa->hentry < ob->hentry) ? -1 : (oa->hentry > ob->hentry);
+}
+
+static int opt_cmp_order(const void *a, const void *b)
+{
+	const struct opt_obj *oa = a;
+	const struct opt_obj *ob = b;
+
+	if (oa->hot != ob->hot)
+		return ob->hot - oa->hot;
+	if (oa->hot) {
+		if (oa->score != ob->score)
+			return (oa->score > ob->score) ? -1 : 1;
+		return (oa->seq < ob->seq) ? -1 : (oa->seq > ob->seq);
+	}
+	if (oa->hentry->f_attr.chunk != ob->hentry->f_attr.chunk)
+		return (oa->hentry->f_attr.chunk < ob->hentry->f_attr.chunk) ? -1 : 1;
+	return (oa->hentry->f_attr.offset < ob->hentry->f_attr.offset) ? -1 :
+		(oa->hentry->f_attr.offset > ob->hentry->f_attr.offset);
+}
+
+/*
+ * Reads a popularity file and marks the listed objects as hot. Accepted are
+ * stats exports (export-stats: hash;laccess;hits;misses;...), dumps of
+ * the top command (...?hash name) and plain lists of hash digests
+ * (hottest first)
+ */
+static int opt_load_popularity(const char *path, struct opt_obj *obj, unsigned int nb_obj)
+{
+	FILE *fp;
+	char *line = NULL;
+	size_t line_size = 0;
+	ssize_t len;
+	char *p;
+	size_t hlen;
+	char str_hash[(shfs_vol.hlen * 2) + 1];
+	hash512_t h;
+	uint64_t laccess, hits, misses;
+	struct shfs_bentry *bentry;
+	struct opt_obj key;
+	struct opt_obj *o;
+	unsigned int seq = 0;
+	unsigned int nb_hot = 0;
+	int ret = 0;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		eprintf("Could not open popularity file %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	while ((len = getline(&line, &line_size, fp)) > 0) {
+		if (strlen(line) < (size_t) len)
+			len = 0; /* end of stats export */
+		if (len == 0)
+			break;
+
+		p = strchr(line, '?');
+		if (p)
+			++p; /* top */
+		else
+			p = line + strspn(line, " \t");
+		hlen = strspn(p, "0123456789abcdefABCDEF");
+		if (hlen != (size_t) shfs_vol.hlen * 2)
+			continue; /* e.g., header */
+		memcpy(str_hash, p, hlen);
+		str_hash[hlen] = '\0';
+		if (hash_parse(str_hash, h, shfs_vol.hlen) != 0)
+			continue;
+
+		++seq;
+		hits = 0;
+		misses = 0;
+		if (p[hlen] == ';' &&
+		    sscanf(p + hlen, ";%"SCNu64";%"SCNu64";%"SCNu64, &laccess, &hits, &misses) != 3)
+			continue;
+
+		bentry = shfs_btable_lookup(shfs_vol.bt, h);
+		if (!bentry)
+			continue; /* removed in the meantime */
+		key.hentry = (struct shfs_hentry *)
+			((uint8_t *) shfs_vol.htable_chunk_cache[bentry->hentry_htchunk]
+			 + bentry->hentry_htoffset);
+		o = bsearch(&key, obj, nb_obj, sizeof(*obj), opt_cmp_hentry);
+		if (!o || o->hot)
+			continue; /* link, empty or listed twice */
+		if (p[hlen] == ';' && hits + misses == 0)
+			continue; /* never requested */
+
+		o->hot = 1;
+		o->score = hits + misses;
+		o->seq = seq;
+		++nb_hot;
+	}
+	if (ferror(fp)) {
+		eprintf("Could not read popularity file %s: %s\n", path, strerror(errno));
+		ret = -1;
+	}
+
+	free(line);
+	fclose(fp);
+	return ret < 0 ? ret : (int) nb_hot;
+}
+
+/* min-heap of objects that still have to be placed, by current location */
+static void opt_heap_push(struct opt_heap *heap, chk_t chunk, unsigned int idx)
+{
+	unsigned int i, parent;
+
+	if (heap->count == heap->size) {
+		heap->size = heap->size ? heap->size << 1 : 1024;
+		heap->el = realloc(heap->el, sizeof(*heap->el) * heap->size);
+		if (!heap->el)
+			die();
+	}
+	for (i = heap->count++; i > 0; i = parent) {
+		parent = (i - 1) / 2;
+		if (heap->el[parent].chunk <= chunk)
+			break;
+		heap->el[i] = heap->el[parent];
+	}
+	heap->el[i].chunk = chunk;
+	heap->el[i].idx = idx;
+}
+
+static void opt_heap_pop(struct opt_heap *heap)
+{
+	struct opt_heap_el last;
+	unsigned int i, child;
+
+	last = heap->el[--heap->count];
+	for (i = 0; (child = 2 * i + 1) < heap->count; i = child) {
+		if (child + 1 < heap->count &&
+		    heap->el[child + 1].chunk < heap->el[child].chunk)
+			++child;
+		if (last.chunk <= heap->el[child].chunk)
+			break;
+		heap->el[i] = heap->el[child];
+	}
+	heap->el[i] = last;
+}
+
+#define OPT_COPY_CHUNKS 64
+
+/* copies the contents of an object to a new location and updates its entry */
+static int opt_move(struct opt_obj *o, chk_t dchk, uint64_t doff, void *buf, void *dbuf)
+{
+	struct shfs_hentry *hentry = o->hentry;
+	chk_t schk = hentry->f_attr.chunk;
+	uint64_t soff = hentry->f_attr.offset;
+	uint64_t len = hentry->f_attr.len;
+	chk_t csize = DIV_ROUND_UP(soff + len, shfs_vol.chunksize);
+	chk_t c, n, i;
+	int ret;
+
+	dprintf(D_L1, "Moving %s from chunk %"PRIchk" (+%"PRIu64") to %"PRIchk" (+%"PRIu64")\n",
+	        hentry->name, schk, soff, dchk, doff);
+	if (soff == 0 && doff == 0) {
+		for (c = 0; c < csize; c += n) {
+			n = min(csize - c, (chk_t) OPT_COPY_CHUNKS);
+			ret = sync_read_chunk(&shfs_vol.s, schk + c, n, buf);
+			if (ret < 0)
+				return ret;
+			ret = sync_write_chunk(&shfs_vol.s, dchk + c, n, buf);
+			if (ret < 0)
+				return ret;
+			for (i = 0; i < n; ++i)
+				csum_set(dchk + c + i,
+				         (uint8_t *) buf + i * shfs_vol.chunksize);
+		}
+	} else {
+		/* packed objects fit into a single chunk */
+		ret = sync_read_chunk(&shfs_vol.s, schk, 1, buf);
+		if (ret < 0)
+			return ret;
+		if (doff) {
+			ret = sync_read_chunk(&shfs_vol.s, dchk, 1, dbuf);
+			if (ret < 0)
+				return ret;
+		} else {
+			memset(dbuf, 0, shfs_vol.chunksize);
+		}
+		memcpy((uint8_t *) dbuf + doff, (uint8_t *) buf + soff, len);
+		ret = sync_write_chunk(&shfs_vol.s, dchk, 1, dbuf);
+		if (ret < 0)
+			return ret;
+		csum_set(dchk, dbuf);
+	}
+
+	/* publish the new location before the old one can be reused */
+	hentry->f_attr.chunk = dchk;
+	hentry->f_attr.offset = doff;
+	shfs_vol.htable_chunk_cache_state[o->htchunk] |= CCS_MODIFIED;
+	ret = sync_vol_meta();
+	if (ret < 0)
+		return ret;
+
+	shfs_alist_unregister(shfs_vol.al, schk, csize);
+	shfs_alist_register(shfs_vol.al, dchk, DIV_ROUND_UP(doff + len, shfs_vol.chunksize));
+	return 0;
+}
+
+/*
+ * Moves objects that were not placed yet and overlap the given area
+ * (except o itself, if it is located there already) to the end of the
+ * free space. Returns the number of moved objects
+ */
+static int opt_evict(struct opt_heap *heap, struct opt_obj *obj, struct opt_obj *o,
+                     chk_t dchk, uint64_t doff, uint64_t alen, void *buf, void *dbuf)
+{
+	struct opt_heap_el top;
+	struct opt_obj *e;
+	uint64_t astart = (uint64_t) dchk * shfs_vol.chunksize + doff;
+	uint64_t estart;
+	chk_t aend = DIV_ROUND_UP(astart + alen, shfs_vol.chunksize);
+	chk_t echk;
+	unsigned int nb_defer = 0;
+	int nb_evicted = 0;
+	int ret;
+
+	while (heap->count && heap->el[0].chunk < aend) {
+		top = heap->el[0];
+		opt_heap_pop(heap);
+		e = &obj[top.idx];
+		if (e->placed || e->hentry->f_attr.chunk != top.chunk)
+			continue; /* outdated */
+
+		estart = (uint64_t) e->hentry->f_attr.chunk * shfs_vol.chunksize
+			+ e->hentry->f_attr.offset;
+		if ((e == o && e->hentry->f_attr.chunk == dchk && e->hentry->f_attr.offset == doff) ||
+		    estart + e->hentry->f_attr.len <= astart || estart >= astart + alen) {
+			/* stays: e.g., packed objects behind the area */
+			if (nb_defer == heap->defer_size) {
+				heap->defer_size = heap->defer_size ? heap->defer_size << 1 : 64;
+				heap->defer = realloc(heap->defer, sizeof(*heap->defer) * heap->defer_size);
+				if (!heap->defer)
+					die();
+			}
+			heap->defer[nb_defer++] = top;
+			continue;
+		}
+
+		echk = shfs_alist_find_free_last(shfs_vol.al,
+		                                 DIV_ROUND_UP(e->hentry->f_attr.len,
+		                                              shfs_vol.chunksize));
+		if (!echk) {
+			eprintf("Not enough free space to relocate %s\n", e->hentry->name);
+			ret = -1;
+			goto out;
+		}
+		ret = opt_move(e, echk, 0, buf, dbuf);
+		if (ret < 0) {
+			eprintf("Could not relocate objects on volume '%s': %s\n",
+			        shfs_vol.volname, strerror(errno));
+			goto out;
+		}
+		opt_heap_push(heap, echk, top.idx);
+		++nb_evicted;
+	}
+	ret = nb_evicted;
+
+ out:
+	while (nb_defer) {
+		--nb_defer;
+		opt_heap_push(heap, heap->defer[nb_defer].chunk, heap->defer[nb_defer].idx);
+	}
+	return ret;
+}
+
+static int actn_optimize(struct token *token)
+{
+	struct htable_el *el;
+	struct shfs_bentry *bentry;
+	struct shfs_hentry *hentry;
+	struct opt_obj *obj;
+	struct opt_obj *o;
+	struct opt_heap heap = { NULL, 0, 0, NULL, 0 };
+	unsigned int nb_obj = 0;
+	unsigned int i;
+	int nb_hot;
+	void *buf;
+	void *dbuf;
+	chk_t p, csize, dchk;
+	chk_t tail = 0; /* chunk that can take packed objects */
+	uint64_t tail_end = 0;
+	uint64_t doff;
+	unsigned int nb_moved = 0, nb_evicted = 0;
+	int ret = 0;
+
+	obj = calloc(shfs_vol.htable_nb_entries, sizeof(*obj));
+	buf = malloc(OPT_COPY_CHUNKS * shfs_vol.chunksize);
+	dbuf = malloc(shfs_vol.chunksize);
+	if (!obj || !buf || !dbuf)
+		die();
+
+	foreach_htable_el(shfs_vol.bt, el) {
+		bentry = el->private;
+		hentry = (struct shfs_hentry *)
+			((uint8_t *) shfs_vol.htable_chunk_cache[bentry->hentry_htchunk]
+			 + bentry->hentry_htoffset);
+		if (SHFS_HENTRY_ISLINK(hentry) || hentry->f_attr.len == 0)
+			continue;
+		obj[nb_obj].hentry = hentry;
+		obj[nb_obj].htchunk = bentry->hentry_htchunk;
+		++nb_obj;
+	}
+	qsort(obj, nb_obj, sizeof(*obj), opt_cmp_hentry);
+
+	nb_hot = opt_load_popularity(token->path, obj, nb_obj);
+	if (nb_hot < 0) {
+		ret = -1;
+		goto out;
+	}
+	qsort(obj, nb_obj, sizeof(*obj), opt_cmp_order);
+	printf("Optimizing layout of %u objects (%d hot)...\n", nb_obj, nb_hot);
+
+	/* first chunk behind volume metadata */
+	p = 2;
+	p = max(p, shfs_vol.htable_ref + shfs_vol.htable_len);
+	if (shfs_vol.htable_bak_ref)
+		p = max(p, shfs_vol.htable_bak_ref + shfs_vol.htable_len);
+	if (shfs_vol.csum_ref)
+		p = max(p, shfs_vol.csum_ref + shfs_vol.csum_len);
+
+	for (i = 0; i < nb_obj; ++i)
+		opt_heap_push(&heap, obj[i].hentry->f_attr.chunk, i);
+
+	for (i = 0; i < nb_obj; ++i) {
+		if (cancel) {
+			ret = -2;
+			goto out;
+		}
+		o = &obj[i];
+		hentry = o->hentry;
+
+		if (!o->hot && hentry->f_attr.len < shfs_vol.chunksize && tail &&
+		    ALIGN_UP(tail_end, SHFS_PACK_ALIGN) + hentry->f_attr.len <= shfs_vol.chunksize) {
+			/* pack into the last chunk of the previous object */
+			dchk = tail;
+			doff = ALIGN_UP(tail_end, SHFS_PACK_ALIGN);
+			csize = 0;
+		} else {
+			dchk = p;
+			doff = 0;
+			csize = DIV_ROUND_UP(hentry->f_attr.len, shfs_vol.chunksize);
+		}
+
+		/* reserve target area, hot objects get their chunks exclusively */
+		if (csize)
+			shfs_alist_register(shfs_vol.al, p, csize);
+		ret = opt_evict(&heap, obj, o, dchk, doff,
+		                o->hot ? csize * shfs_vol.chunksize : hentry->f_attr.len,
+		                buf, dbuf);
+		if (ret < 0) {
+			if (csize)
+				shfs_alist_unregister(shfs_vol.al, p, csize);
+			goto out;
+		}
+		nb_evicted += ret;
+
+		if (hentry->f_attr.chunk != dchk || hentry->f_attr.offset != doff) {
+			ret = opt_move(o, dchk, doff, buf, dbuf);
+			if (ret < 0)
+				goto err_io;
+			++nb_moved;
+		}
+		if (csize)
+			shfs_alist_unregister(shfs_vol.al, p, csize);
+		o->placed = 1;
+
+		if (o->hot) {
+			tail = 0; /* hot objects do not share chunks */
+		} else if (csize) {
+			tail = p + csize - 1;
+			tail_end = hentry->f_attr.len % shfs_vol.chunksize;
+			if (!tail_end)
+				tail = 0;
+		} else {
+			tail_end = doff + hentry->f_attr.len;
+		}
+		p += csize;
+	}
+
+	/* rebuild table for packing further objects */
+	shfs_vol.nb_ptail = 0;
+	for (i = 0; i < nb_obj; ++i)
+		ptail_add_hentry(obj[i].hentry);
+
+	printf("Moved %u objects (%u evicted temporarily), data ends at chunk %"PRIchk"\n",
+	       nb_moved, nb_evicted, p);
+	goto out;
+
+ err_io:
+	eprintf("Could not relocate objects on volume '%s': %s\n", shfs_vol.volname, strerror(errno));
+	ret = -1;
+ out:
+	free(heap.el);
+	free(heap.defer);
+	free(dbuf);
+	free(buf);
+	free(obj);
+	return ret;
+}
+
 
 /******************************************************************************
  * MAIN                                                                       *
@@ -1576,6 +2746,7 @@ int main(int argc, char **argv)
 	struct args args;
 	struct token *ctoken;
 	unsigned int i;
+	unsigned int n;
 	unsigned int failed;
 	int ret;
 
@@ -1606,8 +2777,14 @@ int main(int argc, char **argv)
 
 		switch (ctoken->action) {
 		case ADDOBJ:
-			dprintf(D_L0, "*** Token %u: add-obj\n", i);
-			ret = actn_addfile(ctoken);
+			/* consecutive add-obj tokens are ingested as one batch */
+			n = addobj_batch_len(ctoken);
+			dprintf(D_L0, "*** Token %u-%u: add-obj\n", i, i + n - 1);
+			ret = actn_addfiles(ctoken, n, args.jobs);
+			for (; n > 1; --n) {
+				ctoken = ctoken->next;
+				i++;
+			}
 			break;
 		case ADDLNK:
 			dprintf(D_L0, "*** Token %u: add-lnk\n", i);
@@ -1629,6 +2806,14 @@ int main(int argc, char **argv)
 			dprintf(D_L0, "*** Token %u: clear-default\n", i);
 			ret = actn_cleardefault(ctoken);
 			break;
+		case PINOBJ:
+			dprintf(D_L0, "*** Token %u: pin\n", i);
+			ret = actn_pin(ctoken);
+			break;
+		case UNPINOBJ:
+			dprintf(D_L0, "*** Token %u: unpin\n", i);
+			ret = actn_pin(ctoken);
+			break;
 		case LSOBJS:
 			dprintf(D_L0, "*** Token %u: ls\n", i);
 			ret = actn_ls(ctoken);
@@ -1637,6 +2822,10 @@ int main(int argc, char **argv)
 			dprintf(D_L0, "*** Token %u: info\n", i);
 			ret = actn_info(ctoken);
 			break;
+		case OPTIMIZE:
+			dprintf(D_L0, "*** Token %u: optimize\n", i);
+			ret = actn_optimize(ctoken);
+			break;
 		default:
 			ret = 0;
 			break; /* unsupported token but should never happen */
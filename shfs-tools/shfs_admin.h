@@ -36,6 +36,9 @@
 #ifndef _SHFS_ADMIN_
 #define _SHFS_ADMIN_
 
+#include <pthread.h>
+#include <mhash.h>
+
 #include "tools_common.h"
 #include "shfs_defs.h"
 
@@ -51,8 +54,11 @@ enum action {
 	CATOBJ,
 	SETDEFOBJ,
 	CLEARDEFOBJ,
+	PINOBJ,
+	UNPINOBJ,
 	LSOBJS,
-	SHOWINFO
+	SHOWINFO,
+	OPTIMIZE
 };
 
 enum ltype {
@@ -69,16 +75,34 @@ struct token {
 	char *optstr0;
 	char *optstr1;
 	char *optstr2;
+	char *optstr3;
+	char *optstr4;
 	enum ltype optltype;
+	char *optaltorigin[SHFS_LINK_MAX_NB_ALTORIGINS];
+	unsigned int nb_optaltorigins;
+	unsigned int mline; /* line in manifest (0: from command line) */
 };
 
 struct args {
 	char **devpath;
 	unsigned int nb_devs;
+	unsigned int jobs; /* number of ingest pipelines */
 
 	struct token *tokens; /* list of tokens */
 };
 
+/*
+ * Small objects are packed into the unused tail of chunks that are
+ * occupied already: f_attr.offset points to the object's first byte
+ * within its (first) chunk.
+ */
+#define SHFS_PACK_ALIGN 64 /* start offsets of packed objects are aligned to this */
+
+struct shfs_ptail {
+	chk_t chunk;
+	uint64_t end; /* first unused byte in chunk (aligned) */
+};
+
 struct vol_info {
 	uuid_t uuid;
 	char volname[17];
@@ -106,6 +130,107 @@ struct vol_info {
 	/* allocator */
 	uint8_t allocator;
 	struct shfs_alist *al;
+
+	/* chunk checksums (csum_ref == 0: disabled) */
+	chk_t csum_ref;
+	chk_t csum_len;
+	uint32_t *csum;
+	int *csum_chunk_state;
+
+	/* partially used chunks (for packing) */
+	struct shfs_ptail *ptail;
+	unsigned int nb_ptail;
+	unsigned int max_ptail;
+};
+
+/*
+ * Pipelined ingest
+ * Consecutive add-obj tokens are processed as a batch by multiple jobs.
+ * Each job runs a reader, a hasher and a writer thread that pass
+ * segments (up to INGEST_SEGLEN bytes of a file) to each other, so that
+ * a file is hashed and copied to the volume in a single pass.
+ */
+#define INGEST_SEGLEN (1024 * 1024)
+#define INGEST_NB_SEGS 4 /* segment buffers per job */
+
+struct ingest_file {
+	struct token *token;
+	int fd;
+	uint64_t fsize;
+	chk_t cchk; /* 0: small file, placed by the writer */
+	chk_t csize;
+	MHASH td;
+	hash512_t fhash;
+	int venc;
+	hash512_t ihash;
+	int hret; /* status seen by the hasher */
+	int wret; /* status seen by the writer */
+};
+
+struct ingest_seg {
+	struct ingest_file *f; /* NULL: end of stream */
+	chk_t c; /* first chunk of segment, relative to container */
+	chk_t nb_chunks;
+	size_t len; /* file data in buf (rest of chunks is zeroed) */
+	int last; /* last segment of f */
+	int ret; /* < 0: file failed */
+	void *buf;
+	uint32_t *crc; /* checksum of each chunk */
+};
+
+struct ingest_queue {
+	struct ingest_seg *seg[INGEST_NB_SEGS];
+	unsigned int head;
+	unsigned int count;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+struct ingest_batch {
+	pthread_mutex_t lock; /* protects shfs_vol and the fields below */
+	struct token *next;
+	unsigned int left;
+	unsigned int failed;
+	chk_t seg_chunks;
+};
+
+struct ingest_job {
+	struct ingest_batch *b;
+	pthread_t reader;
+	pthread_t hasher;
+	pthread_t writer;
+	struct ingest_queue freeq;
+	struct ingest_queue hashq;
+	struct ingest_queue writeq;
+	struct ingest_seg seg[INGEST_NB_SEGS];
+	void *pbuf; /* chunk buffer for packing */
+};
+
+/*
+ * Layout optimization
+ */
+struct opt_obj {
+	struct shfs_hentry *hentry;
+	chk_t htchunk;
+	uint64_t score; /* requests (from stats export) */
+	unsigned int seq; /* position in popularity file */
+	int hot;
+	int placed;
+};
+
+struct opt_heap_el {
+	chk_t chunk;
+	unsigned int idx;
+};
+
+struct opt_heap {
+	struct opt_heap_el *el;
+	unsigned int count;
+	unsigned int size;
+
+	/* elements that are pushed back after an eviction */
+	struct opt_heap_el *defer;
+	unsigned int defer_size;
 };
 
 /* chunk_cache_states */
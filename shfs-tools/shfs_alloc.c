@@ -34,10 +34,428 @@
  * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
  */
 #include <stdlib.h>
+#include <stddef.h>
+#include <stdio.h>
 #include <errno.h>
 
 #include "shfs_alloc.h"
 
+#define anode_entry(n, type, member) \
+	((type *) ((char *) (n) - offsetof(type, member)))
+#define fextent_by_start(n)	anode_entry((n), struct shfs_fextent, by_start)
+#define fextent_by_len(n)	anode_entry((n), struct shfs_fextent, by_len)
+#define uextent(n)		anode_entry((n), struct shfs_uextent, node)
+
+/******************************************************************************
+ * AVL tree                                                                   *
+ ******************************************************************************/
+static inline int anode_height(struct shfs_anode *n)
+{
+	return n ? n->height : 0;
+}
+
+static inline void anode_update(struct shfs_atree *t, struct shfs_anode *n)
+{
+	int hl = anode_height(n->left);
+	int hr = anode_height(n->right);
+
+	n->height = 1 + (hl > hr ? hl : hr);
+	if (t->aug)
+		t->aug(n);
+}
+
+static inline void atree_replace_child(struct shfs_atree *t, struct shfs_anode *p,
+                                       struct shfs_anode *old, struct shfs_anode *new)
+{
+	if (!p)
+		t->root = new;
+	else if (p->left == old)
+		p->left = new;
+	else
+		p->right = new;
+}
+
+static struct shfs_anode *atree_rotate_left(struct shfs_atree *t, struct shfs_anode *x)
+{
+	struct shfs_anode *y = x->right;
+
+	x->right = y->left;
+	if (y->left)
+		y->left->parent = x;
+	y->parent = x->parent;
+	atree_replace_child(t, x->parent, x, y);
+	y->left = x;
+	x->parent = y;
+	anode_update(t, x);
+	anode_update(t, y);
+	return y;
+}
+
+static struct shfs_anode *atree_rotate_right(struct shfs_atree *t, struct shfs_anode *x)
+{
+	struct shfs_anode *y = x->left;
+
+	x->left = y->right;
+	if (y->right)
+		y->right->parent = x;
+	y->parent = x->parent;
+	atree_replace_child(t, x->parent, x, y);
+	y->right = x;
+	x->parent = y;
+	anode_update(t, x);
+	anode_update(t, y);
+	return y;
+}
+
+/* updates heights (and augmented data) from n up to the root */
+static void atree_rebalance(struct shfs_atree *t, struct shfs_anode *n)
+{
+	int bal;
+
+	while (n) {
+		anode_update(t, n);
+		bal = anode_height(n->left) - anode_height(n->right);
+		if (bal > 1) {
+			if (anode_height(n->left->left) < anode_height(n->left->right))
+				atree_rotate_left(t, n->left);
+			n = atree_rotate_right(t, n);
+		} else if (bal < -1) {
+			if (anode_height(n->right->right) < anode_height(n->right->left))
+				atree_rotate_right(t, n->right);
+			n = atree_rotate_left(t, n);
+		}
+		n = n->parent;
+	}
+}
+
+static void atree_insert(struct shfs_atree *t, struct shfs_anode *n)
+{
+	struct shfs_anode *p = NULL;
+	struct shfs_anode **link = &t->root;
+
+	while (*link) {
+		p = *link;
+		if (t->cmp(n, p) < 0)
+			link = &p->left;
+		else
+			link = &p->right;
+	}
+	n->left = NULL;
+	n->right = NULL;
+	n->parent = p;
+	*link = n;
+	atree_rebalance(t, n);
+}
+
+static void atree_remove(struct shfs_atree *t, struct shfs_anode *n)
+{
+	struct shfs_anode *s;
+	struct shfs_anode *c;
+	struct shfs_anode *fix;
+
+	if (n->left && n->right) {
+		/* replace n with its successor s */
+		for (s = n->right; s->left; s = s->left);
+		if (s->parent != n) {
+			fix = s->parent;
+			fix->left = s->right;
+			if (s->right)
+				s->right->parent = fix;
+			s->right = n->right;
+			s->right->parent = s;
+		} else {
+			fix = s;
+		}
+		s->left = n->left;
+		s->left->parent = s;
+		s->parent = n->parent;
+		atree_replace_child(t, n->parent, n, s);
+		atree_rebalance(t, fix);
+	} else {
+		c = n->left ? n->left : n->right;
+		if (c)
+			c->parent = n->parent;
+		atree_replace_child(t, n->parent, n, c);
+		atree_rebalance(t, n->parent);
+	}
+}
+
+struct shfs_anode *shfs_atree_first(struct shfs_atree *t)
+{
+	struct shfs_anode *n = t->root;
+
+	if (n)
+		while (n->left)
+			n = n->left;
+	return n;
+}
+
+struct shfs_anode *shfs_anode_next(struct shfs_anode *n)
+{
+	if (n->right) {
+		for (n = n->right; n->left; n = n->left);
+		return n;
+	}
+	while (n->parent && n->parent->right == n)
+		n = n->parent;
+	return n->parent;
+}
+
+static struct shfs_anode *shfs_anode_prev(struct shfs_anode *n)
+{
+	if (n->left) {
+		for (n = n->left; n->right; n = n->right);
+		return n;
+	}
+	while (n->parent && n->parent->left == n)
+		n = n->parent;
+	return n->parent;
+}
+
+/* frees all nodes of a (sub)tree, n is the embedded node of a malloc'ed object */
+static void atree_destroy(struct shfs_anode *n, void *(*entry)(struct shfs_anode *))
+{
+	if (!n)
+		return;
+	atree_destroy(n->left, entry);
+	atree_destroy(n->right, entry);
+	free(entry(n));
+}
+
+/******************************************************************************
+ * Extents                                                                    *
+ ******************************************************************************/
+static int fextent_cmp_start(const struct shfs_anode *a, const struct shfs_anode *b)
+{
+	const struct shfs_fextent *ea = fextent_by_start(a);
+	const struct shfs_fextent *eb = fextent_by_start(b);
+
+	return (ea->start < eb->start) ? -1 : (ea->start > eb->start);
+}
+
+static int fextent_cmp_len(const struct shfs_anode *a, const struct shfs_anode *b)
+{
+	const struct shfs_fextent *ea = fextent_by_len(a);
+	const struct shfs_fextent *eb = fextent_by_len(b);
+	chk_t la = ea->end - ea->start;
+	chk_t lb = eb->end - eb->start;
+
+	if (la != lb)
+		return (la < lb) ? -1 : 1;
+	return (ea->start < eb->start) ? -1 : (ea->start > eb->start);
+}
+
+static void fextent_aug_start(struct shfs_anode *n)
+{
+	struct shfs_fextent *e = fextent_by_start(n);
+
+	e->max_len = e->end - e->start;
+	if (n->left && fextent_by_start(n->left)->max_len > e->max_len)
+		e->max_len = fextent_by_start(n->left)->max_len;
+	if (n->right && fextent_by_start(n->right)->max_len > e->max_len)
+		e->max_len = fextent_by_start(n->right)->max_len;
+}
+
+static int uextent_cmp(const struct shfs_anode *a, const struct shfs_anode *b)
+{
+	const struct shfs_uextent *ea = uextent(a);
+	const struct shfs_uextent *eb = uextent(b);
+
+	return (ea->start < eb->start) ? -1 : (ea->start > eb->start);
+}
+
+static void *fextent_entry(struct shfs_anode *n)
+{
+	return fextent_by_start(n);
+}
+
+static void *uextent_entry(struct shfs_anode *n)
+{
+	return uextent(n);
+}
+
+/* returns the extent with the greatest start <= pos (NULL if there is none) */
+static struct shfs_anode *atree_find_le(struct shfs_anode *n, chk_t pos,
+                                        chk_t (*start)(struct shfs_anode *))
+{
+	struct shfs_anode *found = NULL;
+
+	while (n) {
+		if (start(n) <= pos) {
+			found = n;
+			n = n->right;
+		} else {
+			n = n->left;
+		}
+	}
+	return found;
+}
+
+static chk_t fextent_start(struct shfs_anode *n)
+{
+	return fextent_by_start(n)->start;
+}
+
+static chk_t uextent_start(struct shfs_anode *n)
+{
+	return uextent(n)->start;
+}
+
+static int free_add(struct shfs_alist *al, chk_t start, chk_t end)
+{
+	struct shfs_fextent *e;
+
+	e = malloc(sizeof(*e));
+	if (!e)
+		return -ENOMEM;
+	e->start = start;
+	e->end = end;
+	atree_insert(&al->free_by_start, &e->by_start);
+	atree_insert(&al->free_by_len, &e->by_len);
+	return 0;
+}
+
+static void free_del(struct shfs_alist *al, struct shfs_fextent *e)
+{
+	atree_remove(&al->free_by_start, &e->by_start);
+	atree_remove(&al->free_by_len, &e->by_len);
+	free(e);
+}
+
+/* removes [start, end) from free space (it has to be free) */
+static int free_take(struct shfs_alist *al, chk_t start, chk_t end)
+{
+	struct shfs_anode *n;
+	struct shfs_fextent *e;
+	chk_t e_start, e_end;
+	int ret = 0;
+
+	if (end > al->end)
+		end = al->end;
+	if (start >= end)
+		return 0;
+
+	n = atree_find_le(al->free_by_start.root, start, fextent_start);
+	if (!n)
+		return 0;
+	e = fextent_by_start(n);
+	if (e->end <= start)
+		return 0;
+	e_start = e->start;
+	e_end = e->end;
+	free_del(al, e);
+
+	if (e_start < start)
+		ret = free_add(al, e_start, start);
+	if (ret == 0 && end < e_end)
+		ret = free_add(al, end, e_end);
+	return ret;
+}
+
+/* returns [start, end) to free space (merged with adjacent free extents) */
+static int free_give(struct shfs_alist *al, chk_t start, chk_t end)
+{
+	struct shfs_anode *n;
+	struct shfs_anode *next;
+	struct shfs_fextent *e;
+
+	if (end > al->end)
+		end = al->end;
+	if (start >= end)
+		return 0;
+
+	n = atree_find_le(al->free_by_start.root, start, fextent_start);
+	if (n) {
+		next = shfs_anode_next(n);
+		e = fextent_by_start(n);
+		if (e->end == start) {
+			start = e->start;
+			free_del(al, e);
+		}
+	} else {
+		next = shfs_atree_first(&al->free_by_start);
+	}
+	if (next) {
+		e = fextent_by_start(next);
+		if (e->start == end) {
+			end = e->end;
+			free_del(al, e);
+		}
+	}
+	return free_add(al, start, end);
+}
+
+static struct shfs_uextent *used_add(struct shfs_alist *al, chk_t start, chk_t end,
+                                     unsigned int refcount)
+{
+	struct shfs_uextent *u;
+
+	u = malloc(sizeof(*u));
+	if (!u)
+		return NULL;
+	u->start = start;
+	u->end = end;
+	u->refcount = refcount;
+	atree_insert(&al->used, &u->node);
+	return u;
+}
+
+static void used_del(struct shfs_alist *al, struct shfs_uextent *u)
+{
+	atree_remove(&al->used, &u->node);
+	free(u);
+}
+
+/* ensures that no used extent crosses pos */
+static int used_split(struct shfs_alist *al, chk_t pos)
+{
+	struct shfs_anode *n;
+	struct shfs_uextent *u;
+	chk_t end;
+
+	n = atree_find_le(al->used.root, pos, uextent_start);
+	if (!n)
+		return 0;
+	u = uextent(n);
+	if (u->start == pos || u->end <= pos)
+		return 0;
+	end = u->end;
+	u->end = pos; /* does not change position in tree */
+	return used_add(al, pos, end, u->refcount) ? 0 : -ENOMEM;
+}
+
+/* merges used extents in [start, end) with equal neighbours */
+static void used_merge(struct shfs_alist *al, chk_t start, chk_t end)
+{
+	struct shfs_anode *n;
+	struct shfs_anode *next;
+	struct shfs_uextent *u;
+	struct shfs_uextent *unext;
+
+	n = atree_find_le(al->used.root, start, uextent_start);
+	if (n && shfs_anode_prev(n))
+		n = shfs_anode_prev(n);
+	if (!n)
+		n = shfs_atree_first(&al->used);
+
+	while (n && uextent(n)->start <= end) {
+		u = uextent(n);
+		next = shfs_anode_next(n);
+		if (!next)
+			break;
+		unext = uextent(next);
+		if (u->end == unext->start && u->refcount == unext->refcount) {
+			u->end = unext->end;
+			used_del(al, unext);
+			continue; /* try to merge the following one as well */
+		}
+		n = next;
+	}
+}
+
+/******************************************************************************
+ * Allocator                                                                  *
+ ******************************************************************************/
 struct shfs_alist *shfs_alloc_alist(chk_t area_size, uint8_t allocator)
 {
 	struct shfs_alist *alist;
@@ -52,74 +470,75 @@ struct shfs_alist *shfs_alloc_alist(chk_t area_size, uint8_t allocator)
 	if (!alist)
 		return NULL;
 
-	alist->head = NULL;
-	alist->tail = NULL;
 	alist->count = 0;
 	alist->end = area_size;
 	alist->allocator = allocator;
+	alist->used.root = NULL;
+	alist->used.cmp = uextent_cmp;
+	alist->used.aug = NULL;
+	alist->free_by_start.root = NULL;
+	alist->free_by_start.cmp = fextent_cmp_start;
+	alist->free_by_start.aug = fextent_aug_start;
+	alist->free_by_len.root = NULL;
+	alist->free_by_len.cmp = fextent_cmp_len;
+	alist->free_by_len.aug = NULL;
+
+	if (area_size && free_add(alist, 0, area_size) < 0) {
+		free(alist);
+		errno = ENOMEM;
+		return NULL;
+	}
 	return alist;
 }
 
 void shfs_free_alist(struct shfs_alist *al)
 {
-	struct shfs_aentry *cur;
-	struct shfs_aentry *next;
-
 	if (al) {
-		cur = al->head;
-		while (cur) {
-			next = cur->next;
-			free(cur);
-			cur = next;
-		}
-
+		atree_destroy(al->used.root, uextent_entry);
+		/* free extents are in both trees: free them via one */
+		atree_destroy(al->free_by_start.root, fextent_entry);
 		free(al);
 	}
 }
 
 int shfs_alist_register(struct shfs_alist *al, chk_t start, chk_t len)
 {
-	struct shfs_aentry *e;
-	struct shfs_aentry *prev;
-	struct shfs_aentry *next;
-	struct shfs_aentry *new;
+	struct shfs_anode *n;
+	struct shfs_uextent *u;
+	chk_t end = start + len;
+	chk_t pos;
+	chk_t gap_end;
+	int ret;
 
-	new = malloc(sizeof(*new));
-	if (!new)
-		return -ENOMEM;
-	new->start = start;
-	new->end = (start + len);
-
-	if (!al->head) {
-		/* list is empty */
-		al->head = new;
-		al->tail = new;
-		new->prev = NULL;
-		new->next = NULL;
-	} else {
-		/* search for predecessor which has start <= new->start  */
-		prev = NULL;
-		next = NULL;
-		for (e = al->head; e != NULL; e = e->next) {
-			if (e->start <= start) {
-				prev = e;
+	if (len) {
+		if ((ret = used_split(al, start)) < 0 ||
+		    (ret = used_split(al, end)) < 0)
+			return ret;
+
+		/* count registration for used extents within area,
+		 * gaps in between become used */
+		pos = start;
+		n = atree_find_le(al->used.root, start, uextent_start);
+		if (n && uextent(n)->end <= start)
+			n = shfs_anode_next(n);
+		while (pos < end) {
+			u = n ? uextent(n) : NULL;
+			if (u && u->start <= pos) {
+				++u->refcount;
+				pos = u->end;
+				n = shfs_anode_next(n);
 				continue;
-			} else {
-				next = e;
-				break;
 			}
-		}
 
-		new->prev = prev;
-		new->next = next;
-		if (prev)
-			prev->next = new;
-		else
-			al->head = new;
-		if (next)
-			next->prev = new;
-		else
-			al->tail = new;
+			gap_end = (u && u->start < end) ? u->start : end;
+			if (!used_add(al, pos, gap_end, 1))
+				return -ENOMEM;
+			ret = free_take(al, pos, gap_end);
+			if (ret < 0)
+				return ret;
+			pos = gap_end;
+		}
+		used_merge(al, start, end);
 	}
 
 	al->count++;
@@ -128,90 +547,111 @@ int shfs_alist_register(struct shfs_alist *al, chk_t start, chk_t len)
 
 int shfs_alist_unregister(struct shfs_alist *al, chk_t start, chk_t len)
 {
-	struct shfs_aentry *e;
-	chk_t end = (start + len);
-
-	/* search for element in the list and remove it if found */
-	for (e = al->head; e != NULL; e = e->next) {
-		if (e->start == start &&
-		    e->end == end) {
-			if (e->prev)
-				e->prev->next = e->next;
-			else
-				al->head = e->next;
-			if (e->next)
-				e->next->prev = e->prev;
-			else
-				al->tail = e->prev;
-			free(e);
-			al->count--;
-			return 0;
+	struct shfs_anode *n;
+	struct shfs_anode *next;
+	struct shfs_uextent *u;
+	chk_t end = start + len;
+	chk_t pos;
+	int ret;
+
+	if (len) {
+		/* the area has to be used completely */
+		pos = start;
+		n = atree_find_le(al->used.root, start, uextent_start);
+		while (pos < end) {
+			if (!n)
+				return -ENOENT;
+			u = uextent(n);
+			if (u->start > pos || u->end <= pos)
+				return -ENOENT;
+			pos = u->end;
+			n = shfs_anode_next(n);
+		}
+
+		if ((ret = used_split(al, start)) < 0 ||
+		    (ret = used_split(al, end)) < 0)
+			return ret;
+
+		n = atree_find_le(al->used.root, start, uextent_start);
+		while (n && uextent(n)->start < end) {
+			u = uextent(n);
+			next = shfs_anode_next(n);
+			if (--u->refcount == 0) {
+				ret = free_give(al, u->start, u->end);
+				used_del(al, u);
+				if (ret < 0)
+					return ret;
+			}
+			n = next;
 		}
+		used_merge(al, start, end);
 	}
 
-	return -ENOENT;
+	al->count--;
+	return 0;
 }
 
+/* lowest free extent that can take len chunks */
 static chk_t _shfs_alist_find_ff(struct shfs_alist *al, chk_t len)
 {
-	struct shfs_aentry *e;
-	chk_t free_start, free_end;
-
-	/* list all segments */
-	for (e = al->head; e != NULL; e = e->next) {
-		/* find actual start and end of a free space segment */
-		free_start = e->end;
-		while (e->next &&
-		       e->next->start <= e->end) {
-			if (e->next->end > free_start)
-				free_start = e->next->end;
-			e = e->next;
-		}
+	struct shfs_anode *n = al->free_by_start.root;
+	struct shfs_fextent *e;
 
-		if (e->next)
-			free_end = e->next->start;
-		else {
-			free_end = al->end;
-			if (free_end == free_start)
-				break; /* nothing else found -> cancel */
-		}
+	if (!n || fextent_by_start(n)->max_len < len)
+		return 0;
 
-		/* free_start and free_end points now to a free space segment */
-		if (free_end - free_start >= len)
-			return free_start;
+	while (n) {
+		e = fextent_by_start(n);
+		if (n->left && fextent_by_start(n->left)->max_len >= len)
+			n = n->left;
+		else if (e->end - e->start >= len)
+			return e->start;
+		else
+			n = n->right;
 	}
-
 	return 0;
 }
 
+/* smallest free extent that can take len chunks (the lowest one on ties) */
 static chk_t _shfs_alist_find_bf(struct shfs_alist *al, chk_t len)
 {
-	struct shfs_aentry *e;
-	chk_t free_start, free_end;
-
-	/* list all segments */
-	for (e = al->head; e != NULL; e = e->next) {
-		/* find actual start and end of a free space segment */
-		free_start = e->end;
-		while (e->next &&
-		       e->next->start <= e->end) {
-			if (e->next->end > free_start)
-				free_start = e->next->end;
-			e = e->next;
-		}
+	struct shfs_anode *n = al->free_by_len.root;
+	struct shfs_fextent *e;
+	struct shfs_fextent *found = NULL;
 
-		if (e->next)
-			free_end = e->next->start;
-		else {
-			free_end = al->end;
-			if (free_end == free_start)
-				break; /* nothing else found -> cancel */
+	while (n) {
+		e = fextent_by_len(n);
+		if (e->end - e->start >= len) {
+			found = e;
+			n = n->left;
+		} else {
+			n = n->right;
 		}
-
-		/* free_start and free_end points now to a free space segment */
-		printf("[FREE]  %15"PRIchk" - %15"PRIchk"\n", free_start, free_end);
 	}
+	return found ? found->start : 0;
+}
 
+/*
+ * Returns the highest area of len free chunks (the end of the highest
+ * free extent that can take it), 0 if there is none
+ */
+chk_t shfs_alist_find_free_last(struct shfs_alist *al, chk_t len)
+{
+	struct shfs_anode *n = al->free_by_start.root;
+	struct shfs_fextent *e;
+
+	if (!n || fextent_by_start(n)->max_len < len)
+		return 0;
+
+	while (n) {
+		e = fextent_by_start(n);
+		if (n->right && fextent_by_start(n->right)->max_len >= len)
+			n = n->right;
+		else if (e->end - e->start >= len)
+			return e->end - len;
+		else
+			n = n->left;
+	}
 	return 0;
 }
 
@@ -227,3 +667,24 @@ chk_t shfs_alist_find_free(struct shfs_alist *al, chk_t len)
 	}
 	return 0;
 }
+
+/******* DEBUG ********/
+void print_alist(struct shfs_alist *al)
+{
+	struct shfs_anode *n;
+	struct shfs_uextent *u;
+	struct shfs_fextent *e;
+	unsigned int i = 0;
+
+	for (n = shfs_atree_first(&al->used); n != NULL; n = shfs_anode_next(n)) {
+		u = uextent(n);
+		printf("[used%5u] %15"PRIchk" - %15"PRIchk" (len: %15"PRIchk", refs: %u)\n",
+		       i++, u->start, u->end, u->end - u->start, u->refcount);
+	}
+	i = 0;
+	for (n = shfs_atree_first(&al->free_by_start); n != NULL; n = shfs_anode_next(n)) {
+		e = fextent_by_start(n);
+		printf("[free%5u] %15"PRIchk" - %15"PRIchk" (len: %15"PRIchk")\n",
+		       i++, e->start, e->end, e->end - e->start);
+	}
+}
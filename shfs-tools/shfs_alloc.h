@@ -38,21 +38,59 @@
 
 #include "shfs_defs.h"
 
-struct shfs_aentry {
+/*
+ * Node of a balanced (AVL) binary tree, embedded into the extents
+ */
+struct shfs_anode {
+	struct shfs_anode *left;
+	struct shfs_anode *right;
+	struct shfs_anode *parent;
+	int height;
+};
+
+struct shfs_atree {
+	struct shfs_anode *root;
+	int (*cmp)(const struct shfs_anode *, const struct shfs_anode *);
+	void (*aug)(struct shfs_anode *); /* updates node from its children (optional) */
+};
+
+struct shfs_anode *shfs_atree_first(struct shfs_atree *t);
+struct shfs_anode *shfs_anode_next(struct shfs_anode *n);
+
+/*
+ * Free area of the volume
+ * It is indexed by start (first-fit) and by length (best-fit)
+ */
+struct shfs_fextent {
 	chk_t start;
 	chk_t end;
+	chk_t max_len; /* max. length within subtree of by_start */
 
-	struct shfs_aentry *next;
-	struct shfs_aentry *prev;
+	struct shfs_anode by_start;
+	struct shfs_anode by_len;
+};
+
+/*
+ * Used area of the volume
+ * Registered areas may overlap (e.g., chunks shared by packed objects):
+ * used extents do not overlap but count the registrations covering them
+ */
+struct shfs_uextent {
+	chk_t start;
+	chk_t end;
+	unsigned int refcount;
+
+	struct shfs_anode node;
 };
 
 struct shfs_alist {
 	chk_t end;
-	unsigned int count;
+	unsigned int count; /* number of registrations */
 	uint8_t allocator;
 
-	struct shfs_aentry *head;
-	struct shfs_aentry *tail;
+	struct shfs_atree used;
+	struct shfs_atree free_by_start;
+	struct shfs_atree free_by_len;
 };
 
 struct shfs_alist *shfs_alloc_alist(chk_t area_size, uint8_t allocator);
@@ -61,18 +99,10 @@ void shfs_free_alist(struct shfs_alist *al);
 int shfs_alist_register(struct shfs_alist *al, chk_t start, chk_t len);
 int shfs_alist_unregister(struct shfs_alist *al, chk_t start, chk_t len);
 chk_t shfs_alist_find_free(struct shfs_alist *al, chk_t len);
+chk_t shfs_alist_find_free_last(struct shfs_alist *al, chk_t len);
 
 
 /******* DEBUG ********/
-#include <stdio.h>
-
-static inline void print_alist(struct shfs_alist *al)
-{
-	struct shfs_aentry *e;
-	unsigned int i = 0;
-
-	for (e = al->head; e != NULL; e = e->next)
-		printf("[entry%5u] %15"PRIchk" - %15"PRIchk" (len: %15"PRIchk")\n", i++, e->start, e->end, e->end - e->start);
-}
+void print_alist(struct shfs_alist *al);
 
 #endif /* _SHFS_ALLOC_ */
@@ -52,7 +52,7 @@ int force = 0;
 /******************************************************************************
  * ARGUMENT PARSING                                                           *
  ******************************************************************************/
-const char *short_opts = "h?vVfn:s:cb:e:xF:l:";
+const char *short_opts = "h?vVfn:s:cb:e:xF:l:k";
 
 static struct option long_opts[] = {
 	{"help",		no_argument,		NULL,	'h'},
@@ -67,6 +67,7 @@ static struct option long_opts[] = {
 	{"erase",		no_argument,		NULL,	'x'},
 	{"hash-function",	required_argument,	NULL,	'F'},
 	{"hash-length",		required_argument,	NULL,	'l'},
+	{"checksums",		no_argument,		NULL,	'k'},
 	{NULL, 0, NULL, 0} /* end of list */
 };
 
@@ -94,6 +95,8 @@ static void print_usage(char *argv0)
 	printf("  -n, --name [NAME]                sets volume name to NAME\n");
 	printf("  -s, --stripesize [BYTES]         sets the stripesize for each volume member\n");
 	printf("  -c, --combined-striping          enables combined striping for the volume\n");
+	printf("  -k, --checksums                  reserves a table for chunk checksums (CRC32C)\n");
+	printf("                                    that are verified when chunks are loaded\n");
 	printf("\n");
 	printf(" Hash table related configuration:\n");
 	printf("  -b, --bucket-count [COUNT]       sets the total number of buckets\n");
@@ -145,6 +148,7 @@ static int parse_args(int argc, char **argv, struct args *args)
 	args->entries_per_bucket = 8;
 	args->fullerase = 0;
 	args->combined_striping = 0;
+	args->checksums = 0;
 
 	args->hashfunc = SHFUNC_SHA;
 	args->hashlen = 0; /* set to default after parsing */
@@ -209,6 +213,9 @@ static int parse_args(int argc, char **argv, struct args *args)
 		case 'c': /* combined striping */
 			args->combined_striping = 1;
 			break;
+		case 'k': /* checksums */
+			args->checksums = 1;
+			break;
 		case 'F': /* hash function */
 			if        (strcmp("sha", optarg) == 0) {
 				args->hashfunc = SHFUNC_SHA;
@@ -343,6 +350,7 @@ static void mkfs(struct storage *s, struct args *args)
 	struct shfs_hdr_common *hdr_common;
 	struct shfs_hdr_config *hdr_config;
 	chk_t htable_size;
+	chk_t csum_size;
 	uint64_t mdata_size;
 	uint64_t chunksize;
 	uint64_t member_dsize;
@@ -411,6 +419,10 @@ static void mkfs(struct storage *s, struct args *args)
 	hdr_config->htable_bucket_count = args->bucket_count;
 	hdr_config->htable_entries_per_bucket = args->entries_per_bucket;
 	hdr_config->allocator = args->allocator;
+	htable_size = SHFS_HTABLE_SIZE_CHUNKS(hdr_config, chunksize);
+	csum_size = SHFS_CSUM_SIZE_CHUNKS(hdr_common->vol_size, chunksize);
+	if (args->checksums)
+		hdr_config->csum_ref = hdr_config->htable_ref + htable_size; /* behind hash table */
 
 	/*
 	 * Check device size
@@ -477,7 +489,6 @@ static void mkfs(struct storage *s, struct args *args)
 			die();
 	} else {
 		/* quick format */
-		htable_size = SHFS_HTABLE_SIZE_CHUNKS(hdr_config, chunksize);
 		printf("\rErasing hash table area...\n");
 		ret = sync_erase_chunk(s, hdr_config->htable_ref, htable_size);
 		if (ret < 0)
@@ -489,6 +500,13 @@ static void mkfs(struct storage *s, struct args *args)
 			if (ret < 0)
 				die();
 		}
+
+		if (hdr_config->csum_ref) {
+			printf("\rErasing checksum table area...\n");
+			ret = sync_erase_chunk(s, hdr_config->csum_ref, csum_size);
+			if (ret < 0)
+				die();
+		}
 	}
 
 	/*
@@ -550,6 +568,7 @@ int main(int argc, char **argv)
 
 	printvar(args.hashfunc, "%"PRIu8);
 	printvar(args.allocator, "%"PRIu8);
+	printvar(args.checksums, "%d");
 	printvar(args.hashlen, "%"PRIu32);
 	printvar(args.bucket_count, "%"PRIu32);
 	printvar(args.entries_per_bucket, "%"PRIu32);
@@ -50,6 +50,7 @@ struct args {
 
 	int fullerase;
 	int combined_striping;
+	int checksums;
 
 	uint8_t  allocator;
 	uint8_t  hashfunc;
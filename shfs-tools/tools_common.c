@@ -36,6 +36,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <linux/fs.h>
 #include <getopt.h>
 #include <unistd.h>
@@ -123,9 +124,48 @@ void close_disk(struct disk *d) {
 	free(d);
 }
 
-/* Performs I/O on the member disks of a volume */
+/* Transfers a vector to/from a member disk (retries on partial transfers) */
+static int sync_io_member(struct disk *d, off_t off, struct iovec *iov, int iovcnt, int owrite)
+{
+	ssize_t ret;
+
+	while (iovcnt) {
+		if (owrite)
+			ret = pwritev(d->fd, iov, iovcnt, off);
+		else
+			ret = preadv(d->fd, iov, iovcnt, off);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			eprintf("Could not %s %s: %s\n", owrite ? "write to" : "read from",
+			        d->path, strerror(errno));
+			return -1;
+		}
+		if (ret == 0)
+			break; /* end of device */
+
+		off += ret;
+		while (iovcnt && (size_t) ret >= iov->iov_len) {
+			ret -= iov->iov_len;
+			++iov;
+			--iovcnt;
+		}
+		if (ret) {
+			iov->iov_base = (uint8_t *) iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+	return 0;
+}
+
+/* Performs I/O on the member disks of a volume
+ * The stripes of a member are consecutive on its disk, so they are
+ * transferred with a single vectored I/O call per member.
+ * Since no file offsets are changed, it can be called from multiple threads */
 int sync_io_chunk(struct storage *s, chk_t start, chk_t len, int owrite, void *buffer)
 {
+	struct iovec iov[SYNC_IO_MAXIOV];
+	int iovcnt;
 	off_t startb;
 	unsigned int m;
 	uint8_t *wptr = buffer;
@@ -143,33 +183,29 @@ int sync_io_chunk(struct storage *s, chk_t start, chk_t len, int owrite, void *b
 		end_s = (strp_t) (start_s + len);
 	}
 
-	for (strp = start_s; strp < end_s; ++strp) {
-		m = strp % s->nb_members;
+	for (m = 0; m < s->nb_members; ++m) {
+		/* first stripe that is located on this member */
+		strp = start_s + ((m + s->nb_members - (start_s % s->nb_members)) % s->nb_members);
 		startb = (strp / s->nb_members) * s->stripesize;
-		dprintf(D_MAX, " %s chunk %"PRIstrp" on member %u (at %lu KiB, length: %u KiB)\n",
-		        owrite ? "Writing to" : "Reading from",
-		        s->stripemode == SHFS_SM_COMBINED ? strp / s->nb_members: strp - (s->nb_members - 1),
-		        m,
-		        startb / 1024,
-		        s->stripesize / 1024);
-
-		if (lseek(s->member[m].d->fd, startb, SEEK_SET) < 0) {
-			eprintf("Could not seek on %s: %s\n", s->member[m].d->path, strerror(errno));
-			return -1;
-		}
-		if (owrite) {
-			if (write(s->member[m].d->fd, wptr, s->stripesize) < 0) {
-				eprintf("Could not write to %s: %s\n", s->member[m].d->path, strerror(errno));
-				return -1;
-			}
-		} else {
-			if (read(s->member[m].d->fd, wptr, s->stripesize) < 0) {
-				eprintf("Could not read from %s: %s\n", s->member[m].d->path, strerror(errno));
-				return -1;
+		iovcnt = 0;
+
+		for (; strp < end_s; strp += s->nb_members) {
+			iov[iovcnt].iov_base = wptr + (strp - start_s) * s->stripesize;
+			iov[iovcnt].iov_len = s->stripesize;
+			++iovcnt;
+
+			if (iovcnt == SYNC_IO_MAXIOV || strp + s->nb_members >= end_s) {
+				dprintf(D_MAX, " %s %d stripes on member %u (at %lu KiB, length: %u KiB)\n",
+				        owrite ? "Writing" : "Reading",
+				        iovcnt, m,
+				        startb / 1024,
+				        (iovcnt * s->stripesize) / 1024);
+				if (sync_io_member(s->member[m].d, startb, iov, iovcnt, owrite) < 0)
+					return -1;
+				startb += (off_t) iovcnt * s->stripesize;
+				iovcnt = 0;
 			}
 		}
-
-		wptr += s->stripesize;
 	}
 
 	return 0;
@@ -291,6 +327,11 @@ void print_shfs_hdr_summary(struct shfs_hdr_common *hdr_common,
 	       htable_size_chks, htable_size / 1024,
 	       hdr_config->htable_bak_ref ? "2nd copy enabled" : "No copy");
 	printf("Entry size:         %"PRIu64" Bytes (raw: %zu Bytes)\n", hentry_size, sizeof(struct shfs_hentry));
+	if (hdr_config->csum_ref)
+		printf("Chunk checksums:    CRC32C, %"PRIu64" chunks\n",
+		       SHFS_CSUM_SIZE_CHUNKS(hdr_common->vol_size, chunksize));
+	else
+		printf("Chunk checksums:    Disabled\n");
 	printf("Metadata total:     %"PRIu64" chunks\n", metadata_size(hdr_common, hdr_config));
 	printf("Available space:    %"PRIu64" chunks\n", avail_space(hdr_common, hdr_config));
 
@@ -344,6 +385,8 @@ chk_t metadata_size(struct shfs_hdr_common *hdr_common,
 	ret += htable_size_chks; /* hash table chunks */
 	if (hdr_config->htable_bak_ref)
 		ret += htable_size_chks; /* backup hash table */
+	if (hdr_config->csum_ref)
+		ret += SHFS_CSUM_SIZE_CHUNKS(hdr_common->vol_size, chunksize); /* checksum table */
 	return ret;
 }
 
@@ -112,6 +112,8 @@ struct storage {
 	uint8_t stripemode;
 };
 
+#define SYNC_IO_MAXIOV 256 /* max. number of stripes per I/O call */
+
 int sync_io_chunk(struct storage *s, chk_t start, chk_t len, int owrite, void *buffer);
 #define sync_read_chunk(s, start, len, buffer)	  \
 	sync_io_chunk((s), (start), (len), 0, (buffer))
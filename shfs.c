@@ -56,6 +56,9 @@ int shfs_errno;
 #include "shfs_stats_data.h"
 #include "shfs_stats.h"
 #endif
+#ifdef SHFS_TOP
+#include "shfs_top.h"
+#endif
 
 #ifdef SHFS_DEBUG
 #define ENABLE_DEBUG
@@ -381,6 +384,10 @@ static int load_vol_hconf(void)
 	shfs_vol.htable_nb_entries_per_chunk  = SHFS_HENTRIES_PER_CHUNK(shfs_vol.chunksize);
 	shfs_vol.htable_len                   = SHFS_HTABLE_SIZE_CHUNKS(hdr_config, shfs_vol.chunksize);
 	shfs_vol.hlen = hdr_config->hlen;
+#ifdef SHFS_CSUM
+	shfs_vol.csum_ref                     = hdr_config->csum_ref;
+	shfs_vol.csum_len                     = SHFS_CSUM_SIZE_CHUNKS(shfs_vol.volsize, shfs_vol.chunksize);
+#endif
 	ret = 0;
 
 	/* brief configuration check */
@@ -514,12 +521,19 @@ static int load_vol_htable(void)
 		bentry->hentry_htoffset = SHFS_HTABLE_ENTRY_OFFSET(i, shfs_vol.htable_nb_entries_per_chunk);
 		bentry->refcount = 0;
 		bentry->update = 0;
+		bentry->rate = 0;
 #ifdef __KERNEL__
 		bentry->ino = i + LINUX_FIRST_INO_N;
 #endif
 		init_SEMAPHORE(&bentry->updatelock, 1);
 #ifdef SHFS_STATS
 		memset(&bentry->hstats, 0, sizeof(bentry->hstats));
+#endif
+#ifdef SHFS_CACHE_PIN
+		bentry->pinned = 0;
+#endif
+#ifdef SHFS_VARIANTS
+		memset(bentry->variant, 0, sizeof(bentry->variant));
 #endif
 		if (SHFS_HENTRY_ISDEFAULT(hentry))
 			shfs_vol.def_bentry = bentry;
@@ -547,6 +561,113 @@ static int load_vol_htable(void)
 	return ret;
 }
 
+#ifdef SHFS_CSUM
+/**
+ * Reads the chunk checksum table of the volume (if any) and
+ * replaces the currently used one
+ * Note: On remount, the table has to be re-read because the tools
+ *  update checksums of chunks that get shared with packed objects
+ */
+static int load_vol_csum(int nosched)
+{
+	uint32_t *csum, *ocsum;
+	chk_t c;
+	int ret;
+
+	if (!shfs_vol.csum_ref)
+		return 0;
+
+	printd("Loading chunk checksum table...\n");
+	csum = target_malloc(shfs_vol.ioalign, shfs_vol.csum_len * shfs_vol.chunksize);
+	if (!csum)
+		return -ENOMEM;
+	for (c = 0; c < shfs_vol.csum_len; ++c) {
+		if (nosched)
+			ret = shfs_read_chunk_nosched(shfs_vol.csum_ref + c, 1,
+			                              (uint8_t *) csum + c * shfs_vol.chunksize);
+		else
+			ret = shfs_read_chunk(shfs_vol.csum_ref + c, 1,
+			                      (uint8_t *) csum + c * shfs_vol.chunksize);
+		if (ret < 0) {
+			target_free(csum);
+			return -EIO;
+		}
+	}
+
+	ocsum = shfs_vol.csum;
+	shfs_vol.csum = csum;
+	if (ocsum)
+		target_free(ocsum);
+	return 0;
+}
+#endif
+
+#ifdef SHFS_VARIANTS
+static void unlink_vol_variants(void)
+{
+	struct htable_el *el;
+	struct shfs_bentry *bentry;
+
+	foreach_htable_el(shfs_vol.bt, el) {
+		bentry = el->private;
+		memset(bentry->variant, 0, sizeof(bentry->variant));
+	}
+}
+
+static struct shfs_bentry *lookup_variant_identity(const uint8_t *id)
+{
+	struct htable_el *el;
+	hash512_t h;
+
+	if (shfs_vol.hlen <= SHFS_VARIANT_IDLEN) {
+		hash_clear(h, sizeof(h));
+		memcpy(h, id, shfs_vol.hlen);
+		return shfs_btable_lookup(shfs_vol.bt, h);
+	}
+
+	/* only a prefix of the digest is stored: search */
+	foreach_htable_el(shfs_vol.bt, el) {
+		if (memcmp(*el->h, id, SHFS_VARIANT_IDLEN) == 0)
+			return el->private;
+	}
+	return NULL;
+}
+
+/**
+ * Builds the references from identity objects to their pre-encoded variants
+ * Variants that refer to a missing object are not served by negotiation
+ */
+static void link_vol_variants(void)
+{
+	struct htable_el *el;
+	struct shfs_bentry *bentry;
+	struct shfs_bentry *ibentry;
+	int venc;
+
+	unlink_vol_variants();
+	foreach_htable_el(shfs_vol.bt, el) {
+		bentry = el->private;
+		if (hash_is_zero(*el->h, shfs_vol.hlen) ||
+		    !SHFS_HENTRY_ISVARIANT(bentry->hentry))
+			continue;
+		venc = shfs_venc_parse(bentry->hentry->f_attr.encoding,
+		                       sizeof(bentry->hentry->f_attr.encoding));
+		if (venc < 0)
+			continue;
+		ibentry = lookup_variant_identity(bentry->hentry->f_attr.identity);
+		if (!ibentry || ibentry == bentry ||
+		    hash_is_zero(ibentry->hentry->hash, shfs_vol.hlen) ||
+		    SHFS_HENTRY_ISLINK(ibentry->hentry) ||
+		    SHFS_HENTRY_ISVARIANT(ibentry->hentry)) {
+			printd("Variant at chunk %"PRIchk" has no identity object\n",
+			       bentry->hentry->f_attr.chunk);
+			continue;
+		}
+		ibentry->variant[venc] = bentry;
+	}
+}
+#endif
+
 #ifndef __KERNEL__
 static void _aiotoken_pool_objinit(struct mempool_obj *, void *);
 #endif
@@ -557,6 +678,10 @@ static void _aiotoken_pool_objinit(struct mempool_obj *, void *);
  */
 int mount_shfs(blkdev_id_t bd_id[], unsigned int count)
 {
+#ifdef SHFS_CACHE_PIN
+	struct htable_el *el;
+	struct shfs_bentry *bentry;
+#endif
 	unsigned int i;
 	int ret;
 
@@ -604,11 +729,20 @@ int mount_shfs(blkdev_id_t bd_id[], unsigned int count)
 	if (!shfs_vol.remount_chunk_buffer)
 		goto err_free_htable;
 
+#ifdef SHFS_CSUM
+	shfs_vol.csum = NULL;
+	shfs_vol.csum_nb_errors = 0;
+	ret = load_vol_csum(1);
+	if (ret < 0)
+		goto err_free_remount_buffer;
+	shfs_vol.csum_verify = (shfs_vol.csum != NULL);
+#endif
+
 	/* chunk buffer cache for I/O */
 	printd("Allocating chunk cache...\n");
 	ret = shfs_alloc_cache();
 	if (ret < 0)
-		goto err_free_remount_buffer;
+		goto err_free_csum;
 
 #ifdef SHFS_STATS
 	printd("Initializing statistics...\n");
@@ -621,7 +755,37 @@ int mount_shfs(blkdev_id_t bd_id[], unsigned int count)
 	}
 #endif
 
+#ifdef LATENCY_HIST
+	for (i = 0; i < shfs_vol.nb_members; ++i) {
+		char name[LHIST_NAME_MAXLEN];
+
+		snprintf(name, sizeof(name), "shfs-aio-m%u", i);
+		lhist_reset(&shfs_vol.member[i].aio_lat);
+		lhist_register(&shfs_vol.member[i].aio_lat, name);
+	}
+#endif
+
+#ifdef SHFS_TOP
+	shfs_top_reset();
+#endif
+#ifdef SHFS_VARIANTS
+	link_vol_variants();
+#endif
+
 	shfs_nb_open = 0;
+#ifdef SHFS_CACHE_PIN
+	printd("Pinning objects...\n");
+	foreach_htable_el(shfs_vol.bt, el) {
+		bentry = el->private;
+		if (!hash_is_zero(*el->h, shfs_vol.hlen) &&
+		    SHFS_HENTRY_ISPINNED(bentry->hentry)) {
+			ret = shfs_cache_pin_bentry(bentry);
+			if (ret < 0)
+				printd("Could not pin object at chunk %"PRIchk": %d\n",
+				       bentry->hentry->f_attr.chunk, ret);
+		}
+	}
+#endif
 	up(&shfs_mount_lock);
 	printd("SHFS volume mounted\n");
 	return 0;
@@ -630,6 +794,11 @@ int mount_shfs(blkdev_id_t bd_id[], unsigned int count)
 	goto  err_free_chunkcache;
  err_free_chunkcache:
 	shfs_free_cache();
+ err_free_csum:
+#ifdef SHFS_CSUM
+	if (shfs_vol.csum)
+		target_free(shfs_vol.csum);
+#endif
  err_free_remount_buffer:
 	target_free(shfs_vol.remount_chunk_buffer);
  err_free_htable:
@@ -664,7 +833,7 @@ int umount_shfs(int force) {
 #ifndef __KERNEL__
 		if (shfs_nb_open ||
 		    mempool_free_count(shfs_vol.aiotoken_pool) < MAX_REQUESTS ||
-		    shfs_cache_ref_count()) {
+		    shfs_cache_ref_count() > shfs_cache_pin_count()) {
 			struct htable_el *el;
 
 			/* there are still open files and/or async I/O is happening */
@@ -688,11 +857,19 @@ int umount_shfs(int force) {
 				down(&bentry->updatelock); /* wait until file is closed */
 			}
 		}
+#ifdef SHFS_CACHE_PIN
+		shfs_cache_unpin_all();
+#endif
 		shfs_free_cache();
 #endif
 
 		shfs_mounted = 0;
 		target_free(shfs_vol.remount_chunk_buffer);
+#ifdef SHFS_CSUM
+		if (shfs_vol.csum)
+			target_free(shfs_vol.csum);
+		shfs_vol.csum = NULL;
+#endif
 		for (i = 0; i < shfs_vol.htable_len; ++i) {
 			if (shfs_vol.htable_chunk_cache[i])
 				target_free(shfs_vol.htable_chunk_cache[i]);
@@ -700,6 +877,10 @@ int umount_shfs(int force) {
 		target_free(shfs_vol.htable_chunk_cache);
 		shfs_free_btable(shfs_vol.bt);
 		free_mempool(shfs_vol.aiotoken_pool);
+#ifdef LATENCY_HIST
+		for(i = 0; i < shfs_vol.nb_members; ++i)
+			lhist_unregister(&shfs_vol.member[i].aio_lat);
+#endif
 		for(i = 0; i < shfs_vol.nb_members; ++i)
 			close_blkdev(shfs_vol.member[i].bd); /* might call schedule() */
 		shfs_vol.nb_members = 0;
@@ -727,10 +908,18 @@ static int reload_vol_htable(void) {
 	void *cchk_buf;
 	void *nchk_buf = shfs_vol.remount_chunk_buffer;
 	int chash_is_zero, nhash_is_zero;
+#ifdef SHFS_CACHE_PIN
+	int pin;
+#endif
 	register chk_t c;
 	register unsigned int e;
 	int ret = 0;
 
+#ifdef SHFS_VARIANTS
+	/* entries of variants may get replaced while we yield the CPU:
+	 * serve identity objects only until the references were rebuilt */
+	unlink_vol_variants();
+#endif
 	printd("Re-reading hash table...\n");
 	for (c = 0; c < shfs_vol.htable_len; ++c) {
 		/* read chunk from disk */
@@ -767,6 +956,11 @@ static int reload_vol_htable(void) {
 					/* lock entry */
 					bentry->update = 1; /* forbid further open() */
 					down(&bentry->updatelock); /* wait until files is closed */
+#ifdef SHFS_CACHE_PIN
+					/* the object is gone: release its chunks
+					 * before its hentry gets overwritten */
+					shfs_cache_unpin_bentry(bentry);
+#endif
 
 #ifdef SHFS_STATS
 					if (!chash_is_zero) {
@@ -788,6 +982,10 @@ static int reload_vol_htable(void) {
 						/* delete entry from miss stats */
 						shfs_stats_mstats_drop(nhentry->hash);
 					}
+#endif
+#ifdef SHFS_TOP
+					/* slot is reused for another object */
+					shfs_top_drop(bentry);
 #endif
 					memcpy(chentry, nhentry, sizeof(*chentry));
 
@@ -796,6 +994,11 @@ static int reload_vol_htable(void) {
 					/* unlock entry */
 					up(&bentry->updatelock);
 					bentry->update = 0;
+#ifdef SHFS_CACHE_PIN
+					if (!nhash_is_zero && SHFS_HENTRY_ISPINNED(nhentry) &&
+					    shfs_cache_pin_bentry(bentry) < 0)
+						printd("Could not pin updated entry\n");
+#endif
 
 					/* update default entry reference */
  					if (shfs_vol.def_bentry == bentry &&
@@ -819,6 +1022,15 @@ static int reload_vol_htable(void) {
 				/* lock entry */
 				bentry->update = 1; /* forbid further open() */
 				down(&bentry->updatelock); /* wait until this file is closed */
+#ifdef SHFS_CACHE_PIN
+				/* pins done from the shell are kept unless
+				 * the pin flag of the entry was cleared */
+				pin = SHFS_HENTRY_ISPINNED(nhentry) ||
+				      (bentry->pinned && !SHFS_HENTRY_ISPINNED(chentry));
+				if (bentry->pinned &&
+				    (!pin || memcmp(chentry, nhentry, sizeof(*chentry)) != 0))
+					shfs_cache_unpin_bentry(bentry); /* re-pinned after update */
+#endif
 
 				memcpy(chentry, nhentry, sizeof(*chentry));
 
@@ -827,6 +1039,11 @@ static int reload_vol_htable(void) {
 				/* unlock entry */
 				up(&bentry->updatelock);
 				bentry->update = 0;
+#ifdef SHFS_CACHE_PIN
+				if (pin && !bentry->pinned &&
+				    shfs_cache_pin_bentry(bentry) < 0)
+					printd("Could not re-pin entry\n");
+#endif
 
 				/* update default entry reference */
 				if (shfs_vol.def_bentry == bentry &&
@@ -839,6 +1056,9 @@ static int reload_vol_htable(void) {
 	}
 
  out:
+#ifdef SHFS_VARIANTS
+	link_vol_variants();
+#endif
 	return ret;
 }
 
@@ -859,6 +1079,11 @@ int remount_shfs(void) {
 
 	/* TODO: Re-read chunk0 and check if volume UUID still matches */
 
+#ifdef SHFS_CSUM
+	ret = load_vol_csum(0);
+	if (ret < 0)
+		goto out;
+#endif
 	ret = reload_vol_htable();
  out:
 	up(&shfs_mount_lock);
@@ -875,6 +1100,9 @@ int remount_shfs(void) {
 static void _aiotoken_pool_objinit(struct mempool_obj *t_obj, void *argp)
 {
 	SHFS_AIO_TOKEN *t;
+#ifdef LATENCY_HIST
+	unsigned int i;
+#endif
 
 	t = t_obj->data;
 	t->p_obj = t_obj;
@@ -883,11 +1111,22 @@ static void _aiotoken_pool_objinit(struct mempool_obj *t_obj, void *argp)
 	t->cb = NULL;
 	t->cb_argp = NULL;
 	t->cb_cookie = NULL;
+#ifdef LATENCY_HIST
+	for (i = 0; i < SHFS_MAX_NB_MEMBERS; ++i)
+		t->_member[i] = (uint8_t) i;
+#endif
 }
 #endif
 
 static void _shfs_aio_cb(int ret, void *argp) {
+#ifdef LATENCY_HIST
+	uint8_t *m = argp;
+	SHFS_AIO_TOKEN *t = (SHFS_AIO_TOKEN *) (m - *m - offsetof(SHFS_AIO_TOKEN, _member));
+
+	lhist_add_since(&shfs_vol.member[*m].aio_lat, t->ts_setup);
+#else
 	SHFS_AIO_TOKEN *t = argp;
+#endif
 
 	if (unlikely(ret < 0))
 		t->ret = ret;
@@ -949,6 +1188,9 @@ SHFS_AIO_TOKEN *shfs_aio_chunk(chk_t start, chk_t len, int write, void *buffer,
 	t->cb = cb;
 	t->cb_argp = cb_argp;
 	t->cb_cookie = cb_cookie;
+#ifdef LATENCY_HIST
+	t->ts_setup = lhist_ticks();
+#endif
 
 	/* setup requests */
 	for (strp = start_s; strp < end_s; ++strp) {
@@ -959,8 +1201,13 @@ SHFS_AIO_TOKEN *shfs_aio_chunk(chk_t start, chk_t len, int write, void *buffer,
 
 		printd("Request: member=%u, start=%"PRIsctr"s, len=%"PRIsctr"s, dataptr=@%p\n",
 		        m, start_sec, shfs_vol.member[m].sfactor, ptr);
+#ifdef LATENCY_HIST
+		ret = blkdev_async_io(shfs_vol.member[m].bd, start_sec, shfs_vol.member[m].sfactor,
+		                      write, ptr, _shfs_aio_cb, &t->_member[m]);
+#else
 		ret = blkdev_async_io(shfs_vol.member[m].bd, start_sec, shfs_vol.member[m].sfactor,
 		                      write, ptr, _shfs_aio_cb, t);
+#endif
 		if (unlikely(ret < 0)) {
 			t->cb = NULL; /* erase callback */
 			printd("Error while setting up async I/O request for member %u: %d. "
@@ -52,6 +52,9 @@
 #ifdef SHFS_STATS
 #include "shfs_stats_data.h"
 #endif
+#ifdef LATENCY_HIST
+#include "lhist.h"
+#endif
 
 #if defined __MINIOS__ && !defined CONFIG_ARM && !defined DEBUG_BUILD
 #include <rte_memcpy.h>
@@ -78,6 +81,9 @@ struct vol_member {
 	struct blkdev *bd;
 	uuid_t uuid;
 	sector_t sfactor;
+#ifdef LATENCY_HIST
+	struct lhist aio_lat; /* shfs_aio_chunk() submit-to-completion */
+#endif
 };
 
 struct vol_info {
@@ -113,6 +119,14 @@ struct vol_info {
 	struct mempool *aiotoken_pool; /* token for async I/O */
 	struct shfs_cache *chunkcache; /* chunkcache */
 
+#ifdef SHFS_CSUM
+	chk_t csum_ref;
+	chk_t csum_len;
+	uint32_t *csum; /* chunk checksums (NULL: not available on volume) */
+	int csum_verify; /* verify chunks when they are loaded into the cache */
+	uint64_t csum_nb_errors; /* mismatches since mount */
+#endif
+
 #ifdef SHFS_STATS
 	struct shfs_mstats mstats;
 #endif
@@ -183,6 +197,13 @@ struct _shfs_aio_token {
 	void *cb_cookie;
 	void *cb_argp;
 
+#ifdef LATENCY_HIST
+	uint64_t ts_setup; /* lhist ticks */
+	/* _member[m] = m: per-member argp of block device requests,
+	 * the token is found by subtracting the member index */
+	uint8_t _member[SHFS_MAX_NB_MEMBERS];
+#endif
+
 	struct _shfs_aio_token *_prev; /* token chains (used by shfs_cache) */
 	struct _shfs_aio_token *_next;
 };
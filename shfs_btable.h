@@ -76,8 +76,15 @@ struct shfs_bentry {
 #ifdef SHFS_STATS
 	struct shfs_el_stats hstats;
 #endif /* SHFS_STATS */
+#ifdef SHFS_CACHE_PIN
+	int pinned; /* chunks are held by the cache (see: shfs_cache_pin_bentry()) */
+#endif
+#ifdef SHFS_VARIANTS
+	struct shfs_bentry *variant[SHFS_NB_VENCS]; /* pre-encoded variants of this object */
+#endif
 
 	void *cookie; /* shfs_fio: upper layer software can attach cookies to open files */
+	uint32_t rate; /* shfs_fio: delivery rate cap in bytes/s set by upper layer (0: none) */
 #ifdef __KERNEL__
 	/* Inode number allocated for this file */
 	int ino;
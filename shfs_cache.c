@@ -37,6 +37,9 @@
 
 #include "shfs_cache.h"
 #include "likely.h"
+#ifdef SHFS_CSUM
+#include "crc32c.h"
+#endif
 
 #if (defined SHFS_CACHE_DEBUG || defined SHFS_DEBUG)
 #define ENABLE_DEBUG
@@ -181,6 +184,13 @@ int shfs_alloc_cache(void)
     cc->htmask = htlen - 1;
     cc->nb_entries = 0;
     cc->nb_ref_entries = 0;
+#ifdef SHFS_CACHE_PIN
+    cc->nb_pin_entries = 0;
+    /* Note: without a pre-allocated pool (SHFS_CACHE_GROW),
+     * pinning is not possible */
+    cc->pin_budget = cc->pool ?
+	    (((uint64_t) mempool_nb_objs(cc->pool)) * SHFS_CACHE_PIN_BUDGET) / 100 : 0;
+#endif
 
     shfs_vol.chunkcache = cc;
     shfs_cache_stats_reset();
@@ -337,6 +347,28 @@ void shfs_free_cache(void)
     shfs_vol.chunkcache = NULL;
 }
 
+#ifdef SHFS_CSUM
+/*
+ * Verifies a chunk that was just loaded against the volume's
+ * checksum table. Chunks without a checksum (0) are not verified.
+ */
+static inline int _cce_verify(struct shfs_cache_entry *cce)
+{
+    uint32_t csum;
+
+    if (!shfs_vol.csum_verify)
+	return 0;
+    csum = shfs_vol.csum[cce->addr];
+    if (csum == 0 || likely(crc32c(cce->buffer, shfs_vol.chunksize) == csum))
+	return 0;
+
+    printd("Checksum mismatch at chunk %"PRIchk"\n", cce->addr);
+    ++shfs_vol.csum_nb_errors;
+    shfs_cache_stat_inc(csumerr);
+    return -EIO;
+}
+#endif
+
 static void _cce_aiocb(SHFS_AIO_TOKEN *t, void *cookie, void *argp)
 {
     struct shfs_cache_entry *cce = (struct shfs_cache_entry *) cookie;
@@ -347,6 +379,10 @@ static void _cce_aiocb(SHFS_AIO_TOKEN *t, void *cookie, void *argp)
     BUG_ON(t != cce->t);
 
     ret = shfs_aio_finalize(t);
+#ifdef SHFS_CSUM
+    if (ret >= 0)
+	ret = _cce_verify(cce);
+#endif
     cce->t = NULL;
     cce->invalid = (ret < 0) ? 1 : 0;
     printd("Cache I/O at chunk %"PRIchk" returned: %d\n", cce->addr, ret);
@@ -442,7 +478,7 @@ static inline struct shfs_cache_entry *shfs_cache_add(chk_t addr)
 }
 
 #if (SHFS_CACHE_READAHEAD > 0)
-static inline void shfs_cache_readahead(chk_t addr)
+static inline void shfs_cache_readahead(chk_t addr, chk_t end)
 {
 	struct shfs_cache_entry *cce;
 	register chk_t i;
@@ -450,8 +486,8 @@ static inline void shfs_cache_readahead(chk_t addr)
 	for (i = 1; i <= SHFS_CACHE_READAHEAD; ++i) {
 		register chk_t addri = addr + i;
 
-		if (unlikely((addri) >= shfs_vol.volsize))
-			return; /* end of volume */
+		if (unlikely((addri) >= end))
+			return; /* end of object or volume */
 		cce = shfs_cache_find(addri);
 		if (!cce) {
 			cce = shfs_cache_add(addri);
@@ -474,7 +510,7 @@ static inline void shfs_cache_readahead(chk_t addr)
 }
 #endif
 
-int shfs_cache_aread(chk_t addr, shfs_aiocb_t *cb, void *cb_cookie, void *cb_argp, struct shfs_cache_entry **cce_out, SHFS_AIO_TOKEN **t_out)
+int shfs_cache_aread_lim(chk_t addr, chk_t end, shfs_aiocb_t *cb, void *cb_cookie, void *cb_argp, struct shfs_cache_entry **cce_out, SHFS_AIO_TOKEN **t_out)
 {
     struct shfs_cache_entry *cce;
     SHFS_AIO_TOKEN *t;
@@ -520,7 +556,7 @@ int shfs_cache_aread(chk_t addr, shfs_aiocb_t *cb, void *cb_cookie, void *cb_arg
 #ifndef SHFS_CACHE_DISABLE
 #if (SHFS_CACHE_READAHEAD > 0)
     /* try to read ahead next addresses */
-    shfs_cache_readahead(addr);
+    shfs_cache_readahead(addr, min(end, shfs_vol.volsize));
 #endif
 #endif /* SHFS_CACHE_DISABLE */
     shfs_aio_submit();
@@ -742,6 +778,83 @@ void shfs_cache_release_ioabort(struct shfs_cache_entry *cce, SHFS_AIO_TOKEN *t)
     }
 }
 
+#ifdef SHFS_CACHE_PIN
+#define shfs_cache_hentry_nb_chunks(hentry) \
+	DIV_ROUND_UP((hentry)->f_attr.offset + (hentry)->f_attr.len, shfs_vol.chunksize)
+
+/* Note: Callers have to hold shfs_mount_lock */
+int shfs_cache_pin_bentry(struct shfs_bentry *bentry)
+{
+    struct shfs_hentry *hentry = bentry->hentry;
+    struct shfs_cache_entry *cce;
+    chk_t c, nb_chunks;
+    int ret;
+
+    if (unlikely(!shfs_mounted))
+	return -ENODEV;
+    if (bentry->pinned)
+	return -EALREADY;
+    if (SHFS_HENTRY_ISLINK(hentry))
+	return -EINVAL;
+
+    nb_chunks = shfs_cache_hentry_nb_chunks(hentry);
+    if (shfs_vol.chunkcache->nb_pin_entries + nb_chunks > shfs_vol.chunkcache->pin_budget)
+	return -ENOSPC;
+
+    printd("Pin %"PRIchk" chunks starting at %"PRIchk"\n", nb_chunks, hentry->f_attr.chunk);
+    for (c = 0; c < nb_chunks; ++c) {
+	cce = shfs_cache_read(hentry->f_attr.chunk + c); /* calls schedule() */
+	if (!cce) {
+	    ret = -errno;
+	    goto err_unpin;
+	}
+	/* the reference of the read is kept by the pin */
+	++shfs_vol.chunkcache->nb_pin_entries;
+    }
+    bentry->pinned = 1;
+    return 0;
+
+ err_unpin:
+    while (c) {
+	--c;
+	cce = shfs_cache_find(hentry->f_attr.chunk + c);
+	BUG_ON(!cce);
+	shfs_cache_release(cce);
+	--shfs_vol.chunkcache->nb_pin_entries;
+    }
+    return ret;
+}
+
+void shfs_cache_unpin_bentry(struct shfs_bentry *bentry)
+{
+    struct shfs_hentry *hentry = bentry->hentry;
+    struct shfs_cache_entry *cce;
+    chk_t c, nb_chunks;
+
+    if (!bentry->pinned)
+	return;
+
+    nb_chunks = shfs_cache_hentry_nb_chunks(hentry);
+    printd("Unpin %"PRIchk" chunks starting at %"PRIchk"\n", nb_chunks, hentry->f_attr.chunk);
+    for (c = 0; c < nb_chunks; ++c) {
+	/* pinned buffers are referenced: they are still linked to the hash table */
+	cce = shfs_cache_find(hentry->f_attr.chunk + c);
+	BUG_ON(!cce);
+	shfs_cache_release(cce); /* buffer becomes evictable */
+	--shfs_vol.chunkcache->nb_pin_entries;
+    }
+    bentry->pinned = 0;
+}
+
+void shfs_cache_unpin_all(void)
+{
+    struct htable_el *el;
+
+    foreach_htable_el(shfs_vol.bt, el)
+	shfs_cache_unpin_bentry((struct shfs_bentry *) el->private);
+}
+#endif /* SHFS_CACHE_PIN */
+
 #ifdef SHFS_CACHE_INFO
 int shcmd_shfs_cache_info(FILE *cio, int argc, char *argv[])
 {
@@ -799,6 +912,10 @@ int shcmd_shfs_cache_info(FILE *cio, int argc, char *argv[])
 	        htlen);
 	fprintf(cio, " Current max list depth:             %12"PRIu32"\n",
 	        max_depth);
+#ifdef SHFS_CACHE_PIN
+	fprintf(cio, " Number of pinned buffers:           %12"PRIu64" (budget: %"PRIu64")\n",
+	        shfs_cache_pin_count(), shfs_vol.chunkcache->pin_budget);
+#endif
 #if SHFS_CACHE_READAHEAD
 	fprintf(cio, " Buffer read-ahead:                  %12"PRIu32"\n",
 	        SHFS_CACHE_READAHEAD);
@@ -829,6 +946,9 @@ int shcmd_shfs_cache_info(FILE *cio, int argc, char *argv[])
 	fprintf(cio, "  Out of memory:                     %12"PRIu32"\n", shfs_cache_stat_get(memerr));
 	fprintf(cio, "  Successful I/O:                    %12"PRIu32"\n", shfs_cache_stat_get(iosuc));
 	fprintf(cio, "  Failed I/O:                        %12"PRIu32"\n", shfs_cache_stat_get(ioerr));
+#ifdef SHFS_CSUM
+	fprintf(cio, "   Checksum mismatches:              %12"PRIu32"\n", shfs_cache_stat_get(csumerr));
+#endif
 #endif
 
 #ifdef SHFS_CACHE_DEBUG
@@ -39,6 +39,7 @@
 #include "shfs_cache.h"
 #include "shfs_defs.h"
 #include "shfs.h"
+#include "shfs_btable.h"
 
 #include "dlist.h"
 #include "mempool.h"
@@ -72,6 +73,15 @@
 #endif
 #endif
 
+#ifdef SHFS_CACHE_PIN
+#ifdef SHFS_CACHE_DISABLE
+#error "SHFS_CACHE_PIN requires the chunk cache (SHFS_CACHE_DISABLE is set)"
+#endif
+#ifndef SHFS_CACHE_PIN_BUDGET
+#define SHFS_CACHE_PIN_BUDGET 25 /* max. percentage of pool buffers that can be pinned */
+#endif
+#endif
+
 /*#define SHFS_CACHE_GROW*/ /* uncomment this line to allow the cache to grow in size by
 			     * allocating more buffers on demand (via malloc()). When
 			     * SHFS_GROW_THRESHOLD is defined, left system memory 
@@ -116,6 +126,10 @@ struct shfs_cache {
 	uint32_t htmask;
 	uint64_t nb_ref_entries;
 	uint64_t nb_entries;
+#ifdef SHFS_CACHE_PIN
+	uint64_t nb_pin_entries; /* references held by pinned objects (part of nb_ref_entries) */
+	uint64_t pin_budget;
+#endif
 
 #ifdef SHFS_CACHE_STATS
 	struct {
@@ -128,6 +142,7 @@ struct shfs_cache {
 		uint32_t memerr;
 		uint32_t iosuc;
 		uint32_t ioerr;
+		uint32_t csumerr; /* chunks failed checksum verification (part of ioerr) */
 	} stats;
 #endif /* SHFS_CACHE_STATS */
 
@@ -161,6 +176,44 @@ void shfs_free_cache(void);
 #define shfs_cache_ref_count() \
 	(shfs_vol.chunkcache->nb_ref_entries)
 
+/* number of buffers that can be picked for a new I/O without waiting:
+ * free buffers of the pool and loaded buffers that are not referenced */
+#ifdef SHFS_CACHE_GROW
+#define shfs_cache_avail_count() \
+	(UINT32_MAX) /* buffers are allocated on demand */
+#else
+#define shfs_cache_avail_count() \
+	((uint32_t) (mempool_free_count(shfs_vol.chunkcache->pool) + \
+	             shfs_vol.chunkcache->nb_entries - \
+	             shfs_vol.chunkcache->nb_ref_entries))
+#endif
+
+#ifdef SHFS_CACHE_PIN
+/*
+ * Pinned objects keep a reference on each of their chunk buffers: they are
+ * never put back to the available list and thus never evicted or flushed.
+ * The number of pinned buffers is limited by pin_budget so that enough
+ * buffers are left for regular caching.
+ *
+ * shfs_cache_pin_bentry() reads the object synchronously (calls schedule())
+ * and returns:
+ *  -EINVAL: Object is a link
+ *  -ENOSPC: Pinning the object would exceed the budget
+ *  -EALREADY: Object is pinned already
+ *  or the error of a failed chunk read
+ * Note: The location of an object must not change while it is pinned,
+ *       unpin it before its hentry is updated
+ */
+int shfs_cache_pin_bentry(struct shfs_bentry *bentry);
+void shfs_cache_unpin_bentry(struct shfs_bentry *bentry);
+void shfs_cache_unpin_all(void);
+#define shfs_cache_pin_count() \
+	(shfs_vol.chunkcache->nb_pin_entries)
+#else
+#define shfs_cache_pin_count() \
+	(0)
+#endif
+
 /*
  * Function to read one chunk from the SHFS volume through the cache
  *
@@ -191,8 +244,14 @@ void shfs_free_cache(void);
  *
  * Note: This cache implementation can only be used for read-only operation
  *       because buffers can be shared.
+ *
+ * shfs_cache_aread_lim() does not read ahead chunks at or behind end. Callers
+ * pass the end of the object they read: Small objects are packed into shared
+ * chunks so that reading ahead behind them would load unrelated data.
  */
-int shfs_cache_aread(chk_t addr, shfs_aiocb_t *cb, void *cb_cookie, void *cb_argp, struct shfs_cache_entry **cce_out, SHFS_AIO_TOKEN **t_out);
+int shfs_cache_aread_lim(chk_t addr, chk_t end, shfs_aiocb_t *cb, void *cb_cookie, void *cb_argp, struct shfs_cache_entry **cce_out, SHFS_AIO_TOKEN **t_out);
+#define shfs_cache_aread(addr, cb, cb_cookie, cb_argp, cce_out, t_out) \
+	shfs_cache_aread_lim((addr), shfs_vol.volsize, (cb), (cb_cookie), (cb_argp), (cce_out), (t_out))
 
 /*
  * Function to retrieve a blank SHFS buffer from the cache for custom I/O
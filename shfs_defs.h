@@ -40,6 +40,7 @@
 #include <sys/types.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <stdint.h>
 #include <time.h>
 #include <inttypes.h>
@@ -165,8 +166,18 @@ struct shfs_hdr_config {
 	uint32_t           htable_bucket_count;
 	uint32_t           htable_entries_per_bucket;
 	uint8_t            allocator;
+	chk_t              csum_ref; /* if 0 => no chunk checksums */
 } __attribute__((packed));
 
+/*
+ * Chunk checksum table (optional)
+ * One CRC32C per volume chunk. The checksum is taken over
+ * the full chunk and written by the tools whenever they write object
+ * data. 0 means that there is no checksum for the chunk (e.g., headers).
+ */
+#define SHFS_CSUM_SIZE_CHUNKS(vol_size, chunksize) \
+	DIV_ROUND_UP((uint64_t) (vol_size) * sizeof(uint32_t), (chunksize))
+
 /**
  * SHFS entry (container description)
  * Note: character strings fields are not necessarily null-terminated
@@ -175,12 +186,41 @@ struct shfs_hdr_config {
 #define SHFS_EFLAG_HIDDEN    0x1
 #define SHFS_EFLAG_DEFAULT   0x8
 #define SHFS_EFLAG_LINK      0x4
+#define SHFS_EFLAG_PIN       0x10 /* keep object in cache */
 
 /* l_attr.type */
 #define SHFS_LTYPE_REDIRECT  0x0
 #define SHFS_LTYPE_RAW       0x1
 #define SHFS_LTYPE_AUTO      0x2
 
+/*
+ * Alternative origins of a link (failover/load balancing)
+ * Note: They are stored in the padding area of an entry so that
+ *       the size of an entry stays SHFS_HENTRY_SIZE. Alternative origins
+ *       are reached on the same port as the primary one (l_attr.rport).
+ *       Unused slots are zero.
+ */
+#define SHFS_LINK_MAX_NB_ALTORIGINS 2
+
+struct shfs_altorigin {
+	uint8_t            addr[4]; /* IPv4 */
+} __attribute__((packed));
+
+/*
+ * Pre-encoded variants (e.g., gzip) of an object
+ * Note: A variant is a regular object with f_attr.encoding set.
+ *       f_attr.identity holds the (first bytes of the) hash digest of the
+ *       object that it encodes, the identity version. It uses space of
+ *       the entry that is occupied by l_attr on links only.
+ */
+#define SHFS_VARIANT_IDLEN 32
+
+/* variant encodings, in order of preference */
+#define SHFS_VENC_BR         0
+#define SHFS_VENC_ZSTD       1
+#define SHFS_VENC_GZIP       2
+#define SHFS_NB_VENCS        3
+
 struct shfs_hentry {
 	hash512_t          hash; /* hash digest */
 
@@ -193,6 +233,7 @@ struct shfs_hentry {
 
 			char      mime[32]; /* internet media type */
 			char      encoding[16]; /* set on pre-encoded content */
+			uint8_t   identity[SHFS_VARIANT_IDLEN]; /* see below */
 		} f_attr __attribute__((packed));
 
 		/* SHFS_EFLAG_LINK set */
@@ -207,6 +248,9 @@ struct shfs_hentry {
 	uint64_t           ts_creation;
 	uint8_t            flags;
 	char               name[64];
+
+	/* SHFS_EFLAG_LINK set */
+	struct shfs_altorigin l_altorigin[SHFS_LINK_MAX_NB_ALTORIGINS];
 } __attribute__((packed));
 
 #define SHFS_MIN_CHUNKSIZE 4096
@@ -236,6 +280,10 @@ struct shfs_hentry {
 	((hentry)->flags & (SHFS_EFLAG_DEFAULT))
 #define SHFS_HENTRY_ISLINK(hentry) \
 	((hentry)->flags & (SHFS_EFLAG_LINK))
+#define SHFS_HENTRY_ISPINNED(hentry) \
+	((hentry)->flags & (SHFS_EFLAG_PIN))
+#define SHFS_HENTRY_ISVARIANT(hentry) \
+	(!SHFS_HENTRY_ISLINK((hentry)) && (hentry)->f_attr.encoding[0] != '\0')
 
 #define SHFS_HENTRY_LINKATTR(hentry) \
 	((hentry)->l_attr)
@@ -244,6 +292,25 @@ struct shfs_hentry {
 
 #define SHFS_HENTRY_LINK_TYPE(hentry) \
 	((SHFS_HENTRY_LINKATTR((hentry))).type)
+#define SHFS_HENTRY_LINK_ALTORIGIN(hentry, i) \
+	(&((hentry)->l_altorigin[(i)]))
+#define SHFS_ALTORIGIN_ISSET(ao) \
+	((ao)->addr[0] != 0)
+
+static const char * const shfs_venc_name[SHFS_NB_VENCS] = {
+	"br", "zstd", "gzip"
+};
+
+/* returns SHFS_VENC_* of an encoding string or -1 if it is unknown */
+static inline int shfs_venc_parse(const char *enc, size_t maxlen)
+{
+	int i;
+
+	for (i = 0; i < SHFS_NB_VENCS; ++i)
+		if (strncasecmp(enc, shfs_venc_name[i], maxlen) == 0)
+			return i;
+	return -1;
+}
 
 #ifndef __SHFS_TOOLS__
 static inline int uuid_compare(const uuid_t uu1, const uuid_t uu2)
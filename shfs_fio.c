@@ -44,6 +44,9 @@
 #ifdef SHFS_STATS
 #include "shfs_stats.h"
 #endif
+#ifdef SHFS_TOP
+#include "shfs_top.h"
+#endif
 
 /*
  * Register open on bentry and return it on success
@@ -73,6 +76,9 @@ static inline SHFS_FD _shfs_fio_open_bentry(struct shfs_bentry *bentry)
 	estats = shfs_stats_from_bentry(bentry);
 	estats->laccess = gettimestamp_s();
 	++estats->h;
+#endif
+#ifdef SHFS_TOP
+	shfs_top_hit(bentry);
 #endif
 	return (SHFS_FD) bentry;
 }
@@ -168,6 +174,24 @@ SHFS_FD shfs_fio_openh(hash512_t h)
 	return _shfs_fio_open_bentry(bentry);
 }
 
+#ifdef SHFS_VARIANTS
+SHFS_FD shfs_fio_open_variant(SHFS_FD f, unsigned int venc)
+{
+	struct shfs_bentry *bentry = (struct shfs_bentry *) f;
+
+	if (unlikely(!shfs_mounted)) {
+		errno = ENODEV;
+		return NULL;
+	}
+	if (venc >= SHFS_NB_VENCS || !bentry->variant[venc]) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	return _shfs_fio_open_bentry(bentry->variant[venc]);
+}
+#endif
+
 /*
  * Opens a clone of an already opened file descriptor
  * This clone has to be closed by shfs_fio_close(), too.
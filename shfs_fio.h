@@ -64,6 +64,15 @@ SHFS_FD shfs_fio_openh(hash512_t h);
  * Creates a file descriptor clone
  */
 SHFS_FD shfs_fio_openf(SHFS_FD f);
+#ifdef SHFS_VARIANTS
+/**
+ * Opens the pre-encoded variant (SHFS_VENC_*) of an opened file
+ * errno is set to ENOENT if there is no such variant
+ */
+SHFS_FD shfs_fio_open_variant(SHFS_FD f, unsigned int venc);
+#define shfs_fio_has_variant(f, venc) \
+	((f)->variant[(venc)] != NULL)
+#endif
 /**
  * Closes a file descriptor
  */
@@ -85,6 +94,8 @@ void shfs_fio_size(SHFS_FD f, uint64_t *out); /* returns 0 on links */
 	(SHFS_HENTRY_LINKATTR((f)->hentry).rport)
 #define shfs_fio_link_rhost(f) \
 	(&(SHFS_HENTRY_LINKATTR((f)->hentry).rhost))
+#define shfs_fio_link_altorigin(f, i) \
+	(SHFS_HENTRY_LINK_ALTORIGIN((f)->hentry, (i)))
 void shfs_fio_link_rpath(SHFS_FD f, char *out, size_t outlen); /* null-termination is ensured */
 
 /**
@@ -128,6 +139,15 @@ static inline int shfs_fio_set_cookie(SHFS_FD f, void *cookie) {
 #define shfs_fio_clear_cookie(f) \
   do { (f)->cookie = NULL; } while (0)
 
+/**
+ * Delivery rate caps (bytes/s, 0: none)
+ * They are not stored on the volume
+ */
+#define shfs_fio_rate(f) \
+	((f)->rate)
+#define shfs_fio_set_rate(f, r) \
+  do { (f)->rate = (r); } while (0)
+
 /*
  * Simple but synchronous file read
  * Note: Busy-waiting is used
@@ -149,7 +169,8 @@ static inline int shfs_fio_cache_aread(SHFS_FD f, chk_t offset, shfs_aiocb_t *cb
     if (unlikely(!(shfs_is_fchk_in_bound(f, offset))))
 	return -EINVAL;
     addr = shfs_volchk_fchk(f, offset);
-    return shfs_cache_aread(addr, cb, cb_cookie, cb_argp, cce_out, t_out);
+    return shfs_cache_aread_lim(addr, shfs_volchk_fchk(f, shfs_fio_size_chks(f)),
+                                cb, cb_cookie, cb_argp, cce_out, t_out);
 }
 #endif /* __KERNEL__ */
 
@@ -357,6 +357,59 @@ static int shcmd_shfs_stats_export(FILE *cio, int argc, char *argv[])
 	return ret;
 }
 
+#ifdef LATENCY_HIST
+static int shcmd_latency_export(FILE *cio, int argc, char *argv[])
+{
+	struct lhist *h;
+	char sbuf[256];
+	int slen;
+	int ret = 0;
+
+	/* mount lock serializes exports and (un)registering of histograms */
+	down(&shfs_mount_lock);
+	_stats_dev_reset();
+
+	slen = snprintf(sbuf, sizeof(sbuf),
+	                "a%uk(name);u%us(count);u%us(sum);u8g(min);u8g(p50);u8g(p90);u8g(p99);u8g(p999);u8g(max)\n",
+	                (unsigned int) LHIST_NAME_MAXLEN,
+	                (unsigned int) member_size(struct lhist, count),
+	                (unsigned int) member_size(struct lhist, sum));
+	ret = _stats_dev_write(sbuf, slen);
+	if (unlikely(ret < 0))
+		goto out;
+
+	/* values are in ns */
+	foreach_lhist(h) {
+		slen = snprintf(sbuf, sizeof(sbuf),
+		                "%s;%"PRIu64";%"PRIu64";%"PRIu64";%"PRIu64";%"PRIu64";%"PRIu64";%"PRIu64";%"PRIu64"\n",
+		                h->name, h->count,
+		                lhist_ticks_to_ns(h->sum),
+		                h->count ? lhist_ticks_to_ns(h->min) : 0,
+		                lhist_ticks_to_ns(lhist_quantile(h, 500000)),
+		                lhist_ticks_to_ns(lhist_quantile(h, 900000)),
+		                lhist_ticks_to_ns(lhist_quantile(h, 990000)),
+		                lhist_ticks_to_ns(lhist_quantile(h, 999000)),
+		                lhist_ticks_to_ns(h->max));
+		ret = _stats_dev_write(sbuf, slen);
+		if (unlikely(ret < 0))
+			goto out;
+	}
+
+	ret = _stats_dev_write("", 1); /* terminating zero */
+	if (unlikely(ret < 0))
+		goto out;
+
+	ret = _stats_dev_flush();
+	if (unlikely(ret < 0))
+		goto out;
+
+	ret = 0;
+ out:
+	up(&shfs_mount_lock);
+	return ret;
+}
+#endif
+
 #ifdef HAVE_CTLDIR
 int register_shfs_stats_tools(struct ctldir *cd)
 #else
@@ -372,6 +425,13 @@ int register_shfs_stats_tools(void)
 			ctldir_register_shcmd(cd, "export-stats", shcmd_shfs_stats_export);
 #endif
 		shell_register_cmd("export-stats", shcmd_shfs_stats_export);
+#ifdef LATENCY_HIST
+#ifdef HAVE_CTLDIR
+		if (cd)
+			ctldir_register_shcmd(cd, "export-latency", shcmd_latency_export);
+#endif
+		shell_register_cmd("export-latency", shcmd_latency_export);
+#endif
 	}
 
 	return 0;
@@ -42,6 +42,12 @@
 #include "shfs_cache.h"
 #include "shfs_fio.h"
 #include "shell.h"
+#ifdef SHFS_TOP
+#include "shfs_top.h"
+#endif
+#ifdef SHFS_CSUM
+#include "crc32c.h"
+#endif
 
 #ifdef HAVE_CTLDIR
 #include "target/ctldir.h"
@@ -98,10 +104,11 @@ static int shcmd_shfs_ls(FILE *cio, int argc, char *argv[])
 			        DIV_ROUND_UP(hentry->f_attr.len + hentry->f_attr.offset, shfs_vol.chunksize));
 
 		/* flags */
-		fprintf(cio, "  %c%c%c ",
+		fprintf(cio, " %c%c%c%c ",
 		        (hentry->flags & SHFS_EFLAG_LINK)    ? 'L' : '-',
 		        (hentry->flags & SHFS_EFLAG_DEFAULT) ? 'D' : '-',
-		        (hentry->flags & SHFS_EFLAG_HIDDEN)  ? 'H' : '-');
+		        (hentry->flags & SHFS_EFLAG_HIDDEN)  ? 'H' : '-',
+		        (hentry->flags & SHFS_EFLAG_PIN)     ? 'P' : '-');
 
 		/* ltype, mime */
 		if (SHFS_HENTRY_ISLINK(hentry)) {
@@ -119,7 +126,10 @@ static int shcmd_shfs_ls(FILE *cio, int argc, char *argv[])
 
 			fprintf(cio, "%-24s ", " ");
 		} else {
-			fprintf(cio, "      ");
+			if (SHFS_HENTRY_ISVARIANT(hentry))
+				fprintf(cio, "%5.5s ", hentry->f_attr.encoding);
+			else
+				fprintf(cio, "      ");
 			fprintf(cio, "%-24s ", str_mime);
 		}
 
@@ -166,8 +176,9 @@ static int shcmd_shfs_file(FILE *cio, int argc, char *argv[])
 {
 	char strsbuf[64];
 	char strlbuf[128];
+	struct shfs_altorigin *ao;
 	uint64_t fsize;
-	unsigned int i;
+	unsigned int i, j;
 	SHFS_FD f;
 	int ret = 0;
 
@@ -201,6 +212,15 @@ static int shcmd_shfs_file(FILE *cio, int argc, char *argv[])
 				break;
 			}
 			fprintf(cio, "\n");
+
+			for (j = 0; j < SHFS_LINK_MAX_NB_ALTORIGINS; ++j) {
+				ao = shfs_fio_link_altorigin(f, j);
+				if (!SHFS_ALTORIGIN_ISSET(ao))
+					continue;
+				fprintf(cio, "%s: alternative origin: %"PRIu8".%"PRIu8".%"PRIu8".%"PRIu8":%"PRIu16"\n",
+					argv[i], ao->addr[0], ao->addr[1], ao->addr[2], ao->addr[3],
+					shfs_fio_link_rport(f));
+			}
 		} else {
 			shfs_fio_mime(f, strlbuf, sizeof(strlbuf));
 			fprintf(cio, "%s: %s, ", argv[i], strlbuf);
@@ -595,6 +615,15 @@ static int shcmd_shfs_info(FILE *cio, int argc, char *argv[])
 	        shfs_vol.htable_bak_ref ? "2nd copy enabled" : "No copy");
 	fprintf(cio, "Entry size:         %u Bytes (raw: %zu Bytes)\n",
 	        SHFS_HENTRY_SIZE, sizeof(struct shfs_hentry));
+#ifdef SHFS_CSUM
+	if (shfs_vol.csum)
+		fprintf(cio, "Chunk checksums:    CRC32C (%s%s), %"PRIu64" mismatches\n",
+		        crc32c_hw() ? "hardware" : "software",
+		        shfs_vol.csum_verify ? "" : ", verification off",
+		        shfs_vol.csum_nb_errors);
+	else
+		fprintf(cio, "Chunk checksums:    Not available\n");
+#endif
 
 	fprintf(cio, "\n");
 	fprintf(cio, "Member stripe size: %"PRIu32" KiB\n", shfs_vol.stripesize / 1024);
@@ -615,6 +644,92 @@ static int shcmd_shfs_info(FILE *cio, int argc, char *argv[])
 	return ret;
 }
 
+#ifdef SHFS_CACHE_PIN
+static int shcmd_shfs_pin(FILE *cio, int argc, char *argv[])
+{
+	struct htable_el *el;
+	struct shfs_bentry *bentry;
+	char str_hash[(shfs_vol.hlen * 2) + 1];
+	char str_name[sizeof(bentry->hentry->name) + 1];
+	SHFS_FD f;
+	int ret = 0;
+
+	down(&shfs_mount_lock);
+	if (!shfs_mounted) {
+		fprintf(cio, "No SHFS filesystem is mounted\n");
+		ret = -1;
+		goto out;
+	}
+
+	if (argc <= 1) {
+		/* list pinned objects */
+		str_hash[(shfs_vol.hlen * 2)] = '\0';
+		str_name[sizeof(bentry->hentry->name)] = '\0';
+		foreach_htable_el(shfs_vol.bt, el) {
+			bentry = el->private;
+			if (!bentry->pinned)
+				continue;
+			hash_unparse(*el->h, shfs_vol.hlen, str_hash);
+			strncpy(str_name, bentry->hentry->name, sizeof(bentry->hentry->name));
+			fprintf(cio, "?%s %c %s\n", str_hash,
+			        SHFS_HENTRY_ISPINNED(bentry->hentry) ? 'P' : '-',
+			        str_name);
+		}
+		fprintf(cio, "%"PRIu64" of %"PRIu64" buffers pinned\n",
+		        shfs_cache_pin_count(), shfs_vol.chunkcache->pin_budget);
+		goto out;
+	}
+
+	f = shfs_fio_open(argv[1]);
+	if (!f) {
+		fprintf(cio, "Could not open %s: %s\n", argv[1], strerror(errno));
+		ret = -1;
+		goto out;
+	}
+	ret = shfs_cache_pin_bentry(f);
+	shfs_fio_close(f);
+	if (ret < 0) {
+		fprintf(cio, "Could not pin %s: %s\n", argv[1], strerror(-ret));
+		ret = -1;
+	}
+
+ out:
+	up(&shfs_mount_lock);
+	return ret;
+}
+
+static int shcmd_shfs_unpin(FILE *cio, int argc, char *argv[])
+{
+	SHFS_FD f;
+	int ret = 0;
+
+	if (argc <= 1) {
+		fprintf(cio, "Usage: %s [file]\n", argv[0]);
+		return -1;
+	}
+
+	down(&shfs_mount_lock);
+	if (!shfs_mounted) {
+		fprintf(cio, "No SHFS filesystem is mounted\n");
+		ret = -1;
+		goto out;
+	}
+
+	f = shfs_fio_open(argv[1]);
+	if (!f) {
+		fprintf(cio, "Could not open %s: %s\n", argv[1], strerror(errno));
+		ret = -1;
+		goto out;
+	}
+	shfs_cache_unpin_bentry(f);
+	shfs_fio_close(f);
+
+ out:
+	up(&shfs_mount_lock);
+	return ret;
+}
+#endif
+
 #ifdef HAVE_CTLDIR
 int register_shfs_tools(struct ctldir *cd)
 #else
@@ -631,6 +746,13 @@ int register_shfs_tools(void)
 		ctldir_register_shcmd(cd, "prefetch", shcmd_shfs_prefetch_cache);
 		ctldir_register_shcmd(cd, "shfs-info", shcmd_shfs_info);
 		ctldir_register_shcmd(cd, "cache-info", shcmd_shfs_cache_info);
+#ifdef SHFS_TOP
+		ctldir_register_shcmd(cd, "shfs-top", shcmd_shfs_top);
+#endif
+#ifdef SHFS_CACHE_PIN
+		ctldir_register_shcmd(cd, "pin", shcmd_shfs_pin);
+		ctldir_register_shcmd(cd, "unpin", shcmd_shfs_unpin);
+#endif
 		ctldir_register_shcmd(cd, "ls", shcmd_shfs_ls);
 		ctldir_register_shcmd(cd, "df", shcmd_shfs_dumpfile);
 	}
@@ -656,6 +778,13 @@ int register_shfs_tools(void)
 #ifdef SHFS_CACHE_INFO
 	shell_register_cmd("cache-info", shcmd_shfs_cache_info);
 #endif
+#ifdef SHFS_TOP
+	shell_register_cmd("shfs-top", shcmd_shfs_top);
+#endif
+#ifdef SHFS_CACHE_PIN
+	shell_register_cmd("pin", shcmd_shfs_pin);
+	shell_register_cmd("unpin", shcmd_shfs_unpin);
+#endif
 #endif
 
 	return 0;
@@ -0,0 +1,339 @@
+/*
+ * Heavy hitter tracking for SHFS volumes
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+#include <target/sys.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "likely.h"
+#include "shfs.h"
+#include "shfs_defs.h"
+#include "shfs_top.h"
+#include "shfs_tools.h"
+
+#ifndef min
+#define min(a, b) \
+    ({ __typeof__ (a) __a = (a); \
+       __typeof__ (b) __b = (b); \
+       __a < __b ? __a : __b; })
+#endif
+
+struct shfs_top_sketch {
+	unsigned int nb;
+	struct shfs_bentry *key[SHFS_TOP_K];
+	uint64_t cnt[SHFS_TOP_K];
+	uint64_t err[SHFS_TOP_K];
+};
+
+static struct {
+	uint64_t epoch; /* current epoch number */
+	struct shfs_top_sketch s[SHFS_TOP_NB_EPOCHS][SHFS_TOP_NB_METRICS];
+
+	/* merge buffer for queries */
+	struct shfs_top_el merge[SHFS_TOP_NB_EPOCHS * SHFS_TOP_K];
+} _top;
+
+static inline void _shfs_top_clear_epoch(unsigned int i)
+{
+	unsigned int m;
+
+	for (m = 0; m < SHFS_TOP_NB_METRICS; ++m)
+		_top.s[i][m].nb = 0;
+}
+
+/*
+ * Epochs are advanced lazily: slots of epochs that were skipped
+ * (no activity) are cleared on the next update or query
+ */
+static void _shfs_top_rotate(void)
+{
+	uint64_t now = gettimestamp_s() / SHFS_TOP_EPOCH_LEN;
+	uint64_t n;
+
+	if (likely(now == _top.epoch))
+		return;
+
+	if (unlikely(now < _top.epoch)) {
+		/* clock was set back */
+		shfs_top_reset();
+		_top.epoch = now;
+		return;
+	}
+
+	n = min(now - _top.epoch, (uint64_t) SHFS_TOP_NB_EPOCHS);
+	while (n) {
+		_shfs_top_clear_epoch((now - n + 1) % SHFS_TOP_NB_EPOCHS);
+		--n;
+	}
+	_top.epoch = now;
+}
+
+void _shfs_top_add(struct shfs_bentry *bentry, enum shfs_top_metric m, uint64_t val)
+{
+	struct shfs_top_sketch *s;
+	unsigned int i, imin;
+
+	_shfs_top_rotate();
+	s = &_top.s[_top.epoch % SHFS_TOP_NB_EPOCHS][m];
+
+	for (i = 0; i < s->nb; ++i) {
+		if (s->key[i] == bentry) {
+			s->cnt[i] += val;
+			return;
+		}
+	}
+
+	if (s->nb < SHFS_TOP_K) {
+		i = s->nb++;
+		s->key[i] = bentry;
+		s->cnt[i] = val;
+		s->err[i] = 0;
+		return;
+	}
+
+	/* replace the counter with the smallest count
+	 * Note: A linear search is fine for small K */
+	imin = 0;
+	for (i = 1; i < SHFS_TOP_K; ++i) {
+		if (s->cnt[i] < s->cnt[imin])
+			imin = i;
+	}
+	s->key[imin] = bentry;
+	s->err[imin] = s->cnt[imin];
+	s->cnt[imin] += val;
+}
+
+/*
+ * Removes an object from all summaries
+ * (e.g., because its bentry is going to be reused)
+ */
+void shfs_top_drop(struct shfs_bentry *bentry)
+{
+	struct shfs_top_sketch *s;
+	unsigned int e, m, i;
+
+	for (e = 0; e < SHFS_TOP_NB_EPOCHS; ++e) {
+		for (m = 0; m < SHFS_TOP_NB_METRICS; ++m) {
+			s = &_top.s[e][m];
+			for (i = 0; i < s->nb; ++i) {
+				if (s->key[i] == bentry) {
+					--s->nb;
+					s->key[i] = s->key[s->nb];
+					s->cnt[i] = s->cnt[s->nb];
+					s->err[i] = s->err[s->nb];
+					break;
+				}
+			}
+		}
+	}
+}
+
+void shfs_top_reset(void)
+{
+	unsigned int e;
+
+	for (e = 0; e < SHFS_TOP_NB_EPOCHS; ++e)
+		_shfs_top_clear_epoch(e);
+}
+
+static int _shfs_top_cmp_bentry(const void *a, const void *b)
+{
+	uintptr_t ka = (uintptr_t) ((const struct shfs_top_el *) a)->bentry;
+	uintptr_t kb = (uintptr_t) ((const struct shfs_top_el *) b)->bentry;
+
+	return (ka > kb) - (ka < kb);
+}
+
+static int _shfs_top_cmp_cnt(const void *a, const void *b)
+{
+	uint64_t ca = ((const struct shfs_top_el *) a)->cnt;
+	uint64_t cb = ((const struct shfs_top_el *) b)->cnt;
+
+	return (ca < cb) - (ca > cb); /* descending */
+}
+
+unsigned int shfs_top_get(enum shfs_top_metric m, unsigned int window,
+                          struct shfs_top_el *out, unsigned int n)
+{
+	struct shfs_top_sketch *s;
+	struct shfs_top_el *el;
+	unsigned int nb_epochs, e, i, nb_merge, nb_out;
+	uint64_t smin, summin;
+
+	_shfs_top_rotate();
+
+	nb_epochs = (window + SHFS_TOP_EPOCH_LEN - 1) / SHFS_TOP_EPOCH_LEN;
+	if (nb_epochs == 0)
+		nb_epochs = 1;
+	if (nb_epochs > SHFS_TOP_NB_EPOCHS)
+		nb_epochs = SHFS_TOP_NB_EPOCHS;
+
+	/* Collect counters of all epochs in the window.
+	 * An object that is absent in a full summary might have had up to
+	 * the smallest count of that summary, this is added to its error:
+	 *  err = sum(min of all summaries) - sum(min - err of present ones)
+	 * The second sum is accumulated in err while merging */
+	nb_merge = 0;
+	summin = 0;
+	for (e = 0; e < nb_epochs; ++e) {
+		s = &_top.s[(_top.epoch - e) % SHFS_TOP_NB_EPOCHS][m];
+		smin = 0;
+		if (s->nb == SHFS_TOP_K) {
+			smin = s->cnt[0];
+			for (i = 1; i < s->nb; ++i)
+				if (s->cnt[i] < smin)
+					smin = s->cnt[i];
+		}
+		summin += smin;
+
+		for (i = 0; i < s->nb; ++i) {
+			el = &_top.merge[nb_merge++];
+			el->bentry = s->key[i];
+			el->cnt = s->cnt[i];
+			el->err = smin - s->err[i];
+		}
+	}
+	if (!nb_merge)
+		return 0;
+
+	/* combine counters of the same object */
+	qsort(_top.merge, nb_merge, sizeof(_top.merge[0]), _shfs_top_cmp_bentry);
+	el = &_top.merge[0];
+	for (i = 1; i < nb_merge; ++i) {
+		if (_top.merge[i].bentry == el->bentry) {
+			el->cnt += _top.merge[i].cnt;
+			el->err += _top.merge[i].err;
+		} else {
+			++el;
+			*el = _top.merge[i];
+		}
+	}
+	nb_merge = (unsigned int) (el - &_top.merge[0]) + 1;
+
+	qsort(_top.merge, nb_merge, sizeof(_top.merge[0]), _shfs_top_cmp_cnt);
+	nb_out = min(n, nb_merge);
+	for (i = 0; i < nb_out; ++i) {
+		out[i] = _top.merge[i];
+		out[i].err = summin - _top.merge[i].err;
+	}
+	return nb_out;
+}
+
+static void _shfs_top_print_bytes(FILE *cio, uint64_t b)
+{
+	if (b >= 10ULL * 1024 * 1024 * 1024)
+		fprintf(cio, "%10"PRIu64" GiB", b >> 30);
+	else if (b >= 10ULL * 1024 * 1024)
+		fprintf(cio, "%10"PRIu64" MiB", b >> 20);
+	else if (b >= 10ULL * 1024)
+		fprintf(cio, "%10"PRIu64" KiB", b >> 10);
+	else
+		fprintf(cio, "%10"PRIu64" B  ", b);
+}
+
+int shcmd_shfs_top(FILE *cio, int argc, char *argv[])
+{
+	struct shfs_top_el top[SHFS_TOP_K];
+	enum shfs_top_metric m = SHFS_TOP_REQS;
+	unsigned int window = 60;
+	unsigned int n = 10;
+	unsigned int i, nb;
+	char str_hash[(shfs_vol.hlen * 2) + 1];
+	char str_name[sizeof(((struct shfs_hentry *) 0)->name) + 1];
+	struct shfs_hentry *hentry;
+
+	if (argc > 1) {
+		if (strcmp(argv[1], "reqs") == 0) {
+			m = SHFS_TOP_REQS;
+		} else if (strcmp(argv[1], "bytes") == 0) {
+			m = SHFS_TOP_BYTES;
+		} else {
+			goto usage;
+		}
+	}
+	if (argc > 2) {
+		if (sscanf(argv[2], "%u", &window) != 1 || window == 0)
+			goto usage;
+	}
+	if (argc > 3) {
+		if (sscanf(argv[3], "%u", &n) != 1 || n == 0)
+			goto usage;
+		if (n > SHFS_TOP_K)
+			n = SHFS_TOP_K;
+	}
+	if (argc > 4)
+		goto usage;
+	if (window > SHFS_TOP_MAX_WINDOW)
+		window = SHFS_TOP_MAX_WINDOW;
+
+	down(&shfs_mount_lock);
+	if (!shfs_mounted) {
+		fprintf(cio, "No SHFS filesystem is mounted\n");
+		up(&shfs_mount_lock);
+		return -1;
+	}
+
+	nb = shfs_top_get(m, window, top, n);
+	fprintf(cio, "Top %u by %s of the last %u seconds:\n",
+	        nb, (m == SHFS_TOP_BYTES) ? "bytes" : "requests", window);
+
+	str_hash[(shfs_vol.hlen * 2)] = '\0';
+	str_name[sizeof(str_name) - 1] = '\0';
+	for (i = 0; i < nb; ++i) {
+		hentry = top[i].bentry->hentry;
+		hash_unparse(hentry->hash, shfs_vol.hlen, str_hash);
+		strncpy(str_name, hentry->name, sizeof(hentry->name));
+
+		fprintf(cio, "%3u ", i + 1);
+		if (m == SHFS_TOP_BYTES) {
+			_shfs_top_print_bytes(cio, top[i].cnt);
+			fprintf(cio, " (+/- ");
+			_shfs_top_print_bytes(cio, top[i].err);
+			fprintf(cio, ") ");
+		} else {
+			fprintf(cio, "%10"PRIu64" (+/- %8"PRIu64") ",
+			        top[i].cnt, top[i].err);
+		}
+		fprintf(cio, "?%s %s\n", str_hash, str_name);
+	}
+	up(&shfs_mount_lock);
+	return 0;
+
+ usage:
+	fprintf(cio, "Usage: %s [reqs|bytes] [window seconds (<= %u)] [count (<= %u)]\n",
+	        argv[0], SHFS_TOP_MAX_WINDOW, SHFS_TOP_K);
+	return -1;
+}
@@ -0,0 +1,96 @@
+/*
+ * Heavy hitter tracking for SHFS volumes
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+#ifndef _SHFS_TOP_H_
+#define _SHFS_TOP_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include "shfs_btable.h"
+#include "shfs_fio.h"
+
+/*
+ * Top-K objects are tracked with Space-Saving summaries (Metwally et al.):
+ * A summary keeps SHFS_TOP_K counters; an object that is not monitored yet
+ * replaces the one with the smallest count and inherits its count as error.
+ * Every object whose real count exceeds 1/SHFS_TOP_K of the total is
+ * guaranteed to be monitored.
+ *
+ * Sliding windows are implemented by a ring of summaries, one per epoch
+ * of SHFS_TOP_EPOCH_LEN seconds. Queries merge the epochs of a window.
+ */
+#ifndef SHFS_TOP_K
+#define SHFS_TOP_K 64
+#endif
+#ifndef SHFS_TOP_EPOCH_LEN
+#define SHFS_TOP_EPOCH_LEN 10 /* seconds */
+#endif
+#ifndef SHFS_TOP_NB_EPOCHS
+#define SHFS_TOP_NB_EPOCHS 30 /* -> longest window: 5 min */
+#endif
+#define SHFS_TOP_MAX_WINDOW (SHFS_TOP_EPOCH_LEN * SHFS_TOP_NB_EPOCHS)
+
+enum shfs_top_metric {
+	SHFS_TOP_REQS = 0,
+	SHFS_TOP_BYTES,
+	SHFS_TOP_NB_METRICS
+};
+
+struct shfs_top_el {
+	struct shfs_bentry *bentry;
+	uint64_t cnt;
+	uint64_t err; /* max. overestimation of cnt */
+};
+
+void shfs_top_reset(void);
+void shfs_top_drop(struct shfs_bentry *bentry);
+void _shfs_top_add(struct shfs_bentry *bentry, enum shfs_top_metric m, uint64_t val);
+
+#define shfs_top_hit(bentry) \
+	_shfs_top_add((bentry), SHFS_TOP_REQS, 1)
+#define shfs_top_bytes(f, len) \
+	_shfs_top_add((struct shfs_bentry *) (f), SHFS_TOP_BYTES, (len))
+
+/*
+ * Fills out with the (at most) n heaviest objects of the last window
+ * seconds, sorted by count. Returns the number of filled elements.
+ * Note: Returned bentries are only valid as long as the volume is mounted
+ */
+unsigned int shfs_top_get(enum shfs_top_metric m, unsigned int window,
+                          struct shfs_top_el *out, unsigned int n);
+
+int shcmd_shfs_top(FILE *cio, int argc, char *argv[]);
+
+#endif /* _SHFS_TOP_H_ */
@@ -39,6 +39,9 @@
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <target/blkdev.h>
+#ifdef CAN_NOTIFY_BLKDEV
+#include <sys/signalfd.h>
+#endif
 
 #ifdef BLKDEV_DEBUG
 #define ENABLE_DEBUG
@@ -247,6 +250,38 @@ void blkdev_poll_req(struct blkdev *bd)
   }
 }
 
+#ifdef CAN_NOTIFY_BLKDEV
+int _blkdev_notify_fd = -1;
+
+int blkdev_notify_fd(void)
+{
+  sigset_t mask;
+
+  if (_blkdev_notify_fd >= 0)
+    return _blkdev_notify_fd;
+
+  /* signal has to be blocked, otherwise it is not queued for signalfd */
+  sigemptyset(&mask);
+  sigaddset(&mask, BLKDEV_NOTIFY_SIGNO);
+  if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0)
+    return -errno;
+
+  _blkdev_notify_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (_blkdev_notify_fd < 0)
+    return -errno;
+  printd("Completion notification on fd %d (signal %d)\n", _blkdev_notify_fd, BLKDEV_NOTIFY_SIGNO);
+  return _blkdev_notify_fd;
+}
+
+void blkdev_notify_clear(void)
+{
+  struct signalfd_siginfo si[32];
+
+  /* drain pending notifications, completions are checked by blkdev_poll_req() */
+  while (read(_blkdev_notify_fd, si, sizeof(si)) > 0);
+}
+#endif /* CAN_NOTIFY_BLKDEV */
+
 void _blkdev_sync_io_cb(int ret, void *argp)
 {
 	struct _blkdev_sync_io_sync *iosync = argp;
@@ -38,6 +38,7 @@
 #define _OSV_BLK_H_
 
 #include <aio.h>
+#include <signal.h>
 #include <semaphore.h>
 #include <mempool.h>
 #include <fcntl.h>
@@ -114,6 +115,23 @@ int blkdev_id_parse(const char *id, blkdev_id_t *out);
 #define blkdev_avail_req(bd) mempool_free_count((bd)->reqpool)
 
 
+/**
+ * Completion notification
+ *
+ * Once blkdev_notify_fd() was called, completed requests raise
+ * BLKDEV_NOTIFY_SIGNO that is received via the returned signalfd. The main
+ * loop can wait on it instead of polling the request queues periodically.
+ * blkdev_poll_req() still has to be called on each device afterwards.
+ */
+#ifdef CONFIG_EPOLL
+#define CAN_NOTIFY_BLKDEV
+#define BLKDEV_NOTIFY_SIGNO (SIGRTMIN + 1)
+
+extern int _blkdev_notify_fd;
+int blkdev_notify_fd(void);
+void blkdev_notify_clear(void);
+#endif /* CONFIG_EPOLL */
+
 /**
  * Async I/O
  *
@@ -145,6 +163,12 @@ static inline int blkdev_async_io_nocheck(struct blkdev *bd, sector_t start, sec
   req->aiocb.aio_nbytes = len * blkdev_ssize(bd);
   req->aiocb.aio_reqprio = 0;
   req->aiocb.aio_sigevent.sigev_notify = SIGEV_NONE;
+#ifdef CAN_NOTIFY_BLKDEV
+  if (_blkdev_notify_fd >= 0) {
+    req->aiocb.aio_sigevent.sigev_notify = SIGEV_SIGNAL;
+    req->aiocb.aio_sigevent.sigev_signo = BLKDEV_NOTIFY_SIGNO;
+  }
+#endif
   req->aiocb.aio_lio_opcode = 0; //write ? LIO_WRITE : LIO_READ;
   req->bd = bd;
   req->sector = start;
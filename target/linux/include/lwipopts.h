@@ -59,6 +59,7 @@
 #endif
 #define PBUF_POOL_SIZE CONFIG_LWIP_PBUF_NUM_RX
 #define MEMP_NUM_PBUF CONFIG_LWIP_PBUF_NUM_REF
+#define LWIP_SUPPORT_CUSTOM_PBUF 1 /* zero-copy receive (netmap) */
 
 /*
  * Thread options
@@ -102,7 +103,12 @@
 #define TCP_OVERSIZE TCP_MSS
 #define LWIP_TCP_KEEPALIVE 1
 
+#ifdef CONFIG_NULLIF
+/* pcbs of the load generator are taken from the same pool */
+#define MEMP_NUM_TCP_PCB (2 * CONFIG_LWIP_NUM_TCPCON)
+#else
 #define MEMP_NUM_TCP_PCB CONFIG_LWIP_NUM_TCPCON /* max num of sim. TCP connections */
+#endif
 #define MEMP_NUM_TCP_PCB_LISTEN 32 /* max num of sim. TCP listeners */
 
 /*
@@ -125,6 +131,17 @@
 #define CHECKSUM_GEN_ICMP6 0
 #else
 #define LWIP_CHECKSUM_ON_COPY 1
+#ifdef CONFIG_TAPIF_VNET
+#define CHECKSUM_GEN_TCP 0 /* done by the host (virtio-net header) */
+#endif
+#endif
+
+/*
+ * Segmentation offload: TCP segments up to 64K are handed to the
+ * network interface that has to segment them (pbuf->gso_size)
+ */
+#ifdef CONFIG_LWIP_GSO
+#define TCP_GSO 1
 #endif
 
 #ifdef CONFIG_LWIP_CHECKSUM_NOCHECK
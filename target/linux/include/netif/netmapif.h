@@ -39,6 +39,7 @@
 
 #include <target/sys.h>
 #include "lwip/opt.h"
+#include "lwip/pbuf.h"
 #include "netif/etharp.h"
 #include "netif/ppp/pppoe.h"
 
@@ -51,6 +52,25 @@
 #include <sys/poll.h>
 #include <net/netmap_user.h>
 
+/*
+ * Zero-copy receive: netmap buffers of received packets are swapped
+ * with spare (extra) buffers of the interface and handed over to lwIP as
+ * custom pbufs. The buffer gets a spare one again when the pbuf is freed.
+ * Whenever no spare buffer is left, received data is copied.
+ */
+#if defined CONFIG_LWIP_NOTHREADS && LWIP_SUPPORT_CUSTOM_PBUF && !ETH_PAD_SIZE
+#define NETMAPIF_ZEROCOPY_RX
+#endif
+
+#ifdef NETMAPIF_ZEROCOPY_RX
+struct netmapif_xbuf {
+    struct pbuf_custom pc; /* has to be first */
+    struct netmapif *nmi;
+    uint32_t buf_idx; /* currently owned netmap buffer */
+    struct netmapif_xbuf *next;
+};
+#endif
+
 /**
  * Helper struct to hold private data used to operate the ethernet interface.
  * The user can pre-initialize some values (e.g., providing a mac address,
@@ -71,6 +91,13 @@ struct netmapif {
     struct netmap_if *_nifp;
     struct netmap_ring *_txring;
     int _fd;
+    int _txpending; /* tx ring needs to be synced */
+#ifdef NETMAPIF_ZEROCOPY_RX
+    struct netmapif_xbuf *_xbufs;
+    struct netmapif_xbuf *_xbufs_free;
+    uint32_t _nb_xbufs;
+    uint32_t _nb_xbufs_free;
+#endif
 #ifndef CONFIG_LWIP_NOTHREADS
     volatile int _thread_exit;
     char _thread_name[6];
@@ -90,6 +117,16 @@ struct netmapif {
  * thread get scheduled frequently.
  */
 void netmapif_poll(struct netif *netif);
+
+/* Transmission of enqueued packets is deferred: this call
+ * syncs the tx ring and has to be called at the end of each
+ * main loop iteration.
+ */
+void netmapif_flush(struct netif *netif);
+
+/* file descriptor that signals received packets (e.g., for epoll) */
+#define netmapif_fd(netif) \
+  (((struct netmapif *) (netif)->state)->_fd)
 #endif
 
 err_t netmapif_init(struct netif *netif);
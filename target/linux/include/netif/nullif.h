@@ -0,0 +1,81 @@
+/*
+ * In-memory loopback pipe (null netif) for lwIP
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ *
+ */
+#ifndef __NULLIF_H__
+#define __NULLIF_H__
+
+#include <target/sys.h>
+#include "lwip/opt.h"
+#include "lwip/pbuf.h"
+#include "lwip/netif.h"
+
+/*
+ * A null netif is one end of an in-memory IP pipe: Packets that are sent
+ * on one end are copied and received on the other end by the next poll.
+ * There is no link layer (no ARP), so netif->input has to be ip4_input.
+ *
+ * The first end is added like any other device (state: NULL). The second
+ * one is added with the first netif passed as state, e.g.:
+ *   netif_add(&a, &ip_a, &mask, &gw, NULL,  nullif_init,      ip4_input);
+ *   netif_add(&b, &ip_b, &mask, &gw, &a,    nullif_peer_init, ip4_input);
+ *
+ * Because lwIP routes by destination only, packets of both directions may
+ * leave through the same end. This does not matter: ip4_input() accepts
+ * packets for any local address, each packet crosses the pipe exactly once.
+ */
+#ifndef NULLIF_MTU
+#define NULLIF_MTU 1500
+#endif
+#define NULLIF_RXQ_SIZE 4096 /* has to be a power of two */
+
+struct nullif {
+    struct netif *netif;
+    struct nullif *peer;
+
+    /* the following fields are used internally */
+    struct pbuf *_rxq[NULLIF_RXQ_SIZE];
+    uint32_t _rxq_head; /* next to dequeue */
+    uint32_t _rxq_tail; /* next to enqueue */
+};
+
+/* Hands over enqueued packets of both ends of the pipe to lwIP.
+ * Has to be called periodically */
+void nullif_poll(struct netif *netif);
+
+err_t nullif_init(struct netif *netif);
+err_t nullif_peer_init(struct netif *netif);
+
+#endif /* __NULLIF_H__ */
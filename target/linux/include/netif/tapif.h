@@ -46,6 +46,9 @@ err_t tapif_init(struct netif *netif);
  * thread get scheduled frequently.
  */
 void tapif_poll(struct netif *netif);
+
+/* file descriptor that signals received packets (e.g., for epoll) */
+int tapif_fd(struct netif *netif);
 #endif
 
 #endif /* LWIP_TAPIF_H */
@@ -0,0 +1,123 @@
+/*
+ * AF_XDP networking glue for lwIP
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ *
+ */
+#ifndef __XDPIF_H__
+#define __XDPIF_H__
+
+#include <target/sys.h>
+#include "lwip/opt.h"
+#include "lwip/pbuf.h"
+#include "netif/etharp.h"
+
+#include <net/if.h>
+#include <xdp/xsk.h>
+
+/*
+ * Received frames are handed over to lwIP as custom pbufs that point
+ * directly into the UMEM. A frame is given back to the fill ring when
+ * lwIP frees the pbuf. When lwIP holds too many frames already (e.g., in
+ * out-of-sequence queues) or without custom pbuf support, received data
+ * is copied.
+ */
+#if defined CONFIG_LWIP_NOTHREADS && LWIP_SUPPORT_CUSTOM_PBUF && !ETH_PAD_SIZE
+#define XDPIF_ZEROCOPY_RX
+#endif
+
+struct xdpif;
+
+struct xdpif_frame {
+#ifdef XDPIF_ZEROCOPY_RX
+    struct pbuf_custom pc; /* has to be first */
+    struct xdpif *xi;
+#endif
+    uint64_t addr; /* UMEM offset */
+};
+
+/**
+ * Helper struct to hold private data used to operate the ethernet interface.
+ * The user can pre-initialize some values (e.g., interface name, queue
+ * number, a mac address) and lwIP will use those passed data instead.
+ * For values that are not set (e.g., ifname is empty, hwaddress is zero),
+ * defaults are used or they are retrieved from the interface.
+ *
+ * If no xdpif struct is passed (via netif->state), lwIP allocates and
+ * manages one by itself.
+ */
+struct xdpif {
+    char ifname[IFNAMSIZ];
+    uint32_t queue_id;
+    int copy_mode; /* force copy mode (XDP_COPY, e.g., for veth) */
+    struct eth_addr hwaddr;
+
+    /* the following fields are used internally */
+    void *_umem_area;
+    struct xsk_umem *_umem;
+    struct xsk_socket *_xsk;
+    struct xsk_ring_prod _fq;
+    struct xsk_ring_cons _cq;
+    struct xsk_ring_cons _rx;
+    struct xsk_ring_prod _tx;
+    int _fd;
+    int _txpending; /* tx ring needs to be kicked */
+
+    struct xdpif_frame *_frames;
+    uint64_t *_free_frames; /* stack of unused UMEM frames */
+    uint32_t _nb_free_frames;
+#ifdef XDPIF_ZEROCOPY_RX
+    uint32_t _nb_held_frames; /* frames that are referenced by lwIP */
+#endif
+
+    int _state_is_private;
+    int _hwaddr_is_private;
+};
+
+#ifdef CONFIG_LWIP_NOTHREADS
+/* NIC I/O handling: has to be called periodically
+ * to get received by the lwIP stack. */
+void xdpif_poll(struct netif *netif);
+
+/* Kicks the tx ring and reclaims completed frames: has to be
+ * called at the end of each main loop iteration */
+void xdpif_flush(struct netif *netif);
+
+/* file descriptor that signals received packets (e.g., for epoll) */
+#define xdpif_fd(netif) \
+  (((struct xdpif *) (netif)->state)->_fd)
+#endif
+
+err_t xdpif_init(struct netif *netif);
+
+#endif /* __XDPIF_H__ */
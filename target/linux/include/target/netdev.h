@@ -56,6 +56,39 @@
   netmapif_init
 #define target_netif_poll \
   netmapif_poll
+#define target_netif_flush \
+  netmapif_flush
+#ifdef CONFIG_EPOLL
+#define CAN_POLL_NETDEV
+#define target_netif_fd \
+  netmapif_fd
+#endif /* CONFIG_EPOLL */
+
+#elif defined CONFIG_XDPIF
+#include <netif/xdpif.h>
+#define target_netif_init \
+  xdpif_init
+#define target_netif_poll \
+  xdpif_poll
+#define target_netif_flush \
+  xdpif_flush
+#ifdef CONFIG_EPOLL
+#define CAN_POLL_NETDEV
+#define target_netif_fd \
+  xdpif_fd
+#endif /* CONFIG_EPOLL */
+
+#elif defined CONFIG_NULLIF
+#include <netif/nullif.h>
+#define target_netif_init \
+  nullif_init
+#define target_netif_poll \
+  nullif_poll
+#define CONFIG_LWIP_IPDEV
+/* a second netif can be attached as the other end */
+#define CAN_LOOPBACK_NETDEV
+#define target_netif_peer_init \
+  nullif_peer_init
 
 #else
 #include <netif/tapif.h>
@@ -63,6 +96,11 @@
   tapif_init
 #define target_netif_poll \
   tapif_poll
+#ifdef CONFIG_EPOLL
+#define CAN_POLL_NETDEV
+#define target_netif_fd \
+  tapif_fd
+#endif /* CONFIG_EPOLL */
 
 #endif
 
@@ -114,6 +114,9 @@
 
 #define NMNETIF_MEMCPY memcpy
 
+#define NMNETIF_RX_BATCH 256   /* max. number of packets received per poll */
+#define NMNETIF_NB_XBUFS 1024  /* number of extra buffers requested for zero-copy rx */
+
 /**
  * Helper macros
  */
@@ -157,8 +160,13 @@ static err_t netmapif_output(struct netmapif *nmi, struct pbuf *p, int co_type,
 
   /* do we have space? */
   if (unlikely(nm_ring_space(nmi->_txring) < slots)) {
-    LWIP_DEBUGF(NETIF_DEBUG, ("netmapif_output: not enough slots left on tx ring\n"));
-    return ERR_MEM;
+    /* sync now to reclaim slots of already transmitted packets */
+    ioctl(nmi->_fd, NIOCTXSYNC, NULL);
+    nmi->_txpending = 0;
+    if (unlikely(nm_ring_space(nmi->_txring) < slots)) {
+      LWIP_DEBUGF(NETIF_DEBUG, ("netmapif_output: not enough slots left on tx ring\n"));
+      return ERR_MEM;
+    }
   }
 
   /* copy payload to netmap ring */
@@ -207,11 +215,22 @@ static err_t netmapif_output(struct netmapif *nmi, struct pbuf *p, int co_type,
 
   nmi->_txring->head = nmi->_txring->cur = cur;
 
+  /* tx sync is deferred to netmapif_flush() */
   if (push)
-    ioctl(nmi->_fd, NIOCTXSYNC, NULL);
+    nmi->_txpending = 1;
   return ERR_OK;
 }
 
+void netmapif_flush(struct netif *netif)
+{
+  struct netmapif *nmi = netif->state;
+
+  if (nmi->_txpending) {
+    ioctl(nmi->_fd, NIOCTXSYNC, NULL);
+    nmi->_txpending = 0;
+  }
+}
+
 /**
  * This function does the actual transmission of a packet. The packet is
  * contained in the pbuf that is passed to the function. This pbuf
@@ -415,7 +434,6 @@ netmapif_receive(struct netmap_ring *rxring, unsigned int cur, struct pbuf *p)
 	unsigned int len;
 
 	/* copy payload from netmap ring */
-	cur    = rxring->cur;
 	slot   = &rxring->slot[cur];
 	cur    = nm_ring_next(rxring, cur);
 	s_buf  = NETMAP_BUF(rxring, slot->buf_idx);;
@@ -457,6 +475,125 @@ netmapif_receive(struct netmap_ring *rxring, unsigned int cur, struct pbuf *p)
 
 	}
 }
+
+#ifdef NETMAPIF_ZEROCOPY_RX
+/* called by lwIP when a zero-copy pbuf is released:
+ * the netmap buffer becomes a spare buffer again */
+static void netmapif_xbuf_free(struct pbuf *p)
+{
+	struct netmapif_xbuf *xb = (struct netmapif_xbuf *) p;
+	struct netmapif *nmi = xb->nmi;
+
+	xb->next = nmi->_xbufs_free;
+	nmi->_xbufs_free = xb;
+	++nmi->_nb_xbufs_free;
+}
+
+/* swaps the buffers of the netmap slots of a received packet with
+ * spare buffers and wraps them into a pbuf chain
+ * NULL is returned if there are not enough spare buffers left */
+static inline struct pbuf *
+netmapif_receive_zc(struct netmapif *nmi, struct netmap_ring *rxring,
+		    unsigned int cur, unsigned int nb_slots)
+{
+	struct netmapif_xbuf *xb;
+	struct netmap_slot *slot;
+	struct pbuf *p = NULL;
+	struct pbuf *q;
+	uint32_t buf_idx;
+
+	if (nmi->_nb_xbufs_free < nb_slots)
+		return NULL;
+
+	for (; nb_slots; --nb_slots) {
+		slot = &rxring->slot[cur];
+		cur  = nm_ring_next(rxring, cur);
+
+		xb = nmi->_xbufs_free;
+		nmi->_xbufs_free = xb->next;
+		--nmi->_nb_xbufs_free;
+
+		buf_idx       = xb->buf_idx;
+		xb->buf_idx   = slot->buf_idx;
+		slot->buf_idx = buf_idx;
+		slot->flags  |= NS_BUF_CHANGED;
+
+		q = pbuf_alloced_custom(PBUF_RAW, slot->len, PBUF_REF, &xb->pc,
+					NETMAP_BUF(rxring, xb->buf_idx),
+					rxring->nr_buf_size);
+		if (!p)
+			p = q;
+		else
+			pbuf_cat(p, q);
+	}
+	return p;
+}
+
+/* takes over the extra buffers that were allocated by netmap for this interface
+ * Returns 0 on success, -1 if the bookkeeping could not be allocated */
+static int netmapif_init_xbufs(struct netmapif *nmi)
+{
+	struct netmapif_xbuf *xb;
+	uint32_t buf_idx;
+	uint32_t i;
+
+	nmi->_xbufs_free = NULL;
+	nmi->_nb_xbufs_free = 0;
+	nmi->_nb_xbufs = nmi->dev->req.nr_arg3;
+	if (!nmi->_nb_xbufs || !nmi->_nifp->ni_bufs_head) {
+		nmi->_nb_xbufs = 0;
+		nmi->_xbufs = NULL;
+		return 0;
+	}
+
+	nmi->_xbufs = mem_calloc(nmi->_nb_xbufs, sizeof(*nmi->_xbufs));
+	if (!nmi->_xbufs) {
+		nmi->_nb_xbufs = 0;
+		return -1;
+	}
+
+	/* extra buffers are linked by their first 4 bytes */
+	buf_idx = nmi->_nifp->ni_bufs_head;
+	for (i = 0; i < nmi->_nb_xbufs && buf_idx; ++i) {
+		xb = &nmi->_xbufs[i];
+		xb->nmi = nmi;
+		xb->buf_idx = buf_idx;
+		xb->pc.custom_free_function = netmapif_xbuf_free;
+		buf_idx = *((uint32_t *) NETMAP_BUF(nmi->_txring, buf_idx));
+
+		xb->next = nmi->_xbufs_free;
+		nmi->_xbufs_free = xb;
+		++nmi->_nb_xbufs_free;
+	}
+	nmi->_nb_xbufs = i;
+	nmi->_nifp->ni_bufs_head = 0;
+	return 0;
+}
+
+/* hands extra buffers back to netmap so that they are released on close */
+static void netmapif_exit_xbufs(struct netmapif *nmi)
+{
+	uint32_t head = 0;
+	uint32_t i;
+
+	if (!nmi->_xbufs)
+		return;
+
+	if (nmi->_nb_xbufs_free != nmi->_nb_xbufs)
+		LWIP_DEBUGF(NETIF_DEBUG, ("netmapif_exit_xbufs: %"PRIu32" buffers are still in use\n",
+					  nmi->_nb_xbufs - nmi->_nb_xbufs_free));
+	for (i = 0; i < nmi->_nb_xbufs; ++i) {
+		*((uint32_t *) NETMAP_BUF(nmi->_txring, nmi->_xbufs[i].buf_idx)) = head;
+		head = nmi->_xbufs[i].buf_idx;
+	}
+	nmi->_nifp->ni_bufs_head = head;
+
+	mem_free(nmi->_xbufs);
+	nmi->_xbufs = NULL;
+	nmi->_nb_xbufs = 0;
+}
+#endif /* NETMAPIF_ZEROCOPY_RX */
+
 /*
  * Receive packets from netmap ring and send them to
  * netmapif_input()
@@ -468,19 +605,22 @@ void netmapif_poll(struct netif *netif)
   struct netmap_ring *rxring;
   unsigned int slots, tot_slots;
   unsigned int cur, next, pkg_len;
+  unsigned int budget = NMNETIF_RX_BATCH;
   struct pbuf *p;
 
   /* call receive ioctl (TODO: expose filedescriptor to do rx select/poll outside of this function) */
   ioctl(nmi->_fd, NIOCRXSYNC, NULL);
 
   /* query all rx queues */
-  for (i = nmi->dev->first_rx_ring; i <= nmi->dev->last_rx_ring; ++i) {
+  for (i = nmi->dev->first_rx_ring; i <= nmi->dev->last_rx_ring && budget; ++i) {
     rxring = NETMAP_RXRING(nmi->_nifp, i);
 
-    /* handle received packets */
+    /* handle received packets: slots are released to netmap
+     * once per batch. Packets that exceed the budget are
+     * left on the ring for the next poll */
     tot_slots = nm_ring_space(rxring);
     cur = rxring->cur;
-    while (tot_slots) {
+    while (tot_slots && budget) {
       pkg_len = netmapif_get_rxlen(rxring, cur, &next, &slots);
       LWIP_DEBUGF(NETIF_DEBUG, ("netmapif_poll: %c%c.r%u: "
 				"incoming data %u bytes, %u slots\n",
@@ -493,6 +633,11 @@ void netmapif_poll(struct netif *netif)
 				  netif->name[0], netif->name[1], i));
 	p = NULL;
       } else {
+#ifdef NETMAPIF_ZEROCOPY_RX
+	p = netmapif_receive_zc(nmi, rxring, cur, slots);
+	if (likely(p != NULL))
+	  goto input;
+#endif
 	p = pbuf_alloc(PBUF_RAW, (u16_t) (pkg_len + ETH_PAD_SIZE), PBUF_POOL);
 	if (unlikely(!p)) {
 	  LWIP_DEBUGF(NETIF_DEBUG, ("netmapif_poll: %c%c.r%u: "
@@ -509,9 +654,14 @@ void netmapif_poll(struct netif *netif)
 #endif /* ETH_PAD_SIZE */
 	}
       }
-      netmapif_input(p, netif);
+#ifdef NETMAPIF_ZEROCOPY_RX
+    input:
+#endif
+      if (likely(p != NULL))
+	netmapif_input(p, netif);
       cur = next;
       tot_slots -= slots;
+      --budget;
     }
     rxring->head = rxring->cur = cur;
   }
@@ -533,6 +683,7 @@ static void netmapif_thread(void *argp)
 
     while (likely(!nmi->_thread_exit)) {
         netmapif_poll(dev);
+        netmapif_flush(netif);
         schedule();
     }
 
@@ -552,6 +703,10 @@ static void netmapif_exit(struct netif *netif)
 {
     struct netmapif *nmi = netif->state;
 
+    netmapif_flush(netif);
+#ifdef NETMAPIF_ZEROCOPY_RX
+    netmapif_exit_xbufs(nmi);
+#endif
     nm_close(nmi->dev);
 
 #ifndef CONFIG_LWIP_NOTHREADS
@@ -649,6 +804,9 @@ err_t netmapif_init(struct netif *netif)
 {
     struct netmapif *nmi;
     static uint8_t netmapif_id = 0;
+#ifdef NETMAPIF_ZEROCOPY_RX
+    struct nmreq req;
+#endif
 
     LWIP_ASSERT("netif != NULL", (netif != NULL));
 
@@ -679,7 +837,13 @@ err_t netmapif_init(struct netif *netif)
 	}
 
 	/* use nmi->ifname to open a specific NIC interface */
+#ifdef NETMAPIF_ZEROCOPY_RX
+	memset(&req, 0, sizeof(req));
+	req.nr_arg3 = NMNETIF_NB_XBUFS; /* extra buffers for zero-copy rx */
+	nmi->dev = nm_open(nmi->ifname, &req, 0, NULL);
+#else
 	nmi->dev = nm_open(nmi->ifname, NULL, 0 , NULL);
+#endif
 	if (!nmi->dev) {
 	    LWIP_DEBUGF(NETIF_DEBUG, ("netmapif_init: "
 				      "Could not open %s\n", nmi->ifname));
@@ -701,6 +865,12 @@ err_t netmapif_init(struct netif *netif)
 			      nmi->dev->first_rx_ring, nmi->dev->last_rx_ring));
     nmi->_txring = NETMAP_TXRING(nmi->_nifp, nmi->dev->first_tx_ring);
     LWIP_DEBUGF(NETIF_DEBUG, ("netmapif_init: %s: use tx ring %u\n", nmi->ifname, nmi->dev->first_tx_ring));
+    nmi->_txpending = 0;
+#ifdef NETMAPIF_ZEROCOPY_RX
+    if (netmapif_init_xbufs(nmi) < 0)
+      LWIP_DEBUGF(NETIF_DEBUG, ("netmapif_init: %s: could not allocate zero-copy buffers, received data is copied\n", nmi->ifname));
+    LWIP_DEBUGF(NETIF_DEBUG, ("netmapif_init: %s: %"PRIu32" buffers for zero-copy rx\n", nmi->ifname, nmi->_nb_xbufs));
+#endif
 
     /* Interface identifier */
     netif->name[0] = NMNETIF_NPREFIX;
@@ -0,0 +1,246 @@
+/*
+ * In-memory loopback pipe (null netif) for lwIP
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ *
+ */
+
+#include <netif/nullif.h>
+
+#include "likely.h"
+#include "lwip/def.h"
+#include "lwip/mem.h"
+#include "lwip/pbuf.h"
+#include <lwip/stats.h>
+#include <lwip/snmp.h>
+
+#ifndef CONFIG_LWIP_NOTHREADS
+#error "nullif requires CONFIG_LWIP_NOTHREADS"
+#endif
+
+#define NULLIF_NPREFIX 'n'
+#define NULLIF_SPEED 0ul     /* 0 for unknown */
+
+#define NULLIF_RX_BATCH 256  /* max. number of packets received per end and poll */
+
+#define nullif_rxq_count(nli) \
+  ((nli)->_rxq_tail - (nli)->_rxq_head)
+#define nullif_rxq_full(nli) \
+  (nullif_rxq_count((nli)) == NULLIF_RXQ_SIZE)
+
+/**
+ * Enqueues a copy of a packet on the receive queue of the other end.
+ * A copy is required because lwIP modifies headers of received packets
+ * while the sender might still hold the original one for retransmission.
+ *
+ * @param netif
+ *  the lwip network interface structure for this nullif
+ * @param p
+ *  the IP packet to send
+ * @return
+ *  ERR_OK when the packet could be sent; an err_t value otherwise
+ */
+static err_t nullif_output(struct netif *netif, struct pbuf *p,
+			   const ip_addr_t *ipaddr)
+{
+    struct nullif *nli = netif->state;
+    struct nullif *peer = nli->peer;
+    struct pbuf *q;
+
+    LWIP_DEBUGF(NETIF_DEBUG, ("nullif_output: %c%c: "
+			      "Transmitting %u bytes\n",
+			      netif->name[0], netif->name[1],
+			      p->tot_len));
+    if (unlikely(!peer || nullif_rxq_full(peer))) {
+	LINK_STATS_INC(link.drop);
+	return ERR_OK; /* packet is lost on the wire */
+    }
+
+    /* PBUF_RAM: the copy is contiguous and not limited by the rx pool */
+    q = pbuf_alloc(PBUF_RAW, p->tot_len, PBUF_RAM);
+    if (unlikely(!q)) {
+	LINK_STATS_INC(link.memerr);
+	return ERR_MEM;
+    }
+    pbuf_copy(q, p);
+
+    peer->_rxq[peer->_rxq_tail & (NULLIF_RXQ_SIZE - 1)] = q;
+    ++peer->_rxq_tail;
+    LINK_STATS_INC(link.xmit);
+    return ERR_OK;
+}
+
+/**
+ * Passes received packets of one end to the lwIP stack
+ */
+static void nullif_input(struct nullif *nli)
+{
+    struct netif *netif = nli->netif;
+    unsigned int budget = NULLIF_RX_BATCH;
+    struct pbuf *p;
+    err_t err;
+
+    while (budget && nullif_rxq_count(nli)) {
+	p = nli->_rxq[nli->_rxq_head & (NULLIF_RXQ_SIZE - 1)];
+	++nli->_rxq_head;
+	--budget;
+
+	LINK_STATS_INC(link.recv);
+	err = netif->input(p, netif);
+	if (unlikely(err != ERR_OK)) {
+	    LWIP_DEBUGF(NETIF_DEBUG, ("nullif_input: %c%c: "
+				      "IP input error\n",
+				      netif->name[0], netif->name[1]));
+	    pbuf_free(p);
+	}
+    }
+}
+
+void nullif_poll(struct netif *netif)
+{
+    struct nullif *nli = netif->state;
+
+    nullif_input(nli);
+    if (nli->peer)
+	nullif_input(nli->peer);
+}
+
+#if LWIP_NETIF_REMOVE_CALLBACK
+/**
+ * Closes a network interface.
+ * This function is called by lwIP on netif_remove().
+ * Packets that are still enqueued are dropped.
+ *
+ * @param netif
+ *  the lwip network interface structure for this nullif
+ */
+static void nullif_exit(struct netif *netif)
+{
+    struct nullif *nli = netif->state;
+
+    while (nullif_rxq_count(nli)) {
+	pbuf_free(nli->_rxq[nli->_rxq_head & (NULLIF_RXQ_SIZE - 1)]);
+	++nli->_rxq_head;
+    }
+    if (nli->peer)
+	nli->peer->peer = NULL;
+
+    mem_free(nli);
+    netif->state = NULL;
+}
+#endif /* LWIP_NETIF_REMOVE_CALLBACK */
+
+static err_t _nullif_init(struct netif *netif, struct nullif *peer)
+{
+    struct nullif *nli;
+    static uint8_t nullif_id = 0;
+
+    nli = mem_calloc(1, sizeof(*nli));
+    if (!nli) {
+	LWIP_DEBUGF(NETIF_DEBUG, ("nullif_init: "
+				  "Could not allocate \n"));
+	return ERR_MEM;
+    }
+    nli->netif = netif;
+    nli->peer = peer;
+    if (peer)
+	peer->peer = nli;
+    netif->state = nli;
+
+    /* Interface identifier */
+    netif->name[0] = NULLIF_NPREFIX;
+    netif->name[1] = '0' + nullif_id;
+    nullif_id++;
+
+    /* We send IP packets directly (no link layer) */
+    netif->output = nullif_output;
+    netif->linkoutput = NULL;
+#if LWIP_NETIF_REMOVE_CALLBACK
+    netif->remove_callback = nullif_exit;
+#endif /* CONFIG_NETIF_REMOVE_CALLBACK */
+
+    /* No hardware address support */
+    netif->hwaddr_len = 0;
+
+    /* Initialize the snmp variables and counters inside the struct netif.
+     * The last argument is the link speed, in units of bits per second. */
+    NETIF_INIT_SNMP(netif, snmp_ifType_other, NULLIF_SPEED);
+
+    /* Device capabilities */
+    netif->flags = NETIF_FLAG_LINK_UP;
+
+    /* Maximum transfer unit */
+    netif->mtu = NULLIF_MTU;
+    LWIP_DEBUGF(NETIF_DEBUG, ("nullif_init: %c%c: MTU: %u\n",
+			      netif->name[0], netif->name[1], netif->mtu));
+
+#if LWIP_NETIF_HOSTNAME
+    /* Initialize interface hostname */
+    if (!netif->hostname)
+	netif->hostname = NULL;
+#endif /* LWIP_NETIF_HOSTNAME */
+
+    return ERR_OK;
+}
+
+/**
+ * Initializes the first end of a pipe.
+ * This function should be passed as a parameter to netif_add().
+ *
+ * @param netif
+ *  the lwip network interface structure for this nullif
+ * @return
+ *  ERR_OK if the interface was successfully initialized;
+ *  An err_t value otherwise
+ */
+err_t nullif_init(struct netif *netif)
+{
+    LWIP_ASSERT("netif != NULL", (netif != NULL));
+
+    return _nullif_init(netif, NULL);
+}
+
+/**
+ * Initializes the second end of a pipe.
+ * netif->state has to point to the netif of the first end.
+ */
+err_t nullif_peer_init(struct netif *netif)
+{
+    struct netif *peer;
+
+    LWIP_ASSERT("netif != NULL", (netif != NULL));
+    peer = netif->state;
+    LWIP_ASSERT("peer netif != NULL", (peer != NULL && peer->state != NULL));
+
+    return _nullif_init(netif, peer->state);
+}
@@ -64,6 +64,11 @@
 #include <sys/ioctl.h>
 #include <linux/if.h>
 #include <linux/if_tun.h>
+#ifdef CONFIG_TAPIF_VNET
+#include <stddef.h>
+#include <linux/virtio_net.h>
+#include "lwip/tcp_impl.h"
+#endif
 #define DEVTAP "/dev/net/tun"
 #define NETMASK_ARGS "netmask %d.%d.%d.%d"
 #define IFCONFIG_ARGS "tap0 inet %d.%d.%d.%d " NETMASK_ARGS
@@ -84,6 +89,23 @@
 #define TAPIF_DEBUG LWIP_DBG_OFF
 #endif
 
+/*
+ * With CONFIG_TAPIF_VNET, every packet is prefixed with a virtio-net
+ * header. This lets the host kernel compute TCP checksums and segment
+ * TCP super-segments (TCP_GSO) that are larger than the MTU.
+ */
+#ifdef CONFIG_TAPIF_VNET
+#if defined(linux)
+#if CHECKSUM_GEN_TCP
+#warning "TCP checksums are computed by lwIP although the host could do it"
+#endif
+#define TAPIF_MAX_IOV 32 /* longer pbuf chains are linearized */
+#define TAPIF_MAX_PKTLEN (0xFFFF + SIZEOF_ETH_HDR)
+#else
+#error "CONFIG_TAPIF_VNET is only available on Linux"
+#endif
+#endif /* CONFIG_TAPIF_VNET */
+
 struct tapif {
   struct eth_addr *ethaddr;
   /* Add whatever per-interface state that is needed here. */
@@ -134,11 +156,30 @@ low_level_init(struct netif *netif)
     struct ifreq ifr;
     memset(&ifr, 0, sizeof(ifr));
     ifr.ifr_flags = IFF_TAP|IFF_NO_PI;
+#ifdef CONFIG_TAPIF_VNET
+    ifr.ifr_flags |= IFF_VNET_HDR;
+#endif
     if (ioctl(tapif->fd, TUNSETIFF, (void *) &ifr) < 0) {
       perror("tapif_init: "DEVTAP" ioctl TUNSETIFF");
       exit(1);
     }
   }
+#ifdef CONFIG_TAPIF_VNET
+  {
+    int hdrsz = sizeof(struct virtio_net_hdr);
+
+    if (ioctl(tapif->fd, TUNSETVNETHDRSZ, &hdrsz) < 0) {
+      perror("tapif_init: "DEVTAP" ioctl TUNSETVNETHDRSZ");
+      exit(1);
+    }
+    /* we do not accept offloads for received packets:
+     * the host completes checksums and segments before */
+    if (ioctl(tapif->fd, TUNSETOFFLOAD, 0) < 0) {
+      perror("tapif_init: "DEVTAP" ioctl TUNSETOFFLOAD");
+      exit(1);
+    }
+  }
+#endif /* CONFIG_TAPIF_VNET */
 #endif /* Linux */
   netif_set_link_up(netif);
 
@@ -164,6 +205,96 @@ low_level_init(struct netif *netif)
 
 }
 /*-----------------------------------------------------------------------------------*/
+#ifdef CONFIG_TAPIF_VNET
+/*
+ * Fills the virtio-net header for an outgoing packet:
+ * TCP checksums are left to the host (the checksum field gets the
+ * pseudo header sum); TCP segments that carry more than gso_size bytes
+ * are segmented by the host.
+ * Note: We assume here that all protocol headers are in the first pbuf
+ */
+static void
+low_level_vnethdr(struct pbuf *p, struct virtio_net_hdr *vh)
+{
+  struct eth_hdr *ethhdr;
+  struct ip_hdr *iphdr;
+  struct tcp_hdr *tcphdr;
+  u16_t iphdr_len, tcp_len;
+  u32_t sum;
+
+  memset(vh, 0, sizeof(*vh));
+  vh->gso_type = VIRTIO_NET_HDR_GSO_NONE;
+
+  ethhdr = (struct eth_hdr *) p->payload;
+  if (ethhdr->type != PP_HTONS(ETHTYPE_IP))
+    return;
+  iphdr = (struct ip_hdr *)((uintptr_t) p->payload + SIZEOF_ETH_HDR);
+  if (IPH_PROTO(iphdr) != IP_PROTO_TCP)
+    return;
+  iphdr_len = IPH_HL(iphdr) * 4;
+  tcphdr = (struct tcp_hdr *)((uintptr_t) iphdr + iphdr_len);
+  tcp_len = ntohs(IPH_LEN(iphdr)) - iphdr_len;
+
+  /* checksum offload: pseudo header sum (not inverted) */
+  sum  = (iphdr->src.addr & 0xFFFF) + (iphdr->src.addr >> 16);
+  sum += (iphdr->dest.addr & 0xFFFF) + (iphdr->dest.addr >> 16);
+  sum += PP_HTONS(IP_PROTO_TCP);
+  sum += htons(tcp_len);
+  sum  = (sum & 0xFFFF) + (sum >> 16);
+  sum  = (sum & 0xFFFF) + (sum >> 16);
+  tcphdr->chksum = (u16_t) sum;
+  vh->flags       = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+  vh->csum_start  = SIZEOF_ETH_HDR + iphdr_len;
+  vh->csum_offset = offsetof(struct tcp_hdr, chksum);
+
+#if TCP_GSO
+  /* segmentation offload */
+  if (p->gso_size &&
+      tcp_len - (TCPH_HDRLEN(tcphdr) * 4) > p->gso_size) {
+    vh->gso_type = VIRTIO_NET_HDR_GSO_TCPV4;
+    vh->gso_size = p->gso_size;
+    vh->hdr_len  = SIZEOF_ETH_HDR + iphdr_len + (TCPH_HDRLEN(tcphdr) * 4);
+  }
+#endif
+}
+
+static err_t
+low_level_output(struct netif *netif, struct pbuf *p)
+{
+  static char buf[TAPIF_MAX_PKTLEN];
+  struct virtio_net_hdr vh;
+  struct iovec iov[TAPIF_MAX_IOV + 1];
+  struct tapif *tapif;
+  struct pbuf *q;
+  int iovcnt;
+
+  tapif = (struct tapif *)netif->state;
+  low_level_vnethdr(p, &vh);
+
+  /* pbuf chain is passed as is (no copy) */
+  iov[0].iov_base = &vh;
+  iov[0].iov_len  = sizeof(vh);
+  iovcnt = 1;
+  for(q = p; q != NULL && iovcnt <= TAPIF_MAX_IOV; q = q->next) {
+    iov[iovcnt].iov_base = q->payload;
+    iov[iovcnt].iov_len  = q->len;
+    ++iovcnt;
+  }
+  if (q != NULL) {
+    /* chain is too long */
+    pbuf_copy_partial(p, buf, p->tot_len, 0);
+    iov[1].iov_base = buf;
+    iov[1].iov_len  = p->tot_len;
+    iovcnt = 2;
+  }
+
+  /* signal that packet should be sent(); */
+  if(writev(tapif->fd, iov, iovcnt) == -1) {
+    perror("tapif: writev");
+  }
+  return ERR_OK;
+}
+#else /* CONFIG_TAPIF_VNET */
 /*
  * low_level_output():
  *
@@ -208,6 +339,7 @@ low_level_output(struct netif *netif, struct pbuf *p)
   }
   return ERR_OK;
 }
+#endif /* CONFIG_TAPIF_VNET */
 /*-----------------------------------------------------------------------------------*/
 /*
  * low_level_input():
@@ -224,10 +356,27 @@ low_level_input(struct tapif *tapif)
   u16_t len;
   char buf[1514];
   char *bufptr;
+#ifdef CONFIG_TAPIF_VNET
+  struct virtio_net_hdr vh;
+  struct iovec iov[2];
+  ssize_t rlen;
 
+  /* Obtain the size of the packet and put it into the "len"
+     variable. The virtio-net header is skipped: no offloads were
+     negotiated for received packets. */
+  iov[0].iov_base = &vh;
+  iov[0].iov_len  = sizeof(vh);
+  iov[1].iov_base = buf;
+  iov[1].iov_len  = sizeof(buf);
+  rlen = readv(tapif->fd, iov, 2);
+  if (rlen <= (ssize_t) sizeof(vh))
+    return NULL;
+  len = (u16_t) (rlen - sizeof(vh));
+#else
   /* Obtain the size of the packet and put it into the "len"
      variable. */
   len = read(tapif->fd, buf, sizeof(buf));
+#endif
 #if 0
     if(((double)rand()/(double)RAND_MAX) < 0.2) {
     printf("drop\n");
@@ -280,6 +429,14 @@ tapif_poll(struct netif *netif)
   _tapif_poll(netif, &zero);
 }
 
+int
+tapif_fd(struct netif *netif)
+{
+  struct tapif *tapif = (struct tapif *)netif->state;
+
+  return tapif->fd;
+}
+
 #else
 
 static void
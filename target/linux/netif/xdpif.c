@@ -0,0 +1,571 @@
+/*
+ * AF_XDP networking glue for lwIP
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ *
+ * The packet handling follows netmapif.c (based on Ethernet Interface
+ * skeleton (ethernetif.c) provided by lwIP-1.4.1).
+ */
+
+#include <netif/xdpif.h>
+
+#ifndef CONFIG_LWIP_NOTHREADS
+#error "xdpif requires CONFIG_LWIP_NOTHREADS"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+
+#include "likely.h"
+#include "lwip/def.h"
+#include "lwip/mem.h"
+#include "lwip/pbuf.h"
+#include <lwip/stats.h>
+#include <lwip/snmp.h>
+
+#define XDPNETIF_NPREFIX 'x'
+#define XDPNETIF_SPEED 0ul     /* 0 for unknown */
+#define XDPNETIF_MTU 1500
+
+#ifndef XDPIF_IFNAME
+#define XDPIF_IFNAME "eth2"    /* default interface */
+#endif
+#ifndef XDPIF_QUEUE
+#define XDPIF_QUEUE 0          /* default queue */
+#endif
+
+#define XDPNETIF_NB_FRAMES  4096 /* UMEM size in frames */
+#define XDPNETIF_FRAME_SIZE XSK_UMEM__DEFAULT_FRAME_SIZE
+#define XDPNETIF_RING_SIZE  XSK_RING_CONS__DEFAULT_NUM_DESCS
+#define XDPNETIF_TX_RESERVE 512  /* frames that are never put on the fill ring */
+#define XDPNETIF_RX_BATCH   256  /* max. number of packets received per poll */
+#define XDPNETIF_RX_MINFREE 1024 /* frames that are kept for reception: packets
+                                  * are copied when lwIP would hold more */
+#define XDPNETIF_RX_MAXHELD (XDPNETIF_NB_FRAMES - XDPNETIF_TX_RESERVE - XDPNETIF_RX_MINFREE)
+
+/**
+ * Helper macros
+ */
+#ifndef min
+#define min(a, b)						\
+    ({ __typeof__ (a) __a = (a);				\
+       __typeof__ (b) __b = (b);				\
+       __a < __b ? __a : __b; })
+#endif
+
+#define xdpif_frame_of(xi, addr) \
+  (&(xi)->_frames[(addr) / XDPNETIF_FRAME_SIZE])
+
+/*
+ * UMEM frame allocation
+ */
+static inline uint64_t xdpif_pick_frame(struct xdpif *xi)
+{
+  return xi->_free_frames[--xi->_nb_free_frames];
+}
+
+static inline void xdpif_put_frame(struct xdpif *xi, uint64_t addr)
+{
+  /* frame base address (rx descriptors point behind the headroom) */
+  addr -= addr % XDPNETIF_FRAME_SIZE;
+  xi->_free_frames[xi->_nb_free_frames++] = addr;
+}
+
+/* hands free frames to the kernel for reception */
+static void xdpif_refill(struct xdpif *xi)
+{
+  uint32_t idx;
+  unsigned int n, i;
+
+  if (xi->_nb_free_frames <= XDPNETIF_TX_RESERVE)
+    return;
+  n = xsk_prod_nb_free(&xi->_fq, xi->_nb_free_frames - XDPNETIF_TX_RESERVE);
+  n = min(n, xi->_nb_free_frames - XDPNETIF_TX_RESERVE);
+  if (!n)
+    return;
+  n = xsk_ring_prod__reserve(&xi->_fq, n, &idx);
+  for (i = 0; i < n; ++i)
+    *xsk_ring_prod__fill_addr(&xi->_fq, idx++) = xdpif_pick_frame(xi);
+  xsk_ring_prod__submit(&xi->_fq, n);
+
+  if (xsk_ring_prod__needs_wakeup(&xi->_fq))
+    recvfrom(xi->_fd, NULL, 0, MSG_DONTWAIT, NULL, NULL);
+}
+
+/* reclaims frames of transmitted packets (batched) */
+static void xdpif_complete_tx(struct xdpif *xi)
+{
+  uint32_t idx;
+  unsigned int n, i;
+
+  n = xsk_ring_cons__peek(&xi->_cq, XDPNETIF_RING_SIZE, &idx);
+  if (!n)
+    return;
+  for (i = 0; i < n; ++i)
+    xdpif_put_frame(xi, *xsk_ring_cons__comp_addr(&xi->_cq, idx++));
+  xsk_ring_cons__release(&xi->_cq, n);
+}
+
+/**
+ * This function does the actual transmission of a packet. The packet is
+ * contained in the pbuf that is passed to the function. This pbuf
+ * can be chained. The packet is copied to a UMEM frame, kicking the
+ * kernel is deferred to xdpif_flush().
+ *
+ * @param netif
+ *  the lwip network interface structure for this xdpif
+ * @param p
+ *  the packet to send (e.g. IP packet including MAC addresses and type)
+ * @return
+ *  ERR_OK when the packet could be sent; an err_t value otherwise
+ */
+static err_t xdpif_transmit(struct netif *netif, struct pbuf *p)
+{
+  struct xdpif *xi = netif->state;
+  struct xdp_desc *desc;
+  uint64_t addr;
+  uint32_t idx;
+
+  LWIP_DEBUGF(NETIF_DEBUG, ("xdpif_transmit: %c%c: "
+			    "Transmitting %u bytes\n",
+			    netif->name[0], netif->name[1],
+			    p->tot_len));
+
+#if ETH_PAD_SIZE
+  pbuf_header(p, -ETH_PAD_SIZE); /* drop the padding word */
+#endif
+  if (unlikely(p->tot_len > XDPNETIF_FRAME_SIZE)) {
+    LWIP_DEBUGF(NETIF_DEBUG, ("xdpif_transmit: packet too big, dropping packet\n"));
+    goto err_drop;
+  }
+
+  /* do we have space? */
+  if (unlikely(!xi->_nb_free_frames ||
+	       xsk_ring_prod__reserve(&xi->_tx, 1, &idx) != 1)) {
+    /* kick the kernel and reclaim completed frames */
+    xdpif_flush(netif);
+    if (!xi->_nb_free_frames ||
+	xsk_ring_prod__reserve(&xi->_tx, 1, &idx) != 1) {
+      LWIP_DEBUGF(NETIF_DEBUG, ("xdpif_transmit: tx ring is full, dropping packet\n"));
+      goto err_mem;
+    }
+  }
+
+  addr = xdpif_pick_frame(xi);
+  pbuf_copy_partial(p, xsk_umem__get_data(xi->_umem_area, addr), p->tot_len, 0);
+  desc = xsk_ring_prod__tx_desc(&xi->_tx, idx);
+  desc->addr = addr;
+  desc->len  = p->tot_len;
+  xsk_ring_prod__submit(&xi->_tx, 1);
+  xi->_txpending = 1;
+
+#if ETH_PAD_SIZE
+  pbuf_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
+#endif
+  LINK_STATS_INC(link.xmit);
+  return ERR_OK;
+
+ err_mem:
+#if ETH_PAD_SIZE
+  pbuf_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
+#endif
+  LINK_STATS_INC(link.drop);
+  return ERR_MEM;
+
+ err_drop:
+#if ETH_PAD_SIZE
+  pbuf_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
+#endif
+  LINK_STATS_INC(link.drop);
+  return ERR_BUF;
+}
+
+void xdpif_flush(struct netif *netif)
+{
+  struct xdpif *xi = netif->state;
+
+  if (xi->_txpending) {
+    if (xsk_ring_prod__needs_wakeup(&xi->_tx))
+      sendto(xi->_fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+    xi->_txpending = 0;
+  }
+  xdpif_complete_tx(xi);
+}
+
+/**
+ * Passes a pbuf to the lwIP stack for further processing.
+ * The packet type is determined and checked before passing.
+ *
+ * @param p
+ *  the pointer to received packet data
+ * @param netif
+ *  the lwip network interface structure for this xdpif
+ */
+static inline void xdpif_input(struct pbuf *p, struct netif *netif)
+{
+  struct eth_hdr *ethhdr;
+  err_t err;
+
+  LWIP_DEBUGF(NETIF_DEBUG, ("xdpif_input: %c%c: "
+			    "Received %u bytes\n",
+			    netif->name[0], netif->name[1],
+			    p->tot_len));
+
+  ethhdr = p->payload;
+  switch (ethhdr->type) {
+  /* IP or ARP packet? */
+  case PP_HTONS(ETHTYPE_IP):
+#if IPV6_SUPPORT
+  case PP_HTONS(ETHTYPE_IPV6):
+#endif
+  case PP_HTONS(ETHTYPE_ARP):
+#if PPPOE_SUPPORT
+  case PP_HTONS(ETHTYPE_PPPOEDISC):
+  case PP_HTONS(ETHTYPE_PPPOE):
+#endif
+    err = netif->input(p, netif);
+    if (unlikely(err != ERR_OK)) {
+      LWIP_DEBUGF(NETIF_DEBUG, ("xdpif_input: %c%c: ERROR %d: "
+				"Packet dropped\n",
+				netif->name[0], netif->name[1], err));
+      pbuf_free(p);
+    }
+    break;
+
+  default:
+    LWIP_DEBUGF(NETIF_DEBUG, ("xdpif_input: %c%c: ERROR: "
+			      "Dropped packet with unknown type 0x%04x\n",
+			      netif->name[0], netif->name[1],
+			      htons(ethhdr->type)));
+    pbuf_free(p);
+    break;
+  }
+}
+
+#ifdef XDPIF_ZEROCOPY_RX
+/* called by lwIP when a zero-copy pbuf is released:
+ * the frame can be used for reception again */
+static void xdpif_frame_free(struct pbuf *p)
+{
+  struct xdpif_frame *f = (struct xdpif_frame *) p;
+
+  --f->xi->_nb_held_frames;
+  xdpif_put_frame(f->xi, f->addr);
+}
+#endif
+
+/*
+ * Receive packets from the rx ring and send them to
+ * xdpif_input()
+ */
+void xdpif_poll(struct netif *netif)
+{
+  struct xdpif *xi = netif->state;
+  const struct xdp_desc *desc;
+  struct pbuf *p;
+  uint32_t idx;
+  unsigned int n, i;
+  void *data;
+#ifdef XDPIF_ZEROCOPY_RX
+  struct xdpif_frame *f;
+#endif
+
+  n = xsk_ring_cons__peek(&xi->_rx, XDPNETIF_RX_BATCH, &idx);
+  for (i = 0; i < n; ++i) {
+    desc = xsk_ring_cons__rx_desc(&xi->_rx, idx++);
+    data = xsk_umem__get_data(xi->_umem_area, desc->addr);
+
+#ifdef XDPIF_ZEROCOPY_RX
+    if (likely(xi->_nb_held_frames < XDPNETIF_RX_MAXHELD)) {
+      f = xdpif_frame_of(xi, desc->addr);
+      f->addr = desc->addr;
+      p = pbuf_alloced_custom(PBUF_RAW, desc->len, PBUF_REF, &f->pc, data,
+			      XDPNETIF_FRAME_SIZE - (desc->addr % XDPNETIF_FRAME_SIZE));
+      ++xi->_nb_held_frames;
+    } else
+#endif /* XDPIF_ZEROCOPY_RX */
+    {
+      /* copy: the frame is given back right away so that reception (and
+       * the ACKs that release held frames) cannot run dry */
+      p = pbuf_alloc(PBUF_RAW, (u16_t) (desc->len + ETH_PAD_SIZE), PBUF_POOL);
+      if (likely(p != NULL)) {
+#if ETH_PAD_SIZE
+        pbuf_header(p, -ETH_PAD_SIZE); /* drop the padding word */
+#endif
+        pbuf_take(p, data, desc->len);
+#if ETH_PAD_SIZE
+        pbuf_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
+#endif
+      }
+      xdpif_put_frame(xi, desc->addr);
+    }
+
+    if (unlikely(!p)) {
+      LWIP_DEBUGF(NETIF_DEBUG, ("xdpif_poll: %c%c: "
+				"could not allocate pbuf, dropping packet\n",
+				netif->name[0], netif->name[1]));
+      LINK_STATS_INC(link.memerr);
+      continue;
+    }
+    LINK_STATS_INC(link.recv);
+    xdpif_input(p, netif);
+  }
+  if (n)
+    xsk_ring_cons__release(&xi->_rx, n);
+
+  /* replace consumed frames on the fill ring */
+  xdpif_refill(xi);
+}
+
+/**
+ * Closes a network interface.
+ * This function is called by lwIP on netif_remove().
+ *
+ * @param netif
+ *  the lwip network interface structure for this xdpif
+ */
+static void xdpif_exit(struct netif *netif)
+{
+  struct xdpif *xi = netif->state;
+
+  xdpif_flush(netif);
+  xsk_socket__delete(xi->_xsk);
+  xsk_umem__delete(xi->_umem);
+  munmap(xi->_umem_area, XDPNETIF_NB_FRAMES * XDPNETIF_FRAME_SIZE);
+  mem_free(xi->_free_frames);
+  mem_free(xi->_frames);
+
+  if (xi->_state_is_private) {
+    mem_free(xi);
+    netif->state = NULL;
+  }
+}
+
+/* Returns 0 on success and puts the hwaddress of an interface on addr_out
+ *  on errors, -1 is returned */
+static int _sys_get_hwaddr(const char *ifname, struct eth_addr *out)
+{
+  struct ifreq ifr;
+  int sfd;
+  int ret = 0;
+
+  sfd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (sfd < 0)
+    return -1;
+  memset(&ifr, 0, sizeof(ifr));
+  strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+  if (ioctl(sfd, SIOCGIFHWADDR, &ifr) < 0)
+    ret = -1;
+  else
+    SMEMCPY(out->addr, ifr.ifr_hwaddr.sa_data, ETHARP_HWADDR_LEN);
+  close(sfd);
+  return ret;
+}
+
+/**
+ * Initializes and sets up an AF_XDP interface for lwIP.
+ * This function should be passed as a parameter to netif_add().
+ *
+ * @param netif
+ *  the lwip network interface structure for this xdpif
+ * @return
+ *  ERR_OK if the interface was successfully initialized;
+ *  An err_t value otherwise
+ */
+err_t xdpif_init(struct netif *netif)
+{
+  struct xdpif *xi;
+  struct xsk_umem_config ucfg;
+  struct xsk_socket_config scfg;
+  static uint8_t xdpif_id = 0;
+  uint32_t i;
+  int ret;
+
+  LWIP_ASSERT("netif != NULL", (netif != NULL));
+
+  if (!(netif->state)) {
+    xi = mem_calloc(1, sizeof(*xi));
+    if (!xi) {
+      LWIP_DEBUGF(NETIF_DEBUG, ("xdpif_init: "
+				"Could not allocate \n"));
+      goto err_out;
+    }
+    netif->state = xi;
+    xi->_state_is_private = 1;
+    xi->_hwaddr_is_private = 1;
+#ifdef CONFIG_XDPIF_COPY
+    xi->copy_mode = 1;
+#endif
+  } else {
+    xi = netif->state;
+    xi->_state_is_private = 0;
+    xi->_hwaddr_is_private = eth_addr_cmp(&xi->hwaddr, &ethzero);
+  }
+  if (xi->ifname[0] == '\0') {
+    snprintf(xi->ifname, sizeof(xi->ifname), XDPIF_IFNAME);
+    xi->queue_id = XDPIF_QUEUE;
+  }
+
+  /* UMEM and frame bookkeeping */
+  xi->_umem_area = mmap(NULL, XDPNETIF_NB_FRAMES * XDPNETIF_FRAME_SIZE,
+			PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (xi->_umem_area == MAP_FAILED) {
+    LWIP_DEBUGF(NETIF_DEBUG, ("xdpif_init: Could not allocate UMEM\n"));
+    goto err_free_xi;
+  }
+  xi->_frames = mem_calloc(XDPNETIF_NB_FRAMES, sizeof(*xi->_frames));
+  if (!xi->_frames)
+    goto err_free_umem_area;
+  xi->_free_frames = mem_calloc(XDPNETIF_NB_FRAMES, sizeof(*xi->_free_frames));
+  if (!xi->_free_frames)
+    goto err_free_frames;
+  xi->_nb_free_frames = 0;
+#ifdef XDPIF_ZEROCOPY_RX
+  xi->_nb_held_frames = 0;
+#endif
+  for (i = 0; i < XDPNETIF_NB_FRAMES; ++i) {
+#ifdef XDPIF_ZEROCOPY_RX
+    xi->_frames[i].xi = xi;
+    xi->_frames[i].pc.custom_free_function = xdpif_frame_free;
+#endif
+    xi->_frames[i].addr = (uint64_t) i * XDPNETIF_FRAME_SIZE;
+    xdpif_put_frame(xi, xi->_frames[i].addr);
+  }
+
+  memset(&ucfg, 0, sizeof(ucfg));
+  ucfg.fill_size      = XDPNETIF_RING_SIZE * 2;
+  ucfg.comp_size      = XDPNETIF_RING_SIZE;
+  ucfg.frame_size     = XDPNETIF_FRAME_SIZE;
+  ucfg.frame_headroom = XSK_UMEM__DEFAULT_FRAME_HEADROOM;
+  ret = xsk_umem__create(&xi->_umem, xi->_umem_area,
+			 XDPNETIF_NB_FRAMES * XDPNETIF_FRAME_SIZE,
+			 &xi->_fq, &xi->_cq, &ucfg);
+  if (ret < 0) {
+    LWIP_DEBUGF(NETIF_DEBUG, ("xdpif_init: Could not register UMEM: %s\n", strerror(-ret)));
+    goto err_free_free_frames;
+  }
+
+  /* AF_XDP socket (the default XDP program gets loaded by libxdp) */
+  memset(&scfg, 0, sizeof(scfg));
+  scfg.rx_size    = XDPNETIF_RING_SIZE;
+  scfg.tx_size    = XDPNETIF_RING_SIZE;
+  scfg.bind_flags = XDP_USE_NEED_WAKEUP;
+  if (xi->copy_mode) {
+    /* works with every driver, e.g., veth */
+    scfg.bind_flags |= XDP_COPY;
+    scfg.xdp_flags   = XDP_FLAGS_SKB_MODE;
+  }
+  ret = xsk_socket__create(&xi->_xsk, xi->ifname, xi->queue_id, xi->_umem,
+			   &xi->_rx, &xi->_tx, &scfg);
+  if (ret < 0) {
+    LWIP_DEBUGF(NETIF_DEBUG, ("xdpif_init: Could not open %s@%"PRIu32": %s\n",
+			      xi->ifname, xi->queue_id, strerror(-ret)));
+    goto err_delete_umem;
+  }
+  xi->_fd = xsk_socket__fd(xi->_xsk);
+  xi->_txpending = 0;
+  xdpif_refill(xi);
+  LWIP_DEBUGF(NETIF_DEBUG, ("xdpif_init: %s: use queue %"PRIu32" (%s mode)\n",
+			    xi->ifname, xi->queue_id, xi->copy_mode ? "copy" : "driver"));
+
+  /* Interface identifier */
+  netif->name[0] = XDPNETIF_NPREFIX;
+  netif->name[1] = '0' + xdpif_id;
+  xdpif_id++;
+
+  /* MAC address */
+  if (xi->_hwaddr_is_private) {
+    if (_sys_get_hwaddr(xi->ifname, &xi->hwaddr) < 0) {
+      LWIP_DEBUGF(NETIF_DEBUG, ("xdpif_init: %c%c: failed to retrieve hardware address\n",
+				netif->name[0], netif->name[1]));
+      goto err_delete_xsk;
+    }
+  }
+  LWIP_DEBUGF(NETIF_DEBUG, ("xdpif_init: %c%c: Hardware address: %02x:%02x:%02x:%02x:%02x:%02x\n",
+			    netif->name[0], netif->name[1],
+			    xi->hwaddr.addr[0], xi->hwaddr.addr[1], xi->hwaddr.addr[2],
+			    xi->hwaddr.addr[3], xi->hwaddr.addr[4], xi->hwaddr.addr[5]));
+  SMEMCPY(&netif->hwaddr, &xi->hwaddr, ETHARP_HWADDR_LEN);
+  netif->hwaddr_len = ETHARP_HWADDR_LEN;
+
+  netif->output = etharp_output;
+  netif->linkoutput = xdpif_transmit;
+#if LWIP_NETIF_REMOVE_CALLBACK
+  netif->remove_callback = xdpif_exit;
+#endif /* CONFIG_NETIF_REMOVE_CALLBACK */
+
+  /* Initialize the snmp variables and counters inside the struct netif.
+   * The last argument is the link speed, in units of bits per second. */
+  NETIF_INIT_SNMP(netif, snmp_ifType_ethernet_csmacd, XDPNETIF_SPEED);
+
+  /* Device capabilities */
+  netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_LINK_UP;
+
+  /* Maximum transfer unit */
+  netif->mtu = XDPNETIF_MTU;
+  LWIP_DEBUGF(NETIF_DEBUG, ("xdpif_init: %c%c: MTU: %u\n",
+			    netif->name[0], netif->name[1], netif->mtu));
+
+#if LWIP_NETIF_HOSTNAME
+  /* Initialize interface hostname */
+  if (!netif->hostname)
+    netif->hostname = NULL;
+#endif /* LWIP_NETIF_HOSTNAME */
+
+  return ERR_OK;
+
+ err_delete_xsk:
+  xsk_socket__delete(xi->_xsk);
+ err_delete_umem:
+  xsk_umem__delete(xi->_umem);
+ err_free_free_frames:
+  mem_free(xi->_free_frames);
+ err_free_frames:
+  mem_free(xi->_frames);
+ err_free_umem_area:
+  munmap(xi->_umem_area, XDPNETIF_NB_FRAMES * XDPNETIF_FRAME_SIZE);
+ err_free_xi:
+  if (xi->_state_is_private) {
+    mem_free(xi);
+    netif->state = NULL;
+  }
+ err_out:
+  return ERR_IF;
+}
@@ -44,6 +44,7 @@
 #include "shfs_tools.h"
 #include "shfs_cache.h"
 #include "shfs_fio.h"
+#include "http_parser.h"
 #include "shell.h"
 #ifdef HAVE_CTLDIR
 #include <target/ctldir.h>
@@ -120,9 +121,13 @@ static int shcmd_ioperf(FILE *cio, int argc, char *argv[])
 	uint64_t usecs, bps, reqs;
 	void *buf;
 	size_t buflen = 0;
+#ifdef SHFS_CSUM
+	int csum_verify = shfs_vol.csum_verify;
+	uint64_t csum_nb_errors = shfs_vol.csum_nb_errors;
+#endif
 
 	if (argc <= 1) {
-		fprintf(cio, "Usage: %s [file] [[times]] [[buffer length]] [[flush]]\n", argv[0]);
+		fprintf(cio, "Usage: %s [file] [[times]] [[buffer length]] [[flush|flush-nocsum]]\n", argv[0]);
 		ret = -1;
 		goto out;
 	}
@@ -143,6 +148,8 @@ static int shcmd_ioperf(FILE *cio, int argc, char *argv[])
 	if (argc >= 5) {
 		if (strcmp(argv[4], "flush") == 0)
 			flush = 1;
+		else if (strcmp(argv[4], "flush-nocsum") == 0)
+			flush = 2;
 	}
 
 	f = shfs_fio_open(argv[1]);
@@ -198,6 +205,13 @@ static int shcmd_ioperf(FILE *cio, int argc, char *argv[])
 		timersub(&tm_end, &tm_start, &tm_duration);
 	} else {
 		fprintf(cio, "%s: Flushing SHFS cache before each iteration\n", argv[1]);
+#ifdef SHFS_CSUM
+		/* flush-nocsum: compare with flush to get the verification overhead */
+		if (flush == 2) {
+			fprintf(cio, "%s: Chunk checksum verification disabled\n", argv[1]);
+			shfs_vol.csum_verify = 0;
+		}
+#endif
 		timerclear(&tm_duration);
 		for (t = 0; t < times; ++t) {
 			shfs_flush_cache();
@@ -237,11 +251,19 @@ static int shcmd_ioperf(FILE *cio, int argc, char *argv[])
 		reqs = (reqs * 1000000 + usecs / 2) / usecs;
 		fprintf(cio, "(%"PRIu64" B/s, %"PRIu64" req/s)\n", bps, reqs);
 	}
+#ifdef SHFS_CSUM
+	if (shfs_vol.csum_nb_errors != csum_nb_errors)
+		fprintf(cio, "%s: %"PRIu64" chunk checksum mismatches\n",
+		        argv[1], shfs_vol.csum_nb_errors - csum_nb_errors);
+#endif
 
 	target_free(buf);
  out_close_f:
 	shfs_fio_close(f);
  out:
+#ifdef SHFS_CSUM
+	shfs_vol.csum_verify = csum_verify;
+#endif
 	return ret;
 }
 
@@ -495,6 +517,133 @@ static int shcmd_ocperf2(FILE *cio, int argc, char *argv[])
 	return ret;
 }
 
+/* HTTP parser performance over a corpus of captured requests (a file
+ * containing raw requests back to back) */
+static int hpperf_msg_complete(struct http_parser *parser)
+{
+	++(*((uint64_t *) parser->data));
+	return 0;
+}
+
+static int hpperf_data(struct http_parser *parser, const char *buf, size_t len)
+{
+	return 0;
+}
+
+static int shcmd_hpperf(FILE *cio, int argc, char *argv[])
+{
+	SHFS_FD f;
+	struct http_parser parser;
+	struct http_parser_settings settings;
+	uint64_t fsize, nb_msgs;
+	unsigned int t;
+	unsigned int times = 1000;
+	int fastpath = 1;
+	size_t plen;
+	char *buf;
+	int ret = 0;
+	struct timeval tm_start;
+	struct timeval tm_end;
+	struct timeval tm_duration;
+	uint64_t usecs, bps, mps;
+
+	if (argc <= 1) {
+		fprintf(cio, "Usage: %s [file] [[times]] [[nofast]]\n", argv[0]);
+		ret = -1;
+		goto out;
+	}
+	if (argc >= 3) {
+		if ((sscanf(argv[2], "%u", &times)) != 1) {
+			fprintf(cio, "Could not parse times\n");
+			ret = -1;
+			goto out;
+		}
+	}
+	if (argc >= 4) {
+		if (strcmp(argv[3], "nofast") == 0)
+			fastpath = 0;
+	}
+
+	f = shfs_fio_open(argv[1]);
+	if (!f) {
+		fprintf(cio, "Could not open %s: %s\n", argv[1], strerror(errno));
+		ret = -1;
+		goto out;
+	}
+	if (shfs_fio_islink(f)) {
+		fprintf(cio, "File %s is a link\n", argv[1]);
+		ret = -1;
+		goto out_close_f;
+	}
+	shfs_fio_size(f, &fsize);
+	if (fsize == 0 || fsize > SIZE_MAX) {
+		fprintf(cio, "%s: Invalid corpus size\n", argv[1]);
+		ret = -1;
+		goto out_close_f;
+	}
+
+	buf = target_malloc(8, fsize);
+	if (!buf) {
+		fprintf(cio, "Out of memory\n");
+		ret = -1;
+		goto out_close_f;
+	}
+	ret = shfs_fio_cache_read_nosched(f, 0, buf, fsize);
+	if (ret < 0) {
+		fprintf(cio, "%s: Read error: %s\n", argv[1], strerror(-ret));
+		ret = -1;
+		goto out_free_buf;
+	}
+
+	http_parser_settings_init(&settings);
+	settings.on_url = hpperf_data;
+	settings.on_header_field = hpperf_data;
+	settings.on_header_value = hpperf_data;
+	settings.on_body = hpperf_data;
+	settings.on_message_complete = hpperf_msg_complete;
+	parser.data = &nb_msgs;
+	fastpath = http_parser_set_fastpath(fastpath);
+
+	fprintf(cio, "%s: corpus size: %"PRIu64" B, parse %u times\n",
+	        argv[1], fsize, times);
+
+	nb_msgs = 0;
+	gettimeofday(&tm_start, NULL);
+	barrier();
+	for (t = 0; t < times; ++t) {
+		http_parser_init(&parser, HTTP_REQUEST);
+		plen = http_parser_execute(&parser, &settings, buf, fsize);
+		if (unlikely(plen != fsize)) {
+			fprintf(cio, "%s: Parser error at offset %lu: %s\n", argv[1],
+			        (unsigned long) plen, http_errno_name(HTTP_PARSER_ERRNO(&parser)));
+			ret = -1;
+			goto out_restore;
+		}
+	}
+	barrier();
+	gettimeofday(&tm_end, NULL);
+	timersub(&tm_end, &tm_start, &tm_duration);
+
+	usecs = (tm_duration.tv_usec);
+	usecs += (tm_duration.tv_sec) * 1000000;
+	if (usecs == 0)
+		usecs = 1;
+	fprintf(cio, "%s: Parsed %"PRIu64" requests (%"PRIu64" bytes) in %"PRIu64".%06"PRIu64" seconds ",
+	        argv[1], nb_msgs, fsize * times, usecs / 1000000, usecs % 1000000);
+	bps = (fsize * times * 1000000 + usecs / 2) / usecs;
+	mps = (nb_msgs * 1000000 + usecs / 2) / usecs;
+	fprintf(cio, "(%"PRIu64" B/s, %"PRIu64" req/s)\n", bps, mps);
+
+ out_restore:
+	http_parser_set_fastpath(fastpath);
+ out_free_buf:
+	target_free(buf);
+ out_close_f:
+	shfs_fio_close(f);
+ out:
+	return ret;
+}
+
 #ifdef HAVE_CTLDIR
 int register_testsuite(struct ctldir *cd)
 #else
@@ -509,6 +658,7 @@ int register_testsuite(void)
 		ctldir_register_shcmd(cd, "ioperf2", shcmd_ioperf2);
 		ctldir_register_shcmd(cd, "ocperf", shcmd_ocperf);
 		ctldir_register_shcmd(cd, "ocperf2", shcmd_ocperf2);
+		ctldir_register_shcmd(cd, "hpperf", shcmd_hpperf);
 	}
 #endif
 
@@ -519,6 +669,7 @@ int register_testsuite(void)
 	shell_register_cmd("ioperf2", shcmd_ioperf2);
 	shell_register_cmd("ocperf", shcmd_ocperf);
 	shell_register_cmd("ocperf2", shcmd_ocperf2);
+	shell_register_cmd("hpperf", shcmd_hpperf);
 #endif
 
 	return 0;
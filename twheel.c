@@ -0,0 +1,257 @@
+/*
+ * Hierarchical timer wheel
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <target/sys.h>
+#include <errno.h>
+
+#include "twheel.h"
+
+#ifdef TWHEEL_DEBUG
+#define ENABLE_DEBUG
+#endif
+#include "debug.h"
+
+struct twheel {
+	uint64_t now; /* next tick (ms) that is going to be processed */
+	uint32_t nb_timers;
+	struct dlist_head slot[TWHEEL_NB_LVLS][TWHEEL_LVL_SIZE];
+};
+
+static struct twheel _tw;
+
+int init_twheel(void)
+{
+	unsigned int l, i;
+
+	for (l = 0; l < TWHEEL_NB_LVLS; ++l)
+		for (i = 0; i < TWHEEL_LVL_SIZE; ++i)
+			dlist_init_head(_tw.slot[l][i]);
+	_tw.nb_timers = 0;
+	_tw.now = twheel_now();
+	return 0;
+}
+
+void exit_twheel(void)
+{
+	if (_tw.nb_timers)
+		printd("%"PRIu32" timers are still armed\n", _tw.nb_timers);
+}
+
+static inline void _twheel_enqueue(struct twheel_timer *t)
+{
+	struct dlist_head *slot;
+	uint64_t delta;
+	unsigned int l;
+
+	if (t->expires <= _tw.now) {
+		/* expired already: gets processed with next tick */
+		slot = &_tw.slot[0][_tw.now & TWHEEL_LVL_MASK];
+	} else {
+		delta = t->expires - _tw.now;
+		if (unlikely(delta > TWHEEL_MAX_TIMEOUT)) {
+			t->expires = _tw.now + TWHEEL_MAX_TIMEOUT;
+			delta = TWHEEL_MAX_TIMEOUT;
+		}
+		for (l = 0; l < (TWHEEL_NB_LVLS - 1); ++l) {
+			if (delta < (1ull << (TWHEEL_LVL_BITS * (l + 1))))
+				break;
+		}
+		slot = &_tw.slot[l][(t->expires >> (TWHEEL_LVL_BITS * l)) & TWHEEL_LVL_MASK];
+	}
+
+	dlist_append(t, *slot, slot_list);
+	t->slot = slot;
+}
+
+void twheel_arm(struct twheel_timer *t, uint64_t timeout)
+{
+	if (twheel_is_armed(t))
+		twheel_cancel(t);
+
+	t->interval = 0;
+	t->expires = twheel_now() + timeout;
+	_twheel_enqueue(t);
+	++_tw.nb_timers;
+}
+
+void twheel_arm_periodic(struct twheel_timer *t, uint32_t interval)
+{
+	BUG_ON(interval == 0);
+
+	if (twheel_is_armed(t))
+		twheel_cancel(t);
+
+	t->interval = interval;
+	t->expires = twheel_now() + interval;
+	_twheel_enqueue(t);
+	++_tw.nb_timers;
+}
+
+void twheel_cancel(struct twheel_timer *t)
+{
+	if (!twheel_is_armed(t))
+		return;
+
+	dlist_unlink(t, *t->slot, slot_list);
+	t->slot = NULL;
+	--_tw.nb_timers;
+}
+
+/* moves timers of the current slot of level l down to the lower levels */
+static unsigned int _twheel_cascade(unsigned int l)
+{
+	struct twheel_timer *t, *t_next;
+	struct dlist_head list;
+	unsigned int idx;
+
+	idx = (_tw.now >> (TWHEEL_LVL_BITS * l)) & TWHEEL_LVL_MASK;
+	list = _tw.slot[l][idx];
+	dlist_init_head(_tw.slot[l][idx]);
+
+	t = dlist_first_el(list, struct twheel_timer);
+	while (t) {
+		t_next = dlist_next_el(t, slot_list);
+		_twheel_enqueue(t);
+		t = t_next;
+	}
+	return idx;
+}
+
+/*
+ * The wheel is behind by more than a round of level 0 (e.g., after a stall
+ * of the main loop): instead of stepping through every ms, all timers are
+ * sorted in again relative to now. Expired ones end up in the current slot
+ * of level 0 and are processed with the next tick
+ */
+static void _twheel_jump(uint64_t now)
+{
+	struct twheel_timer *t;
+	struct dlist_head all;
+	unsigned int l, i;
+
+	dlist_init_head(all);
+	for (l = 0; l < TWHEEL_NB_LVLS; ++l) {
+		for (i = 0; i < TWHEEL_LVL_SIZE; ++i) {
+			while ((t = dlist_first_el(_tw.slot[l][i], struct twheel_timer))) {
+				dlist_unlink(t, _tw.slot[l][i], slot_list);
+				dlist_append(t, all, slot_list);
+			}
+		}
+	}
+
+	_tw.now = now;
+	while ((t = dlist_first_el(all, struct twheel_timer))) {
+		dlist_unlink(t, all, slot_list);
+		_twheel_enqueue(t);
+	}
+}
+
+/* ms until the wheel needs to be processed again */
+static inline uint64_t _twheel_next(uint64_t now)
+{
+	uint64_t tick;
+
+	if (!_tw.nb_timers)
+		return UINT64_MAX;
+
+	/* search for the next occupied slot on level 0,
+	 * but not beyond the next cascade */
+	tick = _tw.now;
+	do {
+		if (!dlist_is_empty(_tw.slot[0][tick & TWHEEL_LVL_MASK]))
+			break;
+		++tick;
+	} while (tick & TWHEEL_LVL_MASK);
+
+	return (tick > now) ? (tick - now) : 0;
+}
+
+uint64_t twheel_run(uint64_t now)
+{
+	struct twheel_timer *t;
+	struct dlist_head expired;
+	unsigned int idx, l;
+
+	if (unlikely(now >= _tw.now + TWHEEL_LVL_SIZE && _tw.nb_timers))
+		_twheel_jump(now);
+
+	while (_tw.now <= now) {
+		if (!_tw.nb_timers) {
+			/* wheel is empty: skip ahead */
+			_tw.now = now + 1;
+			break;
+		}
+
+		/* detach expired timers from the wheel before calling the
+		 * callbacks: they might re-arm or cancel timers */
+		idx = _tw.now & TWHEEL_LVL_MASK;
+		expired = _tw.slot[0][idx];
+		dlist_init_head(_tw.slot[0][idx]);
+		dlist_foreach(t, expired, slot_list)
+			t->slot = &expired;
+		++_tw.now;
+
+		/* cascade as soon as a new round on level 0 begins so that
+		 * level 0 always reflects the upcoming TWHEEL_LVL_SIZE ms */
+		if (!(_tw.now & TWHEEL_LVL_MASK)) {
+			for (l = 1; l < TWHEEL_NB_LVLS; ++l) {
+				if (_twheel_cascade(l) != 0)
+					break;
+			}
+		}
+
+		while ((t = dlist_first_el(expired, struct twheel_timer))) {
+			dlist_unlink(t, expired, slot_list);
+			t->slot = NULL;
+			--_tw.nb_timers;
+
+			if (t->interval) {
+				/* periodic timer: re-arm without drift
+				 * (but do not catch up missed periods) */
+				t->expires += t->interval;
+				if (unlikely(t->expires <= now))
+					t->expires += ((now - t->expires) / t->interval + 1)
+					              * t->interval;
+				_twheel_enqueue(t);
+				++_tw.nb_timers;
+			}
+			printd("Timer %p expired (cb: %p)\n", t, t->cb);
+			t->cb(t, t->argp);
+		}
+	}
+
+	return _twheel_next(now);
+}
@@ -0,0 +1,104 @@
+/*
+ * Hierarchical timer wheel
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+#ifndef _TWHEEL_H_
+#define _TWHEEL_H_
+
+#include <target/sys.h>
+#include <stdint.h>
+
+#include "dlist.h"
+#include "likely.h"
+
+/*
+ * Timers are kept in TWHEEL_NB_LVLS levels of TWHEEL_LVL_SIZE slots each.
+ * Level 0 has a resolution of 1 ms, each further level is TWHEEL_LVL_SIZE
+ * times coarser. Timers of a higher level are cascaded down when the
+ * wheel reaches their slot. Arming and cancelling a timer is O(1).
+ *
+ * The wheel is driven by the main loop (twheel_run()), callbacks are
+ * executed from there as well. Note: This implementation is not thread-safe.
+ */
+#define TWHEEL_LVL_BITS 6
+#define TWHEEL_LVL_SIZE (1 << TWHEEL_LVL_BITS)
+#define TWHEEL_LVL_MASK (TWHEEL_LVL_SIZE - 1)
+#define TWHEEL_NB_LVLS 4
+#define TWHEEL_MAX_TIMEOUT ((1ull << (TWHEEL_LVL_BITS * TWHEEL_NB_LVLS)) - 1) /* = x ms (~4.6h) */
+
+struct twheel_timer;
+typedef void (twheel_cb_t)(struct twheel_timer *t, void *argp);
+
+struct twheel_timer {
+	uint64_t expires; /* ms */
+	uint32_t interval; /* ms, periodic timers only */
+	twheel_cb_t *cb;
+	void *argp;
+
+	struct dlist_head *slot; /* NULL if not armed */
+	dlist_el(slot_list);
+};
+
+int  init_twheel(void);
+void exit_twheel(void);
+
+#define twheel_now() \
+	((uint64_t) NSEC_TO_MSEC(target_now_ns()))
+
+static inline void twheel_timer_init(struct twheel_timer *t, twheel_cb_t *cb, void *argp)
+{
+	t->cb = cb;
+	t->argp = argp;
+	t->interval = 0;
+	t->slot = NULL;
+	dlist_init_el(t, slot_list);
+}
+
+#define twheel_is_armed(t) \
+	((t)->slot != NULL)
+
+/* (re-)arms a one-shot timer to expire in timeout ms */
+void twheel_arm(struct twheel_timer *t, uint64_t timeout);
+/* (re-)arms a timer that expires every interval ms */
+void twheel_arm_periodic(struct twheel_timer *t, uint32_t interval);
+void twheel_cancel(struct twheel_timer *t);
+
+/*
+ * Executes callbacks of all expired timers
+ * Returns the number of ms until the wheel needs to run the next time
+ * (UINT64_MAX if there is no armed timer)
+ */
+uint64_t twheel_run(uint64_t now);
+
+#endif /* _TWHEEL_H_ */